@@ -0,0 +1,218 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <malloc.h>
+
+#include "host.hpp"
+#include "dsp-noise/block_noise.hpp"
+#include "dsp-noise/random.hpp"
+
+using namespace FrozenWasteland::bench;
+
+
+// Every heap allocation goes through here, so a module's footprint and anything it allocates on the audio thread can be counted.
+// Only the thread that called track() counts, the one running the modules as Rack's audio thread would: workers the modules start aren't the audio thread's cost
+namespace {
+
+thread_local bool tracking = false;
+std::atomic<size_t> allocations(0);
+std::atomic<size_t> allocatedBytes(0);
+std::atomic<size_t> freedBytes(0);
+
+void *allocate(size_t size) {
+	void *p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	if (tracking) {
+		allocations++;
+		allocatedBytes += malloc_usable_size(p);
+	}
+	return p;
+}
+
+void release(void *p) {
+	if (!p)
+		return;
+	if (tracking)
+		freedBytes += malloc_usable_size(p);
+	std::free(p);
+}
+
+struct Tally {
+	size_t allocations;
+	size_t liveBytes;
+};
+
+void track() {
+	allocations = allocatedBytes = freedBytes = 0;
+	tracking = true;
+}
+
+Tally untrack() {
+	tracking = false;
+	return {allocations.load(), allocatedBytes.load() - freedBytes.load()};
+}
+
+} // namespace
+
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return std::malloc(size ? size : 1); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return std::malloc(size ? size : 1); }
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+
+
+static void benchModule(const Scenario &scenario, float sampleRate, double seconds, bool flushDenormals) {
+	int64_t frames = (int64_t) (seconds * sampleRate);
+
+	track();
+	Rig rig(scenario, sampleRate);
+	rig.flushDenormals = flushDenormals;
+	Tally construction = untrack();
+	// The rig's own bookkeeping isn't the modules'
+	size_t rigBytes = malloc_usable_size(rig.modules.data()) + malloc_usable_size(rig.stimulus.data());
+
+	track();
+	double ns = rig.run(frames);
+	Tally processing = untrack();
+
+	std::printf("{\"module\": \"%s\", \"chain\": %d, \"sample_rate\": %g, \"frames\": %lld, \"ns_per_sample\": %.2f, \"realtime\": %.1f, "
+		"\"flush_denormals\": %s, \"construct_allocations\": %zu, \"footprint_bytes\": %zu, \"process_allocations\": %zu, \"process_bytes\": %zu}\n",
+		scenario.name().c_str(), (int) rig.modules.size(), sampleRate, (long long) frames, ns / frames, 1e9 / sampleRate / (ns / frames),
+		flushDenormals ? "true" : "false", construction.allocations, construction.liveBytes - rigBytes, processing.allocations, processing.liveBytes);
+	std::fflush(stdout);
+}
+
+template <typename G>
+static void benchGenerator(const char *name, double seconds) {
+	const int BLOCK = 64;
+	const int64_t samples = (int64_t) (seconds * 48000.f) / BLOCK * BLOCK;
+	G generator(1);
+	float out[BLOCK];
+	float sum = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t i = 0; i < samples; i += BLOCK) {
+		generator.fill(out, BLOCK);
+		sum += out[0];
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("{\"generator\": \"%s\", \"block\": %d, \"samples_per_second\": %.0f, \"check\": %g}\n", name, BLOCK, samples / s, sum);
+	std::fflush(stdout);
+}
+
+/** Many module instances drawing a random number every sample, spread over threads the way Rack's engine spreads modules.
+With rand() every draw takes the lock glibc keeps for its one shared state, with Random each instance owns its own stream.
+*/
+template <typename DRAW>
+static double timeDraws(int threads, int instances, int64_t samples, DRAW draw) {
+	std::vector<std::thread> workers;
+	std::vector<float> sums(threads);
+	auto start = std::chrono::steady_clock::now();
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([=, &sums]() {
+			std::vector<frozenwasteland::dsp::Random> streams;
+			for (int i = t; i < instances; i += threads) {
+				streams.push_back(frozenwasteland::dsp::Random(i + 1));
+			}
+			float sum = 0.f;
+			for (int64_t n = 0; n < samples; n++) {
+				for (frozenwasteland::dsp::Random &stream : streams) {
+					sum += draw(stream);
+				}
+			}
+			sums[t] = sum;
+		});
+	}
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return instances * samples / s;
+}
+
+static void benchContention(double seconds) {
+	const int INSTANCES = 32;
+	const int64_t samples = (int64_t) (seconds * 48000.f) / 10;
+	for (int threads : {1, 2, 4, 8}) {
+		double xoshiro = timeDraws(threads, INSTANCES, samples, [](frozenwasteland::dsp::Random &stream) {
+			return stream.uniform();
+		});
+		double libc = timeDraws(threads, INSTANCES, samples, [](frozenwasteland::dsp::Random &) {
+			return (float) rand() / RAND_MAX;
+		});
+		std::printf("{\"contention\": \"Random vs rand()\", \"threads\": %d, \"instances\": %d, \"random_draws_per_second\": %.0f, \"rand_draws_per_second\": %.0f}\n",
+			threads, INSTANCES, xoshiro, libc);
+		std::fflush(stdout);
+	}
+}
+
+static void usage() {
+	std::fprintf(stderr,
+		"Usage: fw-bench [--seconds S] [--sample-rate R] [--no-generators] [--contention] [--denormals] [slug ...]\n"
+		"Runs each model headless for S seconds of audio (default 10) at R Hz (default 48000) and prints one JSON object per line.\n"
+		"With no slugs every model the plugin registers is run, then the variants of their scenarios. A variant is named slug:variant.\n"
+		"Modules run with denormals flushed to zero, as on Rack's engine threads. --denormals runs them in the default floating point mode.\n"
+		"--contention also times 32 instances drawing random numbers every sample on 1 to 8 threads, with Random and with rand().\n");
+}
+
+int main(int argc, char **argv) {
+	double seconds = 10.0;
+	float sampleRate = 48000.f;
+	bool generators = true;
+	bool contention = false;
+	bool flushDenormals = true;
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+			seconds = std::atof(argv[++i]);
+		} else if (!std::strcmp(argv[i], "--sample-rate") && i + 1 < argc) {
+			sampleRate = std::atof(argv[++i]);
+		} else if (!std::strcmp(argv[i], "--no-generators")) {
+			generators = false;
+		} else if (!std::strcmp(argv[i], "--contention")) {
+			contention = true;
+		} else if (!std::strcmp(argv[i], "--denormals")) {
+			flushDenormals = false;
+		} else if (argv[i][0] == '-') {
+			usage();
+			return 1;
+		} else {
+			names.push_back(argv[i]);
+		}
+	}
+	if (names.empty()) {
+		for (rack::plugin::Model *model : loadPlugin()->models) {
+			names.push_back(model->slug);
+		}
+		for (const std::string &name : variantNames()) {
+			names.push_back(name);
+		}
+	}
+
+	for (const std::string &name : names) {
+		Scenario scenario = scenarioFor(name);
+		if (!findModel(scenario.slug)) {
+			std::fprintf(stderr, "fw-bench: no model %s\n", name.c_str());
+			return 1;
+		}
+		benchModule(scenario, sampleRate, seconds, flushDenormals);
+	}
+
+	if (generators) {
+		benchGenerator<frozenwasteland::dsp::WhiteNoise>("WhiteNoise", seconds);
+		benchGenerator<frozenwasteland::dsp::GaussianNoise>("GaussianNoise", seconds);
+		benchGenerator<frozenwasteland::dsp::PinkNoise>("PinkNoise", seconds);
+		benchGenerator<frozenwasteland::dsp::RedNoise>("RedNoise", seconds);
+	}
+	if (contention) {
+		benchContention(seconds);
+	}
+	return 0;
+}
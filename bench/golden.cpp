@@ -0,0 +1,392 @@
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "host.hpp"
+#include "dsp-noise/seeds.hpp"
+
+using namespace FrozenWasteland::bench;
+
+
+/** How far a module's render may drift from its reference.
+EXACT is for modules whose output is decisions rather than signal, a gate or note one sample late is a bug.
+CLOSE allows rounding, e.g. from the compiler reordering float maths.
+SPECTRAL is for the resampling delays, where a change of interpolator or the timing of a worker thread moves every sample a little:
+the error may be up to rmsDb below the reference's level, and each octave band's energy within bandDb of the reference's.
+*/
+struct Tolerance {
+	enum Kind {
+		EXACT,
+		CLOSE,
+		SPECTRAL
+	};
+
+	Kind kind;
+	float maxError;
+	float rmsDb;
+	float bandDb;
+};
+
+static const Tolerance EXACT = {Tolerance::EXACT, 0.f, 0.f, 0.f};
+static const Tolerance CLOSE = {Tolerance::CLOSE, 1e-4f, 0.f, 0.f};
+static const Tolerance SPECTRAL = {Tolerance::SPECTRAL, 0.f, -30.f, 1.5f};
+
+static Tolerance toleranceFor(const std::string &slug) {
+	static const std::vector<std::pair<std::string, Tolerance>> tolerances = {
+		{"QuadAlgorithmicRhythm", EXACT},
+		{"QARGrooveExpander", EXACT},
+		{"QARProbabilityExpander", EXACT},
+		{"SeedsOfChange", EXACT},
+		{"SeedsOfChangeCVExpander", EXACT},
+		{"SeedsOfChangeGateExpander", EXACT},
+		{"ProbablyNote", EXACT},
+		{"ProbablyNoteBP", EXACT},
+		{"PNChordExpander", EXACT},
+		{"PortlandWeather", SPECTRAL},
+	};
+	for (const auto &tolerance : tolerances) {
+		if (tolerance.first == slug)
+			return tolerance.second;
+	}
+	return CLOSE;
+}
+
+
+/** Every output of every module in a scenario's chain, one channel each (the first, if an output is polyphonic), named slug#output. */
+struct Render {
+	float sampleRate = 0.f;
+	std::vector<std::string> names;
+	std::vector<std::vector<float>> channels;
+};
+
+static const unsigned int SEED = 20200101;
+
+static Render render(const std::string &slug, float sampleRate, double seconds) {
+	Scenario scenario = scenarioFor(slug);
+	// The same random streams for the modules whichever others were rendered first
+	frozenwasteland::dsp::Seeds::seed(SEED);
+	Rig rig(scenario, sampleRate);
+
+	Render r;
+	r.sampleRate = sampleRate;
+	for (rack::engine::Module *module : rig.modules) {
+		for (int o = 0; o < (int) module->outputs.size(); o++) {
+			r.names.push_back(module->model->slug + "#" + std::to_string(o));
+		}
+	}
+	int64_t frames = (int64_t) (seconds * sampleRate);
+	r.channels.resize(r.names.size());
+	for (std::vector<float> &channel : r.channels) {
+		channel.reserve(frames);
+	}
+	rig.run(frames, [&](const Rig &rig) {
+		int c = 0;
+		for (rack::engine::Module *module : rig.modules) {
+			for (rack::engine::Output &output : module->outputs) {
+				r.channels[c++].push_back(output.getVoltage());
+			}
+		}
+	});
+	return r;
+}
+
+
+// References are 32 bit float WAVs, one channel per output, so they can be opened in an audio editor next to a failing render
+static void put32(std::ofstream &file, uint32_t x) {
+	file.write((const char*) &x, 4);
+}
+
+static void put16(std::ofstream &file, uint16_t x) {
+	file.write((const char*) &x, 2);
+}
+
+static bool writeWav(const std::string &path, const Render &r) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	uint16_t channels = r.channels.size();
+	uint32_t frames = channels ? r.channels[0].size() : 0;
+	uint32_t dataBytes = frames * channels * 4;
+	file.write("RIFF", 4);
+	put32(file, 36 + dataBytes);
+	file.write("WAVEfmt ", 8);
+	put32(file, 16);
+	put16(file, 3);	// IEEE float
+	put16(file, channels);
+	put32(file, (uint32_t) r.sampleRate);
+	put32(file, (uint32_t) r.sampleRate * channels * 4);
+	put16(file, channels * 4);
+	put16(file, 32);
+	file.write("data", 4);
+	put32(file, dataBytes);
+	for (uint32_t i = 0; i < frames; i++) {
+		for (uint16_t c = 0; c < channels; c++) {
+			file.write((const char*) &r.channels[c][i], 4);
+		}
+	}
+	return (bool) file;
+}
+
+/** Reads back what writeWav() wrote. Channel names aren't stored, the caller's render supplies them. */
+static bool readWav(const std::string &path, Render &r) {
+	std::ifstream file(path, std::ios::binary);
+	char id[4];
+	uint32_t size;
+	if (!file.read(id, 4) || std::memcmp(id, "RIFF", 4) || !file.read((char*) &size, 4) || !file.read(id, 4) || std::memcmp(id, "WAVE", 4))
+		return false;
+	uint16_t channels = 0;
+	uint32_t sampleRate = 0;
+	while (file.read(id, 4) && file.read((char*) &size, 4)) {
+		if (!std::memcmp(id, "fmt ", 4)) {
+			uint16_t format, bits;
+			uint32_t byteRate;
+			uint16_t blockAlign;
+			file.read((char*) &format, 2);
+			file.read((char*) &channels, 2);
+			file.read((char*) &sampleRate, 4);
+			file.read((char*) &byteRate, 4);
+			file.read((char*) &blockAlign, 2);
+			file.read((char*) &bits, 2);
+			if (format != 3 || bits != 32)
+				return false;
+			file.seekg(size - 16, std::ios::cur);
+		} else if (!std::memcmp(id, "data", 4)) {
+			// A module with no outputs, e.g. the QAR expanders, has a reference with no channels
+			uint32_t frames = channels ? size / (channels * 4) : 0;
+			r.sampleRate = sampleRate;
+			r.channels.assign(channels, std::vector<float>(frames));
+			for (uint32_t i = 0; i < frames; i++) {
+				for (uint16_t c = 0; c < channels; c++) {
+					file.read((char*) &r.channels[c][i], 4);
+				}
+			}
+			return (bool) file;
+		} else {
+			file.seekg(size, std::ios::cur);
+		}
+	}
+	return false;
+}
+
+
+static void fft(std::vector<std::complex<double>> &x) {
+	const size_t n = x.size();
+	for (size_t i = 1, j = 0; i < n; i++) {
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j)
+			std::swap(x[i], x[j]);
+	}
+	for (size_t length = 2; length <= n; length <<= 1) {
+		std::complex<double> w = std::polar(1.0, -2.0 * M_PI / length);
+		for (size_t i = 0; i < n; i += length) {
+			std::complex<double> wk = 1.0;
+			for (size_t k = 0; k < length / 2; k++) {
+				std::complex<double> u = x[i + k];
+				std::complex<double> v = x[i + k + length / 2] * wk;
+				x[i + k] = u + v;
+				x[i + k + length / 2] = u - v;
+				wk *= w;
+			}
+		}
+	}
+}
+
+/** Energy in octave bands from 31.25 Hz up, from Hann windowed blocks averaged over the whole channel. */
+static std::vector<double> octaveBands(const std::vector<float> &channel, float sampleRate, std::vector<double> &edges) {
+	const int N = 4096;
+	std::vector<double> power(N / 2, 0.0);
+	std::vector<std::complex<double>> x(N);
+	for (size_t start = 0; start + N <= channel.size(); start += N) {
+		for (int i = 0; i < N; i++) {
+			x[i] = channel[start + i] * 0.5 * (1.0 - std::cos(2.0 * M_PI * i / N));
+		}
+		fft(x);
+		for (int k = 1; k < N / 2; k++) {
+			power[k] += std::norm(x[k]);
+		}
+	}
+	edges.clear();
+	std::vector<double> bands;
+	for (double low = 31.25; low < sampleRate / 2; low *= 2) {
+		double energy = 0.0;
+		for (int k = 1; k < N / 2; k++) {
+			double f = (double) k * sampleRate / N;
+			if (f >= low && f < low * 2)
+				energy += power[k];
+		}
+		edges.push_back(low);
+		bands.push_back(energy);
+	}
+	return bands;
+}
+
+/** Compares one channel against its reference, adding a line to report if it's out of tolerance. */
+static bool compare(const std::string &name, const std::vector<float> &reference, const std::vector<float> &actual, float sampleRate, const Tolerance &tolerance,
+	std::string &report) {
+	char line[512];
+	if (reference.size() != actual.size()) {
+		std::snprintf(line, sizeof(line), "  %s: %zu frames, reference has %zu\n", name.c_str(), actual.size(), reference.size());
+		report += line;
+		return false;
+	}
+	size_t worst = 0;
+	float worstError = 0.f;
+	size_t firstDifference = reference.size();
+	double referenceSquares = 0.0, errorSquares = 0.0;
+	for (size_t i = 0; i < reference.size(); i++) {
+		float error = std::fabs(actual[i] - reference[i]);
+		bool same = std::memcmp(&actual[i], &reference[i], sizeof(float)) == 0;
+		if (!same && firstDifference == reference.size())
+			firstDifference = i;
+		// NaN compares false, so it always counts as the worst error
+		if (!same && !(error <= worstError)) {
+			worst = i;
+			worstError = std::isnan(error) ? INFINITY : error;
+		}
+		referenceSquares += (double) reference[i] * reference[i];
+		errorSquares += (double) error * error;
+	}
+	if (firstDifference == reference.size())
+		return true;
+
+	bool pass = true;
+	char detail[256] = "";
+	if (tolerance.kind == Tolerance::EXACT) {
+		pass = false;
+	} else if (tolerance.kind == Tolerance::CLOSE) {
+		pass = worstError <= tolerance.maxError;
+		std::snprintf(detail, sizeof(detail), ", limit %g", tolerance.maxError);
+	} else {
+		// Relative to the reference's level, or to 1mV if the reference is near silent
+		double rms = std::sqrt(referenceSquares / reference.size());
+		double errorDb = 20.0 * std::log10(std::sqrt(errorSquares / reference.size()) / std::max(rms, 1e-3));
+		pass = errorDb <= tolerance.rmsDb;
+		std::vector<double> edges;
+		std::vector<double> referenceBands = octaveBands(reference, sampleRate, edges);
+		std::vector<double> actualBands = octaveBands(actual, sampleRate, edges);
+		double total = 0.0;
+		for (double energy : referenceBands) {
+			total += energy;
+		}
+		double worstBandDb = 0.0;
+		double worstBand = 0.0;
+		for (size_t b = 0; b < edges.size(); b++) {
+			// Bands 60dB below the whole signal in both renders are only noise
+			if (referenceBands[b] < total * 1e-6 && actualBands[b] < total * 1e-6)
+				continue;
+			double db = 10.0 * std::log10((actualBands[b] + 1e-30) / (referenceBands[b] + 1e-30));
+			if (std::fabs(db) > std::fabs(worstBandDb)) {
+				worstBandDb = db;
+				worstBand = edges[b];
+			}
+		}
+		pass = pass && std::fabs(worstBandDb) <= tolerance.bandDb;
+		std::snprintf(detail, sizeof(detail), ", rms error %.1f dB (limit %.1f), worst octave from %g Hz %+.2f dB (limit %.1f)",
+			errorDb, tolerance.rmsDb, worstBand, worstBandDb, tolerance.bandDb);
+	}
+	if (!pass) {
+		std::snprintf(line, sizeof(line), "  %s: first differs at frame %zu, max error %g at frame %zu (reference %g, got %g)%s\n", name.c_str(), firstDifference,
+			worstError, worst, reference[worst], actual[worst], detail);
+		report += line;
+	}
+	return pass;
+}
+
+
+static void usage() {
+	std::fprintf(stderr,
+		"Usage: fw-golden [--update] [--dir DIR] [--seconds S] [slug ...]\n"
+		"Renders each model's scenario at 48000 Hz for S seconds (default 2) and compares it with DIR/slug.wav (default bench/golden).\n"
+		"--update writes the references instead. A model with no reference fails. A failing render is written to build/golden/slug.wav.\n");
+}
+
+int main(int argc, char **argv) {
+	bool update = false;
+	std::string dir = "bench/golden";
+	std::string failedDir = "build/golden";
+	double seconds = 2.0;
+	const float sampleRate = 48000.f;
+	std::vector<std::string> slugs;
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--update")) {
+			update = true;
+		} else if (!std::strcmp(argv[i], "--dir") && i + 1 < argc) {
+			dir = argv[++i];
+		} else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+			seconds = std::atof(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			usage();
+			return 1;
+		} else {
+			slugs.push_back(argv[i]);
+		}
+	}
+	if (slugs.empty()) {
+		for (rack::plugin::Model *model : loadPlugin()->models) {
+			slugs.push_back(model->slug);
+		}
+	}
+	if (update)
+		mkdir(dir.c_str(), 0755);
+
+	int passed = 0, failed = 0, missing = 0;
+	for (const std::string &slug : slugs) {
+		if (!findModel(slug)) {
+			std::fprintf(stderr, "fw-golden: no model %s\n", slug.c_str());
+			return 1;
+		}
+		Render actual = render(slug, sampleRate, seconds);
+		std::string path = dir + "/" + slug + ".wav";
+		if (update) {
+			if (!writeWav(path, actual)) {
+				std::fprintf(stderr, "fw-golden: can't write %s\n", path.c_str());
+				return 1;
+			}
+			std::printf("wrote %s\n", path.c_str());
+			continue;
+		}
+
+		Render reference;
+		if (!readWav(path, reference)) {
+			// Not a pass: a module nobody made a reference for is a module nothing is checking
+			std::printf("FAIL %s\n  no reference at %s, render it on a commit you trust with `make golden-update GOLDEN_ARGS=\"%s\"` and commit it\n",
+				slug.c_str(), path.c_str(), slug.c_str());
+			missing++;
+			continue;
+		}
+		Tolerance tolerance = toleranceFor(slug);
+		bool pass = true;
+		std::string report;
+		if (reference.channels.size() != actual.channels.size() || reference.sampleRate != actual.sampleRate) {
+			char line[256];
+			std::snprintf(line, sizeof(line), "  %zu outputs at %g Hz, reference has %zu at %g Hz\n", actual.channels.size(), actual.sampleRate,
+				reference.channels.size(), reference.sampleRate);
+			report = line;
+			pass = false;
+		} else {
+			for (size_t c = 0; c < actual.channels.size(); c++) {
+				pass = compare(actual.names[c], reference.channels[c], actual.channels[c], sampleRate, tolerance, report) && pass;
+			}
+		}
+		std::printf("%s %s\n%s", pass ? "ok" : "FAIL", slug.c_str(), report.c_str());
+		if (pass) {
+			passed++;
+		} else {
+			failed++;
+			mkdir("build", 0755);
+			mkdir(failedDir.c_str(), 0755);
+			writeWav(failedDir + "/" + slug + ".wav", actual);
+		}
+	}
+	if (!update)
+		std::printf("golden: %d passed, %d failed, %d missing\n", passed, failed, missing);
+	return failed || missing ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/** Included ahead of every plugin source in the bench's own build of the plugin, see the Makefile.
+The bench only ever runs modules, so createModel() is swapped for one whose Models make modules and no widgets. With no ModuleWidget
+constructed anywhere none of Rack's GUI is linked, and every Rack symbol the bench does need is defined in rack_stub.cpp.
+*/
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+namespace bench {
+
+template <class TModule, class TModuleWidget>
+rack::plugin::Model *createHeadlessModel(const std::string &slug) {
+	struct TModel : rack::plugin::Model {
+		rack::engine::Module *createModule() override {
+			TModule *module = new TModule;
+			module->model = this;
+			return module;
+		}
+		rack::app::ModuleWidget *createModuleWidget() override {
+			return NULL;
+		}
+	};
+
+	rack::plugin::Model *model = new TModel;
+	model->slug = slug;
+	return model;
+}
+
+} // namespace bench
+} // namespace FrozenWasteland
+
+#define createModel FrozenWasteland::bench::createHeadlessModel
@@ -0,0 +1,169 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#ifdef __SSE2__
+#include <pmmintrin.h>
+#endif
+
+#include "host.hpp"
+#include "dsp-noise/seed_stream.hpp"
+
+
+namespace FrozenWasteland {
+namespace bench {
+
+float Signal::at(int64_t frame, float sampleRate) const {
+	double t = frame / (double) sampleRate;
+	switch (kind) {
+		case CLOCK : {
+			double beats = t * a / 60.0;
+			return beats - std::floor(beats) < 0.5 ? 10.f : 0.f;
+		}
+		case SINE :
+			return b * (float) std::sin(2.0 * M_PI * std::fmod(a * t, 1.0));
+		case SWEEP : {
+			// Phase of an exponential sweep is the integral of its frequency, restarted every c seconds
+			double s = std::fmod(t, (double) c);
+			double k = std::log((double) b / a);
+			double cycles = a * c / k * (std::exp(k * s / c) - 1.0);
+			return 5.f * (float) std::sin(2.0 * M_PI * std::fmod(cycles, 1.0));
+		}
+		case LFO :
+			return b + c * (float) std::sin(2.0 * M_PI * std::fmod(a * t, 1.0));
+		case IMPULSE :
+			return frame % std::max((int64_t) 1, (int64_t) std::llround(a * sampleRate)) == 0 ? b : 0.f;
+		case NOISE :
+			return b * (float) (2.0 * (frozenwasteland::dsp::SeedStream::mix((uint64_t) a * 0x9e3779b97f4a7c15ULL + frame) >> 11) / 9007199254740992.0 - 1.0);
+		case NOTES : {
+			static const float pattern[] = {0.f, 7.f, 3.f, 10.f, 5.f, -2.f, 12.f, 2.f};
+			int64_t step = (int64_t) (t / a);
+			return pattern[step % 8] / 12.f + (step / 8 % 3 - 1);
+		}
+		default :
+			return a;
+	}
+}
+
+rack::plugin::Plugin *loadPlugin() {
+	static rack::plugin::Plugin *plugin = NULL;
+	if (!plugin) {
+		// Never deleted, like Rack never unloads a plugin while it runs
+		plugin = new rack::plugin::Plugin;
+		plugin->slug = "FrozenWasteland";
+		init(plugin);
+	}
+	return plugin;
+}
+
+rack::plugin::Model *findModel(const std::string &slug) {
+	for (rack::plugin::Model *model : loadPlugin()->models) {
+		if (model->slug == slug)
+			return model;
+	}
+	return NULL;
+}
+
+Rig::Rig(const Scenario &scenario, float sampleRate) : scenario(scenario), sampleRate(sampleRate) {
+	engineSampleRate = sampleRate;
+	std::vector<std::string> slugs = {scenario.slug};
+	slugs.insert(slugs.end(), scenario.chain.begin(), scenario.chain.end());
+	for (const std::string &slug : slugs) {
+		rack::plugin::Model *model = findModel(slug);
+		if (!model)
+			continue;
+		rack::engine::Module *module = model->createModule();
+		for (rack::engine::Output &output : module->outputs) {
+			output.channels = 1;
+		}
+		// Loaded before the module is added, as from a patch
+		if (modules.empty() && !scenario.data.empty()) {
+			json_error_t error;
+			json_t *dataJ = json_loads(scenario.data.c_str(), 0, &error);
+			if (dataJ) {
+				module->dataFromJson(dataJ);
+				json_decref(dataJ);
+			} else {
+				std::fprintf(stderr, "%s: bad data at line %d: %s\n", scenario.name().c_str(), error.line, error.text);
+			}
+		}
+		module->onAdd();
+		module->onSampleRateChange();
+		if (!modules.empty()) {
+			modules.back()->rightExpander.module = module;
+			module->leftExpander.module = modules.back();
+		}
+		modules.push_back(module);
+	}
+	if (modules.empty())
+		return;
+	rack::engine::Module *first = modules.front();
+	for (const Setting &setting : scenario.settings) {
+		if (setting.module < (int) modules.size())
+			modules[setting.module]->params[setting.param].setValue(setting.value);
+	}
+	for (const Patch &patch : scenario.patches) {
+		first->inputs[patch.input].channels = 1;
+	}
+	stimulus.resize(scenario.patches.size() * BLOCK);
+}
+
+Rig::~Rig() {
+	for (rack::engine::Module *module : modules) {
+		delete module;
+	}
+}
+
+double Rig::run(int64_t frames, const std::function<void(const Rig &)> &onFrame) {
+	if (modules.empty())
+		return 0.0;
+	rack::engine::Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	rack::engine::Module *first = modules.front();
+	const int patchCount = scenario.patches.size();
+	double elapsed = 0.0;
+#ifdef __SSE2__
+	const unsigned int FTZ_DAZ = _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON;
+	const unsigned int csr = _mm_getcsr();
+	_mm_setcsr(flushDenormals ? csr | FTZ_DAZ : csr & ~FTZ_DAZ);
+#endif
+	while (frames > 0) {
+		int block = (int) std::min(frames, (int64_t) BLOCK);
+		for (int p = 0; p < patchCount; p++) {
+			for (int i = 0; i < block; i++) {
+				stimulus[p * BLOCK + i] = scenario.patches[p].signal.at(frame + i, sampleRate);
+			}
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < block; i++) {
+			for (int p = 0; p < patchCount; p++) {
+				first->inputs[scenario.patches[p].input].setVoltage(stimulus[p * BLOCK + i]);
+			}
+			for (rack::engine::Module *module : modules) {
+				module->process(args);
+			}
+			// Expander messages flip between samples, as in Rack's engine
+			for (rack::engine::Module *module : modules) {
+				for (rack::engine::Module::Expander *expander : {&module->leftExpander, &module->rightExpander}) {
+					if (expander->messageFlipRequested) {
+						std::swap(expander->producerMessage, expander->consumerMessage);
+						expander->messageFlipRequested = false;
+					}
+				}
+			}
+			frame++;
+			if (onFrame)
+				onFrame(*this);
+		}
+		elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		frames -= block;
+	}
+#ifdef __SSE2__
+	_mm_setcsr(csr);
+#endif
+	return elapsed;
+}
+
+} // namespace bench
+} // namespace FrozenWasteland
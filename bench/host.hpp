@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+namespace bench {
+
+/** What APP->engine->getSampleRate() returns. A Rig sets it before making its modules. */
+extern float engineSampleRate;
+
+/** A test signal worked out from the frame number alone, so every run of a scenario feeds the modules the same voltages. */
+struct Signal {
+	enum Kind {
+		CONSTANT,	// a
+		CLOCK,		// 10V pulses at a BPM, 50% duty
+		SINE,		// a Hz, b volts peak
+		SWEEP,		// a Hz up to b Hz exponentially, repeating every c seconds, 5V peak
+		LFO,		// a Hz sine around b volts, c volts deep
+		IMPULSE,	// a single sample of b volts every a seconds
+		NOISE,		// white, b volts peak, seeded by a
+		NOTES		// a V/Oct note pattern, a new note every a seconds
+	};
+
+	Kind kind;
+	float a;
+	float b;
+	float c;
+
+	float at(int64_t frame, float sampleRate) const;
+};
+
+/** A signal into one input of the first module of a chain. */
+struct Patch {
+	int input;
+	Signal signal;
+};
+
+/** A knob setting. module counts along the chain from the first module, 0, which it is if left out. */
+struct Setting {
+	int param;
+	float value;
+	int module;
+};
+
+/** How a model is exercised: the modules to its right it's chained with, its knobs and what goes into its inputs.
+Every output is treated as connected, so modules that skip unpatched outputs still do all their work.
+A model can have variants besides its own scenario, named slug:variant, e.g. to compare its context menu options.
+data is the first module's data as a patch saves it, in JSON, for the options that aren't knobs.
+*/
+struct Scenario {
+	std::string slug;
+	std::vector<std::string> chain;
+	std::vector<Setting> settings;
+	std::vector<Patch> patches;
+	std::string variant;
+	std::string data;
+
+	std::string name() const;
+};
+
+/** Scenarios for every model the plugin registers, and their variants by slug:variant, see scenarios.cpp.
+Models without one still run, with nothing patched.
+*/
+Scenario scenarioFor(const std::string &name);
+
+/** The names of all the variants, which the bench runs after the models' own scenarios. */
+std::vector<std::string> variantNames();
+
+/** The plugin as Rack would load it, with init() run on it. */
+rack::plugin::Plugin *loadPlugin();
+
+rack::plugin::Model *findModel(const std::string &slug);
+
+/** A scenario's chain of modules, stepped a frame at a time the way Rack's engine steps a row of expanders. The scenario must outlive it. */
+struct Rig {
+	static const int BLOCK = 1024;
+
+	const Scenario &scenario;
+	float sampleRate;
+	std::vector<rack::engine::Module*> modules;
+	int64_t frame = 0;
+	std::vector<float> stimulus;
+	/** Like Rack's engine threads, run() flushes denormals to zero unless this is cleared. */
+	bool flushDenormals = true;
+
+	Rig(const Scenario &scenario, float sampleRate);
+	~Rig();
+
+	/** Runs frames frames, calling onFrame after each. Returns the nanoseconds spent stepping the modules, leaving out working out the
+	test signals, which is done a block at a time beforehand. */
+	double run(int64_t frames, const std::function<void(const Rig &)> &onFrame = nullptr);
+};
+
+} // namespace bench
+} // namespace FrozenWasteland
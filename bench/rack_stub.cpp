@@ -0,0 +1,208 @@
+/** Just enough of Rack's engine for modules to run without it: the parts of Module, ParamQuantity, Plugin and the engine that live in
+Rack's own binary rather than its headers. The bench's build of the plugin makes no widgets (see headless.hpp), so nothing of the GUI
+is needed, and a Rack symbol missing here fails the link rather than crashing a run.
+*/
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "rack.hpp"
+
+#include "host.hpp"
+
+
+namespace FrozenWasteland {
+namespace bench {
+
+float engineSampleRate = 44100.f;
+
+} // namespace bench
+} // namespace FrozenWasteland
+
+
+namespace rack {
+
+namespace engine {
+
+Module::Module() {}
+
+Module::~Module() {
+	for (ParamQuantity *paramQuantity : paramQuantities) {
+		delete paramQuantity;
+	}
+}
+
+void Module::config(int numParams, int numInputs, int numOutputs, int numLights) {
+	params.resize(numParams);
+	inputs.resize(numInputs);
+	outputs.resize(numOutputs);
+	lights.resize(numLights);
+	paramQuantities.resize(numParams);
+}
+
+float Engine::getSampleRate() {
+	return FrozenWasteland::bench::engineSampleRate;
+}
+
+// configParam() makes a ParamQuantity for every knob, which needs its vtable. The bench never shows a parameter, so only the value is real
+
+float ParamQuantity::getValue() {
+	return module ? module->params[paramId].getValue() : 0.f;
+}
+
+void ParamQuantity::setValue(float value) {
+	if (module)
+		module->params[paramId].setValue(math::clamp(value, minValue, maxValue));
+}
+
+float ParamQuantity::getMinValue() {
+	return minValue;
+}
+
+float ParamQuantity::getMaxValue() {
+	return maxValue;
+}
+
+float ParamQuantity::getDefaultValue() {
+	return defaultValue;
+}
+
+float ParamQuantity::getDisplayValue() {
+	return getValue();
+}
+
+void ParamQuantity::setDisplayValue(float displayValue) {
+	setValue(displayValue);
+}
+
+int ParamQuantity::getDisplayPrecision() {
+	return displayPrecision;
+}
+
+std::string ParamQuantity::getDisplayValueString() {
+	return string::f("%g", getDisplayValue());
+}
+
+void ParamQuantity::setDisplayValueString(std::string s) {
+	setDisplayValue(std::atof(s.c_str()));
+}
+
+std::string ParamQuantity::getLabel() {
+	return label;
+}
+
+std::string ParamQuantity::getUnit() {
+	return unit;
+}
+
+std::string ParamQuantity::getDescription() {
+	return description;
+}
+
+} // namespace engine
+
+float Quantity::getDisplayValue() {
+	return getValue();
+}
+
+void Quantity::setDisplayValue(float displayValue) {
+	setValue(displayValue);
+}
+
+int Quantity::getDisplayPrecision() {
+	return 5;
+}
+
+std::string Quantity::getDisplayValueString() {
+	return string::f("%g", getDisplayValue());
+}
+
+void Quantity::setDisplayValueString(std::string s) {
+	setDisplayValue(std::atof(s.c_str()));
+}
+
+std::string Quantity::getString() {
+	return getLabel() + ": " + getDisplayValueString() + getUnit();
+}
+
+void Quantity::reset() {
+	setValue(getDefaultValue());
+}
+
+void Quantity::randomize() {
+	setValue(getMinValue() + (getMaxValue() - getMinValue()) * (std::rand() / (RAND_MAX + 1.f)));
+}
+
+namespace string {
+
+std::string f(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	int size = std::vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	std::string s(size, '\0');
+	va_start(args, format);
+	std::vsnprintf(&s[0], size + 1, format, args);
+	va_end(args);
+	return s;
+}
+
+} // namespace string
+
+namespace logger {
+
+void log(Level level, const char *filename, int line, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	std::fprintf(stderr, "[%s:%d] ", filename, line);
+	std::vfprintf(stderr, format, args);
+	std::fprintf(stderr, "\n");
+	va_end(args);
+}
+
+} // namespace logger
+
+namespace plugin {
+
+void Plugin::addModel(Model *model) {
+	model->plugin = this;
+	models.push_back(model);
+}
+
+} // namespace plugin
+
+Context *contextGet() {
+	// The engine is never constructed: the one method modules call on it is defined above and doesn't touch its members
+	alignas(engine::Engine) static unsigned char engineStorage[sizeof(engine::Engine)];
+	static Context *context = NULL;
+	if (!context) {
+		context = new Context;
+		context->engine = reinterpret_cast<engine::Engine*>(engineStorage);
+	}
+	return context;
+}
+
+} // namespace rack
+
+
+// Colours are made at static initialization by Rack's component library and ours, long before anything is drawn
+NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b) {
+	return nvgRGBA(r, g, b, 255);
+}
+
+NVGcolor nvgRGBf(float r, float g, float b) {
+	return nvgRGBAf(r, g, b, 1.0f);
+}
+
+NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+	return nvgRGBAf(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f);
+}
+
+NVGcolor nvgRGBAf(float r, float g, float b, float a) {
+	NVGcolor color;
+	color.r = r;
+	color.g = g;
+	color.b = b;
+	color.a = a;
+	return color;
+}
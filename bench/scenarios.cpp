@@ -0,0 +1,165 @@
+#include "host.hpp"
+
+
+namespace FrozenWasteland {
+namespace bench {
+
+// Port and param numbers are the modules' enums, which are private to their .cpp files, so each is named in a comment
+static const std::vector<Scenario> scenarios = {
+	{"BPMLFO", {"BPMLFOPhaseExpander"}, {}, {
+		{0, {Signal::CLOCK, 120.f}},				// CLOCK_INPUT
+		{3, {Signal::LFO, 0.1f, 0.f, 2.f}},			// PHASE_INPUT
+	}},
+	{"BPMLFO2", {"BPMLFOPhaseExpander"}, {}, {
+		{0, {Signal::CLOCK, 120.f}},				// CLOCK_INPUT
+		{3, {Signal::LFO, 0.2f, 5.f, 5.f}},			// WAVESLOPE_INPUT
+		{4, {Signal::LFO, 0.13f, 5.f, 5.f}},		// SKEW_INPUT
+	}},
+	{"CDCSeriouslySlowLFO", {}, {}, {
+		{0, {Signal::LFO, 0.05f, 0.f, 2.f}},		// FM_INPUT
+	}},
+	{"DamianLillard", {}, {}, {
+		{0, {Signal::SWEEP, 20.f, 20000.f, 5.f}},	// SIGNAL_IN
+		{1, {Signal::LFO, 0.3f, 0.f, 3.f}},			// FREQ_1_CUTOFF_INPUT
+		{2, {Signal::LFO, 0.2f, 0.f, 3.f}},			// FREQ_2_CUTOFF_INPUT
+		{3, {Signal::LFO, 0.1f, 0.f, 3.f}},			// FREQ_3_CUTOFF_INPUT
+	}},
+	{"EverlastingGlottalStopper", {}, {}, {
+		{0, {Signal::NOTES, 0.25f}},				// PITCH_INPUT
+		{4, {Signal::LFO, 0.3f, 2.5f, 2.5f}},		// BREATHINESS_INPUT
+	}},
+	{"HairPick", {}, {}, {
+		{0, {Signal::CLOCK, 120.f}},				// CLOCK_INPUT
+		{11, {Signal::SWEEP, 20.f, 20000.f, 5.f}},	// IN_L_INPUT
+		{12, {Signal::NOISE, 1.f, 5.f}},			// IN_R_INPUT
+	}},
+	{"LissajousLFO", {}, {}, {
+		{2, {Signal::LFO, 0.1f, 0.f, 1.f}},			// FREQX1_INPUT
+		{5, {Signal::LFO, 0.07f, 0.f, 5.f}},		// WAVESHAPEX1_INPUT
+	}},
+	{"MrBlueSky", {}, {}, {
+		{16, {Signal::SWEEP, 50.f, 5000.f, 2.f}},	// IN_MOD
+		{17, {Signal::NOISE, 2.f, 5.f}},			// IN_CARR
+	}},
+	{"TheOneRingModulator", {}, {}, {
+		{0, {Signal::SINE, 440.f, 5.f}},			// CARRIER_INPUT
+		{1, {Signal::SWEEP, 20.f, 20000.f, 5.f}},	// SIGNAL_INPUT
+	}},
+	{"PhasedLockedLoop", {}, {}, {
+		{3, {Signal::SWEEP, 50.f, 2000.f, 10.f}},	// SIGNAL_INPUT
+	}},
+	{"PortlandWeather", {}, {}, {
+		{0, {Signal::CLOCK, 120.f}},				// CLOCK_INPUT
+		{13, {Signal::LFO, 0.2f, 0.f, 2.f}},		// FEEDBACK_L_PITCH_SHIFT_CV_INPUT
+		{150, {Signal::SWEEP, 20.f, 20000.f, 5.f}},	// IN_L_INPUT
+		{151, {Signal::IMPULSE, 0.25f, 10.f}},		// IN_R_INPUT
+	}},
+	{"ProbablyNote", {"PNChordExpander"}, {}, {
+		{0, {Signal::LFO, 0.1f, 0.f, 2.f}},			// NOTE_INPUT
+		{9, {Signal::CLOCK, 480.f}},				// TRIGGER_INPUT
+	}},
+	{"ProbablyNoteBP", {}, {}, {
+		{0, {Signal::LFO, 0.1f, 0.f, 2.f}},			// NOTE_INPUT
+		{9, {Signal::CLOCK, 480.f}},				// TRIGGER_INPUT
+	}},
+	{"QuadAlgorithmicRhythm", {"QARProbabilityExpander", "QARGrooveExpander"}, {}, {
+		{0, {Signal::LFO, 0.05f, 5.f, 5.f}},		// STEPS_1_INPUT
+		{32, {Signal::CLOCK, 480.f}},				// CLOCK_INPUT
+	}},
+	{"QuantussyCell", {}, {}, {
+		{1, {Signal::LFO, 0.5f, 0.f, 1.f}},			// CV_INPUT
+	}},
+	{"SeedsOfChange", {"SeedsOfChangeCVExpander", "SeedsOfChangeGateExpander"}, {
+		{11, 0.5f}, {12, 0.5f}, {13, 0.5f}, {14, 0.5f},	// GATE_PROBABILITY_1_PARAM to GATE_PROBABILITY_4_PARAM
+		{0, 0.5f, 2}, {1, 0.5f, 2}, {2, 0.5f, 2}, {3, 0.5f, 2},	// the Gate Expander's GATE_PROBABILITY_1_PARAM to GATE_PROBABILITY_4_PARAM
+	}, {
+		{2, {Signal::CLOCK, 480.f}},				// CLOCK_INPUT
+	}},
+	{"StringTheory", {}, {}, {
+		{3, {Signal::NOTES, 0.5f}},					// V_OCT_INPUT
+		{8, {Signal::CLOCK, 120.f}},				// PLUCK_INPUT
+	}},
+	{"RouletteLFO", {}, {}, {
+		{6, {Signal::LFO, 0.1f, 0.f, 2.f}},			// FREQUENCY_INPUT
+	}},
+	{"SeriouslySlowLFO", {}, {}, {
+		{0, {Signal::LFO, 0.05f, 0.f, 2.f}},		// FM_INPUT
+	}},
+	{"VoxInhumana", {"VoxInhumanaExpander"}, {}, {
+		{0, {Signal::NOISE, 3.f, 5.f}},				// SIGNAL_IN
+		{1, {Signal::LFO, 0.2f, 5.f, 5.f}},			// VOWEL_1_CV_IN
+	}},
+};
+
+// A model's own scenario. Only looks in scenarios, which is made first, as the variants below are made from it
+static Scenario scenarioOf(const std::string &slug) {
+	for (const Scenario &scenario : scenarios) {
+		if (scenario.slug == slug)
+			return scenario;
+	}
+	return {slug, {}, {}, {}};
+}
+
+// The same inputs as a model's own scenario, with options set through its saved data
+static Scenario variantOf(const std::string &slug, const std::string &variant, const std::string &data) {
+	Scenario scenario = scenarioOf(slug);
+	scenario.variant = variant;
+	scenario.data = data;
+	return scenario;
+}
+
+// History formats with the taps reading the history directly, so the time goes on reads rather than resampling:
+// HairPick's 64 taps, and PortlandWeather's 16 taps and their feedback.
+static const std::vector<Scenario> variants = {
+	variantOf("HairPick", "float", "{\"historyFormat\": 0, \"delayChangeMode\": 1}"),
+	variantOf("HairPick", "fixed16", "{\"historyFormat\": 1, \"delayChangeMode\": 1}"),
+	variantOf("PortlandWeather", "float", "{\"historyFormat\": 0, \"delayChangeMode\": 1}"),
+	variantOf("PortlandWeather", "fixed16", "{\"historyFormat\": 1, \"delayChangeMode\": 1}"),
+};
+
+// A single 10V impulse into the signal inputs, then silence, for what an instance costs while its filters ring down towards denormals
+// and then sit on silence. Run with and without fw-bench's --denormals to compare with the default floating point mode.
+static Scenario silentOf(const std::string &slug, const std::vector<int> &inputs) {
+	Scenario scenario = scenarioOf(slug);
+	scenario.variant = "silent";
+	scenario.patches.clear();
+	for (int input : inputs) {
+		scenario.patches.push_back({input, {Signal::IMPULSE, 1000.f, 10.f}});
+	}
+	return scenario;
+}
+
+static const std::vector<Scenario> silentVariants = {
+	silentOf("DamianLillard", {0}),				// SIGNAL_IN
+	silentOf("MrBlueSky", {16, 17}),			// IN_MOD, IN_CARR
+	silentOf("PhasedLockedLoop", {3}),			// SIGNAL_INPUT
+	silentOf("PortlandWeather", {150, 151}),	// IN_L_INPUT, IN_R_INPUT
+	silentOf("VoxInhumana", {0}),				// SIGNAL_IN
+};
+
+std::string Scenario::name() const {
+	return variant.empty() ? slug : slug + ":" + variant;
+}
+
+Scenario scenarioFor(const std::string &name) {
+	for (const std::vector<Scenario> *list : {&scenarios, &variants, &silentVariants}) {
+		for (const Scenario &scenario : *list) {
+			if (scenario.name() == name)
+				return scenario;
+		}
+	}
+	return {name, {}, {}, {}};
+}
+
+std::vector<std::string> variantNames() {
+	std::vector<std::string> names;
+	for (const std::vector<Scenario> *list : {&variants, &silentVariants}) {
+		for (const Scenario &scenario : *list) {
+			names.push_back(scenario.name());
+		}
+	}
+	return names;
+}
+
+} // namespace bench
+} // namespace FrozenWasteland
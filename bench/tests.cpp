@@ -0,0 +1,364 @@
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "rack.hpp"
+#include "filters/biquad.h"
+#include "filters/modulated_biquad.hpp"
+#include "dsp-noise/block_noise.hpp"
+#include "dsp-delay/frame.h"
+#include "dsp-delay/granular_delay.h"
+
+
+// Offline checks of the DSP building blocks against their references, run by `make test`.
+// Each check prints one line, and the run fails if any of them does.
+namespace {
+
+int failures = 0;
+
+void report(bool pass, const char *name, const char *format, ...) {
+	char detail[256];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(detail, sizeof(detail), format, args);
+	va_end(args);
+	std::printf("%s %s: %s\n", pass ? "PASS" : "FAIL", name, detail);
+	if (!pass)
+		failures++;
+}
+
+/** Deterministic white noise in -1..1, so every run filters the same signal. */
+struct TestNoise {
+	uint32_t state;
+
+	explicit TestNoise(uint32_t seed) : state(seed) {}
+
+	float next() {
+		state = state * 1664525u + 1013904223u;
+		return (int32_t) state / 2147483648.f;
+	}
+};
+
+float db(double ratio) {
+	return 20.f * (float) std::log10(std::max(ratio, 1e-12));
+}
+
+
+/** BiquadTanTable against std::tan, to the relative error its comment promises. */
+void tanTable() {
+	const float TOLERANCE = 2e-4f;
+	float worst = 0.f;
+	float worstFc = 0.f;
+	for (float Fc = 1e-4f; Fc <= FrozenWasteland::BiquadTanTable::MAX_FC; Fc += 1e-5f) {
+		double reference = std::tan(M_PI * Fc);
+		float error = (float) std::fabs(FrozenWasteland::BiquadTanTable::get().tan(Fc) / reference - 1.0);
+		if (error > worst) {
+			worst = error;
+			worstFc = Fc;
+		}
+	}
+	report(worst < TOLERANCE, "BiquadTanTable", "worst relative error %.2e at Fc %.4f, tolerance %.0e", worst, worstFc, TOLERANCE);
+}
+
+
+/** Filters white noise through a ModulatedBiquad and the double Biquad with the same settings, returns the difference relative to the reference's level. */
+float biquadError(int type, float Fc, float Q, float gain) {
+	Biquad reference(type, Fc, Q, gain);
+	FrozenWasteland::ModulatedBiquad filter(type, Fc, Q, gain);
+	TestNoise noise(1);
+	double errorEnergy = 0.0;
+	double referenceEnergy = 0.0;
+	for (int i = 0; i < 48000; i++) {
+		float in = noise.next();
+		double expected = reference.process(in);
+		double error = filter.process(in) - expected;
+		errorEnergy += error * error;
+		referenceEnergy += expected * expected;
+	}
+	return db(std::sqrt(errorEnergy / referenceEnergy));
+}
+
+const char *biquadTypeNames[] = {"lowpass", "highpass", "bandpass", "notch", "peak", "lowshelf", "highshelf"};
+
+/** ModulatedBiquad settled on fixed settings against the double Biquad, sample for sample.
+From 1 kHz up every type matches to -80 dB. Lower down, float coefficients move the poles of narrow filters a little (see modulatedBiquadPoles()),
+which shows up as a larger difference in the waveform, so Mr. Blue Sky's bands, down to 125 Hz with Q up to 15, are held to -40 dB.
+*/
+void modulatedBiquadMatchesDouble() {
+	const float TOLERANCE_DB = -80.f;
+	const float VOCODER_TOLERANCE_DB = -40.f;
+	const float sampleRate = 48000.f;
+
+	float worst = -200.f;
+	char worstCase[128] = "";
+	for (int type = bq_type_lowpass; type <= bq_type_highshelf; type++) {
+		for (float frequency : {1000.f, 2500.f, 5000.f, 10000.f, 15000.f}) {
+			for (float Q : {0.5f, 0.707f, 5.f, 20.f}) {
+				for (float gain : {-12.f, 6.f}) {
+					float error = biquadError(type, frequency / sampleRate, Q, gain);
+					if (error > worst) {
+						worst = error;
+						std::snprintf(worstCase, sizeof(worstCase), "%s %g Hz Q %g %g dB", biquadTypeNames[type], frequency, Q, gain);
+					}
+				}
+			}
+		}
+	}
+	report(worst < TOLERANCE_DB, "ModulatedBiquad vs Biquad from 1 kHz", "worst error %.1f dB (%s), tolerance %.0f dB", worst, worstCase, TOLERANCE_DB);
+
+	const float bands[] = {125,185,270,350,430,530,630,780,950,1150,1380,1680,2070,2780,3800,6400};
+	worst = -200.f;
+	for (float frequency : bands) {
+		for (float Q : {1.f, 5.f, 15.f}) {
+			float error = biquadError(bq_type_bandpass, frequency / sampleRate, Q, 0.f);
+			if (error > worst) {
+				worst = error;
+				std::snprintf(worstCase, sizeof(worstCase), "%g Hz Q %g", frequency, Q);
+			}
+		}
+	}
+	report(worst < VOCODER_TOLERANCE_DB, "ModulatedBiquad vs Biquad, Mr. Blue Sky's bands", "worst error %.1f dB (%s), tolerance %.0f dB",
+		worst, worstCase, VOCODER_TOLERANCE_DB);
+}
+
+
+/** Biquad with its coefficients readable. */
+struct OpenBiquad : Biquad {
+	OpenBiquad(int type, double Fc, double Q, double peakGainDB) : Biquad(type, Fc, Q, peakGainDB) {}
+	double getB1() const { return b1; }
+	double getB2() const { return b2; }
+};
+
+/** Angle of a pair of complex poles with denominator 1 + b1 z^-1 + b2 z^-2. */
+double poleAngle(double b1, double b2) {
+	return std::acos(rack::clamp(-b1 / (2.0 * std::sqrt(b2)), -1.0, 1.0));
+}
+
+/** Where the float coefficients put the poles of the resonant types, compared with the double Biquad, from 50 Hz up. */
+void modulatedBiquadPoles() {
+	const float TOLERANCE_CENTS = 10.f;
+	const float sampleRate = 48000.f;
+	float worst = 0.f;
+	char worstCase[128] = "";
+	for (int type = bq_type_lowpass; type <= bq_type_notch; type++) {
+		for (float frequency = 50.f; frequency < 20000.f; frequency *= std::pow(2.f, 1.f / 3.f)) {
+			for (float Q : {0.707f, 5.f, 20.f}) {
+				OpenBiquad reference(type, frequency / sampleRate, Q, 0.f);
+				FrozenWasteland::ModulatedBiquad filter(type, frequency / sampleRate, Q, 0.f);
+				float cents = (float) std::fabs(1200.0 * std::log2(poleAngle(filter.c[3], filter.c[4]) / poleAngle(reference.getB1(), reference.getB2())));
+				if (cents > worst) {
+					worst = cents;
+					std::snprintf(worstCase, sizeof(worstCase), "%s %.0f Hz Q %g", biquadTypeNames[type], frequency, Q);
+				}
+			}
+		}
+	}
+	report(worst < TOLERANCE_CENTS, "ModulatedBiquad poles from 50 Hz", "worst shift %.2f cents (%s), tolerance %.0f cents", worst, worstCase, TOLERANCE_CENTS);
+}
+
+
+/** A cutoff sweep through the coefficient ramps: the ramps must land exactly on the new settings' coefficients,
+and once a ramp is over the output must settle back onto the double Biquad that jumped straight there.
+*/
+void modulatedBiquadRamps() {
+	const float TOLERANCE_DB = -60.f;
+	const float sampleRate = 48000.f;
+	const int STEPS = 64;
+	const int SETTLE = 4800;
+
+	Biquad reference(bq_type_bandpass, 100.f / sampleRate, 5.f, 0.f);
+	FrozenWasteland::ModulatedBiquad filter(bq_type_bandpass, 100.f / sampleRate, 5.f, 0.f);
+	TestNoise noise(2);
+	bool landed = true;
+	bool finite = true;
+	// Sweep up by a fifth every ramp, changing Fc before the previous ramp has finished half the time
+	for (int step = 0; step < STEPS; step++) {
+		float Fc = 100.f * std::pow(1.5f, step % 12) / sampleRate;
+		reference.setFc(Fc);
+		filter.setFc(Fc);
+		int hold = step % 2 ? filter.rampSamples / 2 : filter.rampSamples;
+		for (int i = 0; i < hold; i++) {
+			float in = noise.next();
+			reference.process(in);
+			finite = finite && std::isfinite(filter.process(in));
+		}
+		if (hold == filter.rampSamples) {
+			FrozenWasteland::ModulatedBiquad settled(bq_type_bandpass, Fc, 5.f, 0.f);
+			landed = landed && !std::memcmp(filter.c, settled.c, sizeof(filter.c));
+		}
+	}
+
+	double errorEnergy = 0.0;
+	double referenceEnergy = 0.0;
+	for (int i = 0; i < SETTLE * 2; i++) {
+		float in = noise.next();
+		double expected = reference.process(in);
+		double error = filter.process(in) - expected;
+		if (i >= SETTLE) {
+			errorEnergy += error * error;
+			referenceEnergy += expected * expected;
+		}
+	}
+	float errorDb = db(std::sqrt(errorEnergy / referenceEnergy));
+	report(landed, "ModulatedBiquad ramps land", "coefficients %s the settled filter's after each full ramp", landed ? "match" : "differ from");
+	report(finite && errorDb < TOLERANCE_DB, "ModulatedBiquad ramps settle", "%s during the sweep, error %.1f dB %d samples after it, tolerance %.0f dB",
+		finite ? "finite" : "not finite", errorDb, SETTLE, TOLERANCE_DB);
+}
+
+
+/** The batch setQ() must give the same coefficients as setting each filter on its own. */
+void modulatedBiquadBatchQ() {
+	const int COUNT = 8;
+	FrozenWasteland::ModulatedBiquad batch[COUNT];
+	FrozenWasteland::ModulatedBiquad single[COUNT];
+	for (int i = 0; i < COUNT; i++) {
+		batch[i] = single[i] = FrozenWasteland::ModulatedBiquad(i % 7, 0.001f * (i + 1) * (i + 1), 1.f, 3.f);
+	}
+	FrozenWasteland::ModulatedBiquad::setQ(batch, COUNT, 7.5f);
+	bool same = true;
+	for (int i = 0; i < COUNT; i++) {
+		single[i].setQ(7.5f);
+		same = same && !std::memcmp(batch[i].target, single[i].target, sizeof(batch[i].target));
+	}
+	report(same, "ModulatedBiquad batch setQ", "targets %s per filter setQ()", same ? "match" : "differ from");
+}
+
+
+/** Pearson's chi-squared of counts against the expected counts. */
+double chiSquared(const std::vector<double> &counts, const std::vector<double> &expected) {
+	double chi2 = 0.0;
+	for (size_t b = 0; b < counts.size(); b++) {
+		chi2 += (counts[b] - expected[b]) * (counts[b] - expected[b]) / expected[b];
+	}
+	return chi2;
+}
+
+const int NOISE_SAMPLES = 1 << 22;
+const int NOISE_BLOCK = 61;// Odd, so blocks end partway through the generators' chunks and SIMD words
+
+/** WhiteNoise must be uniform in -1..1: its mean and variance, and 16 equal bins held to chi-squared's 0.1% point for 15 degrees of freedom. */
+void whiteNoiseStatistics() {
+	const double CHI2_LIMIT = 37.7;
+	const int BINS = 16;
+	frozenwasteland::dsp::WhiteNoise noise(1);
+	std::vector<double> counts(BINS, 0.0);
+	double sum = 0.0, sumSquares = 0.0;
+	bool inRange = true;
+	float block[NOISE_BLOCK];
+	double n = 0.0;
+	for (int done = 0; done < NOISE_SAMPLES; done += NOISE_BLOCK) {
+		noise.fill(block, NOISE_BLOCK);
+		for (float x : block) {
+			inRange = inRange && x >= -1.f && x < 1.f;
+			sum += x;
+			sumSquares += x * x;
+			counts[std::min((int) ((x + 1.f) * BINS / 2), BINS - 1)]++;
+			n++;
+		}
+	}
+	double mean = sum / n;
+	double variance = sumSquares / n - mean * mean;
+	double chi2 = chiSquared(counts, std::vector<double>(BINS, n / BINS));
+	bool pass = inRange && std::fabs(mean) < 2e-3 && std::fabs(variance - 1.0 / 3.0) < 2e-3 && chi2 < CHI2_LIMIT;
+	report(pass, "WhiteNoise statistics", "%s, mean %.1e, variance %.4f (1/3), chi-squared %.1f over %d bins, limit %.1f",
+		inRange ? "in -1..1" : "out of -1..1", mean, variance, chi2, BINS, CHI2_LIMIT);
+}
+
+/** GaussianNoise must be the standard normal: its moments, how often it passes 2 and 3, and a histogram of 0.5 wide bins from -4 to 4 plus the two tails,
+held to chi-squared's 0.1% point for 17 degrees of freedom. Picking the ziggurat layer from bits that also set the sample skews the histogram far past it.
+*/
+void gaussianNoiseStatistics() {
+	const double CHI2_LIMIT = 40.8;
+	const int BINS = 18;
+	frozenwasteland::dsp::GaussianNoise noise(1);
+	std::vector<double> counts(BINS, 0.0);
+	double sum = 0.0, sumSquares = 0.0, sumFourths = 0.0;
+	double beyond2 = 0.0, beyond3 = 0.0;
+	float block[NOISE_BLOCK];
+	double n = 0.0;
+	for (int done = 0; done < NOISE_SAMPLES; done += NOISE_BLOCK) {
+		noise.fill(block, NOISE_BLOCK);
+		for (float x : block) {
+			sum += x;
+			sumSquares += x * x;
+			sumFourths += (double) x * x * x * x;
+			beyond2 += std::fabs(x) > 2.f;
+			beyond3 += std::fabs(x) > 3.f;
+			counts[x < -4.f ? 0 : x >= 4.f ? BINS - 1 : 1 + (int) ((x + 4.f) * 2.f)]++;
+			n++;
+		}
+	}
+	std::vector<double> expected(BINS);
+	for (int b = 0; b < BINS; b++) {
+		double low = b == 0 ? -INFINITY : -4.0 + (b - 1) * 0.5;
+		double high = b == BINS - 1 ? INFINITY : -4.0 + b * 0.5;
+		expected[b] = n * 0.5 * (std::erfc(low / M_SQRT2) - std::erfc(high / M_SQRT2));
+	}
+	double mean = sum / n;
+	double variance = sumSquares / n - mean * mean;
+	double kurtosis = sumFourths / n / (variance * variance);
+	double chi2 = chiSquared(counts, expected);
+	bool pass = std::fabs(mean) < 3e-3 && std::fabs(variance - 1.0) < 5e-3 && std::fabs(kurtosis - 3.0) < 0.03
+		&& std::fabs(beyond2 / n - 0.0455) < 1e-3 && std::fabs(beyond3 / n - 0.0027) < 2e-4 && chi2 < CHI2_LIMIT;
+	report(pass, "GaussianNoise statistics", "mean %.1e, variance %.4f, kurtosis %.3f, P(|x|>2) %.4f (0.0455), P(|x|>3) %.5f (0.0027), "
+		"chi-squared %.1f over %d bins, limit %.1f", mean, variance, kurtosis, beyond2 / n, beyond3 / n, chi2, BINS, CHI2_LIMIT);
+}
+
+/** GranularDelayPitchShift's block path, FxEngine's Block context, against its per-sample path. Blocks of 1 to 64 frames, so some are split
+and some end partway through Interpolate's groups of 4, with the ratio, grain size and window changed between blocks: the two must agree to the bit.
+*/
+void granularBlocksMatchSamples() {
+	std::vector<float> blockMemory(8192), sampleMemory(8192);
+	GranularDelayPitchShift blocks, samples;
+	blocks.Init(blockMemory.data(), 0.25f);
+	samples.Init(sampleMemory.data(), 0.25f);
+	TestNoise signal(7);
+	TestNoise settings(11);
+	FloatFrame blockFrames[64], sampleFrames[64];
+	size_t differences = 0, frames = 0;
+	for (int round = 0; round < 4000; round++) {
+		float ratio = std::pow(2.f, settings.next());
+		float size = 0.5f + 0.5f * settings.next();
+		bool triangle = round % 3 != 0;
+		int n = 1 + (int) ((settings.next() + 1.f) * 32.f) % 64;
+		blocks.set_ratio(ratio);
+		samples.set_ratio(ratio);
+		blocks.set_size(size);
+		samples.set_size(size);
+		for (int i = 0; i < n; i++) {
+			blockFrames[i].l = sampleFrames[i].l = 5.f * signal.next();
+			blockFrames[i].r = sampleFrames[i].r = 5.f * signal.next();
+		}
+		blocks.Process(blockFrames, n, triangle);
+		for (int i = 0; i < n; i++) {
+			samples.Process(&sampleFrames[i], triangle);
+			differences += std::memcmp(&blockFrames[i], &sampleFrames[i], sizeof(FloatFrame)) != 0;
+			frames++;
+		}
+	}
+	report(differences == 0, "GranularDelayPitchShift blocks", "%zu of %zu frames differ from the per-sample path", differences, frames);
+}
+
+} // namespace
+
+
+int main(int argc, char **argv) {
+	tanTable();
+	modulatedBiquadMatchesDouble();
+	modulatedBiquadPoles();
+	modulatedBiquadRamps();
+	modulatedBiquadBatchQ();
+	whiteNoiseStatistics();
+	gaussianNoiseStatistics();
+	granularBlocksMatchSamples();
+
+	if (failures > 0) {
+		std::printf("%d checks failed\n", failures);
+		return 1;
+	}
+	std::printf("All checks passed\n");
+	return 0;
+}
@@ -2,9 +2,10 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-oscillator/phase_broadcast.hpp"
+#include "dsp-oscillator/morphing_lfo_table.hpp"
 
 
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
 
 struct BPMLFO : Module {
 	enum ParamIds {
@@ -85,14 +86,7 @@ struct BPMLFO : Module {
 				phase -= 1.0;
 		}
 		float sin() {
-			double phaseToUse = phase - 0.25; //Sin is out of ohase of other waveforms
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return 1.0 - cosf(2*M_PI * phaseToUse);
-			else
-				return sinf(2*M_PI * phaseToUse);
+			return FrozenWasteland::MorphingLfoTable::get().sine(phase, offset);
 		}
 		float tri(float x) {
 			return 4.0 * fabsf(x - roundf(x));
@@ -122,8 +116,8 @@ struct BPMLFO : Module {
 	};
 
 	// Expander
-	float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	float consumerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// this module must read from here
+	float producerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// mother will write into here
 
 
 	LowFrequencyOscillator oscillator;
@@ -242,7 +236,8 @@ struct BPMLFO : Module {
 			lights[HOLD_LIGHT].value = holding;
 		} 
 
-		if(!holding || (holding && params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue() == 0.0)) {
+		bool stepping = !holding || (holding && params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue() == 0.0);
+		if(stepping) {
 			oscillator.step(1.0 / args.sampleRate);
 		}
 
@@ -262,19 +257,9 @@ struct BPMLFO : Module {
 		bool rightExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
 		if(rightExpanderPresent) {
 			float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-			messageToSlave[0] = inputs[CLOCK_INPUT].isConnected(); 	
-			messageToSlave[1] = inputs[CLOCK_INPUT].getVoltage();
-			messageToSlave[2] = inputs[RESET_INPUT].getVoltage();
-			messageToSlave[3] = inputs[HOLD_INPUT].getVoltage();
-			messageToSlave[4] = multiplier;
-			messageToSlave[5] = division;
-			messageToSlave[6] = initialPhase;
-			messageToSlave[7] = params[OFFSET_PARAM].getValue();
-			messageToSlave[8] = params[HOLD_MODE_PARAM].getValue();
-			messageToSlave[9] = params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue();
-			messageToSlave[10] = 0.0f	;
-			messageToSlave[11] = 1.0f;
-			messageToSlave[12] = 0.5f;
+			//Expanders follow the phase rather than the clock, so they never drift from this module
+			double deltaPhase = stepping ? fmin(oscillator.freq / args.sampleRate, 0.5) : 0.0;
+			FrozenWasteland::PhaseBroadcast::write(messageToSlave, oscillator.phase, deltaPhase, holding, params[OFFSET_PARAM].getValue() > 0.0, 0.0f, 1.0f, 0.5f);
 		}
 			
 	}
@@ -4,9 +4,10 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-oscillator/phase_broadcast.hpp"
+#include "dsp-oscillator/morphing_lfo_table.hpp"
 
 #define DISPLAY_SIZE 50
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
 
 struct BPMLFO2 : Module {
 	enum ParamIds {
@@ -66,10 +67,6 @@ struct BPMLFO2 : Module {
 		float waveSlope = 0.0; //Original (1 is sin)
 		bool offset = false;
 
-		float lerp(float v0, float v1, float t) {
-			return (1 - t) * v0 + t * v1;
-		}
-
 		void setPitch(float pitch) {
 			pitch = fminf(pitch, 8.0);
 			freq = powf(2.0, pitch);
@@ -106,54 +103,19 @@ struct BPMLFO2 : Module {
 				phase -= 1.0;
 		}
 
-		float skewsawInternal(float x) {
-			//x = dsp::eucmod(x,1.0);
-			x = std::fabs(std::fmod(x ,1.0f));
-
-			float inverseSkew = 1 - skew;
-			float originalWave;
-			if (skew == 0 && x == 0) //Avoid /0 error
-				originalWave = 2;
-			if (x <= skew)
-				originalWave = 2.0 * (1- (-1 / skew * x + 1));
-			else
-				originalWave = 2.0 * (1-(1 / inverseSkew * (x - skew)));
-			return originalWave;
-		}
-		
-		float skewsaw(double phaseOffset) {
+		double phaseAt(double phaseOffset) {
 			double phaseToUse = phase + phaseOffset;
 			if (phaseToUse >= 1.0)
 				phaseToUse -= 1.0;
-
-			if (offset)
-				return lerp(skewsawInternal(phaseToUse),sin(phaseOffset),waveSlope);
-			
-			return lerp(skewsawInternal(phaseToUse) - 1 ,sin(phaseOffset),waveSlope); //Going to keep same phase for now				
+			return phaseToUse;
 		}
 
-
-		float sin(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset - 0.25; //Sin is out of ohase of other waveforms
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return 1.0 - cosf(2*M_PI * (phaseToUse-skew*0));
-			
-			return sinf(2*M_PI * (phaseToUse-skew*0));
+		float skewsaw(double phaseOffset) {
+			return FrozenWasteland::MorphingLfoTable::get().skewsaw(skew, waveSlope, offset, phaseAt(phaseOffset));
 		}
 
 		float sqr(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset;
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			float sqr = (phaseToUse < pw) ? 1.0 : -1.0;
-			sqr = offset ? sqr + 1.0 : sqr;
-
-			float result = lerp(sqr,sin(phaseOffset),waveSlope);
-			return result;
+			return FrozenWasteland::MorphingLfoTable::get().pulse(pw, waveSlope, offset, phaseAt(phaseOffset));
 		}
 		
 		float progress() {
@@ -162,12 +124,12 @@ struct BPMLFO2 : Module {
 	};
 
 	// Expander
-	float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	float consumerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// this module must read from here
+	float producerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// mother will write into here
 
 
 
-	LowFrequencyOscillator oscillator,displayOscillator;
+	LowFrequencyOscillator oscillator;
 	dsp::SchmittTrigger clockTrigger,resetTrigger,holdTrigger;
 	float multiplier = 1;
 	float division = 1;
@@ -302,14 +264,11 @@ void BPMLFO2::process(const ProcessArgs &args) {
 
 	//Recalcluate display waveform if something changed
 	if(lastWaveShape != waveshape || lastWaveSlope != waveSlope || lastSkew != skew) {
-		displayOscillator.waveSlope = waveSlope;
-		displayOscillator.skew = skew;
-		displayOscillator.setPulseWidth(skew);
-		displayOscillator.setFrequency(1.0);
-		displayOscillator.phase = 0;
+		const FrozenWasteland::MorphingLfoTable &table = FrozenWasteland::MorphingLfoTable::get();
+		float pw = clamp(skew, 0.01f, 0.99f);
 		for(int i=0;i<DISPLAY_SIZE;i++) {
-			waveValues[i] = (waveshape == SKEWSAW_WAV ? displayOscillator.skewsaw(0.0) : displayOscillator.sqr(0.0)) * DISPLAY_SIZE / 2;
-			displayOscillator.step(1.0 / DISPLAY_SIZE);			
+			float x = (float)i / DISPLAY_SIZE;
+			waveValues[i] = (waveshape == SKEWSAW_WAV ? table.skewsaw(skew, waveSlope, false, x) : table.pulse(pw, waveSlope, false, x)) * DISPLAY_SIZE / 2;
 		}
 		lastWaveShape = waveshape;
 		lastWaveSlope = waveSlope;
@@ -340,7 +299,8 @@ void BPMLFO2::process(const ProcessArgs &args) {
 		lights[HOLD_LIGHT].value = holding;
 	} 
 
-    if(!holding || (holding && params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue() == 0.0)) {
+    bool stepping = !holding || (holding && params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue() == 0.0);
+    if(stepping) {
     	oscillator.step(1.0 / args.sampleRate);
     }
 
@@ -368,19 +328,9 @@ void BPMLFO2::process(const ProcessArgs &args) {
 	bool rightExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
 	if(rightExpanderPresent) {
 		float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-		messageToSlave[0] = inputs[CLOCK_INPUT].isConnected(); 	
-		messageToSlave[1] = inputs[CLOCK_INPUT].getVoltage();
-		messageToSlave[2] = inputs[RESET_INPUT].getVoltage();
-		messageToSlave[3] = inputs[HOLD_INPUT].getVoltage();
-		messageToSlave[4] = multiplier;
-		messageToSlave[5] = division;
-		messageToSlave[6] = initialPhase;
-		messageToSlave[7] = params[OFFSET_PARAM].getValue();
-		messageToSlave[8] = params[HOLD_MODE_PARAM].getValue();
-		messageToSlave[9] = params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue();
-		messageToSlave[10] = waveshape;
-		messageToSlave[11] = waveSlope;
-		messageToSlave[12] = skew;
+		//Expanders follow the phase rather than the clock, so they never drift from this module
+		double deltaPhase = stepping ? fmin(oscillator.freq / args.sampleRate, 0.5) : 0.0;
+		FrozenWasteland::PhaseBroadcast::write(messageToSlave, oscillator.phase, deltaPhase, holding, params[OFFSET_PARAM].getValue() > 0.0, waveshape, waveSlope, skew);
 	}
 
 }
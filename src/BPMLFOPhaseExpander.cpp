@@ -4,10 +4,11 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-oscillator/phase_broadcast.hpp"
+#include "dsp-oscillator/morphing_lfo_table.hpp"
 
 #define MAX_OUTPUTS 12
 
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
 
 
 struct BPMLFOPhaseExpander : Module {
@@ -37,137 +38,21 @@ struct BPMLFOPhaseExpander : Module {
 
 	
 
-	struct LowFrequencyOscillator {
-		float basePhase = 0.0;
-		double phase = 0.0;
-		double freq = 1.0;
-		float pw = 0.5;
-		float skew = 0.5; // Triangle
-		float waveSlope = 0.0; //Original (1 is sin)
-		bool offset = false;
-
-		float lerp(float v0, float v1, float t) {
-			return (1 - t) * v0 + t * v1;
-		}
-
-		void setPitch(float pitch) {
-			pitch = fminf(pitch, 8.0);
-			freq = powf(2.0, pitch);
-		}
-		void setFrequency(double frequency) {
-			freq = frequency;
-		}
-		void setPulseWidth(float pw_) {
-			const float pwMin = 0.01;
-			pw = clamp(pw_, pwMin, 1.0f - pwMin);
-		}
-		
-		void setBasePhase(float initialPhase) {
-			//Apply change, then remember
-			phase += initialPhase - basePhase;
-
-			//Regular Bounds Checking
-			if (phase >= 1.0)
-				phase -= 1.0;
-			else if (phase < 0)
-				phase += 1.0;	
-			basePhase = initialPhase;
-		}
-
-		void hardReset()
-		{
-			phase = basePhase;
-		}
-
-		void step(double dt) {
-			double deltaPhase = fmin(freq * dt, 0.5);
-			phase += deltaPhase;
-			if (phase >= 1.0)
-				phase -= 1.0;
-		}
-
-		float skewsawInternal(float x) {
-			//x = dsp::eucmod(x,1.0);
-			x = std::fabs(std::fmod(x ,1.0f));
-
-			float inverseSkew = 1 - skew;
-			float originalWave;
-			if (skew == 0 && x == 0) //Avoid /0 error
-				originalWave = 2;
-			if (x <= skew)
-				originalWave = 2.0 * (1- (-1 / skew * x + 1));
-			else
-				originalWave = 2.0 * (1-(1 / inverseSkew * (x - skew)));
-			return originalWave;
-		}
-		
-		float skewsaw(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset;
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return lerp(skewsawInternal(phaseToUse),sin(phaseOffset),waveSlope);
-			
-			return lerp(skewsawInternal(phaseToUse) - 1 ,sin(phaseOffset),waveSlope); //Going to keep same phase for now				
-		}
-
-
-		float sin(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset - 0.25; //Sin is out of ohase of other waveforms
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return 1.0 - cosf(2*M_PI * (phaseToUse-skew*0));
-			
-			return sinf(2*M_PI * (phaseToUse-skew*0));
-		}
-
-		float sqr(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset;
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			float sqr = (phaseToUse < pw) ? 1.0 : -1.0;
-			sqr = offset ? sqr + 1.0 : sqr;
-
-			float result = lerp(sqr,sin(phaseOffset),waveSlope);
-			return result;
-		}
-		
-		float progress() {
-			return phase;
-		}
-	};
-
 	// Expander
-	float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	float consumerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// this module must read from here
+	float producerMessage[FrozenWasteland::PhaseBroadcast::NUM_FIELDS] = {};// mother will write into here
 
 
-	LowFrequencyOscillator oscillator;
-	dsp::SchmittTrigger clockTrigger,resetTrigger,holdTrigger,forceIntegerTrigger;
-	float multiplier = 1;
-	float division = 1;
+	dsp::SchmittTrigger forceIntegerTrigger;
 	float phaseDivision = 3;
 	bool forceInteger = true;
-	double timeElapsed = 0.0;
-	double duration = 0;
 	float waveshape = 0;
 	float waveSlope = 0.0;
 	float skew = 0.5;
-	float initialPhase = 0.0;
+	bool offset = false;
 	bool holding = false;
-	bool firstClockReceived = false;
-	bool secondClockReceived = false;
-	bool phase_quantized = false;
 
 	float lfoOutputValue[MAX_OUTPUTS] = {0.0};
-
-	float lastWaveShape = -1;
-	float lastWaveSlope = -1;
-	float lastSkew = -1;
 	
 
 	BPMLFOPhaseExpander() {
@@ -203,21 +88,13 @@ void BPMLFOPhaseExpander::process(const ProcessArgs &args) {
 											
 	// From Mother	
 	float *messagesFromMother = (float*)leftExpander.consumerMessage;
-	float clockConnected = messagesFromMother[0];
-	float clockInput = messagesFromMother[1];
-	float resetInput = messagesFromMother[2];
-	float holdInput = messagesFromMother[3];
-	multiplier = messagesFromMother[4];
-	division = messagesFromMother[5];
-	initialPhase = messagesFromMother[6];
-	float offset = messagesFromMother[7];
-	float holdMode = messagesFromMother[8];
-	float holdClockMode = messagesFromMother[9];
-	waveshape = messagesFromMother[10];
-	waveSlope = messagesFromMother[11];
-	skew = messagesFromMother[12]; 
-
-	
+	holding = messagesFromMother[FrozenWasteland::PhaseBroadcast::HOLDING] > 0.0;
+	waveshape = messagesFromMother[FrozenWasteland::PhaseBroadcast::WAVESHAPE];
+	offset = messagesFromMother[FrozenWasteland::PhaseBroadcast::OFFSET] > 0.0;
+	waveSlope = messagesFromMother[FrozenWasteland::PhaseBroadcast::WAVE_SLOPE];
+	skew = messagesFromMother[FrozenWasteland::PhaseBroadcast::SKEW];
+	//The message is HOPS samples old by now, so look that far ahead
+	float phase = FrozenWasteland::PhaseBroadcast::currentPhase(messagesFromMother);
 
 	//If another expander is present, pass values on to it
 	bool anotherExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
@@ -225,33 +102,15 @@ void BPMLFOPhaseExpander::process(const ProcessArgs &args) {
 	{					
 		//QAR Pass through right
 		float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-		for(int i = 0; i < PASSTHROUGH_RIGHT_VARIABLE_COUNT;i++) {
+		for(int i = 0; i < FrozenWasteland::PhaseBroadcast::NUM_FIELDS;i++) {
 			messageToSlave[i] = messagesFromMother[i];
 		}	
+		messageToSlave[FrozenWasteland::PhaseBroadcast::HOPS] += 1.f;
 	}
 	
 	leftExpander.messageFlipRequested = true;
 
 	
-
-    timeElapsed += 1.0 / args.sampleRate;
-	if(clockConnected) {
-		if(clockTrigger.process(clockInput)) {
-			if(firstClockReceived) {
-				duration = timeElapsed;
-				secondClockReceived = true;
-			}
-			timeElapsed = 0;
-			firstClockReceived = true;			
-		} else if(secondClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-			duration = timeElapsed;				
-		}	
-	} else {
-		duration = 0.0f;
-		firstClockReceived = false;
-		secondClockReceived = false;
-	}
-	
 	if (forceIntegerTrigger.process(params[FORCE_INTEGER_PARAM].getValue())) {
 		forceInteger = !forceInteger;
 	}
@@ -262,53 +121,18 @@ void BPMLFOPhaseExpander::process(const ProcessArgs &args) {
 		phaseDivision = std::floor(phaseDivision);
 	}
 	phaseDivision = clamp(phaseDivision,3.0,12.0f);	
-	
-	oscillator.offset = (offset > 0.0);
-	oscillator.setBasePhase(initialPhase);
-	oscillator.waveSlope = waveSlope;
-	oscillator.skew = skew;
-	oscillator.setPulseWidth(skew);
-
-	//Recalcluate display waveform if something changed
-	if(lastWaveShape != waveshape || lastWaveSlope != waveSlope || lastSkew != skew) {
-		lastWaveShape = waveshape;
-		lastWaveSlope = waveSlope;
-		lastSkew = skew;
-	}
-
-	if(duration != 0) {
-		oscillator.setFrequency(1.0 / (duration / multiplier * division));
-	}
-	else {
-		oscillator.setFrequency(0);
-	}
-
-	if(resetTrigger.process(resetInput)) {
-		oscillator.hardReset();
-	}		
-
-	if(holdMode == 1.0) { //Latched is default		
-		if(holdTrigger.process(holdInput)) {
-			holding = !holding;
-		}		
-	} else {
-		holding = holdInput >= 1; 			
-	}
-		
-
-    if(!holding || (holding && holdClockMode == 0.0)) {
-    	oscillator.step(1.0 / args.sampleRate);
-    }
 
 	if(!holding) {
-		for(int i = 0; i<phaseDivision; i++) {
-			float phase = (float)i/phaseDivision;
-			if(waveshape == SKEWSAW_WAV) {
-				lfoOutputValue[i] = 5.0 * oscillator.skewsaw(phase);
+		const FrozenWasteland::MorphingLfoTable &table = FrozenWasteland::MorphingLfoTable::get();
+		float pw = clamp(skew, 0.01f, 0.99f);
+		float phaseStep = 1.0 / phaseDivision;
+		for(int i = 0; i < phaseDivision; i += 4) {
+			simd::float_4 x = phase + simd::float_4(i, i + 1, i + 2, i + 3) * phaseStep;
+			x -= simd::floor(x);
+			simd::float_4 value = 5.f * (waveshape == SKEWSAW_WAV ? table.skewsaw(skew, waveSlope, offset, x) : table.pulse(pw, waveSlope, offset, x));
+			for(int j = 0; j < 4 && i + j < phaseDivision; j++) {
+				lfoOutputValue[i + j] = value[j];
 			}
-			else {
-				lfoOutputValue[i] = 5.0 * oscillator.sqr(phase);
-			}		
 		}
 	}
 	
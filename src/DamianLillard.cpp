@@ -1,6 +1,9 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/silence_status.hpp"
 #include "StateVariableFilter.h"
+#include "silence_tracker.hpp"
+#include "denormal.hpp"
 
 using namespace std;
 
@@ -49,12 +52,17 @@ struct DamianLillard : Module {
 
     StateVariableFilterState<T> filterStates[numFilters];
     StateVariableFilterParams<T> filterParams[numFilters];
+	FrozenWasteland::SilenceTracker silence;
+	FrozenWasteland::DenormalStats denormals{"DamianLillard"};
 
 
 	int bandOffset = 0;
 
 	DamianLillard() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		for (int i = 0; i < numFilters; ++i) {
+			denormals.add("filter " + std::to_string(i + 1));
+		}
 
 		configParam(FREQ_1_CUTOFF_PARAM, 0, 1.0, .25,"Cutoff Frequency 1","Hz",560,15);
 		configParam(FREQ_2_CUTOFF_PARAM, 0, 1.0, .5,"Cutoff Frequency 2","Hz",560,15);
@@ -108,6 +116,19 @@ void DamianLillard::process(const ProcessArgs &args) {
 		}
 	}
 
+	//Returns can carry tails of their own, so they keep the module awake too
+	float inputPeak = FrozenWasteland::SilenceTracker::peak(inputs[SIGNAL_IN]);
+	for(int i=0; i<BANDS; i++) {
+		inputPeak = std::max(inputPeak, FrozenWasteland::SilenceTracker::peak(inputs[BAND_1_RETURN_INPUT+i]));
+	}
+	if(silence.idle(inputPeak)) {
+		for(int i=0; i<BANDS; i++) {
+			outputs[BAND_1_OUTPUT+i].setVoltage(0.0f);
+		}
+		outputs[MIX_OUTPUT].setVoltage(0.0f);
+		return;
+	}
+
 	output[0] = StateVariableFilter<T>::run(signalIn, filterStates[0], filterParams[0]) * 5;
 	output[1] = StateVariableFilter<T>::run(StateVariableFilter<T>::run(signalIn, filterStates[1], filterParams[1]), filterStates[2], filterParams[2]) * 5;
 	output[2] = StateVariableFilter<T>::run(StateVariableFilter<T>::run(signalIn, filterStates[3], filterParams[3]), filterStates[4], filterParams[4]) * 5;
@@ -124,7 +145,23 @@ void DamianLillard::process(const ProcessArgs &args) {
 	}
 
 	outputs[MIX_OUTPUT].setVoltage(out / 2.0); 
-	
+
+	for(int i=0; i<numFilters; i++) {
+		denormals.check(i, filterStates[i].z1);
+		denormals.check(i, filterStates[i].z2);
+	}
+	denormals.tick(args.sampleRate);
+
+	float level = inputPeak;
+	for(int i=0; i<BANDS; i++) {
+		level = std::max(level, std::fabs(output[i]));
+	}
+	silence.setHold(0.5f, args.sampleRate);
+	if(silence.update(level)) {
+		for(int i=0; i<numFilters; i++) {
+			filterStates[i] = StateVariableFilterState<T>();
+		}
+	}
 }
 
 
@@ -159,6 +196,18 @@ struct DamianLillardBandDisplay : TransparentWidget {
 };
 
 struct DamianLillardWidget : ModuleWidget {
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		DamianLillard *module = dynamic_cast<DamianLillard*>(this->module);
+		assert(module);
+
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+	}
+
 	DamianLillardWidget(DamianLillard *module) {
 
 		setModule(module);
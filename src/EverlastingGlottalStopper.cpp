@@ -1,9 +1,12 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "dsp-noise/noise.hpp"
-#include "filters/biquad.h"
+#include "dsp-oscillator/glottal.hpp"
 
 using namespace frozenwasteland::dsp;
+using simd::float_4;
+
+#define MAX_VOICES 16
 
 struct EverlastingGlottalStopper : Module {
 	enum ParamIds {
@@ -35,9 +38,32 @@ struct EverlastingGlottalStopper : Module {
 		NUM_LIGHTS
 	};
 
-	Biquad* deemphasisFilter;
-	GaussianNoiseGenerator _gauss;
-	float phase = 0.0;
+	// 2 pole lowpass at 2 kHz, Q 1, same design as the old double precision Biquad
+	struct DeemphasisFilter {
+		float a0 = 1.f, a1 = 0.f, a2 = 0.f, b1 = 0.f, b2 = 0.f;
+		float_4 z1 = 0.f, z2 = 0.f;
+
+		void setFc(float Fc) {
+			float K = std::tan(M_PI * Fc);
+			float norm = 1.f / (1.f + K + K * K);
+			a0 = K * K * norm;
+			a1 = 2.f * a0;
+			a2 = a0;
+			b1 = 2.f * (K * K - 1.f) * norm;
+			b2 = (1.f - K + K * K) * norm;
+		}
+
+		float_4 process(float_4 in) {
+			float_4 out = in * a0 + z1;
+			z1 = in * a1 + z2 - b1 * out;
+			z2 = in * a2 - b2 * out;
+			return out;
+		}
+	};
+
+	GlottalOscillator oscillators[MAX_VOICES / 4];
+	DeemphasisFilter deemphasisFilter[MAX_VOICES / 4];
+	GaussianNoise _gauss;
 
 	EverlastingGlottalStopper() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -51,78 +77,62 @@ struct EverlastingGlottalStopper : Module {
 		configParam(BREATHINESS_CV_ATTENUVERTER_PARAM, -1.0, 1.0, 0, "Breathiness CV Attenuation","%",0,100);
 		//addParam(createParam<CKSS>(Vec(123, 300), module, EverlastingGlottalStopper::DEEMPHASIS_FILTER_PARAM, 0.0, 1.0, 0));
 
-		float sampleRate = APP->engine->getSampleRate();
-		deemphasisFilter = new Biquad(bq_type_lowpass, 2000 / sampleRate, 1, 0);
+		// Builds the shared tables on first use
+		GlottalWavetable::getInstance();
+		onSampleRateChange();
 	}
 
+	void onSampleRateChange() override {
+		float sampleRate = APP->engine->getSampleRate();
+		for (int c = 0; c < MAX_VOICES / 4; c++) {
+			deemphasisFilter[c].setFc(2000 / sampleRate);
+		}
+	}
 
 	void process(const ProcessArgs &args) override;
 };
 
 
 
-float Rosenburg(float timeOpening, float timeOpen, float phase) {
-	float out;
-	if(phase < timeOpening) {
-		out = 0.5f * (1.0f - cosf(M_PI * phase / timeOpening));
-	} else if (phase < timeOpen) {	
-		out = cosf(M_PI * (phase - timeOpening) / (timeOpen - timeOpening) / 2);
-	} else {
-		out = 0.0f;
-	}
-
-	return out;
-}
-
-float HanningWindow(float phase) {
-	return 0.5f * (1 - cosf(2 * M_PI * phase));
-}
-
-inline float quadraticBipolarEG(float x) {
-	float x2 = x*x;
-	return (x >= 0.f) ? x2 : -x2;
-}
-
 void EverlastingGlottalStopper::process(const ProcessArgs &args) {
 	
+	int channels = std::max(inputs[PITCH_INPUT].getChannels(), 1);
+	float noiseLevelParam = params[BREATHINESS_PARAM].getValue();
+	bool deemphasis = params[DEEMPHASIS_FILTER_PARAM].getValue();
 
-	float pitch = params[FREQUENCY_PARAM].getValue();	
-	float pitchCv = 12.0f * inputs[PITCH_INPUT].getVoltage();
-	if (inputs[FM_INPUT].isConnected()) {
-		pitchCv += dsp::quadraticBipolar(params[FM_CV_ATTENUVERTER_PARAM].getValue()) * 12.0f * inputs[FM_INPUT].getVoltage();
-	}
+	float noiseBlock[MAX_VOICES];
+	_gauss.fill(noiseBlock, (channels + 3) / 4 * 4);
 
-	pitch += pitchCv;
-		// Note C4
-	float freq = 261.626f * powf(2.0f, pitch / 12.0f);
+	for (int c = 0; c < channels; c += 4) {
+		float_4 pitch = params[FREQUENCY_PARAM].getValue();	
+		float_4 pitchCv = 12.0f * inputs[PITCH_INPUT].getPolyVoltageSimd<float_4>(c);
+		if (inputs[FM_INPUT].isConnected()) {
+			pitchCv += dsp::quadraticBipolar(params[FM_CV_ATTENUVERTER_PARAM].getValue()) * 12.0f * inputs[FM_INPUT].getPolyVoltageSimd<float_4>(c);
+		}
 
-	//float pitch = params[FREQUENCY_PARAM].getValue() + inputs[FM_INPUT].getVoltage() * params[FM_CV_ATTENUVERTER_PARAM].getValue();	
-	//float freq = powf(2.0, pitch);
+		pitch += pitchCv;
+		// Note C4, offset keeps the approximation in its positive range
+		float_4 freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch / 12.0f + 30.0f) / 1073741824;
 
-	float timeOpening = clamp(params[TIME_OPEN_PARAM].getValue() + inputs[TIME_OPEN_INPUT].getVoltage() * params[TIME_OPEN_CV_ATTENUVERTER_PARAM].getValue(),0.01f,1.0f);
-	float timeClosed = clamp(params[TIME_CLOSED_PARAM].getValue() + inputs[TIME_CLOSED_INPUT].getVoltage() * params[TIME_CLOSED_CV_ATTENUVERTER_PARAM].getValue(),0.0f,1.0f);
-	float timeOpen = clamp(1.0-timeClosed,timeOpening,1.0);
+		float_4 timeOpening = simd::clamp(params[TIME_OPEN_PARAM].getValue() + inputs[TIME_OPEN_INPUT].getPolyVoltageSimd<float_4>(c) * params[TIME_OPEN_CV_ATTENUVERTER_PARAM].getValue(),0.01f,1.0f);
+		float_4 timeClosed = simd::clamp(params[TIME_CLOSED_PARAM].getValue() + inputs[TIME_CLOSED_INPUT].getPolyVoltageSimd<float_4>(c) * params[TIME_CLOSED_CV_ATTENUVERTER_PARAM].getValue(),0.0f,1.0f);
 
-	float dt = 1.0 / args.sampleRate;
-	float deltaPhase = fminf(freq * dt, 0.5);
-	phase += deltaPhase;
-	if (phase >= 1.0) {
-		phase -= 1.0;
-	}
+		GlottalOscillator &oscillator = oscillators[c / 4];
+		float_4 out = oscillator.process(freq * args.sampleTime, timeOpening, timeClosed);
 
-	float out = Rosenburg(timeOpening,timeOpen,phase);
-	float noiseLevel = clamp(params[BREATHINESS_PARAM].getValue() + inputs[BREATHINESS_INPUT].getVoltage() * params[BREATHINESS_CV_ATTENUVERTER_PARAM].getValue(),0.0f,1.0f);
- 	//Noise level follows glottal wave
-	// noise = _gauss.next() * out * noiseLevel;
-	float noise = _gauss.next() / 5.0 * noiseLevel * HanningWindow(phase);
+		float_4 noiseLevel = simd::clamp(noiseLevelParam + inputs[BREATHINESS_INPUT].getPolyVoltageSimd<float_4>(c) * params[BREATHINESS_CV_ATTENUVERTER_PARAM].getValue(),0.0f,1.0f);
+		//Noise level follows glottal wave, one shared generator for all voices
+		float_4 noise = float_4::load(&noiseBlock[c]);
+		float_4 hanningWindow = 0.5f * (1.f - simd::cos(2.f * float(M_PI) * oscillator.phase));
+		out += noise / 5.0f * noiseLevel * hanningWindow;
 
-	out = out + noise;
-	if(params[DEEMPHASIS_FILTER_PARAM].getValue()) {
-		out = deemphasisFilter->process(out);
-	}
+		if(deemphasis) {
+			out = deemphasisFilter[c / 4].process(out);
+		}
 
-	outputs[VOICE_OUTPUT].setVoltage(out * 10.0f  - 5.0f);
-	
+		outputs[VOICE_OUTPUT].setVoltageSimd(out * 10.0f  - 5.0f, c);
+	}
+	outputs[VOICE_OUTPUT].setChannels(channels);
 }
 
 
@@ -2,9 +2,16 @@
 #include <time.h>
 #include "frame.h"
 #include "ringbuffer.hpp"
+#include "hand_over.hpp"
+#include "partitioned_convolver.hpp"
+#include "history_reader.hpp"
+#include "silence_tracker.hpp"
 #include "samplerate.h"
 #include <iostream>
 #include "ui/knobs.hpp"
+#include "ui/history_menu.hpp"
+#include "ui/silence_status.hpp"
+#include "ui/snapshot.hpp"
 
 #define HISTORY_SIZE (1<<22)
 #define NUM_TAPS 64
@@ -12,6 +19,13 @@
 #define DIVISIONS 21
 #define NUM_PATTERNS 16
 #define NUM_FEEDBACK_TYPES 4
+#define NUM_DENSITIES 6
+#define CONVOLUTION_BLOCK_SIZE 256
+#define CONVOLUTION_FADE_BLOCKS 4
+#define CONVOLUTION_LATENCY_BLOCKS 8
+#define MAX_CONVOLUTION_LENGTH 2.0f
+#define COMB_REQUEST_DIVISION 32
+#define HISTORY_RANGE 20
 
 
 struct HairPick : Module {
@@ -60,6 +74,10 @@ struct HairPick : Module {
 		FEEDBACK_CLARINET,
 		FEEDBACK_RAW,
 	};
+	enum DelayChangeModes {
+		DELAY_CHANGE_GLIDE,
+		DELAY_CHANGE_JUMP
+	};
 
 	const char* combPatternNames[NUM_PATTERNS] = {"Uniform","Flat Middle","Early Comb","Fibonacci","Flat Comb","Late Comb","Rev. Fibonacci","Ess Comb","Rand Uniform","Rand Middle","Rand Early","Rand Fibonacci","Rand Flat","Rand Late","Rand Rev Fib","Rand Ess"};
 	const float combPatterns[NUM_PATTERNS][NUM_TAPS] = {
@@ -83,9 +101,33 @@ struct HairPick : Module {
 
 	const char* feedbackTypeNames[NUM_FEEDBACK_TYPES] = {"Guitar","Sitar","Clarinet","Raw"};
 
+	// High density combs interpolate the patterns up to this many taps and run them through the convolver
+	const int densities[NUM_DENSITIES] = {NUM_TAPS,256,512,1024,2048,4096};
+	const char* densityNames[NUM_DENSITIES] = {"64 (Classic)","256","512","1024","2048","4096"};
+
+	struct CombRequest {
+		int pattern = 0;
+		int density = 0;
+		int activeTaps = 0;
+		float edgeLevel = 0.0f;
+		float tentLevel = 0.0f;
+		int tentTap = 0;
+		float delaySamples = 0.0f;
+		int maxLength = 0;
+
+		bool differs(const CombRequest &other) const {
+			return pattern != other.pattern || density != other.density || activeTaps != other.activeTaps || tentTap != other.tentTap || maxLength != other.maxLength ||
+				std::fabs(edgeLevel - other.edgeLevel) > 1e-3f || std::fabs(tentLevel - other.tentLevel) > 1e-3f || std::fabs(delaySamples - other.delaySamples) > 0.25f;
+		}
+	};
+
 
 	int combPattern = 0;
 	int feedbackType = 0;	
+	int density = NUM_TAPS;
+	int lastDensity = NUM_TAPS;
+	int delayChangeMode = DELAY_CHANGE_GLIDE;
+	float crossfadeTime = 0.025f;
 	float edgeLevel = 0.0f;
 	float tentLevel = 1.0f;
 	int tentTap = 32;
@@ -104,41 +146,139 @@ struct HairPick : Module {
 	bool combActive[NUM_TAPS];
 	float combLevel[NUM_TAPS];
 
+	//What the status display draws, copied out at the end of a sample when it asks for a frame
+	struct DisplayFrame {
+		int division;
+		float baseDelay;
+		int combPattern;
+		float edgeLevel;
+		float tentLevel;
+		int tentTap;
+		int feedbackType;
+	};
+	FrozenWasteland::SnapshotBuffer<DisplayFrame> display;
+
+
+	typedef FrozenWasteland::SwitchableMultiTapRingBuffer<FloatFrame, HISTORY_SIZE, NUM_TAPS+1, HISTORY_RANGE> HistoryBuffer;
 
-	FrozenWasteland::MultiTapDoubleRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+1> historyBuffer;
+	// Replaced from the UI thread when the format changes, so the audio thread never allocates one
+	FrozenWasteland::HandOver<HistoryBuffer> historyBuffer{new HistoryBuffer()};
+	int historyFormat = FrozenWasteland::STORAGE_FLOAT;
 	FrozenWasteland::DoubleRingBuffer<FloatFrame, 16> outBuffer[NUM_TAPS+1]; 
 	
 	SRC_STATE *src[NUM_TAPS + 1];
 	FloatFrame lastFeedback = {0.0f,0.0f};
+	FrozenWasteland::SilenceTracker silence;
+
+	FrozenWasteland::CrossfadeDelay jumpDelay[NUM_TAPS + 1];
+	bool jumpPrevious = false;
+	size_t historyLength = 0;
+
+	FrozenWasteland::PartitionedConvolver<CombRequest, CHANNELS> convolver{CONVOLUTION_BLOCK_SIZE, CONVOLUTION_FADE_BLOCKS, CONVOLUTION_LATENCY_BLOCKS};
+	CombRequest lastCombRequest;
+	dsp::ClockDivider combRequestDivider;
 
 	float lerp(float v0, float v1, float t) {
 	  return (1 - t) * v0 + t * v1;
 	}
 
-	int muteTap(int tapIndex)
+	FloatFrame readHistory(float index) {
+		FrozenWasteland::NoColdHistory noColdHistory;
+		return FrozenWasteland::readHistory(*historyBuffer, HISTORY_SIZE, historyLength, noColdHistory, 0, index);
+	}
+
+	// Jump mode reads straight from the history, crossfading to each new delay time
+	FloatFrame readJump(int tap, float index, float fadeLength, bool restart) {
+		return FrozenWasteland::readJump(jumpDelay[tap], index, fadeLength, restart, [this](float delay, int cursor) {
+			return readHistory(delay);
+		});
+	}
+
+	// Taps are muted in bit reversed order, so the ones left are spread across the comb. High density combs reverse over more bits
+	int muteTap(int tapIndex, int bits = 6)
     {
         int tapNumber = 0;
-        for (int levelIndex = 0; levelIndex < 6; levelIndex += 1)
+        for (int levelIndex = 0; levelIndex < bits; levelIndex += 1)
         {
-            tapNumber += (tapIndex & (1 << levelIndex)) > 0 ? (1 << (5-levelIndex)) : 0;
+            tapNumber += (tapIndex & (1 << levelIndex)) > 0 ? (1 << (bits-1-levelIndex)) : 0;
         }
-        return NUM_TAPS-tapNumber;     
+        return (1 << bits)-tapNumber;     
     }
 
-	float envelope(int tapNumber, float edgeLevel, float tentLevel, int tentNumber) {
+	float envelope(float tapNumber, float edgeLevel, float tentLevel, int tentNumber) {
         float t;
         if (tapNumber <= tentNumber)
         {
-            t = (float)tapNumber / tentNumber;
+            t = tapNumber / tentNumber;
             return (1 - t) * edgeLevel + t * tentLevel;
         }
         else
         {
-            t = (float)(tapNumber-tentNumber) / (63-tentNumber);
+            t = (tapNumber-tentNumber) / (63-tentNumber);
             return (1 - t) * tentLevel+ t * edgeLevel;
         }
     }
 
+	// Called on the convolver's worker thread. The pattern is interpolated up to request.density taps, muted and shaped like the classic comb,
+	// and each tap is split between the two samples either side of its delay
+	void buildComb(const CombRequest &request, std::vector<float> &ir) {
+		const float *pattern = combPatterns[request.pattern];
+		int bits = 0;
+		while ((1 << bits) < request.density) {
+			bits++;
+		}
+		std::vector<char> active(request.density, 1);
+		for(int tapIndex = request.density-1; tapIndex >= request.activeTaps; tapIndex--) {
+			active[muteTap(tapIndex, bits)] = 0;
+		}
+
+		float longest = 0.0f;
+		for(int tap = 0; tap < NUM_TAPS; tap++) {
+			longest = std::max(longest, pattern[tap]);
+		}
+		int irLength = std::min((int) std::ceil(request.delaySamples * longest / NUM_TAPS) + 2, request.maxLength);
+		ir.assign(std::max(irLength, 1), 0.0f);
+
+		float gain = 1.0f / std::sqrt((float) request.activeTaps);
+		for(int tap = 0; tap < request.density; tap++) {
+			if(!active[tap])
+				continue;
+			// Position of this tap on the classic comb's 0-63 scale, the last tap landing on the pattern's last
+			float position = (tap + 1.0f) * NUM_TAPS / request.density - 1.0f;
+			float length;
+			if(position < 0.0f) {
+				length = lerp(0.0f, pattern[0], position + 1.0f);
+			} else {
+				int i = (int) position;
+				length = lerp(pattern[i], pattern[std::min(i + 1, NUM_TAPS - 1)], position - i);
+			}
+			float delay = request.delaySamples * length / NUM_TAPS;
+			int i = (int) delay;
+			if(i + 1 >= (int) ir.size())
+				continue;
+			float level = gain * envelope(position, request.edgeLevel, request.tentLevel, request.tentTap);
+			float fraction = delay - i;
+			ir[i] += level * (1.0f - fraction);
+			ir[i + 1] += level * fraction;
+		}
+	}
+
+	// Called from the UI thread. The new history is allocated here and picked up by process(), which empties it
+	void setHistoryFormat(int format) {
+		if (format == historyFormat)
+			return;
+		historyFormat = format;
+		historyBuffer.offer(new HistoryBuffer(format));
+	}
+
+	// The convolver's worker thread only runs once a high density comb is picked
+	void setDensity(int newDensity) {
+		if(newDensity > NUM_TAPS) {
+			convolver.start();
+		}
+		density = newDensity;
+	}
+
 	HairPick() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -160,17 +300,64 @@ struct HairPick : Module {
 			src[i] = src_new(SRC_SINC_FASTEST, 2, NULL);	
 		}
 
-		srand(time(NULL));
+		combRequestDivider.setDivision(COMB_REQUEST_DIVISION);
+		convolver.generate = [this](const CombRequest &request, std::vector<float> &ir) {
+			buildComb(request, ir);
+		};
+		onSampleRateChange();
+
 		//src = src_new(SRC_LINEAR, 1, NULL);		
 		//src = src_new(SRC_ZERO_ORDER_HOLD, 1, NULL);
 	}
 
-	
+	void onSampleRateChange() override {
+		convolver.configure((int) std::ceil(MAX_CONVOLUTION_LENGTH * APP->engine->getSampleRate()));
+		lastCombRequest = CombRequest();
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "density", json_integer(density));
+		json_object_set_new(rootJ, "delayChangeMode", json_integer(delayChangeMode));
+		json_object_set_new(rootJ, "crossfadeTime", json_real(crossfadeTime));
+		json_object_set_new(rootJ, "historyFormat", json_integer(historyFormat));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *densityJ = json_object_get(rootJ, "density");
+		if (densityJ) {
+			// Anything between the listed densities falls back to the next one down
+			int savedDensity = json_integer_value(densityJ);
+			int newDensity = NUM_TAPS;
+			for (int i = 0; i < NUM_DENSITIES; i++) {
+				if (densities[i] <= savedDensity)
+					newDensity = densities[i];
+			}
+			setDensity(newDensity);
+		}
+		json_t *delayChangeModeJ = json_object_get(rootJ, "delayChangeMode");
+		if (delayChangeModeJ) {
+			delayChangeMode = clamp((int) json_integer_value(delayChangeModeJ), (int) DELAY_CHANGE_GLIDE, (int) DELAY_CHANGE_JUMP);
+		}
+		json_t *crossfadeTimeJ = json_object_get(rootJ, "crossfadeTime");
+		if (crossfadeTimeJ) {
+			crossfadeTime = clamp((float) json_number_value(crossfadeTimeJ), FrozenWasteland::jumpCrossfadeTimes[0], FrozenWasteland::jumpCrossfadeTimes[FrozenWasteland::NUM_JUMP_CROSSFADES - 1]);
+		}
+		json_t *historyFormatJ = json_object_get(rootJ, "historyFormat");
+		if (historyFormatJ) {
+			setHistoryFormat(clamp((int) json_integer_value(historyFormatJ), 0, FrozenWasteland::NUM_STORAGE_FORMATS - 1));
+		}
+	}
 
 
 
 	void process(const ProcessArgs &args) override {
 
+		if (historyBuffer.pickUp()) {
+			historyLength = 0;
+		}
+
 		combPattern = (int)clamp(params[PATTERN_TYPE_PARAM].getValue() + (inputs[PATTERN_TYPE_CV_INPUT].getVoltage() * 1.5f),0.0f,15.0);
 		feedbackType = (int)clamp(params[FEEDBACK_TYPE_PARAM].getValue() + (inputs[FEEDBACK_TYPE_CV_INPUT].getVoltage() / 10.0f),0.0f,3.0);
 
@@ -237,11 +424,41 @@ struct HairPick : Module {
 			}	
 		}
 
+		bool highDensity = density > NUM_TAPS;
+		if(density != lastDensity) {
+			if(highDensity) {
+				convolver.reset();
+			} else {
+				// The comb taps sat idle, bring them back in line with the feedback tap
+				for(int tap = 0; tap < NUM_TAPS; tap++) {
+					historyBuffer->alignTap(tap, NUM_TAPS);
+					outBuffer[tap].clear();
+				}
+			}
+			lastDensity = density;
+		}
+
+		// Sleep through silence once the combs have rung out
+		float inputPeak = std::max(std::fabs(inputs[IN_L_INPUT].getVoltage()), std::fabs(inputs[IN_R_INPUT].getVoltage()));
+		if (silence.idle(inputPeak)) {
+			outputs[OUT_L_OUTPUT].setVoltage(0.0f);
+			outputs[OUT_R_OUTPUT].setVoltage(0.0f);
+			if(display.frameRequested())
+				publishDisplay();
+			return;
+		}
+
 		// Push dry sample into history buffer
-		if (!historyBuffer.full(NUM_TAPS-1)) {
-			historyBuffer.push(dryFrame);
+		if (!historyBuffer->full(highDensity ? NUM_TAPS : NUM_TAPS-1)) {
+			historyBuffer->push(dryFrame);
+			historyLength = std::min(historyLength + 1, (size_t) HISTORY_SIZE);
 		}
 
+		bool jump = delayChangeMode == DELAY_CHANGE_JUMP;
+		bool jumpRestart = jump && !jumpPrevious;
+		jumpPrevious = jump;
+		float crossfadeLength = crossfadeTime * args.sampleRate;
+
 		float delayNonlinearity = 1.0f;
 		float percentChange = 10.0f;
 		//Apply non-linearity
@@ -254,7 +471,7 @@ struct HairPick : Module {
 
 		FloatFrame wet = {0.0f, 0.0f}; // This is the mix of delays and input that is outputed
 		FloatFrame feedbackValue = {0.0f,0.0f}; // This is the output of a tap that gets sent back to input
-		for(int tap = 0; tap <= NUM_TAPS;tap++) { 
+		for(int tap = highDensity ? NUM_TAPS : 0; tap <= NUM_TAPS;tap++) { 
 			
 			float delay	= 0.0f;
 			// Compute delay time in seconds
@@ -267,8 +484,15 @@ struct HairPick : Module {
 			float index = delay * args.sampleRate;
 
 			// How many samples do we need consume to catch up?
-			float consume = index - historyBuffer.size(tap);
-			if(index > 0)
+			float consume = index - historyBuffer->size(tap);
+			FloatFrame jumpOutput = {0.0f, 0.0f};
+			bool direct = jump && index > 0;
+			if(direct) {
+				// Keep the resampler's read head at the delay so gliding carries on from here
+				jumpOutput = readJump(tap, index, crossfadeLength, jumpRestart);
+				historyBuffer->setDelay(tap, (size_t) index);
+				outBuffer[tap].clear();
+			} else if(index > 0)
 			{
 				if (outBuffer[tap].empty()) {
 								
@@ -277,25 +501,28 @@ struct HairPick : Module {
 						ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f));
 					}
 
+					FloatFrame srcInput[16];
 					SRC_DATA srcData;
-					srcData.data_in = (const float*) historyBuffer.startData(tap);
+					srcData.input_frames = std::min((int) historyBuffer->size(tap), 16);
+					historyBuffer->read(tap, srcInput, srcData.input_frames);
+					srcData.data_in = (const float*) srcInput;
 					srcData.data_out = (float*) outBuffer[tap].endData();
-					srcData.input_frames = std::min((int) historyBuffer.size(tap), 16);
 					srcData.output_frames = outBuffer[tap].capacity();
 					srcData.end_of_input = false;
 					srcData.src_ratio = ratio;
 					src_process(src[tap], &srcData);
-					historyBuffer.startIncr(tap,srcData.input_frames_used);
+					historyBuffer->startIncr(tap,srcData.input_frames_used);
 					outBuffer[tap].endIncr(srcData.output_frames_gen);
 				}			
 			}
 
 			FloatFrame wetTap = {0.0f, 0.0f};
-			if (!outBuffer[tap].empty()) {
+			if (direct || !outBuffer[tap].empty()) {
+				FloatFrame tapOutput = direct ? jumpOutput : outBuffer[tap].shift();
 				if(tap == NUM_TAPS) {
-					feedbackValue = outBuffer[tap].shift();
+					feedbackValue = tapOutput;
 				} else {
-					wetTap = outBuffer[tap].shift();
+					wetTap = tapOutput;
 					if(!combActive[tap]) {
 						wetTap = {0.0f, 0.0f};
 					} else {
@@ -309,8 +536,30 @@ struct HairPick : Module {
 			wet.r += wetTap.r;
 		}
 
-		wet.l = wet.l / ((float)tapCount) * sqrt((float)tapCount);
-		wet.r = wet.r / ((float)tapCount) * sqrt((float)tapCount);
+		if(highDensity) {
+			if(combRequestDivider.process()) {
+				CombRequest request;
+				request.pattern = combPattern;
+				request.density = density;
+				request.activeTaps = std::max(tapCount * density / NUM_TAPS, 1);
+				request.edgeLevel = edgeLevel;
+				request.tentLevel = tentLevel;
+				request.tentTap = tentTap;
+				request.delaySamples = baseDelay * args.sampleRate;
+				request.maxLength = (int) std::ceil(MAX_CONVOLUTION_LENGTH * args.sampleRate);
+				if(request.differs(lastCombRequest) && convolver.request(request)) {
+					lastCombRequest = request;
+				}
+			}
+			float in[CHANNELS] = {dryFrame.l, dryFrame.r};
+			float out[CHANNELS];
+			convolver.process(in, out);
+			wet.l = out[0];
+			wet.r = out[1];
+		} else {
+			wet.l = wet.l / ((float)tapCount) * sqrt((float)tapCount);
+			wet.r = wet.r / ((float)tapCount) * sqrt((float)tapCount);
+		}
 
 		float feedbackWeight = 0.5;
 		switch(feedbackType) {
@@ -340,6 +589,30 @@ struct HairPick : Module {
 		outputs[OUT_L_OUTPUT].setVoltage(out.l);
 		outputs[OUT_R_OUTPUT].setVoltage(out.r);
 
+		// The feedback tap reads furthest back, the sitar stretches it by up to 10%
+		silence.setHold(baseDelay * 1.1f + (highDensity ? MAX_CONVOLUTION_LENGTH : 0.0f) + 1.0f, args.sampleRate);
+		float peak = std::max(std::max(std::fabs(out.l), std::fabs(out.r)), std::max(std::fabs(lastFeedback.l), std::fabs(lastFeedback.r)));
+		if (silence.update(std::max(peak, inputPeak))) {
+			// Whatever is left is below the threshold. Direct reads treat the time asleep as silence
+			historyLength = 0;
+			lastFeedback = {0.0f, 0.0f};
+			convolver.reset();
+		}
+
+		if(display.frameRequested())
+			publishDisplay();
+	}
+
+	void publishDisplay() {
+		DisplayFrame &frame = display.writeBuffer();
+		frame.division = division;
+		frame.baseDelay = baseDelay;
+		frame.combPattern = combPattern;
+		frame.edgeLevel = edgeLevel;
+		frame.tentLevel = tentLevel;
+		frame.tentTap = tentTap;
+		frame.feedbackType = feedbackType;
+		display.publish();
 	}
 };
 
@@ -420,16 +693,73 @@ struct HPStatusDisplay : TransparentWidget {
 		if (!module)
 			return;
 		
-		drawDivision(args, Vec(91,60), module->division);
-		drawDelayTime(args, Vec(350,65), module->baseDelay);
-		drawPatternType(args, Vec(64,135), module->combPattern);
-		drawEnvelope(args,Vec(55,163),module->edgeLevel,module->tentLevel,module->tentTap);
-		drawFeedbackType(args, Vec(62,305), module->feedbackType);
+		module->display.requestFrame();
+		module->display.update();
+		const HairPick::DisplayFrame &frame = module->display.readBuffer();
+
+		drawDivision(args, Vec(91,60), frame.division);
+		drawDelayTime(args, Vec(350,65), frame.baseDelay);
+		drawPatternType(args, Vec(64,135), frame.combPattern);
+		drawEnvelope(args,Vec(55,163),frame.edgeLevel,frame.tentLevel,frame.tentTap);
+		drawFeedbackType(args, Vec(62,305), frame.feedbackType);
 	}
 };
 
 
 struct HairPickWidget : ModuleWidget {
+	void step() override {
+		HairPick *module = dynamic_cast<HairPick*>(this->module);
+		if (module)
+			module->historyBuffer.collect();
+		ModuleWidget::step();
+	}
+
+	struct DensityItem : MenuItem {
+		HairPick *module;
+		int density;
+		void onAction(const event::Action &e) override {
+			module->setDensity(density);
+		}
+		void step() override {
+			rightText = (module->density == density) ? "✔" : "";
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		HairPick *module = dynamic_cast<HairPick*>(this->module);
+		assert(module);
+
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		MenuLabel *densityLabel = new MenuLabel();
+		densityLabel->text = "Comb Density";
+		menu->addChild(densityLabel);
+
+		for (int i = 0; i < NUM_DENSITIES; i++) {
+			DensityItem *densityItem = new DensityItem();
+			densityItem->text = module->densityNames[i];
+			densityItem->module = module;
+			densityItem->density = module->densities[i];
+			menu->addChild(densityItem);
+		}
+
+		menu->addChild(new MenuLabel());// empty line
+
+		FrozenWasteland::appendDelayChangeMenu(menu, module);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		FrozenWasteland::appendHistoryFormatMenu(menu, module);
+	}
+
+
 	HairPickWidget(HairPick *module) {
 		setModule(module);
 
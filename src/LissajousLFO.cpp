@@ -2,6 +2,8 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/snapshot.hpp"
+#include "dsp-oscillator/morphing_lfo_table.hpp"
 
 #define BUFFER_SIZE 512
 
@@ -87,10 +89,6 @@ struct LissajousLFO : Module {
 		float waveSlope = 1.0; //Original (1 is sin)
 		bool offset = false;
 		
-		float lerp(float v0, float v1, float t) {
-			return (1 - t) * v0 + t * v1;
-		}
-		
 		void setPitch(float pitch) {
 			pitch = fminf(pitch, 8.0);
 			freq = powf(2.0, pitch);
@@ -114,33 +112,8 @@ struct LissajousLFO : Module {
 				phase -= 1.0;
 		}
 
-		float skewsaw(float x) {
-			
-			x = std::fabs(std::fmod(x ,1.0f));
-
-			float inverseSkew = 1 - skew;
-			float originalWave;
-			if (skew == 0 && x == 0) //Avoid /0 error
-				originalWave = 2;
-			if (x <= skew)
-				originalWave = 2.0 * (1- (-1 / skew * x + 1));
-			else
-				originalWave = 2.0 * (1-(1 / inverseSkew * (x - skew)));
-			return originalWave;
-		}
-		
 		float skewsaw() {
-			if (offset)
-				return lerp(skewsaw(phase),sin(),waveSlope);
-			
-			return lerp(skewsaw(phase) - 1 ,sin(),waveSlope);skewsaw(phase) ; //Going to keep same phase for now				
-		}
-
-		float sin() {
-			if (offset) // Sin wave is 90 degrees out of phase with other waves
-				return 1.0 - cosf(2*M_PI * (phase - 0.25)) ;
-			else
-				return sinf(2*M_PI * (phase - 0.25)) ;
+			return FrozenWasteland::MorphingLfoTable::get().skewsaw(skew, waveSlope, offset, phase);
 		}
 
 	};
@@ -151,6 +124,15 @@ struct LissajousLFO : Module {
 
 	LowFrequencyOscillator oscillatorX1,oscillatorY1,oscillatorX2,oscillatorY2;
 
+	struct ScopeFrame {
+		float x1[BUFFER_SIZE];
+		float y1[BUFFER_SIZE];
+		float x2[BUFFER_SIZE];
+		float y2[BUFFER_SIZE];
+	};
+	FrozenWasteland::SnapshotBuffer<ScopeFrame> scope;
+
+	//Audio thread only, the display reads published ScopeFrames
 	float bufferX1[BUFFER_SIZE] = {};
 	float bufferY1[BUFFER_SIZE] = {};
 	float bufferX2[BUFFER_SIZE] = {};
@@ -276,25 +258,33 @@ void LissajousLFO::process(const ProcessArgs &args) {
 	float out8 = (x1*x2*y1*y2);
 	outputs[OUTPUT_8].setVoltage(clamp(out8,-5.0f,5.0f) );
 
-	//Update scope.
+	//Update scope, only while the display is being drawn
+	if (!scope.watching(args.sampleTime))
+		return;
+
 	int frameCount = (int)ceilf(deltaTime * args.sampleRate);
 
 	// Add frame to buffers
-	if (bufferIndex < BUFFER_SIZE) {
-		if (++frameIndex > frameCount) {
-			frameIndex = 0;
-			bufferX1[bufferIndex] = x1;
-			bufferY1[bufferIndex] = y1;
-			bufferX2[bufferIndex] = x2;
-			bufferY2[bufferIndex] = y2;
-			bufferIndex++;
-		}
+	if (++frameIndex > frameCount) {
+		frameIndex = 0;
+		bufferX1[bufferIndex] = x1;
+		bufferY1[bufferIndex] = y1;
+		bufferX2[bufferIndex] = x2;
+		bufferY2[bufferIndex] = y2;
+		bufferIndex = (bufferIndex + 1) % BUFFER_SIZE;
 	}
 
-	// Are we waiting on the next trigger?
-	if (bufferIndex >= BUFFER_SIZE) {
-		bufferIndex = 0;
-		frameIndex = 0;
+	if (scope.frameRequested()) {
+		// Oldest point first
+		ScopeFrame &frame = scope.writeBuffer();
+		for (int i = 0; i < BUFFER_SIZE; i++) {
+			int j = (i + bufferIndex) % BUFFER_SIZE;
+			frame.x1[i] = bufferX1[j];
+			frame.y1[i] = bufferY1[j];
+			frame.x2[i] = bufferX2[j];
+			frame.y2[i] = bufferY2[j];
+		}
+		scope.publish();
 	}
 }
 
@@ -368,14 +358,15 @@ struct ScopeDisplay : TransparentWidget {
 		//float offsetX = module->x1;
 		//float offsetY = module->y1;
 
+		module->scope.requestFrame();
+		module->scope.update();
+		const LissajousLFO::ScopeFrame &frame = module->scope.readBuffer();
+
 		float valuesX[BUFFER_SIZE];
 		float valuesY[BUFFER_SIZE];
 		for (int i = 0; i < BUFFER_SIZE; i++) {
-			int j = i;
-			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX1[j]) * gainX / 10.0;
-			valuesY[i] = (module->bufferY1[j]) * gainY / 10.0;
+			valuesX[i] = frame.x1[i] * gainX / 10.0;
+			valuesY[i] = frame.y1[i] * gainY / 10.0;
 		}
 
 		// Draw waveforms for LFO 1
@@ -385,11 +376,8 @@ struct ScopeDisplay : TransparentWidget {
 
 
 		for (int i = 0; i < BUFFER_SIZE; i++) {
-			int j = i;
-			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX2[j]) * gainX / 10.0;
-			valuesY[i] = (module->bufferY2[j]) * gainY / 10.0;
+			valuesX[i] = frame.x2[i] * gainX / 10.0;
+			valuesY[i] = frame.y2[i] * gainY / 10.0;
 		}
 
 		// Draw waveforms for LFO 2
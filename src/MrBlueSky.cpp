@@ -1,11 +1,16 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
-#include "filters/biquad.h"
+#include "ui/silence_status.hpp"
+#include "filters/modulated_biquad.hpp"
+#include "spectral_vocoder.hpp"
+#include "silence_tracker.hpp"
+#include "denormal.hpp"
 
 using namespace std;
 
 #define BANDS 16
+#define NUM_BAND_COUNTS 6
 
 struct MrBlueSky : Module {
 	enum ParamIds {
@@ -48,8 +53,8 @@ struct MrBlueSky : Module {
 		LEARN_LIGHT,
 		NUM_LIGHTS
 	};
-	Biquad* iFilter[2*BANDS];
-	Biquad* cFilter[2*BANDS];
+	FrozenWasteland::ModulatedBiquad iFilter[2*BANDS];
+	FrozenWasteland::ModulatedBiquad cFilter[2*BANDS];
 	float mem[BANDS] = {0};
 	float freq[BANDS] = {125,185,270,350,430,530,630,780,950,1150,1380,1680,2070,2780,3800,6400};
 	float peaks[BANDS] = {0};
@@ -61,6 +66,16 @@ struct MrBlueSky : Module {
 	int lastBandOffset = 0;
 	dsp::SchmittTrigger shiftLeftTrigger,shiftRightTrigger;
 
+	// 0 is the filter bank, otherwise the number of bands of the spectral vocoder
+	int spectralBands = 0;
+	int lastSpectralBands = 0;
+	const int bandCounts[NUM_BAND_COUNTS] = {0,32,64,128,256,512};
+	const char* bandCountNames[NUM_BAND_COUNTS] = {"16 (filter bank)","32 (spectral)","64 (spectral)","128 (spectral)","256 (spectral)","512 (spectral, one per bin)"};
+	FrozenWasteland::SpectralVocoder vocoder;
+
+	FrozenWasteland::SilenceTracker silence;
+	FrozenWasteland::DenormalStats denormals{"MrBlueSky"};
+
 	MrBlueSky() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -85,9 +100,35 @@ struct MrBlueSky : Module {
 		float sampleRate = APP->engine->getSampleRate();
 
 		for(int i=0; i<2*BANDS; i++) {
-			iFilter[i] = new Biquad(bq_type_bandpass, freq[i%BANDS] / sampleRate, 5, 6);
-			cFilter[i] = new Biquad(bq_type_bandpass, freq[i%BANDS] / sampleRate, 5, 6);
+			iFilter[i] = FrozenWasteland::ModulatedBiquad(bq_type_bandpass, freq[i%BANDS] / sampleRate, 5, 6);
+			cFilter[i] = FrozenWasteland::ModulatedBiquad(bq_type_bandpass, freq[i%BANDS] / sampleRate, 5, 6);
 		};
+		//Modulator filters first, then carrier
+		for(int i=0; i<4*BANDS; i++) {
+			denormals.add(std::string(i < 2*BANDS ? "modulator " : "carrier ") + std::to_string((int) freq[i%BANDS]) + " Hz" + (i%(2*BANDS) < BANDS ? "" : " second stage"));
+		}
+	}
+
+	void onSampleRateChange() override {
+		vocoder.configure(spectralBands > 0 ? spectralBands : vocoder.bands, APP->engine->getSampleRate());
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "spectralBands", json_integer(spectralBands));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *spectralBandsJ = json_object_get(rootJ, "spectralBands");
+		if (spectralBandsJ) {
+			int bands = json_integer_value(spectralBandsJ);
+			spectralBands = 0;
+			for (int i = 0; i < NUM_BAND_COUNTS; i++) {
+				if (bandCounts[i] == bands)
+					spectralBands = bands;
+			}
+		}
 	}
 
 	void process(const ProcessArgs &args) override;
@@ -143,7 +184,6 @@ void MrBlueSky::process(const ProcessArgs &args) {
 	const float slewMin = 0.001;
 	const float slewMax = 500.0;
 	const float shapeScale = 1/10.0;
-	const float qEpsilon = 0.1;
 	float attack = params[ATTACK_PARAM].getValue();
 	float decay = params[DECAY_PARAM].getValue();
 	if(inputs[ATTACK_INPUT].isConnected()) {
@@ -163,10 +203,9 @@ void MrBlueSky::process(const ProcessArgs &args) {
 	}
 
 	currentQ = clamp(currentQ,1.0f,15.0f);
-	if (abs(currentQ - lastModQ) >= qEpsilon ) {
-		for(int i=0; i<2*BANDS; i++) {
-			iFilter[i]->setQ(currentQ);
-			}
+	//Filters glide to the new Q, so there's no need to wait for big changes
+	if (currentQ != lastModQ) {
+		FrozenWasteland::ModulatedBiquad::setQ(iFilter, 2*BANDS, currentQ);
 		lastModQ = currentQ;
 	}
 
@@ -177,48 +216,110 @@ void MrBlueSky::process(const ProcessArgs &args) {
 	}
 
 	currentQ = clamp(currentQ,1.0f,15.0f);
-	if (abs(currentQ - lastCarrierQ) >= qEpsilon ) {
-		for(int i=0; i<2*BANDS; i++) {
-			cFilter[i]->setQ(currentQ);
-			}
+	if (currentQ != lastCarrierQ) {
+		FrozenWasteland::ModulatedBiquad::setQ(cFilter, 2*BANDS, currentQ);
 		lastCarrierQ = currentQ;
 	}
 
 
 
-	//First process all the modifier bands
+	//Inserted carrier bands can keep a band sounding on their own
+	float inputPeak = std::max(FrozenWasteland::SilenceTracker::peak(inputs[IN_MOD]), FrozenWasteland::SilenceTracker::peak(inputs[IN_CARR]));
 	for(int i=0; i<BANDS; i++) {
-		float coeff = mem[i];
-		float peak = abs(iFilter[i+BANDS]->process(iFilter[i]->process(inM*params[GMOD_PARAM].getValue())));
-		if (peak>coeff) {
-			coeff += slewAttack * shapeScale * (peak - coeff) / args.sampleRate;
-			if (coeff > peak)
-				coeff = peak;
+		inputPeak = std::max(inputPeak, FrozenWasteland::SilenceTracker::peak(inputs[CARRIER_IN+i]));
+	}
+	if(silence.idle(inputPeak)) {
+		for(int i=0; i<BANDS; i++) {
+			outputs[MOD_OUT+i].setVoltage(0.0);
 		}
-		else if (peak < coeff) {
-			coeff -= slewDecay * shapeScale * (coeff - peak) / args.sampleRate;
-			if (coeff < peak)
-				coeff = peak;
+		outputs[OUT].setVoltage(0.0);
+		return;
+	}
+
+	if(spectralBands != lastSpectralBands) {
+		if(spectralBands > 0) {
+			vocoder.configure(spectralBands, args.sampleRate);
 		}
-		peaks[i]=peak;
-		mem[i]=coeff;
-		outputs[MOD_OUT+i].setVoltage(coeff * 5.0);
+		lastSpectralBands = spectralBands;
 	}
 
-	//Then process carrier bands. Mod bands are normalled to their matched carrier band unless an insert
-	for(int i=0; i<BANDS; i++) {
-		float coeff;
-		if(inputs[(CARRIER_IN+i+bandOffset) % BANDS].isConnected()) {
-			coeff = inputs[CARRIER_IN+i+bandOffset].getVoltage() / 5.0;
-		} else {
-			coeff = mem[(i+bandOffset) % BANDS];
+	if(spectralBands > 0) {
+		//Envelopes move once per hop, and the 16 groups of bands take the place of the filter bank's bands
+		float hopTime = FrozenWasteland::SpectralVocoder::HOP / args.sampleRate;
+		vocoder.attack = std::min(slewAttack * shapeScale * hopTime, 1.0f);
+		vocoder.decay = std::min(slewDecay * shapeScale * hopTime, 1.0f);
+		vocoder.groupOffset = bandOffset;
+		for(int i=0; i<BANDS; i++) {
+			vocoder.inserted[i] = inputs[CARRIER_IN+i].isConnected();
+			vocoder.insertLevel[i] = inputs[CARRIER_IN+i].getVoltage() / 5.0;
+			vocoder.groupGain[i] = params[BG_PARAM+i].getValue();
+		}
+		out = vocoder.process(inM*params[GMOD_PARAM].getValue(), inC*params[GCARR_PARAM].getValue());
+		for(int i=0; i<BANDS; i++) {
+			mem[i] = vocoder.groupLevel[i];
+			peaks[i] = vocoder.groupLevel[i];
+			outputs[MOD_OUT+i].setVoltage(mem[i] * 5.0);
+		}
+	} else {
+		//First process all the modifier bands
+		for(int i=0; i<BANDS; i++) {
+			float coeff = mem[i];
+			float peak = abs(iFilter[i+BANDS].process(iFilter[i].process(inM*params[GMOD_PARAM].getValue())));
+			if (peak>coeff) {
+				coeff += slewAttack * shapeScale * (peak - coeff) / args.sampleRate;
+				if (coeff > peak)
+					coeff = peak;
+			}
+			else if (peak < coeff) {
+				coeff -= slewDecay * shapeScale * (coeff - peak) / args.sampleRate;
+				if (coeff < peak)
+					coeff = peak;
+			}
+			peaks[i]=peak;
+			mem[i]=coeff;
+			outputs[MOD_OUT+i].setVoltage(coeff * 5.0);
 		}
 
-		float bandOut = cFilter[i+BANDS]->process(cFilter[i]->process(inC*params[GCARR_PARAM].getValue())) * coeff * params[BG_PARAM+i].getValue();
-		out += bandOut;
+		//Then process carrier bands. Mod bands are normalled to their matched carrier band unless an insert
+		for(int i=0; i<BANDS; i++) {
+			float coeff;
+			if(inputs[(CARRIER_IN+i+bandOffset) % BANDS].isConnected()) {
+				coeff = inputs[CARRIER_IN+i+bandOffset].getVoltage() / 5.0;
+			} else {
+				coeff = mem[(i+bandOffset) % BANDS];
+			}
+
+			float bandOut = cFilter[i+BANDS].process(cFilter[i].process(inC*params[GCARR_PARAM].getValue())) * coeff * params[BG_PARAM+i].getValue();
+			out += bandOut;
+		}
 	}
 	outputs[OUT].setVoltage(out * 5 * params[G_PARAM].getValue());
 
+	for(int i=0; i<2*BANDS; i++) {
+		denormals.check(i, iFilter[i].getZ1());
+		denormals.check(i, iFilter[i].getZ2());
+		denormals.check(2*BANDS+i, cFilter[i].getZ1());
+		denormals.check(2*BANDS+i, cFilter[i].getZ2());
+	}
+	denormals.tick(args.sampleRate);
+
+	//Envelopes are part of the level so a slow decay is never cut short
+	float level = std::max(inputPeak, std::fabs(out * 5 * params[G_PARAM].getValue()));
+	for(int i=0; i<BANDS; i++) {
+		level = std::max(level, mem[i] * 5.0f);
+	}
+	silence.setHold(0.5f, args.sampleRate);
+	if(silence.update(level)) {
+		for(int i=0; i<2*BANDS; i++) {
+			iFilter[i].reset();
+			cFilter[i].reset();
+		}
+		vocoder.reset();
+		for(int i=0; i<BANDS; i++) {
+			mem[i] = 0;
+			peaks[i] = 0;
+		}
+	}
 }
 
 struct MrBlueSkyBandDisplay : TransparentWidget {
@@ -240,7 +341,7 @@ struct MrBlueSkyBandDisplay : TransparentWidget {
 		//static const int portX0[4] = {20, 63, 106, 149};
 		for (int i=0; i<BANDS; i++) {
 			char fVal[10];
-			snprintf(fVal, sizeof(fVal), "%1i", (int)module->freq[i]);
+			snprintf(fVal, sizeof(fVal), "%1i", (int)(module->spectralBands > 0 ? module->vocoder.groupFreq[i] : module->freq[i]));
 			nvgFillColor(args.vg,nvgRGBA(255, rescale(clamp(module->peaks[i],0.0f,1.0f),0,1,255,0), rescale(clamp(module->peaks[i],0.0f,1.0f),0,1,255,0), 255));
 			nvgText(args.vg, 56 + 24*i, 30, fVal, NULL);
 		}
@@ -275,6 +376,47 @@ struct BandOffsetDisplay : TransparentWidget {
 };
 
 struct MrBlueSkyWidget : ModuleWidget {
+	struct BandCountItem : MenuItem {
+		MrBlueSky *module;
+		int spectralBands;
+		void onAction(const event::Action &e) override {
+			module->spectralBands = spectralBands;
+		}
+		void step() override {
+			rightText = (module->spectralBands == spectralBands) ? "✔" : "";
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		MrBlueSky *module = dynamic_cast<MrBlueSky*>(this->module);
+		assert(module);
+
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		MenuLabel *bandsLabel = new MenuLabel();
+		bandsLabel->text = "Bands";
+		menu->addChild(bandsLabel);
+
+		for (int i = 0; i < NUM_BAND_COUNTS; i++) {
+			BandCountItem *bandCountItem = new BandCountItem();
+			bandCountItem->text = module->bandCountNames[i];
+			bandCountItem->module = module;
+			bandCountItem->spectralBands = module->bandCounts[i];
+			menu->addChild(bandCountItem);
+		}
+
+		MenuLabel *latencyLabel = new MenuLabel();
+		latencyLabel->text = rack::string::f("Spectral modes are %d samples (%.1f ms) late", FrozenWasteland::SpectralVocoder::LATENCY, 1000.f * FrozenWasteland::SpectralVocoder::LATENCY / APP->engine->getSampleRate());
+		menu->addChild(latencyLabel);
+	}
+
 	MrBlueSkyWidget(MrBlueSky *module) {
 		setModule(module);
 
@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "denormal.hpp"
 
 // The clipping function of a transistor pair is approximately tanh(x)
 // TODO: Put this in a lookup table. 5th order approx doesn't seem to cut it
@@ -234,6 +235,7 @@ struct PhasedLockedLoop : Module {
 
 	dsp::SchmittTrigger modeTrigger;
 	float filterOutput = 0;
+	FrozenWasteland::DenormalStats denormals{"PhasedLockedLoop"};
 	int currentComparatorType = XOR_COMPARATOR;
 
 	
@@ -246,6 +248,7 @@ struct PhasedLockedLoop : Module {
 		configParam(LPF_FREQ_PARAM, 0, 1, 0.5,"LPF Frequency"," Hz",540,15);
 		configParam(COMPARATOR_TYPE_PARAM, 0.0, 1.0, 0.0);
 
+		denormals.add("ladder filter");
 	}
 	void process(const ProcessArgs &args) override;
 
@@ -357,6 +360,11 @@ void PhasedLockedLoop::process(const ProcessArgs &args) {
 	filterOutput = 5.0 * filter.state[3];
 	outputs[LPF_OUTPUT].setVoltage(filterOutput);
 
+	for (int i = 0; i < 4; i++) {
+		denormals.check(0, filter.state[i]);
+	}
+	denormals.tick(args.sampleRate);
+
 
 }
 
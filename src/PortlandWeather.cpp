@@ -1,11 +1,21 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/snapshot.hpp"
+#include "ui/history_menu.hpp"
+#include "ui/silence_status.hpp"
 #include "frame.h"
 #include "granular_delay.h"
 #include "samplerate.h"
 #include "ringbuffer.hpp"
+#include "reverse_heads.hpp"
+#include "history_reader.hpp"
+#include "cold_history.hpp"
+#include "hand_over.hpp"
+#include "silence_tracker.hpp"
+#include "denormal.hpp"
 #include "StateVariableFilter.h"
+#include "biquad_cascade.hpp"
 #include <iostream>
 
 #define HISTORY_SIZE (1<<22)
@@ -15,6 +25,11 @@
 #define CHANNELS 2
 #define DIVISIONS 36
 #define NUM_GROOVES 16
+#define LONG_DELAY_SECONDS 600
+#define HOT_HISTORY_LIMIT (HISTORY_SIZE - 64)
+#define COLD_CURSORS 4
+#define HISTORY_RANGE 20
+#define MAX_FILTER_STAGES 4
 
 
 struct PortlandWeather : Module {
@@ -115,6 +130,16 @@ struct PortlandWeather : Module {
 		TRIGGER_TRIGGER_MODE,
 		GATE_TRIGGE_MODE
 	};
+	enum DelayChangeModes {
+		DELAY_CHANGE_GLIDE,
+		DELAY_CHANGE_JUMP
+	};
+	enum FilterSlopes {
+		FILTER_SLOPE_12DB,
+		FILTER_SLOPE_24DB,
+		FILTER_SLOPE_48DB,
+		NUM_FILTER_SLOPES
+	};
 
 
 
@@ -146,6 +171,9 @@ struct PortlandWeather : Module {
 
 	bool pingPong = false;
 	bool reverse = false;
+	bool longDelays = false;
+	int delayChangeMode = DELAY_CHANGE_GLIDE;
+	float crossfadeTime = 0.025f;
 	int grainCount = 3; //NOTE Should be 3
 	float grainSize = 0.5f; //Can be between 0 and 1			
 	bool tapMuted[NUM_TAPS];
@@ -168,11 +196,19 @@ struct PortlandWeather : Module {
 	
 	StateVariableFilterState<T> filterStates[NUM_TAPS][CHANNELS];
     StateVariableFilterParams<T> filterParams[NUM_TAPS];
+	// 24 and 48 dB tap filters, one lane per tap and channel
+	int filterSlope = FILTER_SLOPE_12DB;
+	int lastFilterSlope = FILTER_SLOPE_12DB;
+	FrozenWasteland::CascadeCache<MAX_FILTER_STAGES> tapFilterDesigns;
+	FrozenWasteland::BiquadCascade<NUM_TAPS * CHANNELS / 4, MAX_FILTER_STAGES> tapFilters;
+	uint32_t tapDesignKey[NUM_TAPS];
+	FloatFrame tapOutput[NUM_TAPS];
 	dsp::RCFilter lowpassFilter[CHANNELS];
 	dsp::RCFilter highpassFilter[CHANNELS];
 	float lastColor = 0.0f;
 
 	const char* filterNames[5] = {"OFF","LP","HP","BP","NOTCH"};
+	const char* filterSlopeNames[NUM_FILTER_SLOPES] = {"12 dB/oct","24 dB/oct","48 dB/oct"};
 
 	const char* tapNames[NUM_TAPS+2] {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","ALL","EXT"};
 	
@@ -191,8 +227,26 @@ struct PortlandWeather : Module {
 
 	
 	
-	FrozenWasteland::MultiTapDoubleRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+CHANNELS> historyBuffer;
-	FrozenWasteland::ReverseRingBuffer<float, HISTORY_SIZE> reverseHistoryBuffer[CHANNELS];
+	typedef FrozenWasteland::SwitchableMultiTapRingBuffer<FloatFrame, HISTORY_SIZE, NUM_TAPS+CHANNELS, HISTORY_RANGE> HistoryBuffer;
+	typedef FrozenWasteland::ColdHistory<(NUM_TAPS+CHANNELS)*COLD_CURSORS, HistoryBuffer> ColdHistory;
+
+	// The ring and the older history than it holds, each reader gets a cold cursor per reverse or jump head and channel
+	struct History {
+		HistoryBuffer buffer;
+		ColdHistory cold;
+
+		explicit History(int format) : buffer(format), cold(buffer, HISTORY_SIZE) {
+		}
+	};
+
+	// Replaced from the UI thread when the format changes, so the audio thread never allocates one or starts its worker
+	FrozenWasteland::HandOver<History> history{new History(FrozenWasteland::STORAGE_FLOAT)};
+	int historyFormat = FrozenWasteland::STORAGE_FLOAT;
+	FrozenWasteland::ReverseHeads reverseHeads[CHANNELS];
+	float reverseLength[CHANNELS] = {0.0f,0.0f};
+	size_t historyLength = 0; // How much of the history has been written since the last clear, cold tier included
+	FrozenWasteland::CrossfadeDelay jumpDelay[NUM_TAPS+CHANNELS];
+	bool directPrevious[NUM_TAPS+CHANNELS] = {};
 	FrozenWasteland::DoubleRingBuffer<FloatFrame, 16> outBuffer[NUM_TAPS+CHANNELS]; 
 	FloatFrame pitchShiftBuffer[NUM_TAPS+CHANNELS][MAX_GRAINS][MAX_GRAIN_SIZE];
 	
@@ -203,6 +257,21 @@ struct PortlandWeather : Module {
 	
 	FloatFrame lastFeedback = {0.0f,0.0f};
 
+	//What the status display draws, copied out at the end of a sample when it asks for a frame
+	struct DisplayFrame {
+		int division;
+		float baseDelay;
+		int tapGroovePattern;
+		int feedbackTap[CHANNELS];
+		float feedbackPitch[CHANNELS];
+		float feedbackDetune[CHANNELS];
+		int filterType[NUM_TAPS];
+	};
+	FrozenWasteland::SnapshotBuffer<DisplayFrame> display;
+
+	FrozenWasteland::SilenceTracker silence;
+	FrozenWasteland::DenormalStats denormals{"PortlandWeather"};
+
 	float lerp(float v0, float v1, float t) {
 	  return (1 - t) * v0 + t * v1;
 	}
@@ -211,6 +280,87 @@ struct PortlandWeather : Module {
 		return powf(2,semiTone/12.0f);
 	}
 
+	// Past the end of the ring the frames come from the cold tier, which reads as silence until the cursor's block is decoded
+	FloatFrame readHistory(float index, int cursor) {
+		return FrozenWasteland::readHistory(history->buffer, HISTORY_SIZE, historyLength, history->cold, cursor, index);
+	}
+
+	// Plays the history backwards around a tap's delay, in segments as long as the feedback delay
+	FloatFrame readReverse(int reader, float index) {
+		FloatFrame out = {0.0f, 0.0f};
+		for(int head = 0; head < 2; head++) {
+			out.l += readHistory(index + reverseHeads[0].offset(head), reader * COLD_CURSORS + head * 2).l * reverseHeads[0].gain(head);
+			out.r += readHistory(index + reverseHeads[1].offset(head), reader * COLD_CURSORS + head * 2 + 1).r * reverseHeads[1].gain(head);
+		}
+		return out;
+	}
+
+	// Jump mode also reads straight from the history, crossfading to each new delay time
+	FloatFrame readJump(int reader, float index, float fadeLength, bool restart) {
+		return FrozenWasteland::readJump(jumpDelay[reader], index, fadeLength, restart, [this, reader](float delay, int cursor) {
+			return readHistory(delay, reader * COLD_CURSORS + cursor);
+		});
+	}
+
+	// The cold tier's worker only runs once long delays have been asked for
+	void setLongDelays(bool enabled) {
+		longDelays = enabled;
+		if (longDelays)
+			history.latest()->cold.start();
+	}
+
+	// Called from the UI thread. The new history is allocated here and picked up by process(), which empties it
+	void setHistoryFormat(int format) {
+		if (format == historyFormat)
+			return;
+		historyFormat = format;
+		History *replacement = new History(format);
+		if (longDelays)
+			replacement->cold.start();
+		history.offer(replacement);
+	}
+
+	// The steep tap filters' designs are worked out on their own thread, which only runs once they have been picked
+	void setFilterSlope(int slope) {
+		filterSlope = slope;
+		if (filterSlope != FILTER_SLOPE_12DB)
+			tapFilterDesigns.start();
+	}
+
+	// Keeps a resampled reader at its delay while it is read directly, so it can carry on from there.
+	// Never all the way back, or the history would stop taking new frames
+	void holdResampler(int reader, float index) {
+		history->buffer.setDelay(reader, std::min((size_t) index, (size_t) HISTORY_SIZE - 1));
+		outBuffer[reader].clear();
+	}
+
+	// Stacking and muting buttons and gates, which keep working while the module sleeps
+	void updateTapSwitches(int tap) {
+		// Stacking
+		if(params[STACK_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_STACK_CV_INPUT+tap].isConnected()) {
+			tapStacked[tap] = inputs[TAP_STACK_CV_INPUT+tap].getVoltage() > 0.0f;
+		}
+		//Button (or trigger) can override input
+		if (tap < NUM_TAPS -1 && stackingTrigger[tap].process(params[TAP_STACKED_PARAM+tap].getValue() + (params[STACK_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_STACK_CV_INPUT+tap].getVoltage() : 0.0f))) {
+			tapStacked[tap] = !tapStacked[tap];
+		}
+
+		// Muting
+		if(params[MUTE_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_MUTE_CV_INPUT+tap].isConnected()) {
+			tapMuted[tap] = inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() > 0.0f;
+		}
+		//Button (or trigger) can override input
+		if (mutingTrigger[tap].process(params[TAP_MUTE_PARAM+tap].getValue() + (inputs[TAP_MUTE_CV_INPUT+tap].isConnected() && params[MUTE_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() : 0))) {
+			tapMuted[tap] = !tapMuted[tap];
+			// if(!tapMuted[tap]) {
+			// 	activeTapCount +=1.0f;
+			// }
+		}			
+
+		lights[TAP_STACKED_LIGHT+tap].value = tapStacked[tap];
+		lights[TAP_MUTED_LIGHT+tap].value = (tapMuted[tap]);	
+	}
+
 	PortlandWeather() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -280,6 +430,7 @@ struct PortlandWeather : Module {
 			lastFilterType[i] = FILTER_NONE;
 			lastTapFc[i] = 800.0f / sampleRate;
 			lastTapQ[i] = 5.0f;
+			tapDesignKey[i] = UINT32_MAX;
 			filterParams[i].setMode(StateVariableFilterParams<T>::Mode::LowPass);
 			filterParams[i].setQ(5); 	
 	        filterParams[i].setFreq(T(800.0f / sampleRate));
@@ -291,6 +442,14 @@ struct PortlandWeather : Module {
 	    	 	granularPitchShift[i][j].Init((float*) pitchShiftBuffer[i][j],((float)j)/MAX_GRAINS);
 			}
 	    }	
+		// Tap filters first, then the feedback filters
+		for(int i=0;i<NUM_TAPS;i++) {
+			denormals.add("tap " + std::to_string(i + 1) + " filter");
+		}
+		for(int i=0;i<CHANNELS;i++) {
+			denormals.add(std::string("feedback ") + (i == 0 ? "L" : "R") + " lowpass");
+			denormals.add(std::string("feedback ") + (i == 0 ? "L" : "R") + " highpass");
+		}
 		for(int i=0;i<CHANNELS;i++) {
 			src[NUM_TAPS+i] = src_new(SRC_SINC_FASTEST, 2, NULL);
 
@@ -312,6 +471,16 @@ struct PortlandWeather : Module {
 
 		json_object_set_new(rootJ, "grainSize", json_real((float) grainSize));
 
+		json_object_set_new(rootJ, "delayChangeMode", json_integer(delayChangeMode));
+
+		json_object_set_new(rootJ, "crossfadeTime", json_real(crossfadeTime));
+
+		json_object_set_new(rootJ, "longDelays", json_boolean(longDelays));
+
+		json_object_set_new(rootJ, "historyFormat", json_integer(historyFormat));
+
+		json_object_set_new(rootJ, "filterSlope", json_integer(filterSlope));
+
 		for(int i=0;i<NUM_TAPS;i++) {
 			//This is so stupid!!! why did he not use strings?
 			char buf[100];
@@ -343,6 +512,31 @@ struct PortlandWeather : Module {
 			grainCount = json_integer_value(sumGc);			
 		}
 
+		json_t *delayChangeModeJ = json_object_get(rootJ, "delayChangeMode");
+		if (delayChangeModeJ) {
+			delayChangeMode = clamp((int) json_integer_value(delayChangeModeJ), (int) DELAY_CHANGE_GLIDE, (int) DELAY_CHANGE_JUMP);
+		}
+
+		json_t *crossfadeTimeJ = json_object_get(rootJ, "crossfadeTime");
+		if (crossfadeTimeJ) {
+			crossfadeTime = clamp((float) json_number_value(crossfadeTimeJ), FrozenWasteland::jumpCrossfadeTimes[0], FrozenWasteland::jumpCrossfadeTimes[FrozenWasteland::NUM_JUMP_CROSSFADES - 1]);
+		}
+
+		json_t *longDelaysJ = json_object_get(rootJ, "longDelays");
+		if (longDelaysJ) {
+			setLongDelays(json_boolean_value(longDelaysJ));
+		}
+
+		json_t *historyFormatJ = json_object_get(rootJ, "historyFormat");
+		if (historyFormatJ) {
+			setHistoryFormat(clamp((int) json_integer_value(historyFormatJ), 0, FrozenWasteland::NUM_STORAGE_FORMATS - 1));
+		}
+
+		json_t *filterSlopeJ = json_object_get(rootJ, "filterSlope");
+		if (filterSlopeJ) {
+			setFilterSlope(clamp((int) json_integer_value(filterSlopeJ), 0, NUM_FILTER_SLOPES - 1));
+		}
+
 		json_t *sumGs = json_object_get(rootJ, "grainSize");
 		if (sumGs) {
 			grainSize = json_real_value(sumGs);			
@@ -375,8 +569,13 @@ struct PortlandWeather : Module {
 	void process(const ProcessArgs &args) override {
 
 		if (clearBufferTrigger.process(params[CLEAR_BUFFER_PARAM].getValue())) {
-			historyBuffer.clear();
+			history->buffer.clear();
+			historyLength = 0;
 		}
+		if (history.pickUp()) {
+			historyLength = 0;
+		}
+		history->cold.setCapacity(longDelays ? (int64_t) (LONG_DELAY_SECONDS * args.sampleRate) : 0);
  
 
 		tapGroovePattern = (int)clamp(params[GROOVE_TYPE_PARAM].getValue() + (inputs[GROOVE_TYPE_CV_INPUT].isConnected() ?  inputs[GROOVE_TYPE_CV_INPUT].getVoltage() / 10.0f : 0.0f),0.0f,15.0);
@@ -408,7 +607,7 @@ struct PortlandWeather : Module {
 			}
 				
 		} else {
-			baseDelay = clamp(params[TIME_PARAM].getValue() + inputs[TIME_CV_INPUT].getVoltage(), 0.001f, HISTORY_SIZE / args.sampleRate);	
+			baseDelay = clamp(params[TIME_PARAM].getValue() + inputs[TIME_CV_INPUT].getVoltage(), 0.001f, longDelays ? (float) LONG_DELAY_SECONDS : HISTORY_SIZE / args.sampleRate);	
 			duration = 0.0f;
 			firstClockReceived = false;
 			secondClockReceived = false;			
@@ -439,9 +638,13 @@ struct PortlandWeather : Module {
 			reverse = !reverse;
 		}
 		lights[REVERSE_LIGHT].value = reverse;
-		if(reverse && reverse != reversePrevious) {
-			reverseHistoryBuffer[0].clear();
-			reverseHistoryBuffer[1].clear();		
+		for(int channel = 0;channel < CHANNELS;channel++) {
+			reverseHeads[channel].setLength(reverseLength[channel]);
+			if(reverse && reverse != reversePrevious) {
+				reverseHeads[channel].reset();
+			} else if(reverse) {
+				reverseHeads[channel].advance();
+			}
 		}
 
 		
@@ -469,40 +672,58 @@ struct PortlandWeather : Module {
 			feedbackPitch[channel] = floor(params[FEEDBACK_L_PITCH_SHIFT_PARAM+channel].getValue() + (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].getVoltage()*2.4f) : 0));
 			feedbackDetune[channel] = floor(params[FEEDBACK_L_DETUNE_PARAM+channel].getValue() + (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].getVoltage()*10.0f) : 0));		
 		}
-		FloatFrame dryToUse = dryFrame; //Normally the same as dry unless in reverse mode
-
-		// Push dry sample into reverse history buffers
-		reverseHistoryBuffer[0].push(dryFrame.l);
-		reverseHistoryBuffer[1].push(dryFrame.r);
-		if(reverse) {
-			FloatFrame reverseDry;
-			reverseDry.l = reverseHistoryBuffer[0].shift();
-			reverseDry.r = reverseHistoryBuffer[1].shift();
-			dryToUse = reverseDry;
-		}	
+		// Sleep through silence once the taps and feedback have nothing left to play
+		float inputPeak = std::max(std::max(std::fabs(inFrame.l), std::fabs(inFrame.r)), std::max(std::fabs(inputs[FEEDBACK_L_RETURN].getVoltage()), std::fabs(inputs[FEEDBACK_R_RETURN].getVoltage())));
+		if (silence.idle(inputPeak)) {
+			for(int tap = 0; tap < NUM_TAPS; tap++) {
+				updateTapSwitches(tap);
+			}
+			outputs[OUT_L_OUTPUT].setVoltage(0.0f);
+			outputs[OUT_R_OUTPUT].setVoltage(0.0f);
+			outputs[FEEDBACK_L_OUTPUT].setVoltage(0.0f);
+			outputs[FEEDBACK_R_OUTPUT].setVoltage(0.0f);
+			if(display.frameRequested())
+				publishDisplay();
+			return;
+		}
 
 		// Push dry sample into history buffer
-		if (!historyBuffer.full(NUM_TAPS-1)) {
-			historyBuffer.push(dryToUse);
+		if (!history->buffer.full(NUM_TAPS-1)) {
+			history->buffer.push(dryFrame);
+			history->cold.advance();
+			historyLength = std::min(historyLength + 1, (size_t) (longDelays ? LONG_DELAY_SECONDS * args.sampleRate : HISTORY_SIZE));
 		}
 
 
 		
 
+		bool jump = delayChangeMode == DELAY_CHANGE_JUMP && !reverse;
+		float crossfadeLength = crossfadeTime * args.sampleRate;
+
 		FloatFrame wet = {0.0f, 0.0f}; // This is the mix of delays and input that is outputed
 		FloatFrame feedbackValue = {0.0f, 0.0f}; // This is the output of a tap that gets sent back to input
 		float activeTapCount = 0.0f; // This will be used to normalize output
+		float longestDelay = 0.0f; // In seconds, how far back the taps and feedback are reading
+
+		if(filterSlope != lastFilterSlope) {
+			// Make every tap set its filter up again for the new slope
+			for(int tap = 0; tap < NUM_TAPS;tap++) {
+				lastFilterType[tap] = -1;
+				lastTapFc[tap] = -1.0f;
+				lastTapQ[tap] = -1.0f;
+				tapDesignKey[tap] = UINT32_MAX;
+				for(int channel=0;channel <CHANNELS;channel++) {
+					tapFilters.bypass(tap * CHANNELS + channel);
+				}
+			}
+			tapFilters.setStages(filterSlope == FILTER_SLOPE_48DB ? 4 : 2);
+			tapFilters.reset();
+			lastFilterSlope = filterSlope;
+		}
 		
 		for(int tap = 0; tap < NUM_TAPS;tap++) { 
 
-			// Stacking
-			if(params[STACK_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_STACK_CV_INPUT+tap].isConnected()) {
-				tapStacked[tap] = inputs[TAP_STACK_CV_INPUT+tap].getVoltage() > 0.0f;
-			}
-			//Button (or trigger) can override input
-			if (tap < NUM_TAPS -1 && stackingTrigger[tap].process(params[TAP_STACKED_PARAM+tap].getValue() + (params[STACK_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_STACK_CV_INPUT+tap].getVoltage() : 0.0f))) {
-				tapStacked[tap] = !tapStacked[tap];
-			}
+			updateTapSwitches(tap);
 
 			float pitch,detune;
 			pitch = floor(params[TAP_PITCH_SHIFT_PARAM+tap].getValue() + (inputs[TAP_PITCH_SHIFT_CV_INPUT+tap].isConnected() ? (inputs[TAP_PITCH_SHIFT_CV_INPUT+tap].getVoltage()*2.4f) : 0));
@@ -523,16 +744,33 @@ struct PortlandWeather : Module {
 			
 			
 			delayTime[tap] = (delay + delayMod); 
+			longestDelay = std::max(longestDelay, delayTime[tap]);
 
 			// if(tap == 0) { //TEST CODE
 			// 	testDelay = duration;
 			// }
 
 			float index = delayTime[tap] * args.sampleRate;
-			if(index > 0)
+			// Delays past the end of the ring are too long for the resampler, read them like jumps
+			bool direct = jump || (!reverse && index >= HOT_HISTORY_LIMIT);
+			bool directRestart = direct && !directPrevious[tap];
+			directPrevious[tap] = direct;
+			FloatFrame initialOutput = {0.0f, 0.0f};
+			if(reverse) {
+				// Reverse reads straight from the history, keep the resampler's read head in place for when it ends
+				if(index > 0) {
+					initialOutput = readReverse(tap, index);
+					holdResampler(tap, index);
+				}
+			} else if(direct) {
+				if(index > 0) {
+					initialOutput = readJump(tap, index, crossfadeLength, directRestart);
+					holdResampler(tap, index);
+				}
+			} else if(index > 0)
 			{
 				// How many samples do we need consume to catch up?
-				float consume = index - historyBuffer.size(tap);		
+				float consume = index - history->buffer.size(tap);		
 
 				if (outBuffer[tap].empty()) {
 					
@@ -542,20 +780,21 @@ struct PortlandWeather : Module {
 					}
 													
 
+					FloatFrame srcInput[16];
 					SRC_DATA srcData;
-					srcData.data_in = (const float*) historyBuffer.startData(tap);
+					srcData.input_frames = std::min((int) history->buffer.size(tap), 16);
+					history->buffer.read(tap, srcInput, srcData.input_frames);
+					srcData.data_in = (const float*) srcInput;
 					srcData.data_out = (float*) outBuffer[tap].endData();
-					srcData.input_frames = std::min((int) historyBuffer.size(tap), 16);
 					srcData.output_frames = outBuffer[tap].capacity();
 					srcData.end_of_input = false;
 					srcData.src_ratio = ratio;
 					src_process(src[tap], &srcData);
-					historyBuffer.startIncr(tap,srcData.input_frames_used);
+					history->buffer.startIncr(tap,srcData.input_frames_used);
 					outBuffer[tap].endIncr(srcData.output_frames_gen);
 				}
 			}
 			
-			FloatFrame initialOutput = {0.0f, 0.0f};
 			FloatFrame wetTap = {0.0f, 0.0f};
 			if (!outBuffer[tap].empty()) {
 				initialOutput = outBuffer[tap].shift();
@@ -585,63 +824,81 @@ struct PortlandWeather : Module {
 			wetTap.r = wetTap.r;		        	
 					
 
-			// Muting
-			if(params[MUTE_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_MUTE_CV_INPUT+tap].isConnected()) {
-				tapMuted[tap] = inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() > 0.0f;
-			}
-			//Button (or trigger) can override input
-			if (mutingTrigger[tap].process(params[TAP_MUTE_PARAM+tap].getValue() + (inputs[TAP_MUTE_CV_INPUT+tap].isConnected() && params[MUTE_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() : 0))) {
-				tapMuted[tap] = !tapMuted[tap];
-				// if(!tapMuted[tap]) {
-				// 	activeTapCount +=1.0f;
-				// }
-			}			
-
 			//Each tap - channel has its own filter
 			int tapFilterType = (int)params[TAP_FILTER_TYPE_PARAM+tap].getValue();
 			// Apply Filter to tap wet output			
 			if(tapFilterType != FILTER_NONE) {
-				if(tapFilterType != lastFilterType[tap]) {
-					switch(tapFilterType) {
-						case FILTER_LOWPASS:
-						filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::LowPass);
-						break;
-						case FILTER_HIGHPASS:
-						filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::HiPass);
-						break;
-						case FILTER_BANDPASS:
-						filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::BandPass);
-						break;
-						case FILTER_NOTCH:
-						filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::Notch);
-						break;
-					}					
-				}
-
 				float cutoffExp = clamp(params[TAP_FC_PARAM+tap].getValue() + inputs[TAP_FC_CV_INPUT+tap].getVoltage() / 10.0f,0.0f,1.0f); 
 				float tapFc = minCutoff * powf(maxCutoff / minCutoff, cutoffExp) / args.sampleRate;
-				if(lastTapFc[tap] != tapFc) {
-					filterParams[tap].setFreq(T(tapFc));
-					lastTapFc[tap] = tapFc;
-				}
 				float tapQ = clamp(params[TAP_Q_PARAM+tap].getValue() + (inputs[TAP_Q_CV_INPUT+tap].getVoltage() / 10.0f),0.01f,1.0f) * 50; 
-				if(lastTapQ[tap] != tapQ) {
-					filterParams[tap].setQ(tapQ); 
-					lastTapQ[tap] = tapQ;
-				}
-				for(int channel=0;channel <CHANNELS;channel++) {		
-					if(channel == 0) {
-						wetTap.l = StateVariableFilter<T>::run(wetTap.l, filterStates[tap][channel], filterParams[tap]);
+				if(filterSlope == FILTER_SLOPE_12DB) {
+					if(tapFilterType != lastFilterType[tap]) {
+						switch(tapFilterType) {
+							case FILTER_LOWPASS:
+							filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::LowPass);
+							break;
+							case FILTER_HIGHPASS:
+							filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::HiPass);
+							break;
+							case FILTER_BANDPASS:
+							filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::BandPass);
+							break;
+							case FILTER_NOTCH:
+							filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::Notch);
+							break;
+						}					
+					}
+					if(lastTapFc[tap] != tapFc) {
+						filterParams[tap].setFreq(T(tapFc));
+						lastTapFc[tap] = tapFc;
+					}
+					if(lastTapQ[tap] != tapQ) {
+						filterParams[tap].setQ(tapQ); 
+						lastTapQ[tap] = tapQ;
+					}
+					for(int channel=0;channel <CHANNELS;channel++) {		
+						if(channel == 0) {
+							wetTap.l = StateVariableFilter<T>::run(wetTap.l, filterStates[tap][channel], filterParams[tap]);
+						} else {
+							wetTap.r = StateVariableFilter<T>::run(wetTap.r, filterStates[tap][channel], filterParams[tap]);
+						}
+					}
+				} else if(tapFilterType != lastFilterType[tap] || lastTapFc[tap] != tapFc || lastTapQ[tap] != tapQ) {
+					// Steep filters run for all taps at once below, designs are cached so modulating them stays cheap
+					uint32_t designKey = tapFilterDesigns.key(tapFilterType - FILTER_LOWPASS, filterSlope == FILTER_SLOPE_48DB ? 4 : 2, tapFc, tapQ);
+					FrozenWasteland::CascadeDesign<MAX_FILTER_STAGES> design;
+					if(designKey == tapDesignKey[tap]) {
+						lastTapFc[tap] = tapFc;
+						lastTapQ[tap] = tapQ;
+					} else if(tapFilterDesigns.load(designKey, design)) {
+						for(int channel=0;channel <CHANNELS;channel++) {
+							tapFilters.set(tap * CHANNELS + channel, design);
+						}
+						tapDesignKey[tap] = designKey;
+						lastTapFc[tap] = tapFc;
+						lastTapQ[tap] = tapQ;
 					} else {
-						wetTap.r = StateVariableFilter<T>::run(wetTap.r, filterStates[tap][channel], filterParams[tap]);
+						// Not designed yet, keep the old coefficients and look again next sample
+						lastTapFc[tap] = -1.0f;
 					}
 				}
+			} else if(filterSlope != FILTER_SLOPE_12DB && lastFilterType[tap] != FILTER_NONE) {
+				for(int channel=0;channel <CHANNELS;channel++) {
+					tapFilters.bypass(tap * CHANNELS + channel);
+				}
+				tapDesignKey[tap] = UINT32_MAX;
 			}
 			lastFilterType[tap] = tapFilterType;
 
-			
+			tapOutput[tap] = wetTap;
+		}
 
+		if(filterSlope != FILTER_SLOPE_12DB) {
+			tapFilters.process((float*) tapOutput);
+		}
 
+		for(int tap = 0; tap < NUM_TAPS;tap++) { 
+			FloatFrame wetTap = tapOutput[tap];
 			if(!tapMuted[tap])  {
 				float pan = clamp((params[TAP_PAN_PARAM+tap].getValue() + (inputs[TAP_PAN_CV_INPUT+tap].isConnected() ? (inputs[TAP_PAN_CV_INPUT+tap].getVoltage() / 10.0f) : 0)),0.0f,1.0f);
 				wetTap.l = wetTap.l * clamp(params[TAP_MIX_PARAM+tap].getValue() + (inputs[TAP_MIX_CV_INPUT+tap].isConnected() ? (inputs[TAP_MIX_CV_INPUT+tap].getVoltage() / 10.0f) : 0),0.0f,1.0f) * (1.0 - pan);
@@ -653,11 +910,6 @@ struct PortlandWeather : Module {
 
 			wet.l += wetTap.l;
 			wet.r += wetTap.r;
-		
-
-			lights[TAP_STACKED_LIGHT+tap].value = tapStacked[tap];
-			lights[TAP_MUTED_LIGHT+tap].value = (tapMuted[tap]);	
-
 		}
 
 				
@@ -686,10 +938,23 @@ struct PortlandWeather : Module {
 			
 
 				float index = delay * args.sampleRate;
-				if(index > 0)
+				bool direct = jump || (!reverse && index >= HOT_HISTORY_LIMIT);
+				bool directRestart = direct && !directPrevious[NUM_TAPS+channel];
+				directPrevious[NUM_TAPS+channel] = direct;
+				if(reverse || direct) {
+					if(index > 0) {
+						FloatFrame directOutput = reverse ? readReverse(NUM_TAPS+channel, index) : readJump(NUM_TAPS+channel, index, crossfadeLength, directRestart);
+						if(channel == 0) {
+							initialFBOutput.l = directOutput.l;
+						} else {
+							initialFBOutput.r = directOutput.r;
+						}
+						holdResampler(NUM_TAPS+channel, index);
+					}
+				} else if(index > 0)
 				{
 					// How many samples do we need consume to catch up?
-					float consume = index - historyBuffer.size(NUM_TAPS+channel);		
+					float consume = index - history->buffer.size(NUM_TAPS+channel);		
 
 					if (outBuffer[NUM_TAPS+channel].empty()) {
 										
@@ -698,15 +963,17 @@ struct PortlandWeather : Module {
 							ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f)) ; 
 						}
 														
+						FloatFrame srcInput[16];
 						SRC_DATA srcData;
-						srcData.data_in = (const float*) historyBuffer.startData(NUM_TAPS+channel);
+						srcData.input_frames = std::min((int) history->buffer.size(NUM_TAPS+channel), 16);
+						history->buffer.read(NUM_TAPS+channel, srcInput, srcData.input_frames);
+						srcData.data_in = (const float*) srcInput;
 						srcData.data_out = (float*) outBuffer[NUM_TAPS+channel].endData();
-						srcData.input_frames = std::min((int) historyBuffer.size(NUM_TAPS+channel), 16);
 						srcData.output_frames = outBuffer[NUM_TAPS+channel].capacity();
 						srcData.end_of_input = false;
 						srcData.src_ratio = ratio;
 						src_process(src[NUM_TAPS+channel], &srcData);
-						historyBuffer.startIncr(NUM_TAPS+channel,srcData.input_frames_used);
+						history->buffer.startIncr(NUM_TAPS+channel,srcData.input_frames_used);
 						outBuffer[NUM_TAPS+channel].endIncr(srcData.output_frames_gen);
 					}
 				}
@@ -734,7 +1001,8 @@ struct PortlandWeather : Module {
 			
 		
 			//Set reverse size = delay of feedback
-			reverseHistoryBuffer[channel].setDelaySize((delay) * args.sampleRate);			
+			reverseLength[channel] = delay * args.sampleRate;
+			longestDelay = std::max(longestDelay, delay);
 
 		
 
@@ -832,6 +1100,45 @@ struct PortlandWeather : Module {
 		outputs[OUT_L_OUTPUT].setVoltage(outL);
 		outputs[OUT_R_OUTPUT].setVoltage(outR);
 
+		for(int tap=0;tap<NUM_TAPS;tap++) {
+			for(int channel=0;channel<CHANNELS;channel++) {
+				denormals.check(tap, filterStates[tap][channel].z1);
+				denormals.check(tap, filterStates[tap][channel].z2);
+			}
+		}
+		for(int i=0;i<CHANNELS;i++) {
+			denormals.check(NUM_TAPS + i * 2, lowpassFilter[i].ystate[0]);
+			denormals.check(NUM_TAPS + i * 2 + 1, highpassFilter[i].ystate[0]);
+		}
+		denormals.tick(args.sampleRate);
+
+		// Reverse reads up to twice the delay back, the grains up to their size
+		silence.setHold((reverse ? 2.0f : 1.0f) * longestDelay + (float) MAX_GRAIN_SIZE / args.sampleRate + 1.0f, args.sampleRate);
+		float peak = std::max(std::max(std::fabs(outL), std::fabs(outR)), std::max(std::fabs(lastFeedback.l), std::fabs(lastFeedback.r)));
+		if (silence.update(std::max(std::max(peak, inputPeak), std::max(std::fabs(wet.l), std::fabs(wet.r))))) {
+			// Whatever is left is below the threshold. Direct reads treat the time asleep as silence
+			historyLength = 0;
+			lastFeedback = {0.0f, 0.0f};
+		}
+
+		if(display.frameRequested())
+			publishDisplay();
+	}
+
+	void publishDisplay() {
+		DisplayFrame &frame = display.writeBuffer();
+		frame.division = division;
+		frame.baseDelay = baseDelay;
+		frame.tapGroovePattern = tapGroovePattern;
+		for(int channel = 0; channel < CHANNELS; channel++) {
+			frame.feedbackTap[channel] = feedbackTap[channel];
+			frame.feedbackPitch[channel] = feedbackPitch[channel];
+			frame.feedbackDetune[channel] = feedbackDetune[channel];
+		}
+		for(int tap = 0; tap < NUM_TAPS; tap++) {
+			frame.filterType[tap] = lastFilterType[tap];
+		}
+		display.publish();
 	}
 };
 
@@ -900,7 +1207,7 @@ struct PWStatusDisplay : TransparentWidget {
 		nvgText(args.vg, pos.x, pos.y, text, NULL);
 	}
 
-	void drawFeedbackTaps(const DrawArgs &args, Vec pos, int *feedbackTaps) {
+	void drawFeedbackTaps(const DrawArgs &args, Vec pos, const int *feedbackTaps) {
 		nvgFontSize(args.vg, 12);
 		nvgFontFaceId(args.vg, fontText->handle);
 		nvgTextLetterSpacing(args.vg, -2);
@@ -913,7 +1220,7 @@ struct PWStatusDisplay : TransparentWidget {
 		}
 	}
 
-	void drawFeedbackPitch(const DrawArgs &args, Vec pos, float *feedbackPitch) {
+	void drawFeedbackPitch(const DrawArgs &args, Vec pos, const float *feedbackPitch) {
 		nvgFontSize(args.vg, 12);
 		nvgFontFaceId(args.vg, fontText->handle);
 		nvgTextLetterSpacing(args.vg, -2);
@@ -926,7 +1233,7 @@ struct PWStatusDisplay : TransparentWidget {
 		nvgText(args.vg, pos.x + 45, pos.y, text, NULL);
 	}
 
-	void drawFeedbackDetune(const DrawArgs &args, Vec pos, float *feedbackDetune) {
+	void drawFeedbackDetune(const DrawArgs &args, Vec pos, const float *feedbackDetune) {
 		nvgFontSize(args.vg, 12);
 		nvgFontFaceId(args.vg, fontText->handle);
 		nvgTextLetterSpacing(args.vg, -2);
@@ -940,7 +1247,7 @@ struct PWStatusDisplay : TransparentWidget {
 	}
 
 
-	void drawFilterTypes(const DrawArgs &args, Vec pos, int *filterType) {
+	void drawFilterTypes(const DrawArgs &args, Vec pos, const int *filterType) {
 		nvgFontSize(args.vg, 10);
 		nvgFontFaceId(args.vg, fontText->handle);
 		nvgTextLetterSpacing(args.vg, -2);
@@ -986,15 +1293,19 @@ struct PWStatusDisplay : TransparentWidget {
 		if (!module)
 			return;
 		
-		drawDivision(args, Vec(100,65), module->division);
+		module->display.requestFrame();
+		module->display.update();
+		const PortlandWeather::DisplayFrame &frame = module->display.readBuffer();
+		
+		drawDivision(args, Vec(100,65), frame.division);
 		//drawDelayTime(args, Vec(82,65), module->testDelay);
-		drawDelayTime(args, Vec(82,127), module->baseDelay);
-		drawGrooveType(args, Vec(95,203), module->tapGroovePattern);
-		drawFeedbackTaps(args, Vec(292,174), module->feedbackTap);
-		drawFeedbackPitch(args, Vec(292,254), module->feedbackPitch);
-		drawFeedbackDetune(args, Vec(292,295), module->feedbackDetune);
+		drawDelayTime(args, Vec(82,127), frame.baseDelay);
+		drawGrooveType(args, Vec(95,203), frame.tapGroovePattern);
+		drawFeedbackTaps(args, Vec(292,174), frame.feedbackTap);
+		drawFeedbackPitch(args, Vec(292,254), frame.feedbackPitch);
+		drawFeedbackDetune(args, Vec(292,295), frame.feedbackDetune);
 		
-		drawFilterTypes(args, Vec(490,210), module->lastFilterType);
+		drawFilterTypes(args, Vec(490,210), frame.filterType);
 		//drawTapPitchShift(args, Vec(513,320), module->tapPitchShift);
 		//drawTapDetune(args, Vec(513,360), module->tapDetune);
 	}
@@ -1002,8 +1313,13 @@ struct PWStatusDisplay : TransparentWidget {
 
 
 struct PortlandWeatherWidget : ModuleWidget {
+	void step() override {
+		PortlandWeather *module = dynamic_cast<PortlandWeather*>(this->module);
+		if (module)
+			module->history.collect();
+		ModuleWidget::step();
+	}
 
-	
 
 	PortlandWeatherWidget(PortlandWeather *module) {
 		setModule(module);
@@ -1154,6 +1470,27 @@ struct PortlandWeatherWidget : ModuleWidget {
 		}
 	};
 
+	struct LongDelaysItem : MenuItem {
+		PortlandWeather *module;
+		void onAction(const event::Action &e) override {
+			module->setLongDelays(!module->longDelays);
+		}
+		void step() override {
+			rightText = module->longDelays ? "✔" : "";
+		}
+	};
+
+	struct FilterSlopeItem : MenuItem {
+		PortlandWeather *module;
+		int filterSlope;
+		void onAction(const event::Action &e) override {
+			module->setFilterSlope(filterSlope);
+		}
+		void step() override {
+			rightText = (module->filterSlope == filterSlope) ? "✔" : "";
+		}
+	};
+
 	// struct GrainSizeItem : MenuItem {
 	// 	PortlandWeather *module;
 	// 	void onAction(const event::Action &e) override {
@@ -1174,6 +1511,12 @@ struct PortlandWeatherWidget : ModuleWidget {
 		PortlandWeather *module = dynamic_cast<PortlandWeather*>(this->module);
 		assert(module);
 
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+
+		menu->addChild(new MenuLabel());// empty line
+
 		MenuLabel *themeLabel = new MenuLabel();
 		themeLabel->text = "Grain Count";
 		menu->addChild(themeLabel);
@@ -1233,6 +1576,35 @@ struct PortlandWeatherWidget : ModuleWidget {
 		grainSize4Item->grainSize= 1.0f;
 		menu->addChild(grainSize4Item);
 
+		menu->addChild(new MenuLabel());// empty line
+
+		FrozenWasteland::appendDelayChangeMenu(menu, module);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		LongDelaysItem *longDelaysItem = new LongDelaysItem();
+		longDelaysItem->text = "Long Delays (up to 10 min)";
+		longDelaysItem->module = module;
+		menu->addChild(longDelaysItem);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		FrozenWasteland::appendHistoryFormatMenu(menu, module);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		MenuLabel *filterSlopeLabel = new MenuLabel();
+		filterSlopeLabel->text = "Tap Filter Slope";
+		menu->addChild(filterSlopeLabel);
+
+		for (int i = 0; i < PortlandWeather::NUM_FILTER_SLOPES; i++) {
+			FilterSlopeItem *filterSlopeItem = new FilterSlopeItem();
+			filterSlopeItem->text = module->filterSlopeNames[i];
+			filterSlopeItem->module = module;
+			filterSlopeItem->filterSlope = i;
+			menu->addChild(filterSlopeItem);
+		}
+
 		// DelayDisplayNoteItem *ddnItem = createMenuItem<DelayDisplayNoteItem>("Display delay values in notes", CHECKMARK(module->displayDelayNoteMode));
 		// ddnItem->module = module;
 		// menu->addChild(ddnItem);
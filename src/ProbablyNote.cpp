@@ -1,7 +1,10 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed_menu.hpp"
+#include "ui/snapshot.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/random.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -112,6 +115,9 @@ struct ProbablyNote : Module {
 	dsp::SchmittTrigger clockTrigger,resetScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,keyScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
     GaussianNoiseGenerator _gauss;
+    Random random;
+    //The seed is only saved, and a loaded patch only replays it, when the menu locks it
+    bool lockSeed = false;
  
     bool octaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
@@ -149,6 +155,18 @@ struct ProbablyNote : Module {
 
 	bool useCircleLayout = false;
 
+	//What the display draws, copied out at the end of a sample when it asks for a frame
+	struct DisplayFrame {
+		int scale;
+		bool shifted;
+		int lastKey;
+		int transposedKey;
+		int key;
+		int probabilityNote;
+		float noteInitialProbability[MAX_NOTES];
+	};
+	FrozenWasteland::SnapshotBuffer<DisplayFrame> display;
+
 	bool generateChords = false;
 	float dissonance5Prbability = 0.0;
 	float dissonance7Prbability = 0.0;
@@ -187,8 +205,6 @@ struct ProbablyNote : Module {
 		configParam(ProbablyNote::TEMPERMENT_PARAM, 0.0, 1.0, 0.0,"Just Intonation");
 		configParam(ProbablyNote::WEIGHT_SCALING_PARAM, 0.0, 1.0, 0.0,"Weight Scaling","%",0,100);
 
-        srand(time(NULL));
-
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNote::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
             configParam(ProbablyNote::NOTE_WEIGHT_PARAM + i, 0.0, 1.0, 0.0,"Note Weight");		
@@ -266,6 +282,10 @@ struct ProbablyNote : Module {
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
+		json_object_set_new(rootJ, "lockSeed", json_boolean(lockSeed));
+		if (lockSeed)
+			json_object_set_new(rootJ, "randomSeed", json_integer((json_int_t) random.getSeed()));
+
 		json_object_set_new(rootJ, "octaveWrapAround", json_integer((int) octaveWrapAround));
 		json_object_set_new(rootJ, "justIntonation", json_integer((int) justIntonation));
 		json_object_set_new(rootJ, "shiftLogarithmic", json_integer((int) shiftLogarithmic));
@@ -292,6 +312,14 @@ struct ProbablyNote : Module {
 
 	void dataFromJson(json_t *rootJ) override {
 
+		json_t *lockSeedJ = json_object_get(rootJ, "lockSeed");
+		if (lockSeedJ)
+			lockSeed = json_boolean_value(lockSeedJ);
+		json_t *seedJ = json_object_get(rootJ, "randomSeed");
+		if (lockSeed && seedJ) {
+			random.seed((uint64_t) json_integer_value(seedJ));
+		}
+
 		json_t *sumO = json_object_get(rootJ, "octaveWrapAround");
 		if (sumO) {
 			octaveWrapAround = json_integer_value(sumO);			
@@ -578,7 +606,7 @@ struct ProbablyNote : Module {
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].getVoltage()) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
@@ -617,22 +645,22 @@ struct ProbablyNote : Module {
 					outputs[QUANT_OUTPUT].setChannels(4);
 					outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV,0);
 
-					float rndDissonance5 = ((float) rand()/RAND_MAX);
+					float rndDissonance5 = random.uniform();
 					if(externalDissonance5Random != -1)
 						rndDissonance5 = externalDissonance5Random;
 
-					float rndDissonance7 = ((float) rand()/RAND_MAX);
+					float rndDissonance7 = random.uniform();
 					if(externalDissonance7Random != -1)
 						rndDissonance7 = externalDissonance7Random;
 
-					float rndSuspension = ((float) rand()/RAND_MAX);
+					float rndSuspension = random.uniform();
 					if(externalSuspensionRandom != -1)
 						rndSuspension = externalSuspensionRandom;
-					//float rndInversion = ((float) rand()/RAND_MAX);
+					//float rndInversion = random.uniform();
 
 					int secondNote = nextActiveNote(randomNote,2);					
 					if(rndSuspension < suspensionProbability) {
-						float secondOrFourth = ((float) rand()/RAND_MAX);
+						float secondOrFourth = random.uniform();
 						if(secondOrFourth > 0.5) {
 							thirdOffset = 1;
 							secondNote = nextActiveNote(randomNote,3);
@@ -650,7 +678,7 @@ struct ProbablyNote : Module {
 
 					int thirdNote = nextActiveNote(randomNote,4);
 					if(rndDissonance5 < dissonance5Prbability) {
-						float flatOrSharp = ((float) rand()/RAND_MAX);
+						float flatOrSharp = random.uniform();
 						fifthOffset = -1;
 						if(flatOrSharp > 0.5) {
 							fifthOffset = 1;
@@ -668,7 +696,7 @@ struct ProbablyNote : Module {
 
 					int fourthNote = nextActiveNote(randomNote,6);
 					if(rndDissonance7 < dissonance7Prbability) {
-						float flatOrSharp = ((float) rand()/RAND_MAX);
+						float flatOrSharp = random.uniform();
 						seventhOffset = -1;
 						if(flatOrSharp > 0.5) {
 							seventhOffset = 1;
@@ -700,6 +728,19 @@ struct ProbablyNote : Module {
 		
 		}
 
+		if(display.frameRequested()) {
+			DisplayFrame &frame = display.writeBuffer();
+			frame.scale = lastScale;
+			frame.shifted = lastWeightShift != 0;
+			frame.lastKey = lastKey;
+			frame.transposedKey = transposedKey;
+			frame.key = key;
+			frame.probabilityNote = probabilityNote;
+			for(int i = 0; i < MAX_NOTES; i++) {
+				frame.noteInitialProbability[i] = noteInitialProbability[i];
+			}
+			display.publish();
+		}
 	}
 
 	// For more advanced Module features, see engine/Module.hpp in the Rack API.
@@ -793,7 +834,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 
 	
 
-	void drawNoteRangeNormal(const DrawArgs &args, float *noteInitialProbability) 
+	void drawNoteRangeNormal(const DrawArgs &args, const float *noteInitialProbability, int probabilityNote) 
 	{		
 		// Draw indicator
 		for(int i = 0; i<MAX_NOTES;i++) {
@@ -801,7 +842,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 
 			float opacity = noteInitialProbability[i] * 255;
 			nvgFillColor(args.vg, nvgRGBA(0xff, 0xff, 0x20, (int)opacity));
-			if(i == module->probabilityNote) {
+			if(i == probabilityNote) {
 				nvgFillColor(args.vg, nvgRGBA(0x20, 0xff, 0x20, (int)opacity));
 			}
 			switch(i) {
@@ -966,7 +1007,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 		}
 	}
 
-	void drawNoteRangeCircular(const DrawArgs &args, float *noteInitialProbability, int key) 
+	void drawNoteRangeCircular(const DrawArgs &args, const float *noteInitialProbability, int key, int probabilityNote) 
 	{		
 		float notePosition[MAX_NOTES][3] = {
 			{103,163,NVG_ALIGN_LEFT},
@@ -991,7 +1032,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 
 			float opacity = noteInitialProbability[actualTarget] * 255;
 			nvgFillColor(args.vg, nvgRGBA(0xff, 0xff, 0x20, (int)opacity));
-			if(actualTarget == module->probabilityNote) {
+			if(actualTarget == probabilityNote) {
 				nvgFillColor(args.vg, nvgRGBA(0x20, 0xff, 0x20, (int)opacity));
 			}
 
@@ -1031,13 +1072,17 @@ struct ProbablyNoteWidget : ModuleWidget {
 		if (!module)
 			return; 
 
-		drawScale(args, Vec(4,84), module->lastScale, module->lastWeightShift != 0);
-		drawKey(args, Vec(72,84), module->lastKey, module->transposedKey);
+		module->display.requestFrame();
+		module->display.update();
+		const ProbablyNote::DisplayFrame &frame = module->display.readBuffer();
+
+		drawScale(args, Vec(4,84), frame.scale, frame.shifted);
+		drawKey(args, Vec(72,84), frame.lastKey, frame.transposedKey);
 		//drawOctave(args, Vec(66, 280), module->octave);
 		if(module->useCircleLayout) {
-			drawNoteRangeCircular(args, module->noteInitialProbability, module->key);
+			drawNoteRangeCircular(args, frame.noteInitialProbability, frame.key, frame.probabilityNote);
 		} else {
-			drawNoteRangeNormal(args, module->noteInitialProbability);
+			drawNoteRangeNormal(args, frame.noteInitialProbability, frame.probabilityNote);
 		}
 	}
 };
@@ -1478,6 +1523,10 @@ struct ProbablyNoteWidget : ModuleWidget {
 		pnLayout2Item->module = module;
 		pnLayout2Item->layout= true;
 		menu->addChild(pnLayout2Item);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		FrozenWasteland::appendSeedMenu(menu, module);
 			
 	}
 };
@@ -1,7 +1,9 @@
  #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed_menu.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/random.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -100,6 +102,9 @@ struct ProbablyNoteArabic : Module {
 	dsp::SchmittTrigger clockTrigger,writeScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
     GaussianNoiseGenerator _gauss;
+    Random random;
+    //The seed is only saved, and a loaded patch only replays it, when the menu locks it
+    bool lockSeed = false;
  
     bool octaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
@@ -150,7 +155,6 @@ struct ProbablyNoteArabic : Module {
 		configParam(ProbablyNoteArabic::OCTAVE_WRAPAROUND_PARAM, 0.0, 1.0, 0.0,"Octave Wraparound");
 		
 
-        srand(time(NULL));
 
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNoteArabic::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
@@ -185,6 +189,10 @@ struct ProbablyNoteArabic : Module {
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
+		json_object_set_new(rootJ, "lockSeed", json_boolean(lockSeed));
+		if (lockSeed)
+			json_object_set_new(rootJ, "randomSeed", json_integer((json_int_t) random.getSeed()));
+
 		json_object_set_new(rootJ, "octaveWrapAround", json_integer((int) octaveWrapAround));
 		json_object_set_new(rootJ, "justIntonation", json_integer((int) justIntonation));
 		json_object_set_new(rootJ, "shiftLogarithmic", json_integer((int) shiftLogarithmic));
@@ -206,6 +214,14 @@ struct ProbablyNoteArabic : Module {
 
 	void dataFromJson(json_t *rootJ) override {
 
+		json_t *lockSeedJ = json_object_get(rootJ, "lockSeed");
+		if (lockSeedJ)
+			lockSeed = json_boolean_value(lockSeedJ);
+		json_t *seedJ = json_object_get(rootJ, "randomSeed");
+		if (lockSeed && seedJ) {
+			random.seed((uint64_t) json_integer_value(seedJ));
+		}
+
 		json_t *sumO = json_object_get(rootJ, "octaveWrapAround");
 		if (sumO) {
 			octaveWrapAround = json_integer_value(sumO);			
@@ -426,7 +442,7 @@ struct ProbablyNoteArabic : Module {
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].value) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
@@ -948,6 +964,16 @@ struct ProbablyNoteArabicWidget : ModuleWidget {
 
 			
 	// }
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		ProbablyNoteArabic *module = dynamic_cast<ProbablyNoteArabic*>(this->module);
+		assert(module);
+
+		FrozenWasteland::appendSeedMenu(menu, module);
+	}
 };
 
 
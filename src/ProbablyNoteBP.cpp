@@ -1,7 +1,10 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed_menu.hpp"
+#include "ui/snapshot.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/random.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -108,6 +111,9 @@ struct ProbablyNoteBP : Module {
 	dsp::SchmittTrigger clockTrigger,resetScaleTrigger,tritaveWrapAroundTrigger,tempermentTrigger,tritaveMappingTrigger,shiftScalingTrigger,keyScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
     GaussianNoiseGenerator _gauss;
+    Random random;
+    //The seed is only saved, and a loaded patch only replays it, when the menu locks it
+    bool lockSeed = false;
  
     bool tritaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
@@ -144,6 +150,18 @@ struct ProbablyNoteBP : Module {
 	bool keyLogarithmic = false;
 	bool tritaveMapping = true;
 
+	//What the display draws, copied out at the end of a sample when it asks for a frame
+	struct DisplayFrame {
+		int scale;
+		bool shifted;
+		int lastKey;
+		int transposedKey;
+		int key;
+		int probabilityNote;
+		float noteInitialProbability[MAX_NOTES];
+	};
+	FrozenWasteland::SnapshotBuffer<DisplayFrame> display;
+
 
 	std::string lastPath;
     
@@ -169,8 +187,6 @@ struct ProbablyNoteBP : Module {
 		configParam(ProbablyNoteBP::TEMPERMENT_PARAM, 0.0, 1.0, 0.0,"Just Intonation");
 		configParam(ProbablyNoteBP::WEIGHT_SCALING_PARAM, 0.0, 1.0, 0.0,"Weight Scaling","%",0,100);
 
-        srand(time(NULL));
-
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNoteBP::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
             configParam(ProbablyNoteBP::NOTE_WEIGHT_PARAM + i, 0.0, 1.0, 0.0,"Note Weight");		
@@ -244,6 +260,10 @@ struct ProbablyNoteBP : Module {
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
+		json_object_set_new(rootJ, "lockSeed", json_boolean(lockSeed));
+		if (lockSeed)
+			json_object_set_new(rootJ, "randomSeed", json_integer((json_int_t) random.getSeed()));
+
 		json_object_set_new(rootJ, "tritaveWrapAround", json_integer((int) tritaveWrapAround));
 		json_object_set_new(rootJ, "justIntonation", json_integer((int) justIntonation));
 		json_object_set_new(rootJ, "shiftLogarithmic", json_integer((int) shiftLogarithmic));
@@ -267,6 +287,14 @@ struct ProbablyNoteBP : Module {
 
 	void dataFromJson(json_t *rootJ) override {
 
+		json_t *lockSeedJ = json_object_get(rootJ, "lockSeed");
+		if (lockSeedJ)
+			lockSeed = json_boolean_value(lockSeedJ);
+		json_t *seedJ = json_object_get(rootJ, "randomSeed");
+		if (lockSeed && seedJ) {
+			random.seed((uint64_t) json_integer_value(seedJ));
+		}
+
 		json_t *sumO = json_object_get(rootJ, "tritaveWrapAround");
 		if (sumO) {
 			tritaveWrapAround = json_integer_value(sumO);			
@@ -535,7 +563,7 @@ struct ProbablyNoteBP : Module {
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].value) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
@@ -582,6 +610,19 @@ struct ProbablyNoteBP : Module {
 			outputs[NOTE_CHANGE_OUTPUT].setVoltage(noteChangePulse.process(1.0 / args.sampleRate) ? 10.0 : 0);
 		}
 
+		if(display.frameRequested()) {
+			DisplayFrame &frame = display.writeBuffer();
+			frame.scale = scale;
+			frame.shifted = weightShift != 0;
+			frame.lastKey = lastKey;
+			frame.transposedKey = transposedKey;
+			frame.key = key;
+			frame.probabilityNote = probabilityNote;
+			for(int i = 0; i < MAX_NOTES; i++) {
+				frame.noteInitialProbability[i] = noteInitialProbability[i];
+			}
+			display.publish();
+		}
 	}
 
 	// For more advanced Module features, see engine/Module.hpp in the Rack API.
@@ -660,7 +701,7 @@ struct ProbablyNoteBPDisplay : TransparentWidget {
 
 	
 
-	void drawNoteRange(const DrawArgs &args, float *noteInitialProbability, int key) 
+	void drawNoteRange(const DrawArgs &args, const float *noteInitialProbability, int key, int probabilityNote) 
 	{		
 		float notePosition[MAX_NOTES][3] = {
 			{103,163,NVG_ALIGN_LEFT},
@@ -686,7 +727,7 @@ struct ProbablyNoteBPDisplay : TransparentWidget {
 
 			float opacity = noteInitialProbability[actualTarget] * 255;
 			nvgFillColor(args.vg, nvgRGBA(0xff, 0xff, 0x20, (int)opacity));
-			if(actualTarget == module->probabilityNote) {
+			if(actualTarget == probabilityNote) {
 				nvgFillColor(args.vg, nvgRGBA(0x20, 0xff, 0x20, (int)opacity));
 			}
 
@@ -727,10 +768,14 @@ struct ProbablyNoteBPDisplay : TransparentWidget {
 		if (!module)
 			return; 
 
-		drawScale(args, Vec(4,83), module->scale, module->weightShift != 0);
-		drawKey(args, Vec(72,84), module->lastKey, module->transposedKey);
+		module->display.requestFrame();
+		module->display.update();
+		const ProbablyNoteBP::DisplayFrame &frame = module->display.readBuffer();
+
+		drawScale(args, Vec(4,83), frame.scale, frame.shifted);
+		drawKey(args, Vec(72,84), frame.lastKey, frame.transposedKey);
 		//drawTritave(args, Vec(66, 280), module->tritave);
-		drawNoteRange(args, module->noteInitialProbability, module->key);
+		drawNoteRange(args, frame.noteInitialProbability, frame.key, frame.probabilityNote);
 	}
 };
 
@@ -842,6 +887,16 @@ struct ProbablyNoteBPWidget : ModuleWidget {
 
 	}
 
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		ProbablyNoteBP *module = dynamic_cast<ProbablyNoteBP*>(this->module);
+		assert(module);
+
+		FrozenWasteland::appendSeedMenu(menu, module);
+	}
+
 	
 };
 
@@ -1,7 +1,9 @@
  #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed_menu.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/random.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -98,6 +100,9 @@ struct ProbablyNoteIndian : Module {
 	dsp::SchmittTrigger clockTrigger,writeScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
     GaussianNoiseGenerator _gauss;
+    Random random;
+    //The seed is only saved, and a loaded patch only replays it, when the menu locks it
+    bool lockSeed = false;
  
     bool octaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
@@ -146,8 +151,6 @@ struct ProbablyNoteIndian : Module {
 		configParam(ProbablyNoteIndian::OCTAVE_WRAPAROUND_PARAM, 0.0, 1.0, 0.0,"Octave Wraparound");
 		configParam(ProbablyNoteIndian::TEMPERMENT_PARAM, 0.0, 1.0, 0.0,"Just Intonation");
 
-        srand(time(NULL));
-
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNoteIndian::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
             configParam(ProbablyNoteIndian::NOTE_WEIGHT_PARAM + i, 0.0, 1.0, 0.0,"Note Weight");		
@@ -181,6 +184,10 @@ struct ProbablyNoteIndian : Module {
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
+		json_object_set_new(rootJ, "lockSeed", json_boolean(lockSeed));
+		if (lockSeed)
+			json_object_set_new(rootJ, "randomSeed", json_integer((json_int_t) random.getSeed()));
+
 		json_object_set_new(rootJ, "octaveWrapAround", json_integer((int) octaveWrapAround));
 		json_object_set_new(rootJ, "justIntonation", json_integer((int) justIntonation));
 		json_object_set_new(rootJ, "shiftLogarithmic", json_integer((int) shiftLogarithmic));
@@ -202,6 +209,14 @@ struct ProbablyNoteIndian : Module {
 
 	void dataFromJson(json_t *rootJ) override {
 
+		json_t *lockSeedJ = json_object_get(rootJ, "lockSeed");
+		if (lockSeedJ)
+			lockSeed = json_boolean_value(lockSeedJ);
+		json_t *seedJ = json_object_get(rootJ, "randomSeed");
+		if (lockSeed && seedJ) {
+			random.seed((uint64_t) json_integer_value(seedJ));
+		}
+
 		json_t *sumO = json_object_get(rootJ, "octaveWrapAround");
 		if (sumO) {
 			octaveWrapAround = json_integer_value(sumO);			
@@ -425,7 +440,7 @@ struct ProbablyNoteIndian : Module {
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].value) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
@@ -950,6 +965,16 @@ struct ProbablyNoteIndianWidget : ModuleWidget {
 
 			
 	// }
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		ProbablyNoteIndian *module = dynamic_cast<ProbablyNoteIndian*>(this->module);
+		assert(module);
+
+		FrozenWasteland::appendSeedMenu(menu, module);
+	}
 };
 
 
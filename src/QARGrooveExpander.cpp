@@ -5,8 +5,8 @@
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
 #define NUM_TAPS 16
-#define PASSTHROUGH_LEFT_VARIABLE_COUNT 13
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 8
+#define PASSTHROUGH_LEFT_VARIABLE_COUNT 17
+#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 14
 #define TRACK_LEVEL_PARAM_COUNT TRACK_COUNT * 6
 #define PASSTHROUGH_OFFSET MAX_STEPS * TRACK_COUNT * 3 + TRACK_LEVEL_PARAM_COUNT
 
@@ -3,7 +3,11 @@
 #include <time.h>
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/seed_menu.hpp"
+#include "ui/snapshot.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/random.hpp"
+#include "dsp-sequencer/step_scheduler.hpp"
 
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
@@ -11,8 +15,8 @@
 #define EXPANDER_MAX_STEPS 18
 #define NUM_RULERS 10
 #define MAX_DIVISIONS 6
-#define PASSTHROUGH_LEFT_VARIABLE_COUNT 13
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 8
+#define PASSTHROUGH_LEFT_VARIABLE_COUNT 17
+#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 14
 #define TRACK_LEVEL_PARAM_COUNT TRACK_COUNT * 6
 #define PASSTHROUGH_OFFSET MAX_STEPS * TRACK_COUNT * 3 + TRACK_LEVEL_PARAM_COUNT
 
@@ -151,22 +155,51 @@ struct QuadAlgorithmicRhythm : Module {
 
 	float probabilityMatrix[TRACK_COUNT][MAX_STEPS];
 	float swingMatrix[TRACK_COUNT][MAX_STEPS];
-	float probabilityGroupModeMatrix[TRACK_COUNT][MAX_STEPS];
+	float probabilityGroupModeMatrix[TRACK_COUNT][MAX_STEPS] = {};
 	int probabilityGroupTriggered[TRACK_COUNT];
-	int probabilityGroupFirstStep[TRACK_COUNT];
-	float workingProbabilityMatrix[TRACK_COUNT][MAX_STEPS];
-	float workingSwingMatrix[TRACK_COUNT][MAX_STEPS];
+	int probabilityGroupFirstStep[TRACK_COUNT] = {-1, -1, -1, -1};
 
 	int beatIndex[TRACK_COUNT];
 	int stepsCount[TRACK_COUNT];
 	int lastStepsCount[TRACK_COUNT];
 	double stepDuration[TRACK_COUNT];
-	double lastStepTime[TRACK_COUNT];	
+    double swingDuration[TRACK_COUNT] = {0.0};
     double lastSwingDuration[TRACK_COUNT];
 
+	//The settings each track's pattern was last built from, it is only rebuilt when they change
+	int patternSettings[TRACK_COUNT][7];
+	double lastMasterStepCount = 0;
+	//The part of the expander message the probability and groove come from, as last read
+	float lastExpanderMessage[PASSTHROUGH_OFFSET];
+	bool expanderMessageRead = false;
+
+	//Each track's steps as they will next come round, rebuilt when the pattern, the expanders or the rolls change
+	enum StepEvents {
+		BEAT_EVENT = 1,
+		ACCENT_EVENT = 2
+	};
+	int stepEvents[TRACK_COUNT][MAX_STEPS];
+	double stepSwing[TRACK_COUNT][MAX_STEPS]; //In steps, from the step's place on the clock
+	//Probability and swing randomness are rolled a cycle ahead: when a step is taken, its rolls for the next time round are drawn
+	float probabilityRoll[TRACK_COUNT][MAX_STEPS];
+	float swingRoll[TRACK_COUNT][MAX_STEPS];
+	bool stepTablesStale = true;
+
+	//Step timing, in samples on this module's timeline. Nothing is worked out per sample:
+	//a track's next step is only scheduled again when it is taken or its timing changes
+	FrozenWasteland::StepScheduler<TRACK_COUNT> stepScheduler;
+	double sampleTime = 0.0;
+	bool trackActive[TRACK_COUNT] = {false};
+	double stepStart[TRACK_COUNT] = {0.0}; //While active
+	double pausedElapsed[TRACK_COUNT] = {0.0}; //While stopped or unclocked, time doesn't pass for a track
+	bool timingChanged[TRACK_COUNT] = {false};
+	bool clockStretched = false; //The clock is late, so its length keeps growing until the next edge
+	bool startPending[TRACK_COUNT] = {false};
+	double startLateness[TRACK_COUNT] = {0.0};
+	double eocLateness[TRACK_COUNT] = {0.0}; //How far past its exact time the last end of cycle went out, in samples
+
 	float swingRandomness[TRACK_COUNT];
 	bool useGaussianDistribution[TRACK_COUNT] = {false};
-	double calculatedSwingRandomness[TRACK_COUNT] = {0.0f};
 	bool trackSwingUsingDivs[TRACK_COUNT] = {false};
 	int subBeatLength[TRACK_COUNT];
 	int subBeatIndex[TRACK_COUNT];
@@ -178,7 +211,11 @@ struct QuadAlgorithmicRhythm : Module {
 	float expanderAccentValue[TRACK_COUNT];
 	float expanderEocValue[TRACK_COUNT];
 	float lastExpanderEocValue[TRACK_COUNT];
+	float expanderEocLateness[TRACK_COUNT] = {0};
+	float lastExpanderEocLateness[TRACK_COUNT] = {0};
 	
+	float expanderClockElapsed = 0;
+	float expanderDuration = 0;
 	float expanderClockValue = 0;
 	float expanderResetValue = 0;
 	float expanderMuteValue = 0;
@@ -219,7 +256,29 @@ struct QuadAlgorithmicRhythm : Module {
 	dsp::PulseGenerator beatPulse[TRACK_COUNT],accentPulse[TRACK_COUNT],eocPulse[TRACK_COUNT];
 
 	GaussianNoiseGenerator _gauss;
-
+	//Each track draws from its own stream, so the steps of one track don't change the rolls of another
+	Random trackRandom[TRACK_COUNT];
+	uint64_t randomSeed = 0;
+	//The seed is only saved, and a loaded patch only replays it, when the menu locks it
+	bool lockSeed = false;
+
+	//What the beat display draws, copied out at the end of a sample when it asks for a frame
+	struct DisplayFrame {
+		int algorithm[TRACK_COUNT];
+		int stepsCount[TRACK_COUNT];
+		int beatIndex[TRACK_COUNT];
+		bool running[TRACK_COUNT];
+		bool beat[TRACK_COUNT][MAX_STEPS];
+		bool accent[TRACK_COUNT][MAX_STEPS];
+		float probability[TRACK_COUNT][MAX_STEPS];
+		float swing[TRACK_COUNT][MAX_STEPS];
+		int probabilityGroupMode[TRACK_COUNT][MAX_STEPS];
+		int probabilityGroupTriggered[TRACK_COUNT];
+		float swingRandomness[TRACK_COUNT];
+		bool constantTime;
+		int masterTrack;
+	};
+	FrozenWasteland::SnapshotBuffer<DisplayFrame> display;
 
 
 	QuadAlgorithmicRhythm() {
@@ -267,7 +326,7 @@ struct QuadAlgorithmicRhythm : Module {
 		leftExpander.producerMessage = producerMessage;
 		leftExpander.consumerMessage = consumerMessage;
 		
-		srand(time(NULL));
+		seedRandom(Random().getSeed());
 		
 
 		for(int i = 0; i < TRACK_COUNT; i++) {
@@ -275,7 +334,7 @@ struct QuadAlgorithmicRhythm : Module {
 			beatIndex[i] = -1;
 			stepsCount[i] = MAX_STEPS;
 			lastStepsCount[i] = -1;
-			lastStepTime[i] = 0.0;
+			setStepElapsed(i, 0.0);
 			stepDuration[i] = 0.0;
             lastSwingDuration[i] = 0.0;
 			subBeatIndex[i] = -1;
@@ -306,6 +365,8 @@ struct QuadAlgorithmicRhythm : Module {
 	void process(const ProcessArgs &args) override  {
 
 		int beatLocation[MAX_STEPS];
+		bool patternChanged[TRACK_COUNT];
+		bool anyPatternChanged = false;
 
 		//Initialize
 		for(int i = 0; i < TRACK_COUNT; i++) {
@@ -327,6 +388,7 @@ struct QuadAlgorithmicRhythm : Module {
 					expanderOutputValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3] ; 
 					expanderAccentValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3 + 1] ; 
 					lastExpanderEocValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3 + 2] ; 					
+					lastExpanderEocLateness[i] = message[PASSTHROUGH_OFFSET + 1 + TRACK_COUNT * 3 + i] ; 
 				}
 			}
 		}
@@ -357,7 +419,10 @@ struct QuadAlgorithmicRhythm : Module {
 
 				for(int i = 0; i < TRACK_COUNT; i++) {				
 					expanderEocValue[i] = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 4 + i] ; 
+					expanderEocLateness[i] = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 10 + i] ; 
 				}
+				expanderClockElapsed = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 8] ; 
+				expanderDuration = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 9] ; 
 			}
 		}
 
@@ -383,7 +448,7 @@ struct QuadAlgorithmicRhythm : Module {
 			constantTime = masterTrack > 0;
 			for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
 				beatIndex[trackNumber] = -1;
-                lastStepTime[trackNumber] = 0;
+                setStepElapsed(trackNumber, 0.0);
                 lastSwingDuration[trackNumber] = 0; // Not sure about this
 				expanderEocValue[trackNumber] = 0; 
 				lastExpanderEocValue[trackNumber] = 0;		
@@ -510,8 +575,17 @@ struct QuadAlgorithmicRhythm : Module {
 			int accentDivision = int(accentDivisionf);
 			int accentRotation = int(accentRotationf);
 
+			//Only build the pattern again when its settings change. Logic tracks follow the two tracks they are built from
+			int settings[7] = {algorithnMatrix[trackNumber], stepsCount[trackNumber], division, offset, pad, accentDivision, accentRotation};
+			patternChanged[trackNumber] = memcmp(settings, patternSettings[trackNumber], sizeof(settings)) != 0
+				|| (algorithnMatrix[trackNumber] == BOOLEAN_LOGIC_ALGO && (patternChanged[trackNumber-1] || patternChanged[trackNumber-2]));
+			if(patternChanged[trackNumber]) {
+				memcpy(patternSettings[trackNumber], settings, sizeof(settings));
+				timingChanged[trackNumber] = true;
+				anyPatternChanged = true;
+			}
 
-			if(stepsCount[trackNumber] > 0) {
+			if(stepsCount[trackNumber] > 0 && patternChanged[trackNumber]) {
 				
                 int bucket = stepsCount[trackNumber] - pad - 1;                    
                 if(algorithnMatrix[trackNumber] == EUCLIDEAN_ALGO ) { //Euclidean Algorithn
@@ -615,6 +689,15 @@ struct QuadAlgorithmicRhythm : Module {
 			}	
 		}
 
+		if(anyPatternChanged)
+			stepTablesStale = true;
+		if(constantTime && masterStepCount != lastMasterStepCount) { //Constant time tracks are timed from the master track's length
+			for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
+				timingChanged[trackNumber] = true;
+			}
+		}
+		lastMasterStepCount = masterStepCount;
+
 		float resetInput = inputs[RESET_INPUT].getVoltage();
 		if(!inputs[RESET_INPUT].isConnected() && masterQARPresent) {
 			resetInput = expanderResetValue;
@@ -624,7 +707,7 @@ struct QuadAlgorithmicRhythm : Module {
 			for(int trackNumber=0;trackNumber<4;trackNumber++)
 			{
 				beatIndex[trackNumber] = -1;
-				lastStepTime[trackNumber] = 0;
+				setStepElapsed(trackNumber, 0.0);
 				lastSwingDuration[trackNumber] = 0; // Not sure about this
 				expanderEocValue[trackNumber] = 0; 
 				lastExpanderEocValue[trackNumber] = 0;		
@@ -635,161 +718,43 @@ struct QuadAlgorithmicRhythm : Module {
 			timeElapsed = 0;
 			firstClockReceived = false;
 			setRunningState();
+			expanderMessageRead = false;
+			stepTablesStale = true;
 		}
 		
 
 		
 
-		//Get Expander Info
+		//Get Expander Info, only reading it again when it or the patterns it is laid over change
+		float *expanderMessage = nullptr;
 		if(rightExpander.module && (rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander))
 		{			
 			QARExpanderDisconnectReset = true;
-			float *message = (float*) rightExpander.module->leftExpander.consumerMessage;
-
-			//Process Probability Expander Stuff						
-			for(int i = 0; i < TRACK_COUNT; i++) {
-				probabilityGroupFirstStep[i] = -1;
-				for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
-					workingProbabilityMatrix[i][j] = 1;					
-				}
-
-				if(message[i] > 0) { // 0 is track not selected
-					bool useDivs = message[i] == 2; //2 is divs
-					for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
-						int stepIndex = j;
-						bool stepFound = true;
-						if(useDivs) { //Use j as a count to the div # we are looking for
-							int divIndex = -1;
-							stepFound = false;
-							for(int k = 0; k< MAX_STEPS; k++) {
-								if (beatMatrix[i][k]) {
-									divIndex ++;
-									if(divIndex == j) {
-										stepIndex = k;
-										stepFound = true;	
-										break;								
-									}
-								}
-							}
-						}
-						
-						if(stepFound) {
-							float probability = message[TRACK_LEVEL_PARAM_COUNT + (i * EXPANDER_MAX_STEPS) + j];
-							float probabilityMode = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT) + (i * EXPANDER_MAX_STEPS) + j];
-							
-							workingProbabilityMatrix[i][stepIndex] = probability;
-							probabilityGroupModeMatrix[i][stepIndex] = probabilityMode;
-							for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
-								if(probabilityGroupFirstStep[i] < 0 && probabilityGroupModeMatrix[i][j] != NONE_PGTM ) {
-									probabilityGroupFirstStep[i] = j;
-									break;
-								}
-							}
-						} 
-					}
-				}
-			}
-
-			//Process Groove Expander Stuff									
-			for(int i = 0; i < TRACK_COUNT; i++) {
-				for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities
-					workingSwingMatrix[i][j] = 0.0;
-				}
-
-				if(message[TRACK_COUNT + i] > 0) { // 0 is track not selected
-					bool useDivs = message[TRACK_COUNT + i] == 2; //2 is divs
-					trackSwingUsingDivs[i] = useDivs;
-
-					int grooveLength = (int)(message[TRACK_COUNT * 2 + i]);
-					bool useTrackLength = message[TRACK_COUNT * 3 + i];
-
-					swingRandomness[i] = message[TRACK_COUNT * 4 + i];
-					useGaussianDistribution[i] = message[TRACK_COUNT * 5 + i];
-
-					if(useTrackLength) {
-						grooveLength = stepsCount[i];
-					}
-					subBeatLength[i] = grooveLength;
-					if(subBeatIndex[i] >= grooveLength) { //Reset if necessary
-						subBeatIndex[i] = 0;
-					}
-					
-
-					int workingBeatIndex;
-					if(!useDivs) {
-						workingBeatIndex = (subBeatIndex[i] - beatIndex[i]) % grooveLength; 
-						if(workingBeatIndex <0) {
-							workingBeatIndex +=grooveLength;
-						}
-					} else {
-						int divCount = -1;
-						for(int k = 0; k<= beatIndex[i]; k++) {
-							if (beatMatrix[i][k]) {
-								divCount++;
-							}
-						}
-
-						workingBeatIndex = (subBeatIndex[i] - divCount) % grooveLength; 
-						if(workingBeatIndex <0) {
-							workingBeatIndex +=grooveLength;
-						}
-					}
-
-					for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
-						int stepIndex = j;
-						bool stepFound = true;
-						if(useDivs) { //Use j as a count to the div # we are looking for
-							int divIndex = -1;
-							stepFound = false;
-							for(int k = 0; k< MAX_STEPS; k++) {
-								if (beatMatrix[i][k]) {
-									divIndex ++;
-									if(divIndex == j) {
-										stepIndex = k;
-										stepFound = true;	
-										break;								
-									}
-								}
-							}
-						}
-						
-						if(stepFound) {
-							float swing = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT * 2) + (i * EXPANDER_MAX_STEPS) + workingBeatIndex];
-							workingSwingMatrix[i][stepIndex] = swing;						
-						} 
-						workingBeatIndex +=1;
-						if(workingBeatIndex >= grooveLength) {
-							workingBeatIndex = 0;
-						}
-					}
+			expanderMessage = (float*) rightExpander.module->leftExpander.consumerMessage;
+			if(!expanderMessageRead || anyPatternChanged || memcmp(expanderMessage, lastExpanderMessage, sizeof(lastExpanderMessage)) != 0) {
+				memcpy(lastExpanderMessage, expanderMessage, sizeof(lastExpanderMessage));
+				expanderMessageRead = true;
+				readProbabilities(expanderMessage);
+				for(int i = 0; i < TRACK_COUNT; i++) {
+					readGroove(expanderMessage, i);
 				}
+				stepTablesStale = true;
 			}
-			
-			
 		} else {
+			expanderMessageRead = false;
 			if(QARExpanderDisconnectReset) { //If QRE gets disconnected, reset probability and swing
 				for(int i = 0; i < TRACK_COUNT; i++) {
 					subBeatIndex[i] = 0;
 					for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities
-						workingProbabilityMatrix[i][j] = 1;
-						workingSwingMatrix[i][j] = 0;
+						probabilityMatrix[i][j] = 1;
+						swingMatrix[i][j] = 0;
 					}
 				}
 				QARExpanderDisconnectReset = false;
+				stepTablesStale = true;
 			}
 		}
 
-
-		//set calculated probability and swing
-		for(int i = 0; i < TRACK_COUNT; i++) {
-			for(int j = 0; j < MAX_STEPS; j++) { 
-				probabilityMatrix[i][j] = workingProbabilityMatrix[i][j];
-				swingMatrix[i][j] =workingSwingMatrix[i][j];
-			}
-		}
-
-
-		
 		float muteInput = inputs[MUTE_INPUT].getVoltage();
 		if(!inputs[MUTE_INPUT].isConnected() && masterQARPresent) {
 			muteInput = expanderMuteValue;
@@ -804,26 +769,40 @@ struct QuadAlgorithmicRhythm : Module {
 		//See if need to start up
 		for(int trackNumber=0;trackNumber < TRACK_COUNT;trackNumber++) {
 			float startInput = 0;
+			float lateness = 0;
 			if(inputs[START_1_INPUT + (trackNumber * 8)].isConnected()) {
 				startInput = inputs[START_1_INPUT + (trackNumber * 8)].getVoltage();
 			} else if(masterQARPresent) {
 				startInput = expanderEocValue[trackNumber];
+				lateness = expanderEocLateness[trackNumber];
 			} else if(rightExpanderPresent) {
 				startInput = lastExpanderEocValue[trackNumber];
+				lateness = lastExpanderEocLateness[trackNumber];
 			}
 			
 			if(chainMode != CHAIN_MODE_NONE && (inputs[(trackNumber * 8) + START_1_INPUT].isConnected() || masterQARPresent || slavedQARPresent) && !running[trackNumber]) {
 				if(startTrigger[trackNumber].process(startInput)) {
 					running[trackNumber] = true;
 					beatIndex[trackNumber] = -1;
-					lastStepTime[trackNumber] = 200000; //Trying some arbitrary large value
+					stepTablesStale = true;
+					//Take the first step straight away, from when the other module's cycle ended
+					setStepElapsed(trackNumber, 0.0);
+					startPending[trackNumber] = true;
+					startLateness[trackNumber] = lateness;
 				}
 			}
 		}
+		if(stepTablesStale) {
+			for(int i = 0; i < TRACK_COUNT; i++) {
+				buildStepTable(i);
+			}
+			stepTablesStale = false;
+		}
 
 		//Calculate clock duration
 		double timeAdvance =1.0 / args.sampleRate;
 		timeElapsed += timeAdvance;
+		sampleTime += 1.0;
 
 		float clockInput = inputs[CLOCK_INPUT].getVoltage();
 		if(!inputs[CLOCK_INPUT].isConnected() && masterQARPresent) {
@@ -831,42 +810,71 @@ struct QuadAlgorithmicRhythm : Module {
 		}
 
 	
-
-		if(inputs[CLOCK_INPUT].isConnected() || masterQARPresent) {
+		bool clocked = inputs[CLOCK_INPUT].isConnected() || masterQARPresent;
+		if(inputs[CLOCK_INPUT].isConnected()) {
 			if(clockTrigger.process(clockInput)) {
 				if(firstClockReceived) {
-					duration = timeElapsed;
+					setDuration(timeElapsed, true);
 				}
 				timeElapsed = 0;
 				firstClockReceived = true;							
 			} else if(firstClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-				duration = timeElapsed;
+				setDuration(timeElapsed, false);
 			}			
-			
-			for(int trackNumber=0;trackNumber < TRACK_COUNT;trackNumber++) {
-				if(stepsCount[trackNumber] > 0 && constantTime && beatIndex[trackNumber] >= 0 ) {
-					double stepsChangeAdjustemnt = (double)(lastStepsCount[trackNumber] / (double)stepsCount[trackNumber]); 
-					stepDuration[trackNumber] = duration * masterStepCount / (double)stepsCount[trackNumber] * stepsChangeAdjustemnt; //Constant Time scales duration based on a master track
-				}
+		} else if(masterQARPresent) {
+			//Take the clock as the master measured it, so chained modules step on its timeline rather than finding the edges again
+			bool masterClocked = expanderClockElapsed < timeElapsed - timeAdvance;
+			timeElapsed = expanderClockElapsed;
+			if(expanderDuration != duration || (masterClocked && clockStretched)) {
+				setDuration(expanderDuration, masterClocked);
+			}
+		}
+
+		//Only tracks whose timing changed get their next step scheduled again
+		for(int trackNumber=0;trackNumber < TRACK_COUNT;trackNumber++) {
+			bool active = clocked && running[trackNumber];
+			if(active != trackActive[trackNumber]) {
+				//The sample a track starts on counts towards its step, the one it stops on doesn't
+				if(active)
+					stepStart[trackNumber] = sampleTime - 1.0 - pausedElapsed[trackNumber];
 				else
-					stepDuration[trackNumber] = duration; //Otherwise Clock based
-				
+					pausedElapsed[trackNumber] = sampleTime - 1.0 - stepStart[trackNumber];
+				trackActive[trackNumber] = active;
+				timingChanged[trackNumber] = true;
+				stepScheduler.cancel(trackNumber);
+			}
+			if(!active)
+				continue;
+
+			if(startPending[trackNumber]) {
+				startPending[trackNumber] = false;
+				timingChanged[trackNumber] = false;
+				stepScheduler.schedule(trackNumber, sampleTime - startLateness[trackNumber]);
+			} else if(timingChanged[trackNumber]) {
+				scheduleStep(trackNumber, args.sampleRate);
+			}
+		}
 
-                //swing is affected by next beat
-                int nextBeat = beatIndex[trackNumber] + 1;
-                if(nextBeat >= stepsCount[trackNumber])
-                    nextBeat = 0;
-                double swingDuration = (calculatedSwingRandomness[trackNumber] + swingMatrix[trackNumber][nextBeat]) * stepDuration[trackNumber];
-            
-				if(running[trackNumber]) {
-					lastStepTime[trackNumber] +=timeAdvance;
-					if(stepDuration[trackNumber] > 0.0 && lastStepTime[trackNumber] >= stepDuration[trackNumber] + swingDuration - lastSwingDuration[trackNumber]) {
-						lastSwingDuration[trackNumber] = swingDuration;
-						lastStepsCount[trackNumber] = stepsCount[trackNumber];
-						advanceBeat(trackNumber);					
-					}					
-				}	
-			}			
+		int dueTrack;
+		double dueTime;
+		while(stepScheduler.pop(sampleTime, dueTrack, dueTime)) {
+			//Time the next step from when this one was due, unless it is late because its timing just changed
+			double lateness = sampleTime - dueTime < 1.0 ? sampleTime - dueTime : 0.0;
+			stepStart[dueTrack] = sampleTime - lateness;
+			lastSwingDuration[dueTrack] = swingDuration[dueTrack];
+			lastStepsCount[dueTrack] = stepsCount[dueTrack];
+			advanceBeat(dueTrack, lateness);
+			if(expanderMessage) {
+				readGroove(expanderMessage, dueTrack);
+			}
+			buildStepTable(dueTrack);
+			timingChanged[dueTrack] = true;
+		}
+		//Steps are taken at most once a sample, the next one is scheduled after the queue has been checked
+		for(int trackNumber=0;trackNumber < TRACK_COUNT;trackNumber++) {
+			if(trackActive[trackNumber] && timingChanged[trackNumber]) {
+				scheduleStep(trackNumber, args.sampleRate);
+			}
 		}
 
 		// Set output to current state
@@ -892,10 +900,12 @@ struct QuadAlgorithmicRhythm : Module {
 				producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3] = beatOutputValue; 
 				producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3 + 1] = accentOutputValue;
 				producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3 + 2] = rightExpanderPresent ? lastExpanderEocValue[trackNumber] : eocOutputValue; // If last QAR send Eoc Back, otherwise pass through
+				producerMessage[PASSTHROUGH_OFFSET + 1 + TRACK_COUNT * 3 + trackNumber] = rightExpanderPresent ? lastExpanderEocLateness[trackNumber] : eocLateness[trackNumber];
 			} 
 			if(rightExpanderPresent) {
 				float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
 				messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 4 + trackNumber] = eocOutputValue; 				
+				messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 10 + trackNumber] = eocLateness[trackNumber]; 				
 			}
 
 		}
@@ -907,12 +917,39 @@ struct QuadAlgorithmicRhythm : Module {
 			messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 1] = clockInput; 
 			messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 2] = resetInput; 
 			messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 3] = muteInput; 				
+			messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 8] = timeElapsed; 
+			messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 9] = duration; 
 		}
 		
 		if(leftExpanderPresent) {
 			producerMessage[PASSTHROUGH_OFFSET] = true; //Tell Master that slave is present
 			leftExpander.messageFlipRequested = true;	
 		} 			
+
+		if(display.frameRequested())
+			publishDisplay();
+	}
+
+	void publishDisplay() {
+		DisplayFrame &frame = display.writeBuffer();
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			frame.algorithm[i] = algorithnMatrix[i];
+			frame.stepsCount[i] = stepsCount[i];
+			frame.beatIndex[i] = beatIndex[i];
+			frame.running[i] = running[i];
+			frame.probabilityGroupTriggered[i] = probabilityGroupTriggered[i];
+			frame.swingRandomness[i] = swingRandomness[i];
+			for(int j = 0; j < MAX_STEPS; j++) {
+				frame.beat[i][j] = beatMatrix[i][j];
+				frame.accent[i][j] = accentMatrix[i][j];
+				frame.probability[i][j] = probabilityMatrix[i][j];
+				frame.swing[i][j] = swingMatrix[i][j];
+				frame.probabilityGroupMode[i][j] = (int) probabilityGroupModeMatrix[i][j];
+			}
+		}
+		frame.constantTime = constantTime;
+		frame.masterTrack = masterTrack;
+		display.publish();
 	}
 
 
@@ -930,6 +967,9 @@ struct QuadAlgorithmicRhythm : Module {
 		json_object_set_new(rootJ, "masterTrack", json_integer((int) masterTrack));
 		json_object_set_new(rootJ, "chainMode", json_integer((int) chainMode));
 		json_object_set_new(rootJ, "muted", json_integer((bool) muted));
+		json_object_set_new(rootJ, "lockSeed", json_boolean(lockSeed));
+		if (lockSeed)
+			json_object_set_new(rootJ, "randomSeed", json_integer((json_int_t) randomSeed));
 
 		return rootJ;
 	}
@@ -960,6 +1000,13 @@ struct QuadAlgorithmicRhythm : Module {
 		json_t *mutedJ = json_object_get(rootJ, "muted");
 		if (mutedJ)
 			muted = json_integer_value(mutedJ);
+
+		json_t *lockSeedJ = json_object_get(rootJ, "lockSeed");
+		if (lockSeedJ)
+			lockSeed = json_boolean_value(lockSeedJ);
+		json_t *seedJ = json_object_get(rootJ, "randomSeed");
+		if (lockSeed && seedJ)
+			seedRandom((uint64_t) json_integer_value(seedJ));
 	}
 
 	void setRunningState() {
@@ -974,15 +1021,253 @@ struct QuadAlgorithmicRhythm : Module {
 		}
 	}
 
-	void advanceBeat(int trackNumber) {
+	void seedRandom(uint64_t seed) {
+		randomSeed = seed;
+		Random random(seed);
+		random.split(trackRandom, TRACK_COUNT);
+		_gauss.seed(random.next());
+		for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
+			for(int j = 0; j < MAX_STEPS; j++) {
+				rollStep(trackNumber, j);
+			}
+		}
+		stepTablesStale = true;
+	}
+
+	/** Reads the probabilities of every track from the Probability Expander's part of the message. */
+	void readProbabilities(const float *message) {
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			probabilityGroupFirstStep[i] = -1;
+			for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
+				probabilityMatrix[i][j] = 1;					
+			}
+
+			if(message[i] > 0) { // 0 is track not selected
+				bool useDivs = message[i] == 2; //2 is divs
+				for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
+					int stepIndex = j;
+					bool stepFound = true;
+					if(useDivs) { //Use j as a count to the div # we are looking for
+						int divIndex = -1;
+						stepFound = false;
+						for(int k = 0; k< MAX_STEPS; k++) {
+							if (beatMatrix[i][k]) {
+								divIndex ++;
+								if(divIndex == j) {
+									stepIndex = k;
+									stepFound = true;	
+									break;								
+								}
+							}
+						}
+					}
+					
+					if(stepFound) {
+						float probability = message[TRACK_LEVEL_PARAM_COUNT + (i * EXPANDER_MAX_STEPS) + j];
+						float probabilityMode = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT) + (i * EXPANDER_MAX_STEPS) + j];
+						
+						probabilityMatrix[i][stepIndex] = probability;
+						probabilityGroupModeMatrix[i][stepIndex] = probabilityMode;
+						for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
+							if(probabilityGroupFirstStep[i] < 0 && probabilityGroupModeMatrix[i][j] != NONE_PGTM ) {
+								probabilityGroupFirstStep[i] = j;
+								break;
+							}
+						}
+					} 
+				}
+			}
+		}
+	}
+
+	/** Reads a track's groove from the Groove Expander's part of the message, lined up with the step the track is on. */
+	void readGroove(const float *message, int i) {
+		for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities
+			swingMatrix[i][j] = 0.0;
+		}
+
+		if(message[TRACK_COUNT + i] > 0) { // 0 is track not selected
+			bool useDivs = message[TRACK_COUNT + i] == 2; //2 is divs
+			trackSwingUsingDivs[i] = useDivs;
+
+			int grooveLength = (int)(message[TRACK_COUNT * 2 + i]);
+			bool useTrackLength = message[TRACK_COUNT * 3 + i];
+
+			swingRandomness[i] = message[TRACK_COUNT * 4 + i];
+			useGaussianDistribution[i] = message[TRACK_COUNT * 5 + i];
+
+			if(useTrackLength) {
+				grooveLength = stepsCount[i];
+			}
+			subBeatLength[i] = grooveLength;
+			if(subBeatIndex[i] >= grooveLength) { //Reset if necessary
+				subBeatIndex[i] = 0;
+			}
+			
+
+			int workingBeatIndex;
+			if(!useDivs) {
+				workingBeatIndex = (subBeatIndex[i] - beatIndex[i]) % grooveLength; 
+				if(workingBeatIndex <0) {
+					workingBeatIndex +=grooveLength;
+				}
+			} else {
+				int divCount = -1;
+				for(int k = 0; k<= beatIndex[i]; k++) {
+					if (beatMatrix[i][k]) {
+						divCount++;
+					}
+				}
+
+				workingBeatIndex = (subBeatIndex[i] - divCount) % grooveLength; 
+				if(workingBeatIndex <0) {
+					workingBeatIndex +=grooveLength;
+				}
+			}
+
+			for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
+				int stepIndex = j;
+				bool stepFound = true;
+				if(useDivs) { //Use j as a count to the div # we are looking for
+					int divIndex = -1;
+					stepFound = false;
+					for(int k = 0; k< MAX_STEPS; k++) {
+						if (beatMatrix[i][k]) {
+							divIndex ++;
+							if(divIndex == j) {
+								stepIndex = k;
+								stepFound = true;	
+								break;								
+							}
+						}
+					}
+				}
+				
+				if(stepFound) {
+					float swing = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT * 2) + (i * EXPANDER_MAX_STEPS) + workingBeatIndex];
+					swingMatrix[i][stepIndex] = swing;						
+				} 
+				workingBeatIndex +=1;
+				if(workingBeatIndex >= grooveLength) {
+					workingBeatIndex = 0;
+				}
+			}
+		}
+	}
+
+	/** Draws a step's probability and swing randomness for the next time it comes round. */
+	void rollStep(int trackNumber, int step) {
+		probabilityRoll[trackNumber][step] = trackRandom[trackNumber].uniform();
+		if(useGaussianDistribution[trackNumber]) {
+			bool gaussOk = false; // don't want values that are beyond our mean
+			float gaussian;
+			do {
+				gaussian= _gauss.next();
+				gaussOk = gaussian >= -1 && gaussian <= 1;
+			} while (!gaussOk);
+			swingRoll[trackNumber][step] = gaussian / 2;
+		} else {
+			swingRoll[trackNumber][step] = trackRandom[trackNumber].uniform() - 0.5f;
+		}
+	}
+
+	/** Decides each step of a track from its pattern, probabilities and rolls, and where the groove and swing randomness put it. */
+	void buildStepTable(int trackNumber) {
+		int firstStep = probabilityGroupFirstStep[trackNumber];
+		bool firstStepTaken = firstStep >= 0 && firstStep <= beatIndex[trackNumber];
+		for(int j = 0; j < MAX_STEPS; j++) {
+			bool probabilityResult = probabilityRoll[trackNumber][j] < probabilityMatrix[trackNumber][j];
+			if(probabilityGroupModeMatrix[trackNumber][j] != NONE_PGTM && firstStep >= 0 && firstStep < j) {
+				//The rest of a group follows its first step: this cycle's outcome if it has been taken and this step hasn't, otherwise its next roll
+				if(firstStepTaken && j > beatIndex[trackNumber]) {
+					if(probabilityGroupTriggered[trackNumber] == NOT_TRIGGERED_PGTS)
+						probabilityResult = false;
+				} else if(probabilityRoll[trackNumber][firstStep] >= probabilityMatrix[trackNumber][firstStep]) {
+					probabilityResult = false;
+				}
+			}
+			stepEvents[trackNumber][j] = 0;
+			if(beatMatrix[trackNumber][j] && probabilityResult)
+				stepEvents[trackNumber][j] |= BEAT_EVENT;
+			if(accentMatrix[trackNumber][j] && probabilityResult)
+				stepEvents[trackNumber][j] |= ACCENT_EVENT;
+			stepSwing[trackNumber][j] = swingMatrix[trackNumber][j] - swingRoll[trackNumber][j] * swingRandomness[trackNumber];
+		}
+		timingChanged[trackNumber] = true;
+	}
+
+	/** Takes a new clock length, measured at a clock or stretched by a late one. Steps are scheduled again when the clock changes length
+	and when it starts running late, not while it stays late: nextStepTime() allows for a clock that keeps growing.
+	*/
+	void setDuration(double newDuration, bool measured) {
+		if(measured ? newDuration != duration || clockStretched : !clockStretched) {
+			for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
+				timingChanged[trackNumber] = true;
+			}
+		}
+		clockStretched = !measured;
+		duration = newDuration;
+	}
+
+	/** When a track's next step is due, in samples, from the clock's length and the step table. INFINITY until the clock has a length,
+	or while a late clock keeps stretching the step at least as fast as time passes.
+	*/
+	double nextStepTime(int trackNumber, float sampleRate) {
+		if(stepsCount[trackNumber] > 0 && constantTime && beatIndex[trackNumber] >= 0 ) {
+			double stepsChangeAdjustemnt = (double)(lastStepsCount[trackNumber] / (double)stepsCount[trackNumber]); 
+			stepDuration[trackNumber] = duration * masterStepCount / (double)stepsCount[trackNumber] * stepsChangeAdjustemnt; //Constant Time scales duration based on a master track
+		}
+		else
+			stepDuration[trackNumber] = duration; //Otherwise Clock based
+		if(stepDuration[trackNumber] <= 0.0)
+			return INFINITY;
+
+		//swing is affected by next beat
+		int nextBeat = beatIndex[trackNumber] + 1;
+		if(nextBeat >= stepsCount[trackNumber])
+			nextBeat = 0;
+		swingDuration[trackNumber] = stepSwing[trackNumber][nextBeat] * stepDuration[trackNumber];
+		double time = stepStart[trackNumber] + (stepDuration[trackNumber] + swingDuration[trackNumber] - lastSwingDuration[trackNumber]) * sampleRate;
+		if(clockStretched && time > sampleTime) {
+			//The clock's length is the time since its last edge, so the step grows by growth samples every sample. Find where time catches up with it
+			double growth = (stepDuration[trackNumber] + swingDuration[trackNumber]) / duration;
+			if(growth >= 1.0)
+				return INFINITY;
+			double clockStart = sampleTime - timeElapsed * sampleRate;
+			time = (stepStart[trackNumber] - lastSwingDuration[trackNumber] * sampleRate - growth * clockStart) / (1.0 - growth);
+		}
+		return time;
+	}
+
+	void scheduleStep(int trackNumber, float sampleRate) {
+		timingChanged[trackNumber] = false;
+		double time = nextStepTime(trackNumber, sampleRate);
+		if(time < INFINITY)
+			stepScheduler.schedule(trackNumber, time);
+		else
+			stepScheduler.cancel(trackNumber);
+	}
+
+	/** Sets how long ago, in samples, the current step of a track started. */
+	void setStepElapsed(int trackNumber, double samples) {
+		if(trackActive[trackNumber])
+			stepStart[trackNumber] = sampleTime - samples;
+		else
+			pausedElapsed[trackNumber] = samples;
+		startPending[trackNumber] = false;
+		timingChanged[trackNumber] = true;
+	}
+
+	/** Takes a track's next step, lateness samples after it was due, and fires whatever its step table holds for it. */
+	void advanceBeat(int trackNumber, double lateness) {
        
 		beatIndex[trackNumber]++;
-		lastStepTime[trackNumber] = 0.0;
     
 		//End of Cycle
 		if(beatIndex[trackNumber] >= stepsCount[trackNumber]) {
 			beatIndex[trackNumber] = 0;
 			eocPulse[trackNumber].trigger(1e-3);
+			eocLateness[trackNumber] = lateness;
 			probabilityGroupTriggered[trackNumber] = PENDING_PGTS;
 			if(chainMode != CHAIN_MODE_NONE) {
 				running[trackNumber] = false;
@@ -1001,37 +1286,22 @@ struct QuadAlgorithmicRhythm : Module {
 			}
 		}
 
-
-        bool probabilityResult = (float) rand()/RAND_MAX < probabilityMatrix[trackNumber][beatIndex[trackNumber]];	
-		if(probabilityGroupModeMatrix[trackNumber][beatIndex[trackNumber]] != NONE_PGTM) {
-			if(probabilityGroupFirstStep[trackNumber] == beatIndex[trackNumber]) {
-				probabilityGroupTriggered[trackNumber] = probabilityResult ? TRIGGERED_PGTS : NOT_TRIGGERED_PGTS;
-			} else if(probabilityGroupTriggered[trackNumber] == NOT_TRIGGERED_PGTS) {
-				probabilityResult = false;
-			}
+		int step = beatIndex[trackNumber];
+		if(probabilityGroupModeMatrix[trackNumber][step] != NONE_PGTM && probabilityGroupFirstStep[trackNumber] == step) {
+			probabilityGroupTriggered[trackNumber] = probabilityRoll[trackNumber][step] < probabilityMatrix[trackNumber][step] ? TRIGGERED_PGTS : NOT_TRIGGERED_PGTS;
 		}
 
         //Create Beat Trigger    
-        if(beatMatrix[trackNumber][beatIndex[trackNumber]] == true && probabilityResult && running[trackNumber] && !muted) {
+        if((stepEvents[trackNumber][step] & BEAT_EVENT) && running[trackNumber] && !muted) {
             beatPulse[trackNumber].trigger(1e-3);		
         } 
 
         //Create Accent Trigger
-        if(accentMatrix[trackNumber][beatIndex[trackNumber]] == true && probabilityResult && running[trackNumber] && !muted) {
+        if((stepEvents[trackNumber][step] & ACCENT_EVENT) && running[trackNumber] && !muted) {
             accentPulse[trackNumber].trigger(1e-3);
         }
 
-		if(useGaussianDistribution[trackNumber]) {
-			bool gaussOk = false; // don't want values that are beyond our mean
-			float gaussian;
-			do {
-				gaussian= _gauss.next();
-				gaussOk = gaussian >= -1 && gaussian <= 1;
-			} while (!gaussOk);
-			calculatedSwingRandomness[trackNumber] = 1.0 - gaussian / 2 * swingRandomness[trackNumber];
-		} else {
-			calculatedSwingRandomness[trackNumber] = 1.0 - (((double) rand()/RAND_MAX - 0.5f) * swingRandomness[trackNumber]);
-		}
+		rollStep(trackNumber, step);
 	}
 	// For more advanced Module features, read Rack's engine.hpp header file
 	// - onSampleRateChange: event triggered by a change of sample rate
@@ -1042,7 +1312,7 @@ struct QuadAlgorithmicRhythm : Module {
             algorithnMatrix[i] = EUCLIDEAN_ALGO;
 			beatIndex[i] = -1;
 			stepsCount[i] = MAX_STEPS;
-			lastStepTime[i] = 0.0;
+			setStepElapsed(i, 0.0);
 			stepDuration[i] = 0.0;
             lastSwingDuration[i] = 0.0;
 			expanderAccentValue[i] = 0.0;
@@ -1060,7 +1330,12 @@ struct QuadAlgorithmicRhythm : Module {
 				beatMatrix[i][j] = false;
 				accentMatrix[i][j] = false;				
 			}
+			for(int k = 0; k < 7; k++) {
+				patternSettings[i][k] = -1;
+			}
 		}	
+		expanderMessageRead = false;
+		stepTablesStale = true;
 	}
 };
 
@@ -1167,24 +1442,27 @@ struct QARBeatDisplay : TransparentWidget {
 	void draw(const DrawArgs &args) override {
 		if (!module)
 			return;
+		module->display.requestFrame();
+		module->display.update();
+		const QuadAlgorithmicRhythm::DisplayFrame &frame = module->display.readBuffer();
 		
 		for(int trackNumber = 0;trackNumber < TRACK_COUNT;trackNumber++) {
-            int algorithn = module->algorithnMatrix[trackNumber];
-            for(int stepNumber = 0;stepNumber < module->stepsCount[trackNumber];stepNumber++) {				
-                bool isBeat = module->beatMatrix[trackNumber][stepNumber];
-				bool isAccent = module->accentMatrix[trackNumber][stepNumber];
-				bool isCurrent = module->beatIndex[trackNumber] == stepNumber && module->running[trackNumber];		
-				float probability = module->probabilityMatrix[trackNumber][stepNumber];
-				float swing = module->swingMatrix[trackNumber][stepNumber];				
-				float swingRandomness = module->swingRandomness[trackNumber];
-				int triggerState = module->probabilityGroupTriggered[trackNumber];
-				int probabilityGroupMode = module->probabilityGroupModeMatrix[trackNumber][stepNumber];
+            int algorithn = frame.algorithm[trackNumber];
+            for(int stepNumber = 0;stepNumber < frame.stepsCount[trackNumber];stepNumber++) {				
+                bool isBeat = frame.beat[trackNumber][stepNumber];
+				bool isAccent = frame.accent[trackNumber][stepNumber];
+				bool isCurrent = frame.beatIndex[trackNumber] == stepNumber && frame.running[trackNumber];		
+				float probability = frame.probability[trackNumber][stepNumber];
+				float swing = frame.swing[trackNumber][stepNumber];				
+				float swingRandomness = frame.swingRandomness[trackNumber];
+				int triggerState = frame.probabilityGroupTriggered[trackNumber];
+				int probabilityGroupMode = frame.probabilityGroupMode[trackNumber][stepNumber];
 				drawBox(args, float(stepNumber), float(trackNumber),algorithn,isBeat,isAccent,isCurrent,probability,triggerState,probabilityGroupMode,swing,swingRandomness);
 			}
 		}
 
-		if(module->constantTime)
-			drawMasterTrack(args, Vec(box.size.x - 21, box.size.y - 80), module->masterTrack);
+		if(frame.constantTime)
+			drawMasterTrack(args, Vec(box.size.x - 21, box.size.y - 80), frame.masterTrack);
 			//drawMasterTrack(args, Vec(box.size.x - 21, box.size.y - 80), module->probabilityGroupFirstStep[1]);
 	}
 };
@@ -1320,6 +1598,16 @@ struct QuadAlgorithmicRhythmWidget : ModuleWidget {
 		addChild(createLight<LargeLight<RedLight>>(Vec(415, 347), module, QuadAlgorithmicRhythm::MUTED_LIGHT));
 		
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		QuadAlgorithmicRhythm *module = dynamic_cast<QuadAlgorithmicRhythm*>(this->module);
+		assert(module);
+
+		FrozenWasteland::appendSeedMenu(menu, module);
+	}
 };
 
 Model *modelQuadAlgorithmicRhythm = createModel<QuadAlgorithmicRhythm, QuadAlgorithmicRhythmWidget>("QuadAlgorithmicRhythm");
@@ -2,6 +2,7 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/snapshot.hpp"
 
 
 #define BUFFER_SIZE 512
@@ -56,6 +57,14 @@ struct RouletteLFO : Module {
 	};
 	
 
+	struct ScopeFrame {
+		float x1[BUFFER_SIZE];
+		float y1[BUFFER_SIZE];
+		float displayScaling;
+	};
+	FrozenWasteland::SnapshotBuffer<ScopeFrame> scope;
+
+	//Audio thread only, the display reads published ScopeFrames
 	float bufferX1[BUFFER_SIZE] = {};
 	float bufferY1[BUFFER_SIZE] = {};
 	float displayScaling = 1;
@@ -180,23 +189,29 @@ struct RouletteLFO : Module {
 		float scaling = 10.0f / (displayScaling + (eF + eG + d / 2.0f - 2));
 
 
-		//Update scope.
-		int frameCount = (int)ceilf(scopeDeltaTime * args.sampleRate);
+		//Update scope, only while the display is being drawn
+		if (scope.watching(args.sampleTime)) {
+			int frameCount = (int)ceilf(scopeDeltaTime * args.sampleRate);
 
-		// Add frame to buffers
-		if (bufferIndex < BUFFER_SIZE) {
+			// Add frame to buffers
 			if (++frameIndex > frameCount) {
 				frameIndex = 0;
 				bufferX1[bufferIndex] = x1;
 				bufferY1[bufferIndex] = y1;
-				bufferIndex++;
+				bufferIndex = (bufferIndex + 1) % BUFFER_SIZE;
 			}
-		}
 
-		// Are we waiting on the next trigger?
-		if (bufferIndex >= BUFFER_SIZE) {
-			bufferIndex = 0;
-			frameIndex = 0;
+			if (scope.frameRequested()) {
+				// Oldest point first
+				ScopeFrame &frame = scope.writeBuffer();
+				for (int i = 0; i < BUFFER_SIZE; i++) {
+					int j = (i + bufferIndex) % BUFFER_SIZE;
+					frame.x1[i] = bufferX1[j];
+					frame.y1[i] = bufferY1[j];
+				}
+				frame.displayScaling = displayScaling;
+				scope.publish();
+			}
 		}
 
 		x1 = x1 * scaling;
@@ -270,15 +285,16 @@ struct RouletteScopeDisplay : TransparentWidget {
 	void draw(const DrawArgs &args) override {
 		if (!module)
 			return;
+		module->scope.requestFrame();
+		module->scope.update();
+		const RouletteLFO::ScopeFrame &frame = module->scope.readBuffer();
+
 		float valuesX[BUFFER_SIZE];
 		float valuesY[BUFFER_SIZE];
-		float scaling = module->displayScaling;
+		float scaling = fmaxf(frame.displayScaling, 1.0f);
 		for (int i = 0; i < BUFFER_SIZE; i++) {
-			int j = i;
-			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX1[j]) / (1.5f * scaling);
-			valuesY[i] = (module->bufferY1[j]) / (1.5f * scaling);
+			valuesX[i] = frame.x1[i] / (1.5f * scaling);
+			valuesY[i] = frame.y1[i] / (1.5f * scaling);
 		}
 
 		nvgStrokeColor(args.vg, nvgRGBA(0x9f, 0xe4, 0x36, 0xc0));
@@ -1,19 +1,13 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-noise/seed_stream.hpp"
 //#include <dsp/digital.hpp>
 
+#include <cstdlib>
 #include <sstream>
 #include <iomanip>
 
-#define N 624
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-
-
 #define NBOUT 4
 
 
@@ -48,14 +42,12 @@ struct SeedsOfChange : Module {
 	};
 
 
-	float outbuffer[NBOUT * 2];
+	float outbuffer[NBOUT * 2] = {};
 
 
 	// Expander
-	float consumerMessage[4] = {};// this module must read from here
-	float producerMessage[4] = {};// mother will write into here
-	int seed;
-	float clockValue,resetValue,distributionValue;
+	float consumerMessage[frozenwasteland::dsp::SeedStreamMessage::NUM_FIELDS] = {};// this module must read from here
+	float producerMessage[frozenwasteland::dsp::SeedStreamMessage::NUM_FIELDS] = {};// mother will write into here
 
 
 	dsp::SchmittTrigger resetTrigger,clockTrigger,distributionModeTrigger; 
@@ -78,13 +70,15 @@ struct SeedsOfChange : Module {
 		rightExpander.consumerMessage = consumerMessage;
 
 	}
-	unsigned long mt[N]; /* the array for the state vector  */
-	int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
-	void init_genrand(unsigned long s);
-	unsigned long genrand_int32();
-	double genrand_real();
-	int latest_seed = 0;
-	float normal_number();
+	frozenwasteland::dsp::SeedStream stream;
+	// The original Mersenne Twister sequences, chosen in the context menu, see dataFromJson()
+	bool mersenne = false;
+	frozenwasteland::dsp::MersenneTwister twister;
+	// Added to the knob or CV's 0-99, so the context menu can reach every 32 bit seed
+	uint32_t seedBase = 0;
+	uint32_t latest_seed = 0;
+	uint32_t clocksSinceReset = 0;
+	uint32_t block = 0;
 
 	void process(const ProcessArgs &args) override {
 	
@@ -102,11 +96,21 @@ struct SeedsOfChange : Module {
 		resetInput += params[RESET_PARAM].getValue(); 		
 
         if (resetTrigger.process(resetInput) ) {
-            init_genrand((unsigned long)(inputs[SEED_INPUT].isConnected() ? inputs[SEED_INPUT].getVoltage()*9.9 : params[SEED_PARAM].getValue()));
+            float seedValue = inputs[SEED_INPUT].isConnected() ? inputs[SEED_INPUT].getVoltage()*9.9 : params[SEED_PARAM].getValue();
+            latest_seed = seedBase + (uint32_t) clamp(seedValue, 0.0f, 99.0f);
+            clocksSinceReset = 0;
+            if (mersenne) {
+                twister.seed(latest_seed);
+            }
         } 
 
 		if( inputs[CLOCK_INPUT].active ) {
 			if (clockTrigger.process(inputs[CLOCK_INPUT].value) ) {
+				//Each clock takes the next block of the stream, the expanders take their slices of the same block
+				block = clocksSinceReset++;
+				if (!mersenne) {
+					stream.set(latest_seed, block, 0);
+				}
 				for (int i=0; i<NBOUT; i++) {
 					float mult=params[MULTIPLY_1_PARAM+i].value;
 					float off=params[OFFSET_1_PARAM+i].value;
@@ -119,7 +123,12 @@ struct SeedsOfChange : Module {
 						off = off + inputs[OFFSET_1_INPUT + i].value ;
 					}
 
-					float initialRandomNumber = gaussianMode ? normal_number() : genrand_real();					
+					float initialRandomNumber;
+					if (mersenne) {
+						initialRandomNumber = gaussianMode ? twister.normal() : twister.real();
+					} else {
+						initialRandomNumber = gaussianMode ? stream.normal(i * 2) : stream.real(i * 2);
+					}					
 					//outbuffer[i] = clamp((float)(initialRandomNumber * mult + off - mult*.5),-10.0f, 10.0f);
 					outbuffer[i] = clamp((float)(initialRandomNumber * mult + off),-10.0f, 10.0f);
 
@@ -132,7 +141,8 @@ struct SeedsOfChange : Module {
 					} else {
 						prob = params[GATE_PROBABILITY_1_PARAM + i].value;
 					}
-					outbuffer[i+NBOUT] = genrand_real() < prob ? 10.0 : 0;
+					double gateRandomNumber = mersenne ? twister.real() : stream.real(NBOUT * 2 + i);
+					outbuffer[i+NBOUT] = gateRandomNumber < prob ? 10.0 : 0;
 				}
 			} 
 		}
@@ -143,15 +153,11 @@ struct SeedsOfChange : Module {
 		}	
 
 		//Set Expander Info
-		if(rightExpander.module && rightExpander.module->model == modelSeedsOfChangeCVExpander) {	
+		if(rightExpander.module && (rightExpander.module->model == modelSeedsOfChangeCVExpander || rightExpander.module->model == modelSeedsOfChangeGateExpander)) {	
 
 			//Send outputs to slaves if present		
 			float *messageToExpander = (float*)(rightExpander.module->leftExpander.producerMessage);
-			
-			messageToExpander[0] = latest_seed; 
-			messageToExpander[1] = inputs[CLOCK_INPUT].getVoltage(); 
-			messageToExpander[2] = resetInput; 
-			messageToExpander[3] = gaussianMode; 
+			frozenwasteland::dsp::SeedStreamMessage::write(messageToExpander, latest_seed, block, 1, inputs[CLOCK_INPUT].getVoltage(), gaussianMode, resetInput, mersenne);
 			rightExpander.module->leftExpander.messageFlipRequested = true;						
 		}					
 	}
@@ -161,6 +167,24 @@ struct SeedsOfChange : Module {
 	// - onSampleRateChange: event triggered by a change of sample rate
 	// - onReset, onRandomize: implements custom behavior requested by the user
 	void onReset() override;
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "seedStream", json_integer(!mersenne));
+		json_object_set_new(rootJ, "seedBase", json_integer((json_int_t) seedBase));
+		return rootJ;
+	}
+
+	// Only called for modules saved with data. Every save has "seedStream", so data without it predates SeedStream and keeps the Mersenne Twister.
+	// Patches saved before Seeds of Change had any data can't be told from a new instance and start on SeedStream
+	void dataFromJson(json_t *rootJ) override {
+		json_t *seedStreamJ = json_object_get(rootJ, "seedStream");
+		mersenne = seedStreamJ ? !json_integer_value(seedStreamJ) : true;
+
+		json_t *seedBaseJ = json_object_get(rootJ, "seedBase");
+		if (seedBaseJ)
+			seedBase = (uint32_t) json_integer_value(seedBaseJ);
+	}
 };
 
 void SeedsOfChange::onReset() {
@@ -172,83 +196,6 @@ void SeedsOfChange::onReset() {
 	clockTrigger.reset();
 }
 
-/* initializes mt[N] with a seed */
-void SeedsOfChange::init_genrand(unsigned long s)
-{
-	
-	s = s>99?99:s;
-	latest_seed = s;
-    mt[0]= s & 0xffffffffUL;
-    for (mti=1; mti<N; mti++) {
-        mt[mti] = 
-	    (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti); 
-        /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-        /* In the previous versions, MSBs of the seed affect   */
-        /* only MSBs of the array mt[].                        */
-        /* 2002/01/09 modified by Makoto Matsumoto             */
-        mt[mti] &= 0xffffffffUL;
-        /* for >32 bit machines */
-    }
-}
-/* generates a random number on [0,0xffffffff]-interval */
-unsigned long SeedsOfChange::genrand_int32()
-{
-    unsigned long y;
-    static unsigned long mag01[2]={0x0UL, MATRIX_A};
-    /* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-    if (mti >= N) { /* generate N words at one time */
-        int kk;
-
-        if (mti == N+1)   /* if init_genrand() has not been called, */
-            init_genrand(5489UL); /* a default initial seed is used */
-
-        for (kk=0;kk<N-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-        mti = 0;
-    }
-  
-    y = mt[mti++];
-
-    /* Tempering */
-    y ^= (y >> 11);
-    y ^= (y << 7) & 0x9d2c5680UL;
-    y ^= (y << 15) & 0xefc60000UL;
-    y ^= (y >> 18);
-
-    return y;
-}
-/* generates a random number on [0,1)-real-interval */
-double SeedsOfChange::genrand_real()
-{
-    return genrand_int32()*(1.0/4294967296.0); 
-    /* divided by 2^32 */
-}
-float SeedsOfChange::normal_number() {
-	const double x1 = .68;
-	const double x2 = .92;
-	double x = genrand_real();
-	double y = genrand_real();
-	double s = (y<.5) ? .5 : -.5;
-	if (x<x1) {
-		return y*.333*s + .5;
-	} else if (x<x2) {
-		return (y*.333+.333)*s + .5;		
-	} else {
-		return (y*.333+.666)*s + .5;
-	}
-}
-
-
 struct SeedsOfChangeSeedDisplay : TransparentWidget {
 	SeedsOfChange *module;
 	int frame = 0;
@@ -258,14 +205,14 @@ struct SeedsOfChangeSeedDisplay : TransparentWidget {
 		font = APP->window->loadFont(asset::plugin(pluginInstance, "res/fonts/01 Digit.ttf"));
 	}
 
-	void drawSeed(const DrawArgs &args, Vec pos, int seed) {
+	void drawSeed(const DrawArgs &args, Vec pos, uint32_t seed) {
 		nvgFontSize(args.vg, 12);
 		nvgFontFaceId(args.vg, font->handle);
 		nvgTextLetterSpacing(args.vg, -1);
 
 		nvgFillColor(args.vg, nvgRGBA(0x00, 0xff, 0x00, 0xff));
 		char text[128];
-		snprintf(text, sizeof(text), " %i", seed);
+		snprintf(text, sizeof(text), " %u", seed);
 		nvgText(args.vg, pos.x, pos.y, text, NULL);
 	}
 
@@ -325,6 +272,67 @@ struct SeedsOfChangeWidget : ModuleWidget {
 			addOutput(createOutput<FWPortInSmall>(Vec(97, 260 + i*25),  module, SeedsOfChange::GATE_1_OUTPUT + i));
 		}
 	}
+
+	struct SequenceItem : MenuItem {
+		SeedsOfChange *module;
+		bool mersenne;
+		void onAction(const event::Action &e) override {
+			module->mersenne = mersenne;
+		}
+		void step() override {
+			rightText = (module->mersenne == mersenne) ? "✔" : "";
+		}
+	};
+
+	// Takes effect on the next reset, like the knob
+	struct SeedBaseField : ui::TextField {
+		SeedsOfChange *module;
+		SeedBaseField() {
+			box.size.x = 120;
+		}
+		void onAction(const event::Action &e) override {
+			char *end;
+			unsigned long long seedBase = std::strtoull(text.c_str(), &end, 10);
+			if (end != text.c_str() && seedBase <= 0xffffffffULL)
+				module->seedBase = (uint32_t) seedBase;
+			text = std::to_string(module->seedBase);
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		SeedsOfChange *module = dynamic_cast<SeedsOfChange*>(this->module);
+		assert(module);
+
+		MenuLabel *sequenceLabel = new MenuLabel();
+		sequenceLabel->text = "Random Sequence";
+		menu->addChild(sequenceLabel);
+
+		SequenceItem *mersenneItem = new SequenceItem();
+		mersenneItem->text = "Original (expanders repeat these values)";
+		mersenneItem->module = module;
+		mersenneItem->mersenne = true;
+		menu->addChild(mersenneItem);
+
+		SequenceItem *streamItem = new SequenceItem();
+		streamItem->text = "Shared (expanders get values of their own)";
+		streamItem->module = module;
+		streamItem->mersenne = false;
+		menu->addChild(streamItem);
+
+		menu->addChild(new MenuLabel());// empty line
+
+		MenuLabel *seedBaseLabel = new MenuLabel();
+		seedBaseLabel->text = "Seed Base (0-4294967295, added to the knob, Enter to set)";
+		menu->addChild(seedBaseLabel);
+
+		SeedBaseField *seedBaseField = new SeedBaseField();
+		seedBaseField->module = module;
+		seedBaseField->text = std::to_string(module->seedBase);
+		menu->addChild(seedBaseField);
+	}
 };
 
 
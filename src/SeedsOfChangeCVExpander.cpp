@@ -1,19 +1,12 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-noise/seed_stream.hpp"
 //#include <dsp/digital.hpp>
 
 #include <sstream>
 #include <iomanip>
 
-#define N 624
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-
-
 #define NBOUT 12
 
 
@@ -36,14 +29,14 @@ struct SeedsOfChangeCVExpander : Module {
 		NUM_LIGHTS
 	};
 
-	float outbuffer[NBOUT];
+	float outbuffer[NBOUT] = {};
 
 	// Expander
-	float consumerMessage[4] = {};// this module must read from here
-	float producerMessage[4] = {};// mother will write into here
+	float consumerMessage[frozenwasteland::dsp::SeedStreamMessage::NUM_FIELDS] = {};// this module must read from here
+	float producerMessage[frozenwasteland::dsp::SeedStreamMessage::NUM_FIELDS] = {};// mother will write into here
 
 	
-	dsp::SchmittTrigger resetTrigger,clockTrigger,distributionModeTrigger; 
+	dsp::SchmittTrigger resetTrigger,clockTrigger; 
 
 	bool gaussianMode = false;
 
@@ -58,14 +51,15 @@ struct SeedsOfChangeCVExpander : Module {
 		leftExpander.producerMessage = producerMessage;
 		leftExpander.consumerMessage = consumerMessage;
 	}
-	unsigned long mt[N]; /* the array for the state vector  */
-	int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
-	void init_genrand(unsigned long s);
-	unsigned long genrand_int32();
-	double genrand_real();
-	int latest_seed = 0;
-	float resetInput, clockInput;
-	float normal_number();
+	frozenwasteland::dsp::SeedStream stream;
+	// Chains loaded from patches saved before SeedStream, the mother decides
+	bool mersenne = false;
+	frozenwasteland::dsp::MersenneTwister twister;
+	uint32_t latest_seed = 0;
+	uint32_t block = 0;
+	int position = 1;
+	float clockInput = 0;
+	float resetInput = 0;
 
 	void process(const ProcessArgs &args) override {
 
@@ -77,10 +71,13 @@ struct SeedsOfChangeCVExpander : Module {
 
 			// From Mother	
 			float *messagesFromMother = (float*)leftExpander.consumerMessage;		
-			latest_seed = messagesFromMother[0]; 
-			clockInput = messagesFromMother[1]; 
-			resetInput = messagesFromMother[2]; 
-			gaussianMode = messagesFromMother[3]; 					
+			latest_seed = frozenwasteland::dsp::SeedStreamMessage::seed(messagesFromMother);
+			block = frozenwasteland::dsp::SeedStreamMessage::block(messagesFromMother);
+			position = messagesFromMother[frozenwasteland::dsp::SeedStreamMessage::POSITION];
+			clockInput = messagesFromMother[frozenwasteland::dsp::SeedStreamMessage::CLOCK];
+			gaussianMode = messagesFromMother[frozenwasteland::dsp::SeedStreamMessage::GAUSSIAN];
+			resetInput = messagesFromMother[frozenwasteland::dsp::SeedStreamMessage::RESET];
+			mersenne = messagesFromMother[frozenwasteland::dsp::SeedStreamMessage::MERSENNE];					
 		}
 
 		//Set Expander Info
@@ -89,18 +86,20 @@ struct SeedsOfChangeCVExpander : Module {
 			//Send outputs to slaves if present		
 			float *messageToExpander = (float*)(rightExpander.module->leftExpander.producerMessage);
 			
-			messageToExpander[0] = latest_seed; 
-			messageToExpander[1] = clockInput;
-			messageToExpander[2] = resetInput; 
-			messageToExpander[3] = gaussianMode; 
+			frozenwasteland::dsp::SeedStreamMessage::write(messageToExpander, latest_seed, block, position + 1, clockInput, gaussianMode, resetInput, mersenne);
 			rightExpander.module->leftExpander.messageFlipRequested = true;						
 		}
 			
-        if (resetTrigger.process(resetInput) ) {
-            init_genrand((unsigned long)(latest_seed));
-        } 
+
+		if (resetTrigger.process(resetInput) && mersenne) {
+			twister.seed(latest_seed);
+		}
 
 		if (clockTrigger.process(clockInput)) {
+			//The block the mother drew for this clock, which arrives with it
+			if (!mersenne) {
+				stream.set(latest_seed, block, position);
+			}
 			for (int i=0; i<NBOUT; i++) {
 				float mult=params[MULTIPLY_1_PARAM+i].value;
 				float off=params[OFFSET_1_PARAM+i].value;
@@ -113,7 +112,12 @@ struct SeedsOfChangeCVExpander : Module {
 					off = off + inputs[OFFSET_1_INPUT + i].value ;
 				}
 
-				float initialRandomNumber = gaussianMode ? normal_number() : genrand_real();					
+				float initialRandomNumber;
+				if (mersenne) {
+					initialRandomNumber = gaussianMode ? twister.normal() : twister.real();
+				} else {
+					initialRandomNumber = gaussianMode ? stream.normal(i * 2) : stream.real(i * 2);
+				}					
 				//outbuffer[i] = clamp((float)(initialRandomNumber * mult + off - mult*.5),-10.0f, 10.0f);
 				outbuffer[i] = clamp((float)(initialRandomNumber * mult + off),-10.0f, 10.0f);			
 			}
@@ -139,83 +143,6 @@ void SeedsOfChangeCVExpander::onReset() {
 	clockTrigger.reset();
 }
 
-/* initializes mt[N] with a seed */
-void SeedsOfChangeCVExpander::init_genrand(unsigned long s)
-{
-	
-	s = s>99?99:s;
-	latest_seed = s;
-    mt[0]= s & 0xffffffffUL;
-    for (mti=1; mti<N; mti++) {
-        mt[mti] = 
-	    (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti); 
-        /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-        /* In the previous versions, MSBs of the seed affect   */
-        /* only MSBs of the array mt[].                        */
-        /* 2002/01/09 modified by Makoto Matsumoto             */
-        mt[mti] &= 0xffffffffUL;
-        /* for >32 bit machines */
-    }
-}
-/* generates a random number on [0,0xffffffff]-interval */
-unsigned long SeedsOfChangeCVExpander::genrand_int32()
-{
-    unsigned long y;
-    static unsigned long mag01[2]={0x0UL, MATRIX_A};
-    /* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-    if (mti >= N) { /* generate N words at one time */
-        int kk;
-
-        if (mti == N+1)   /* if init_genrand() has not been called, */
-            init_genrand(5489UL); /* a default initial seed is used */
-
-        for (kk=0;kk<N-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-        mti = 0;
-    }
-  
-    y = mt[mti++];
-
-    /* Tempering */
-    y ^= (y >> 11);
-    y ^= (y << 7) & 0x9d2c5680UL;
-    y ^= (y << 15) & 0xefc60000UL;
-    y ^= (y >> 18);
-
-    return y;
-}
-/* generates a random number on [0,1)-real-interval */
-double SeedsOfChangeCVExpander::genrand_real()
-{
-    return genrand_int32()*(1.0/4294967296.0); 
-    /* divided by 2^32 */
-}
-float SeedsOfChangeCVExpander::normal_number() {
-	const double x1 = .68;
-	const double x2 = .92;
-	double x = genrand_real();
-	double y = genrand_real();
-	double s = (y<.5) ? .5 : -.5;
-	if (x<x1) {
-		return y*.333*s + .5;
-	} else if (x<x2) {
-		return (y*.333+.333)*s + .5;		
-	} else {
-		return (y*.333+.666)*s + .5;
-	}
-}
-
-
 struct SeedsOfChangeCVExpanderSeedDisplay : TransparentWidget {
 	SeedsOfChangeCVExpander *module;
 	int frame = 0;
@@ -1,16 +1,43 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
-#include "ringbuffer.hpp"
-#include "samplerate.h"
+#include "ui/silence_status.hpp"
+#include "string_engine.hpp"
+#include "hand_over.hpp"
+#include "silence_tracker.hpp"
 #include "dsp-noise/noise.hpp"
 
 using namespace frozenwasteland::dsp;
 
-#define HISTORY_SIZE (1<<21)
 #define MAX_GRAINS 8
+#define MAX_VOICES 16
+#define VOICE_BANKS (MAX_VOICES / 4)
+#define STRING_BANKS (MAX_GRAINS * VOICE_BANKS)
+#define MAX_COARSE_DELAY 0.5f //Seconds
+#define MAX_FINE_DELAY 20.f //Milliseconds
+#define MAX_SAMPLE_DELAY 200.f
+#define COLOR_UPDATE_DIVISION 16
+#define IDLE_ENERGY_THRESHOLD 1e-6f
+#define IDLE_ENERGY_RATE 100.f //Energy follower speed in Hz
 #define GRAIN_SPACING 256 //This will undoubtably become a parameter
 
+// One voice's strings, a line for each grain as long as that grain can get
+struct VoiceLines {
+	std::vector<float> lines[MAX_GRAINS];
+
+	// The longest a voice gets with the time knobs all the way up. Lower notes than that stop there
+	static float longestVoice(float sampleRate) {
+		return (MAX_COARSE_DELAY + MAX_FINE_DELAY * 1e-3f) * sampleRate + MAX_SAMPLE_DELAY;
+	}
+
+	// Grain i is at most 1 + i / grainCount times as long as its voice, at full spread, and grainCount is more than i
+	explicit VoiceLines(float sampleRate) {
+		for(int i=0;i<MAX_GRAINS;i++) {
+			lines[i].assign((int) std::ceil(longestVoice(sampleRate) * (1.f + i / (i + 1.f))) + 4, 0.f);
+		}
+	}
+};
+
 struct StringTheory : Module {
 	enum ParamIds {
 		COARSE_TIME_PARAM,
@@ -72,26 +99,45 @@ struct StringTheory : Module {
 		NUM_WINDOW_FUNCTIONS
 	};
 
-	dsp::DoubleRingBuffer<float, HISTORY_SIZE> historyBuffer[MAX_GRAINS];
-	dsp::DoubleRingBuffer<float, 16> outBuffer[MAX_GRAINS];
-	SRC_STATE *src[MAX_GRAINS];
-	dsp::RCFilter lowpassFilter;
-	dsp::RCFilter highpassFilter;
-
+	// Each bank of 4 voices has its own strings, bank i of them holding grain i of the 4 voices.
+	// Filters are laid out voice bank major, so filter (voiceBank * MAX_GRAINS + grain) goes with that grain
+	FrozenWasteland::StringEngine<MAX_GRAINS> strings[VOICE_BANKS];
+	// Each voice's lines, one per grain, made on the UI thread. Only made for as many voices as the patch has played, the first always.
+	// process() asks for more through voicesWanted, and a voice stays silent until its lines have been picked up
+	FrozenWasteland::HandOver<VoiceLines> voiceLines[MAX_VOICES];
+	std::atomic<int> voicesWanted{1};
+	bool voiceStrung[MAX_VOICES] = {};
+	dsp::TRCFilter<simd::float_4> lowpassFilter[STRING_BANKS];
+	dsp::TRCFilter<simd::float_4> highpassFilter[STRING_BANKS];
+	// The filters' cutoffs in radians per sample, and what the loop adds to each string's delay, see loopLatency()
+	float lowpassCutoff = 1.f;
+	float highpassCutoff = 1.f;
+	simd::float_4 stringLatency[STRING_BANKS];
+	dsp::ClockDivider colorDivider;
+	float lastColor = -1.f;
+
+	// One excitation source is shared by every voice
 	WhiteNoiseGenerator _whiteNoise;
 	PinkNoiseGenerator _pinkNoise;
 	GaussianNoiseGenerator _gaussianNoise;
 
-	dsp::SchmittTrigger pluckTrigger, noiseTypeTrigger,windowFunctionTrigger;
-
-	float lastWet[MAX_GRAINS] = {0.f};
-	float individualWet[MAX_GRAINS] = {0.f};
-	bool acceptingInput[MAX_GRAINS]; //If true, means pluck has been activated and will accept input 
-	float timeDelay[MAX_GRAINS] = {0.0};
-	float timeElapsed[MAX_GRAINS] = {0.0};
+	dsp::SchmittTrigger pluckTrigger[MAX_VOICES], noiseTypeTrigger,windowFunctionTrigger;
+
+	// Per grain state is stored [grain][voice] so a voice bank loads straight into a float_4
+	float lastWet[MAX_GRAINS][MAX_VOICES] = {};
+	float individualWet[MAX_GRAINS][MAX_VOICES] = {};
+	float dry[MAX_GRAINS][MAX_VOICES] = {};
+	bool acceptingInput[MAX_GRAINS][MAX_VOICES] = {}; //If true, means pluck has been activated and will accept input 
+	float timeDelay[MAX_GRAINS][MAX_VOICES] = {};
+	float timeElapsed[MAX_GRAINS][MAX_VOICES] = {};
+	float voiceIndex[MAX_VOICES] = {};
+	float voiceEnergy[MAX_VOICES] = {};
+	bool voiceActive[MAX_VOICES] = {};
 	int noiseType = WHITE_NOISE;
 	int windowFunction = NO_WINDOW_FUNCTION;
 	int grainCount = MAX_GRAINS;
+	// Voices go idle by themselves once their tails decay, the module sleeps when all of them have
+	FrozenWasteland::SilenceTracker silence;
 
 	float HanningWindow(float phase) {
 		return 0.5f * (1 - cosf(2 * M_PI * phase));
@@ -112,9 +158,9 @@ struct StringTheory : Module {
 	StringTheory() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		//configParam(COARSE_TIME_PARAM, 0.0f, 1.f, 0.5f, "Coarse Time", " ms",0,500);
-		configParam(COARSE_TIME_PARAM, 0.0f, 1.f, 0.5f, "Coarse Time", " ms",0.5f / 1e-3,1);
-		configParam(FINE_TIME_PARAM, 0.01f, 20.f, 0.01f, "Fine Time", " ms");
-		configParam(SAMPLE_TIME_PARAM, 0.0f, 200.f, 0.0f, "Samples");
+		configParam(COARSE_TIME_PARAM, 0.0f, 1.f, 0.5f, "Coarse Time", " ms",MAX_COARSE_DELAY / 1e-3,1);
+		configParam(FINE_TIME_PARAM, 0.01f, MAX_FINE_DELAY, 0.01f, "Fine Time", " ms");
+		configParam(SAMPLE_TIME_PARAM, 0.0f, MAX_SAMPLE_DELAY, 0.0f, "Samples");
 		configParam(GRAIN_COUNT_PARAM, 1.0f, MAX_GRAINS, 1.0f, "Grain Count");
 		configParam(PHASE_OFFSET_PARAM, 0.0f, 1.f, 0.0f, "Phase Offset", "%", 0, 100);
 		configParam(SPREAD_PARAM, 0.0f, 1.f, 0.0f, "Spread", "%", 0, 100);
@@ -127,52 +173,160 @@ struct StringTheory : Module {
 		configParam(NOISE_TYPE_PARAM, 0.f, 1.f, 0.0f);
 		configParam(WINDOW_FUNCTION_PARAM, 0.f, 1.f, 0.0f);
 
+		colorDivider.setDivision(COLOR_UPDATE_DIVISION);
+		for(int b=0;b<STRING_BANKS;b++) {
+			stringLatency[b] = 1.f;
+		}
+		onSampleRateChange();
+	}
 
+	// Called from the UI thread, which Rack changes the sample rate from. Every voice made so far gets lines for the new rate
+	void onSampleRateChange() override {
+		float sampleRate = APP->engine->getSampleRate();
+		for(int v=0;v<MAX_VOICES;v++) {
+			if(v == 0 || voiceLines[v].latest()) {
+				voiceLines[v].offer(new VoiceLines(sampleRate));
+			}
+		}
+		lastColor = -1.f;
+	}
+
+	// Called from the UI thread. Makes lines for the voices process() has asked for, and deletes the ones it has let go of
+	void makeVoices() {
+		int wanted = voicesWanted.load(std::memory_order_relaxed);
+		for(int v=0;v<MAX_VOICES;v++) {
+			if(v < wanted && !voiceLines[v].latest()) {
+				voiceLines[v].offer(new VoiceLines(APP->engine->getSampleRate()));
+			}
+			voiceLines[v].collect();
+		}
+	}
+
+	// A voice's new lines start out silent
+	void pickUpLines(int v) {
+		if(!voiceLines[v].pickUp())
+			return;
 		for(int i=0;i<MAX_GRAINS;i++) {
-			src[i] = src_new(SRC_SINC_FASTEST, 1, NULL);
-			assert(src[i]);
+			std::vector<float> &line = voiceLines[v]->lines[i];
+			strings[v / 4].attach(i * 4 + v % 4, line.data(), line.size());
 		}
-		//src = src_new(SRC_LINEAR, 1, NULL);
+		voiceStrung[v] = true;
 	}
 
-	~StringTheory() {
+	// A voice that starts again starts from silence, whatever its strings and filters held when it stopped
+	void clearVoice(int v) {
+		int vb = v / 4;
+		int k = v % 4;
 		for(int i=0;i<MAX_GRAINS;i++) {
-			src_delete(src[i]);
+			strings[vb].clear(i * 4 + k);
+			int b = vb * MAX_GRAINS + i;
+			lowpassFilter[b].xstate[0][k] = 0.f;
+			lowpassFilter[b].ystate[0][k] = 0.f;
+			highpassFilter[b].xstate[0][k] = 0.f;
+			highpassFilter[b].ystate[0][k] = 0.f;
+			lastWet[i][v] = 0.f;
+			individualWet[i][v] = 0.f;
+			dry[i][v] = 0.f;
+		}
+	}
+
+	// A single filter design is shared by all voices and grains
+	void updateColor(float color, float sampleRate) {
+		float colorFreq = std::pow(100.f, 2.f * color - 1.f);
+		float lowpassFreq = clamp(20000.f * colorFreq, 20.f, 20000.f);
+		float highpassFreq = clamp(20.f * colorFreq, 20.f, 20000.f);
+		lowpassCutoff = 2.f * M_PI * lowpassFreq / sampleRate;
+		highpassCutoff = highpassFreq / sampleRate;
+		lowpassFilter[0].setCutoff(lowpassCutoff);
+		highpassFilter[0].setCutoff(highpassCutoff);
+		for(int b=1;b<STRING_BANKS;b++) {
+			lowpassFilter[b].c = lowpassFilter[0].c;
+			highpassFilter[b].c = highpassFilter[0].c;
+		}
+		lastColor = color;
+	}
+
+	// A string's output is fed back in a sample after it is read, and the color filters delay it by their phase delay at the string's pitch.
+	// They are bilinear RC filters, so at w radians per sample they have the analog filters' phase at 2 tan(w / 2)
+	simd::float_4 loopLatency(simd::float_4 delay) {
+		simd::float_4 latency;
+		for(int k=0;k<4;k++) {
+			float w = 2.f * M_PI / std::max(delay[k], 2.5f);
+			float analog = 2.f * std::tan(w / 2.f);
+			latency[k] = 1.f + (std::atan(analog / lowpassCutoff) - std::atan(highpassCutoff / analog)) / w;
+		}
+		return latency;
+	}
+
+	float excitation() {
+		switch(noiseType) {
+			case PINK_NOISE :
+				return _pinkNoise.next() * 5.0f;
+			case GAUSSIAN_NOISE :
+				return _gaussianNoise.next() * 5.0f;
+			default :
+				return _whiteNoise.next() * 5.0f;
 		}
 	}
 
 	void process(const ProcessArgs &args) override {
 		
 		grainCount = params[GRAIN_COUNT_PARAM].getValue();
+		int channels = std::max(std::max(inputs[V_OCT_INPUT].getChannels(), inputs[PLUCK_INPUT].getChannels()), 1);
+		bool polyphonic = channels > 1;
+		int voiceBanks = (channels + 3) / 4;
+		if(channels > voicesWanted.load(std::memory_order_relaxed)) {
+			voicesWanted.store(channels, std::memory_order_relaxed);
+		}
+		for(int v=0;v<channels;v++) {
+			pickUpLines(v);
+		}
 
 		// Compute delay time in seconds - eventually milliseconds
 		float coarseDelay = params[COARSE_TIME_PARAM].getValue() + inputs[COARSE_TIME_INPUT].getVoltage() / 10.f;
 		coarseDelay = clamp(coarseDelay, 0.f, 1.f);
-		coarseDelay = 1e-3 * std::pow(0.5f / 1e-3, coarseDelay);
+		coarseDelay = 1e-3 * std::pow(MAX_COARSE_DELAY / 1e-3, coarseDelay);
 
 		float fineDelay = params[FINE_TIME_PARAM].getValue() + inputs[FINE_TIME_INPUT].getVoltage() / 10.f;
-		fineDelay = 1e-3 * fineDelay;
+		fineDelay = 1e-3 * clamp(fineDelay, 0.01f, MAX_FINE_DELAY);
 
 		// Number of delay samples
 		float delay = coarseDelay + fineDelay;
-
-		float pitch = inputs[V_OCT_INPUT].getVoltage();
-		delay = delay / std::pow(2.0f, pitch);
-
-		//float index = std::round(delay * args.sampleRate) + params[SAMPLE_TIME_PARAM].getValue() ; // Maybe get rid of rounding
-		float index = (delay * args.sampleRate) + params[SAMPLE_TIME_PARAM].getValue() ; // Maybe get rid of rounding
-
-		float pluckInput = params[PLUCK_PARAM].getValue();
-		if(inputs[PLUCK_INPUT].isConnected()) {
-			pluckInput += inputs[PLUCK_INPUT].getVoltage();
-		} 
-		if(pluckTrigger.process(pluckInput)) {
-			for(int i=0; i<grainCount;i++) {
-				acceptingInput[i] = true;
-				timeElapsed[i] = 0.0;
-				timeDelay[i] = ((float) i) * index / 2.0 * (params[PHASE_OFFSET_PARAM].getValue() + inputs[PHASE_OFFSET_INPUT].getVoltage() / 10.0f );
+		float phaseOffset = params[PHASE_OFFSET_PARAM].getValue() + inputs[PHASE_OFFSET_INPUT].getVoltage() / 10.0f;
+
+		float spread = params[SPREAD_PARAM].getValue() + inputs[SPREAD_INPUT].getVoltage() / 10.0f;
+		spread = clamp(spread, 0.f, 1.f);
+		float longest = VoiceLines::longestVoice(args.sampleRate);
+
+		for(int v=0;v<channels;v++) {
+			float pitch = inputs[V_OCT_INPUT].getPolyVoltage(v);
+			//float index = std::round(delay * args.sampleRate) + params[SAMPLE_TIME_PARAM].getValue() ; // Maybe get rid of rounding
+			voiceIndex[v] = (delay / std::pow(2.0f, pitch) * args.sampleRate) + params[SAMPLE_TIME_PARAM].getValue() ; // Maybe get rid of rounding
+			voiceIndex[v] = std::min(voiceIndex[v], longest);
+
+			float pluckInput = params[PLUCK_PARAM].getValue();
+			if(inputs[PLUCK_INPUT].isConnected()) {
+				pluckInput += inputs[PLUCK_INPUT].getPolyVoltage(v);
+			} 
+			if(pluckTrigger[v].process(pluckInput) && voiceStrung[v]) {
+				if(!voiceActive[v])
+					clearVoice(v);
+				voiceActive[v] = true;
+				voiceEnergy[v] = 1.0f;
+				for(int i=0; i<grainCount;i++) {
+					acceptingInput[i][v] = true;
+					timeElapsed[i][v] = 0.0;
+					timeDelay[i][v] = ((float) i) * voiceIndex[v] / 2.0 * phaseOffset;
+				}
+			}	
+		}
+		// Voices above the channel count fall silent and go idle
+		for(int v=channels;v<MAX_VOICES;v++) {
+			voiceActive[v] = false;
+			for(int i=0; i<MAX_GRAINS;i++) {
+				acceptingInput[i][v] = false;
 			}
-		}	
+		}
 
 		if(noiseTypeTrigger.process(params[NOISE_TYPE_PARAM].getValue())) {
 			noiseType = (noiseType + 1) % NUM_NOISE_TYPES;
@@ -203,160 +357,198 @@ struct StringTheory : Module {
 		int ringModGrain = clamp(params[RING_MOD_GRAIN_PARAM].getValue() + inputs[RING_MOD_GRAIN_INPUT].getVoltage() / 10.0f,0.0,(float)grainCount);
 		float ringModMix = clamp(params[RING_MOD_MIX_PARAM].getValue() + inputs[RING_MOD_MIX_INPUT].getVoltage() / 10.0f,0.0f,1.0f);
 
-
-		float ringModIn = 0.0;
 		switch(noiseType) {
 			case WHITE_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 1;
 				lights[NOISE_TYPE_LIGHT + 1].value = 1;
 				lights[NOISE_TYPE_LIGHT + 2].value = 1;
-				ringModIn = _whiteNoise.next() * 5.0f;
 				break;
 			case PINK_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 1;
 				lights[NOISE_TYPE_LIGHT + 1].value = 0.1;
 				lights[NOISE_TYPE_LIGHT + 2].value = 0.1;
-				ringModIn = _pinkNoise.next() * 5.0f;
 				break;
 			case GAUSSIAN_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 0.2f;
 				lights[NOISE_TYPE_LIGHT + 1].value = 0.2f;
 				lights[NOISE_TYPE_LIGHT + 2].value = 0.2f;
-				ringModIn = _gaussianNoise.next() * 5.0f;
 				break;
 		}
+		bool sounding = false;
+		for(int v=0;v<channels;v++) {
+			sounding = sounding || voiceActive[v];
+		}
+		if(sounding) {
+			silence.wake();
+		} else {
+			silence.sleep();
+			for(int v=0;v<channels;v++) {
+				outputs[OUT_OUTPUT].setVoltage(0.f, v);
+			}
+			outputs[OUT_OUTPUT].setChannels(channels);
+			outputs[FB_SEND_OUTPUT].setChannels(polyphonic ? 1 : grainCount);
+			for(int i=0;i<grainCount;i++) {
+				outputs[FB_SEND_OUTPUT].setVoltage(0.f, i);
+			}
+			return;
+		}
+
+		float ringModIn = excitation();
 		if(inputs[EXTERNAL_RING_MOD_INPUT].isConnected()) {
 			ringModIn = inputs[EXTERNAL_RING_MOD_INPUT].getVoltage();
 		}
 
-	
-		for(int i=0; i<grainCount;i++) {
-			timeDelay[i] -= 1.0;
-			if(timeDelay[i] > 0)
-				continue;
+		float feedback = params[FEEDBACK_PARAM].getValue() + inputs[FEEDBACK_INPUT].getVoltage() / 10.f;
+		feedback = clamp(feedback, 0.f, 1.f);
 
-			timeElapsed[i] += 1.0;
-			if(timeElapsed[i] > index * (1.0 + (float)i / (float)grainCount * (params[SPREAD_PARAM].getValue() + inputs[SPREAD_INPUT].getVoltage() / 10.0f ))) {
-				acceptingInput[i] = false;
+		// Loop filter coefficients and the loop's latency only move at control rate
+		bool controlRate = colorDivider.process() || lastColor < 0.f;
+		if(controlRate) {
+			float color = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 10.f;
+			color = clamp(color, 0.f, 1.f);
+			if(color != lastColor) {
+				updateColor(color, args.sampleRate);
 			}
+		}
+
+		for(int v=0;v<channels;v++) {
+			if(!voiceActive[v])
+				continue;
+			float index = voiceIndex[v];
+			for(int i=0; i<grainCount;i++) {
+				float grainIndex = index * (1.0 + (float)i / (float)grainCount * spread);
 
+				timeDelay[i][v] -= 1.0;
+				if(timeDelay[i][v] > 0) {
+					dry[i][v] = lastWet[i][v] * feedback;
+					continue;
+				}
 
-			float in = 0.0;
-			if(acceptingInput[i]) {
-				float phase = timeElapsed[i] / index;
-				// Get input to delay block
-				if(inputs[IN_INPUT].isConnected()) {
-					in = inputs[IN_INPUT].getVoltage();
-				} else {
-					switch(noiseType) {
-						case WHITE_NOISE :
-							in = _whiteNoise.next() * 5.0f;
+				timeElapsed[i][v] += 1.0;
+				if(timeElapsed[i][v] > grainIndex) {
+					acceptingInput[i][v] = false;
+				}
+
+				float in = 0.0;
+				if(acceptingInput[i][v]) {
+					float phase = timeElapsed[i][v] / index;
+					// Get input to delay block
+					if(inputs[IN_INPUT].isConnected()) {
+						in = inputs[IN_INPUT].getPolyVoltage(v);
+					} else {
+						in = excitation();
+					}
+					switch (windowFunction) {
+						case NO_WINDOW_FUNCTION :
 							break;
-						case PINK_NOISE :
-							in = _pinkNoise.next() * 5.0f;
+						case HANNING_WINDOW_FUNCTION :
+							in = in * HanningWindow(phase);
 							break;
-						case GAUSSIAN_NOISE :
-							in = _gaussianNoise.next() * 5.0f;
+						case BLACKMAN_WINDOW_FUNCTION :
+							in = in * BlackmanWindow(phase);
 							break;
 					}
 				}
-				switch (windowFunction) {
-					case NO_WINDOW_FUNCTION :
-						break;
-					case HANNING_WINDOW_FUNCTION :
-						in = in * HanningWindow(phase);
-						break;
-					case BLACKMAN_WINDOW_FUNCTION :
-						in = in * BlackmanWindow(phase);
-						break;
-				}
-			}
-
-			float feedback = params[FEEDBACK_PARAM].getValue() + inputs[FEEDBACK_INPUT].getVoltage() / 10.f;
-			feedback = clamp(feedback, 0.f, 1.f);
-			float dry = in + lastWet[i] * feedback;
 
-
-			// Push dry sample into history buffer
-			if (!historyBuffer[i].full()) {
-				historyBuffer[i].push(dry);
+				dry[i][v] = in + lastWet[i][v] * feedback;
 			}
+		}
 
-			// How many samples do we need consume to catch up?
-			float consume = (index * (1.0 + (float)i / (float)grainCount * (params[SPREAD_PARAM].getValue() + inputs[SPREAD_INPUT].getVoltage() / 10.0f))) - historyBuffer[i].size();
-
-			if (outBuffer[i].empty()) {
-				double ratio = 1.f;
-				if (std::fabs(consume) >= 16.f) {
-					// Here's where the delay magic is. Smooth the ratio depending on how divergent we are from the correct delay time.
-					//ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f,	 1.f));
-					//ratio = std::pow(10.f, clamp(consume / 10000.f, -4.f, 4.f));
-					ratio = std::pow(10.f, consume / 10000.f);
+		// Strings run across voices, 4 voices per bank. Banks whose voices are all idle are skipped.
+		for(int vb=0;vb<voiceBanks;vb++) {
+			if(!(voiceActive[vb*4] || voiceActive[vb*4+1] || voiceActive[vb*4+2] || voiceActive[vb*4+3]))
+				continue;
+			simd::float_4 index = simd::float_4::load(&voiceIndex[vb * 4]);
+			for(int i=0; i<grainCount;i++) {
+				int b = vb * MAX_GRAINS + i;
+				simd::float_4 grainDelay = index * (1.0f + (float)i / (float)grainCount * spread);
+				if(controlRate) {
+					stringLatency[b] = loopLatency(grainDelay);
+				}
+				strings[vb].setDelay(i, grainDelay, stringLatency[b]);
+
+				simd::float_4 wet = strings[vb].read(i);
+				// The feedback insert carries grains, so it is only available to a single voice
+				if(!polyphonic) {
+					outputs[FB_SEND_OUTPUT].setVoltage(wet[0],i);
+					if(inputs[FB_RETURN_INPUT].isConnected()) {
+						wet[0] = inputs[FB_RETURN_INPUT].getPolyVoltage(i);
+					}
 				}
 
-				SRC_DATA srcData;
-				srcData.data_in = (const float*) historyBuffer[i].startData();
-				srcData.data_out = (float*) outBuffer[i].endData();
-				srcData.input_frames = std::min((int) historyBuffer[i].size(), 16);
-				srcData.output_frames = outBuffer[i].capacity();
-				srcData.end_of_input = false;
-				srcData.src_ratio = ratio;
-				src_process(src[i], &srcData);
-				historyBuffer[i].startIncr(srcData.input_frames_used);
-				outBuffer[i].endIncr(srcData.output_frames_gen);
-			}
-
-			individualWet[i] = 0.0f;
-			if (!outBuffer[i].empty()) {
-				individualWet[i] = outBuffer[i].shift();
-			}
-
-			// if(i < ringModGrain) {
-			// 	float ringModdedValue = ringModIn * individualWet[i] / 5.0f;
-			// 	individualWet[i] = lerp(individualWet[i], ringModdedValue, ringModMix);
-			// }
-
-			outputs[FB_SEND_OUTPUT].setVoltage(individualWet[i],i);
+				// Apply color to delay wet output
+				lowpassFilter[b].process(wet);
+				wet = lowpassFilter[b].lowpass();
+				highpassFilter[b].process(wet);
+				wet = highpassFilter[b].highpass();
+				wet.store(&individualWet[i][vb * 4]);
 
-			if(inputs[FB_RETURN_INPUT].isConnected()) {
-				individualWet[i] = inputs[FB_RETURN_INPUT].getPolyVoltage(i);			
+				strings[vb].write(i, simd::float_4::load(&dry[i][vb * 4]));
 			}
-
-			// Apply color to delay wet output
-			float color = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 10.f;
-			color = clamp(color, 0.f, 1.f);
-			float colorFreq = std::pow(100.f, 2.f * color - 1.f);
-
-			float lowpassFreq = clamp(20000.f * colorFreq, 20.f, 20000.f);
-			lowpassFilter.setCutoffFreq(lowpassFreq / args.sampleRate);
-			lowpassFilter.process(individualWet[i]);
-			individualWet[i] = lowpassFilter.lowpass();
-
-			float highpassFreq = clamp(20.f * colorFreq, 20.f, 20000.f);
-			highpassFilter.setCutoff(highpassFreq / args.sampleRate);
-			highpassFilter.process(individualWet[i]);
-			individualWet[i] = highpassFilter.highpass();
-			
 		}
 
-		float wet = 0.f;
-		for(int i= 0; i<grainCount;i++) {
-			lastWet[i] = individualWet[(i + feedBackShift) % grainCount];
-			if(i < ringModGrain) {
-				float ringModdedValue = ringModIn * individualWet[i] / 5.0f;
-				individualWet[i] = lerp(individualWet[i], ringModdedValue, ringModMix);
+		for(int v=0;v<channels;v++) {
+			if(!voiceActive[v]) {
+				outputs[OUT_OUTPUT].setVoltage(0.f, v);
+				continue;
+			}
+			float wet = 0.f;
+			float energy = 0.f;
+			bool excited = false;
+			for(int i= 0; i<grainCount;i++) {
+				lastWet[i][v] = individualWet[(i + feedBackShift) % grainCount][v];
+				energy += individualWet[i][v] * individualWet[i][v];
+				excited = excited || acceptingInput[i][v] || timeDelay[i][v] > 0;
+				if(i < ringModGrain) {
+					float ringModdedValue = ringModIn * individualWet[i][v] / 5.0f;
+					individualWet[i][v] = lerp(individualWet[i][v], ringModdedValue, ringModMix);
+				}
+				wet += individualWet[i][v];
+			}
+			wet = wet / std::sqrt((float)grainCount); //RMS 
+			outputs[OUT_OUTPUT].setVoltage(wet, v);
+
+			// Once the tail has decayed the voice stops costing anything until it is plucked again
+			voiceEnergy[v] += (energy - voiceEnergy[v]) * std::min(IDLE_ENERGY_RATE * args.sampleTime, 1.f);
+			if(!excited && voiceEnergy[v] < IDLE_ENERGY_THRESHOLD) {
+				voiceActive[v] = false;
+				for(int i=0; i<MAX_GRAINS;i++) {
+					lastWet[i][v] = 0.f;
+					individualWet[i][v] = 0.f;
+					dry[i][v] = 0.f;
+				}
 			}
-			wet += individualWet[i];
 		}
-		wet = wet / std::sqrt((float)grainCount); //RMS 
 		
-		outputs[FB_SEND_OUTPUT].setChannels(grainCount);
-		outputs[OUT_OUTPUT].setVoltage(wet);
+		if(polyphonic) {
+			outputs[FB_SEND_OUTPUT].setVoltage(0.f);
+		}
+		outputs[FB_SEND_OUTPUT].setChannels(polyphonic ? 1 : grainCount);
+		outputs[OUT_OUTPUT].setChannels(channels);
 	}
 };
 
 
 struct StringTheoryWidget : ModuleWidget {
+	void step() override {
+		StringTheory *module = dynamic_cast<StringTheory*>(this->module);
+		if (module)
+			module->makeVoices();
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		StringTheory *module = dynamic_cast<StringTheory*>(this->module);
+		assert(module);
+
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+	}
+
 	StringTheoryWidget(StringTheory *module) {
 		setModule(module);
 		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/StringTheory.svg")));
@@ -3,6 +3,10 @@
 #include "ui/knobs.hpp"
 
 #define BUFFER_SIZE 512
+#define MAX_POLYPHONY 16
+#define RESAMPLER_QUALITY 8
+
+using simd::float_4;
 
 struct TheOneRingModulator : Module {
 	enum ParamIds {
@@ -38,6 +42,98 @@ struct TheOneRingModulator : Module {
 		BLINK_LIGHT_4,
 		NUM_LIGHTS
 	};
+	enum QualityModes {
+		NAIVE_QUALITY,
+		ADAA_QUALITY,
+		ADAA_2X_QUALITY,
+		ADAA_4X_QUALITY,
+		NUM_QUALITY_MODES
+	};
+
+	// Piecewise diode response: zero below the bias, quadratic knee up to the linear voltage, then a straight line
+	struct DiodeCurve {
+		float vb = 0.f;
+		float vl = 0.5f;
+		float h = 1.f;
+		float k = 1.f; // Quadratic knee
+		float c = 0.f; // Linear section offset
+		float Fl = 0.f; // Antiderivative at the start of the linear section
+
+		void set(float voltageBias, float voltageLinear, float slope, float nonLinearity) {
+			vb = voltageBias;
+			vl = voltageLinear;
+			h = slope;
+			k = h / (nonLinearity * (vl - vb));
+			c = -h * vl + k * (vl - vb) * (vl - vb);
+			Fl = k / 3.f * (vl - vb) * (vl - vb) * (vl - vb);
+		}
+
+		float_4 f(float_4 v) const {
+			float_4 d = v - vb;
+			float_4 knee = k * d * d;
+			float_4 linear = h * v + c;
+			return simd::ifelse(v <= vb, 0.f, simd::ifelse(v <= vl, knee, linear));
+		}
+
+		float_4 F(float_4 v) const {
+			float_4 d = v - vb;
+			float_4 knee = k / 3.f * d * d * d;
+			float_4 linear = Fl + h / 2.f * (v * v - vl * vl) + c * (v - vl);
+			return simd::ifelse(v <= vb, 0.f, simd::ifelse(v <= vl, knee, linear));
+		}
+	};
+
+	// First order antiderivative antialiasing of one diode input
+	struct DiodeADAA {
+		float_4 x1 = 0.f;
+		float_4 F1 = 0.f;
+
+		float_4 process(const DiodeCurve &curve, float_4 x) {
+			float_4 F = curve.F(x);
+			float_4 dx = x - x1;
+			float_4 slope = (F - F1) / simd::ifelse(dx == 0.f, 1.f, dx);
+			float_4 y = simd::ifelse(simd::fabs(dx) < 1e-4f, curve.f(0.5f * (x + x1)), slope);
+			x1 = x;
+			F1 = F;
+			return y;
+		}
+
+		// Cached antiderivative has to follow the curve when it changes
+		void refresh(const DiodeCurve &curve) {
+			F1 = curve.F(x1);
+		}
+	};
+
+	// One ring of 4 diodes for 4 channels
+	struct DiodeRing {
+		DiodeADAA dPA, dMA, dPB, dMB;
+
+		float_4 process(const DiodeCurve &curve, float_4 vIn, float_4 vC, bool adaa) {
+			float_4 A = 0.5f * vIn + vC;
+			float_4 B = vC - 0.5f * vIn;
+			if(!adaa)
+				return curve.f(A) + curve.f(-A) - curve.f(B) - curve.f(-B);
+			return dPA.process(curve, A) + dMA.process(curve, -A) - dPB.process(curve, B) - dMB.process(curve, -B);
+		}
+
+		void refresh(const DiodeCurve &curve) {
+			dPA.refresh(curve);
+			dMA.refresh(curve);
+			dPB.refresh(curve);
+			dMB.refresh(curve);
+		}
+	};
+
+	DiodeCurve curve;
+	DiodeRing rings[MAX_POLYPHONY / 4];
+	dsp::Upsampler<2, RESAMPLER_QUALITY, float_4> signalUpsampler2x[MAX_POLYPHONY / 4], carrierUpsampler2x[MAX_POLYPHONY / 4];
+	dsp::Decimator<2, RESAMPLER_QUALITY, float_4> decimator2x[MAX_POLYPHONY / 4];
+	dsp::Upsampler<4, RESAMPLER_QUALITY, float_4> signalUpsampler4x[MAX_POLYPHONY / 4], carrierUpsampler4x[MAX_POLYPHONY / 4];
+	dsp::Decimator<4, RESAMPLER_QUALITY, float_4> decimator4x[MAX_POLYPHONY / 4];
+	// Upsampling then decimating delays the wet signal by RESAMPLER_QUALITY - 1 samples at either rate, so the dry signal is held back as long
+	float_4 dryDelay[MAX_POLYPHONY / 4][RESAMPLER_QUALITY - 1] = {};
+	int dryDelayIndex = 0;
+	int quality = ADAA_QUALITY;
 
 
 	float bufferX1[BUFFER_SIZE] = {};
@@ -56,22 +152,6 @@ struct TheOneRingModulator : Module {
 	//SchmittTrigger resetTrigger;
 
 
-	inline float diode_sim(float inVoltage )
-	  {
-	  	//Original
-	  	//if( inVoltage < 0 ) return 0;
-      	//	else return 0.2 * log( 1.0 + exp( 10 * ( inVoltage - 1 ) ) );
-	  	
-      	//Mine
-	  	if( inVoltage <= voltageBias ) 
-	  		return 0;
-	    if( inVoltage <= voltageLinear) {
-	    	return h * (inVoltage - voltageBias) * (inVoltage - voltageBias) / ((nl * voltageLinear) - (nl * voltageBias));
-	    } else {
-	    	return (h * inVoltage) - (h * voltageLinear) + (h * ((voltageLinear - voltageBias) * (voltageLinear - voltageBias) / ((nl * voltageLinear) - (nl * voltageBias))));
-	    }	    
-	  }
-
 	TheOneRingModulator()  {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);		
 		configParam(FORWARD_BIAS_PARAM, 0.0, 10.0, 0.0,"Forward Bias","v");
@@ -84,9 +164,22 @@ struct TheOneRingModulator : Module {
 		// configParam(NONLINEARITY_ATTENUVERTER_PARAM, -1.0, 1.0, 0.0,"Nonlinearity CV Attenuation","%",0,100);
 		configParam(MIX_PARAM, -0.0, 1.0, 0.5,"Mix","%",0,100);
 
+		curve.set(voltageBias, voltageLinear, h, nl);
 	}
 	void process(const ProcessArgs &args) override;
 
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "quality", json_integer((int) quality));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ)
+			quality = clamp((int) json_integer_value(qualityJ), 0, NUM_QUALITY_MODES - 1);
+	}
+
 	// For more advanced Module features, read Rack's engine.hpp header file
 	// - dataToJson, dataFromJson: serialization of internal data
 	// - onSampleRateChange: event triggered by a change of sample rate
@@ -96,27 +189,66 @@ struct TheOneRingModulator : Module {
 
 void TheOneRingModulator::process(const ProcessArgs &args) {
 
-	
-    float vIn = inputs[ SIGNAL_INPUT ].getVoltage();
-    float vC  = inputs[ CARRIER_INPUT ].getVoltage();
     float wd  = params[ MIX_PARAM ].getValue();
 
-    voltageBias = clamp(params[FORWARD_BIAS_PARAM].getValue() + (inputs[FORWARD_BIAS_CV_INPUT].getVoltage() * params[FORWARD_BIAS_ATTENUVERTER_PARAM].getValue()),0.0,10.0);
-	voltageLinear = clamp(params[LINEAR_VOLTAGE_PARAM].getValue() + (inputs[LINEAR_VOLTAGE_CV_INPUT].getVoltage() * params[LINEAR_VOLTAGE_ATTENUVERTER_PARAM].getValue()),voltageBias + 0.001f,10.0);
-    h = clamp(params[SLOPE_PARAM].getValue() + (inputs[SLOPE_CV_INPUT].getVoltage() / 10.0 * params[SLOPE_ATTENUVERTER_PARAM].getValue()),0.1f,1.0f);
+    float newBias = clamp(params[FORWARD_BIAS_PARAM].getValue() + (inputs[FORWARD_BIAS_CV_INPUT].getVoltage() * params[FORWARD_BIAS_ATTENUVERTER_PARAM].getValue()),0.0,10.0);
+	float newLinear = clamp(params[LINEAR_VOLTAGE_PARAM].getValue() + (inputs[LINEAR_VOLTAGE_CV_INPUT].getVoltage() * params[LINEAR_VOLTAGE_ATTENUVERTER_PARAM].getValue()),newBias + 0.001f,10.0);
+    float newH = clamp(params[SLOPE_PARAM].getValue() + (inputs[SLOPE_CV_INPUT].getVoltage() / 10.0 * params[SLOPE_ATTENUVERTER_PARAM].getValue()),0.1f,1.0f);
 	//nl = clamp(params[NONLINEARITY_PARAM].getValue() + (inputs[NONLINEARITY_CV_INPUT].getVoltage() / 10.0 * params[NONLINEARITY_ATTENUVERTER_PARAM].getValue()),0.5f,3.0f);
 
-    float A = 0.5 * vIn + vC;
-    float B = vC - 0.5 * vIn;
+	int channels = std::max(std::max(inputs[SIGNAL_INPUT].getChannels(), inputs[CARRIER_INPUT].getChannels()), 1);
 
-    float dPA = diode_sim( A );
-    float dMA = diode_sim( -A );
-    float dPB = diode_sim( B );
-    float dMB = diode_sim( -B );
+	// Only redesign the curve when the controls move
+	bool curveChanged = newBias != voltageBias || newLinear != voltageLinear || newH != h;
+	if (curveChanged) {
+		voltageBias = newBias;
+		voltageLinear = newLinear;
+		h = newH;
+		curve.set(voltageBias, voltageLinear, h, nl);
+	}
 
-    float res = dPA + dMA - dPB - dMB;
-    //outputs[WET_OUTPUT].setVoltage(res);
-    outputs[MIX_OUTPUT].setVoltage(wd * res + ( 1.0 - wd ) * vIn);
+	bool adaa = quality != NAIVE_QUALITY;
+	bool oversampled = quality == ADAA_2X_QUALITY || quality == ADAA_4X_QUALITY;
+	for (int c = 0; c < channels; c += 4) {
+		DiodeRing &ring = rings[c / 4];
+		if (curveChanged)
+			ring.refresh(curve);
+
+		float_4 vIn = inputs[ SIGNAL_INPUT ].getPolyVoltageSimd<float_4>(c);
+		float_4 vC  = inputs[ CARRIER_INPUT ].getPolyVoltageSimd<float_4>(c);
+
+		float_4 res;
+		if (quality == ADAA_2X_QUALITY) {
+			float_4 inUp[2], carrierUp[2], resUp[2];
+			signalUpsampler2x[c / 4].process(vIn, inUp);
+			carrierUpsampler2x[c / 4].process(vC, carrierUp);
+			for (int i = 0; i < 2; i++) {
+				resUp[i] = ring.process(curve, inUp[i], carrierUp[i], adaa);
+			}
+			res = decimator2x[c / 4].process(resUp);
+		} else if (quality == ADAA_4X_QUALITY) {
+			float_4 inUp[4], carrierUp[4], resUp[4];
+			signalUpsampler4x[c / 4].process(vIn, inUp);
+			carrierUpsampler4x[c / 4].process(vC, carrierUp);
+			for (int i = 0; i < 4; i++) {
+				resUp[i] = ring.process(curve, inUp[i], carrierUp[i], adaa);
+			}
+			res = decimator4x[c / 4].process(resUp);
+		} else {
+			res = ring.process(curve, vIn, vC, adaa);
+		}
+
+		if (oversampled) {
+			float_4 &delayed = dryDelay[c / 4][dryDelayIndex];
+			std::swap(vIn, delayed);
+		}
+
+	    //outputs[WET_OUTPUT].setVoltageSimd(res, c);
+	    outputs[MIX_OUTPUT].setVoltageSimd(wd * res + ( 1.0f - wd ) * vIn, c);
+	}
+	if (oversampled)
+		dryDelayIndex = (dryDelayIndex + 1) % (RESAMPLER_QUALITY - 1);
+	outputs[MIX_OUTPUT].setChannels(channels);
 }
 
 
@@ -222,6 +354,38 @@ struct TheOneRingModulatorWidget : ModuleWidget {
 		addOutput(createOutput<PJ301MPort>(Vec(122, 330), module, TheOneRingModulator::MIX_OUTPUT));
 		
 	}
+
+	struct QualityItem : MenuItem {
+		TheOneRingModulator *module;
+		int quality;
+		void onAction(const event::Action &e) override {
+			module->quality = quality;
+		}
+		void step() override {
+			rightText = (module->quality == quality) ? "✔" : "";
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		TheOneRingModulator *module = dynamic_cast<TheOneRingModulator*>(this->module);
+		assert(module);
+
+		MenuLabel *qualityLabel = new MenuLabel();
+		qualityLabel->text = "Quality";
+		menu->addChild(qualityLabel);
+
+		const char *qualityNames[TheOneRingModulator::NUM_QUALITY_MODES] = {"Naive", "Antialiased", "Antialiased + 2x Oversampling", "Antialiased + 4x Oversampling"};
+		for (int i = 0; i < TheOneRingModulator::NUM_QUALITY_MODES; i++) {
+			QualityItem *qualityItem = new QualityItem();
+			qualityItem->text = qualityNames[i];
+			qualityItem->module = module;
+			qualityItem->quality = i;
+			menu->addChild(qualityItem);
+		}
+	}
 };
 
 Model *modelTheOneRingModulator = createModel<TheOneRingModulator, TheOneRingModulatorWidget>("TheOneRingModulator");
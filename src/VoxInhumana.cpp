@@ -1,10 +1,16 @@
 #include "FrozenWasteland.hpp"
 #include "StateVariableFilter.h"
 #include "ui/knobs.hpp"
+#include "ui/silence_status.hpp"
+#include "silence_tracker.hpp"
+#include "denormal.hpp"
 
 using namespace std;
 
 #define BANDS 5
+#define VOICE_TYPES 5
+#define VOWELS 5
+#define CONTROL_DIVISION 16
 
 struct VoxInhumana : Module {
 	typedef float T;
@@ -72,19 +78,34 @@ struct VoxInhumana : Module {
 	};
 	
 	StateVariableFilterState<T> filterStates[BANDS * 2];
+	FrozenWasteland::SilenceTracker silence;
+	FrozenWasteland::DenormalStats denormals{"VoxInhumana"};
     StateVariableFilterParams<T> filterParams[BANDS * 2];
 	
 	float freq[BANDS] = {0};
-	float lastFreq[BANDS] = {0};
 
 	float Q[BANDS] = {0};
 	float expanderQ[BANDS] = {0};
-	float lastQ[BANDS] = {0};
-
-	float peak[BANDS] = {0};
 
 	bool twelveDbSlope[BANDS] = {false};
 
+	// Formant settings at every (voice type, vowel) point, built for the current sample rate
+	struct FormantCoefficients {
+		float Fc;
+		float Q;
+		float gain;
+	};
+	FormantCoefficients formantGrid[VOICE_TYPES][VOWELS][BANDS];
+
+	// Filter settings are worked out every CONTROL_DIVISION samples and ramped to in between
+	dsp::ClockDivider controlDivider;
+	float currentFc[BANDS] = {0};
+	float currentBandwidth[BANDS] = {0};
+	float currentGain[BANDS] = {0};
+	float fcStep[BANDS] = {0};
+	float bandwidthStep[BANDS] = {0};
+	float gainStep[BANDS] = {0};
+
 	int vowel1 = 0;
 	int vowel2 = 0;
 	float vowelBalance = 0;
@@ -96,7 +117,7 @@ struct VoxInhumana : Module {
 	}
 
 
-	// First Index is Voice Type (soprano,alto,counter-tenor,tenor,bass)
+	// First Index is Voice Type (bass,tenor,counter-tenor,alto,soprano)
 	// Second Index is Vowel (a,e,i,o,u) // should find more
 	// Third if filter/formant index
 	// Fourth: Cutoff,Q,Peak db)
@@ -145,6 +166,9 @@ struct VoxInhumana : Module {
 
 	VoxInhumana() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		for(int i=0;i<BANDS*2;i++) {
+			denormals.add("formant " + std::to_string(i % BANDS + 1) + (i < BANDS ? "" : " second stage"));
+		}
 
 		configParam(VOWEL_1_PARAM, 0, 4.6, 0,"Vowel 1");
 		configParam(VOWEL_2_PARAM, 0, 4.6, 0,"Vowel 2");
@@ -186,9 +210,41 @@ struct VoxInhumana : Module {
 	        filterParams[i].setFreq(T(.1));
 	    }
 
+		controlDivider.setDivision(CONTROL_DIVISION);
+		onSampleRateChange();
 		onReset();
 	}
 
+	void onSampleRateChange() override {
+		float sampleRate = APP->engine->getSampleRate();
+		for(int v = 0; v < VOICE_TYPES; v++) {
+			for(int vowel = 0; vowel < VOWELS; vowel++) {
+				for(int i = 0; i < BANDS; i++) {
+					formantGrid[v][vowel][i].Fc = formantParameters[v][vowel][i][0] / sampleRate;
+					formantGrid[v][vowel][i].Q = formantParameters[v][vowel][i][1];
+					formantGrid[v][vowel][i].gain = powf(10,formantParameters[v][vowel][i][2] / 20.0f);
+				}
+			}
+		}
+	}
+
+	/** Bilinear interpolation of the grid at a point between voice types and vowels. */
+	FormantCoefficients morph(float voicePosition, float vowelPosition, int band) {
+		int v = std::min((int) voicePosition, VOICE_TYPES - 2);
+		int vowel = std::min((int) vowelPosition, VOWELS - 2);
+		float vf = voicePosition - v;
+		float vowelf = vowelPosition - vowel;
+		const FormantCoefficients &c00 = formantGrid[v][vowel][band];
+		const FormantCoefficients &c01 = formantGrid[v][vowel + 1][band];
+		const FormantCoefficients &c10 = formantGrid[v + 1][vowel][band];
+		const FormantCoefficients &c11 = formantGrid[v + 1][vowel + 1][band];
+		FormantCoefficients c;
+		c.Fc = lerp(lerp(c00.Fc, c01.Fc, vowelf), lerp(c10.Fc, c11.Fc, vowelf), vf);
+		c.Q = lerp(lerp(c00.Q, c01.Q, vowelf), lerp(c10.Q, c11.Q, vowelf), vf);
+		c.gain = lerp(lerp(c00.gain, c01.gain, vowelf), lerp(c10.gain, c11.gain, vowelf), vf);
+		return c;
+	}
+
 	void onReset() override {
 		
 		params[FC_MAIN_CUTOFF_PARAM].setValue(1.0f);
@@ -201,18 +257,28 @@ struct VoxInhumana : Module {
 	
 	void process(const ProcessArgs &args) override {
 	
-		float signalIn = inputs[SIGNAL_IN].getVoltage()/5.0f;
+		float signalIn = inputs[SIGNAL_IN].getVoltageSum()/5.0f; //Polyphonic sources sing as a choir through one vocal tract
 		
 
-		vowel1 = (int)clamp(params[VOWEL_1_PARAM].getValue() + (inputs[VOWEL_1_CV_IN].getVoltage() * params[VOWEL_1_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
-		vowel2 = (int)clamp(params[VOWEL_2_PARAM].getValue() + (inputs[VOWEL_2_CV_IN].getVoltage() * params[VOWEL_2_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
+		//Vowels and voice type are points in a continuous space, so CV sweeps glide between them
+		float vowel1Position = clamp(params[VOWEL_1_PARAM].getValue() + (inputs[VOWEL_1_CV_IN].getVoltage() * params[VOWEL_1_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
+		float vowel2Position = clamp(params[VOWEL_2_PARAM].getValue() + (inputs[VOWEL_2_CV_IN].getVoltage() * params[VOWEL_2_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
 		vowelBalance = clamp(params[VOWEL_BALANCE_PARAM].getValue() + (inputs[VOWEL_BALANCE_CV_IN].getVoltage() * params[VOWEL_BALANCE_ATTENUVERTER_PARAM].getValue() /10.0f),0.0f,1.0f);
-		voiceType = (int)clamp(params[VOICE_TYPE_PARAM].getValue() + (inputs[VOICE_TYPE_CV_IN].getVoltage() * params[VOICE_TYPE_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
+		float voicePosition = clamp(params[VOICE_TYPE_PARAM].getValue() + (inputs[VOICE_TYPE_CV_IN].getVoltage() * params[VOICE_TYPE_ATTENUVERTER_PARAM].getValue()),0.0f,4.0f);
 		fcShift = clamp(params[FC_MAIN_CUTOFF_PARAM].getValue() + (inputs[FC_MAIN_CV_IN].getVoltage() * params[FC_MAIN_ATTENUVERTER_PARAM].getValue()/10.0f) ,0.0f,2.0f);
+		vowel1 = (int)vowel1Position;
+		vowel2 = (int)vowel2Position;
+		voiceType = (int)voicePosition;
 
 		lights[VOWEL_1_LIGHT].value = 1.0-vowelBalance;
 		lights[VOWEL_2_LIGHT].value = vowelBalance;
 
+		float inputPeak = FrozenWasteland::SilenceTracker::peak(inputs[SIGNAL_IN]);
+		if(silence.idle(inputPeak)) {
+			outputs[VOX_OUTPUT].setVoltage(0.0f);
+			return;
+		}
+
 		//Get Expander Info
 		if(rightExpander.module && rightExpander.module->model == modelVoxInhumanaExpander) {			
 			float *message = (float*) rightExpander.module->leftExpander.consumerMessage;
@@ -227,31 +293,40 @@ struct VoxInhumana : Module {
 			}			
 		}
 		
-		for (int i=0; i<BANDS;i++) {
-			float cutoffExp = params[FREQ_1_CUTOFF_PARAM+i].getValue() + inputs[FREQ_1_CUTOFF_INPUT+i].getVoltage() * params[FREQ_1_CV_ATTENUVERTER_PARAM+i].getValue(); 
-			cutoffExp = clamp(cutoffExp, -1.0f, 1.0f);
-			freq[i] = lerp(formantParameters[voiceType][vowel1][i][0],formantParameters[voiceType][vowel2][i][0],vowelBalance); 
-			//Apply individual formant CV
-			freq[i] = freq[i] + (freq[i] / 2 * cutoffExp); //Formant CV can alter formant by +/- 50%
-			//Apply global Fc shift
-			freq[i] = freq[i] * fcShift; //Global can double or really lower freq
-			 
-			Q[i] = lerp(formantParameters[voiceType][vowel1][i][1],formantParameters[voiceType][vowel2][i][1],vowelBalance);
-			peak[i] = lerp(formantParameters[voiceType][vowel1][i][2],formantParameters[voiceType][vowel2][i][2],vowelBalance);		
-
-
-			if(freq[i] != lastFreq[i]) {	
-				float Fc = freq[i] / args.sampleRate;
-				filterParams[i].setFreq(T(Fc));
-				filterParams[BANDS + i].setFreq(T(Fc));
-				lastFreq[i] = freq[i];
+		if(controlDivider.process()) {
+			for (int i=0; i<BANDS;i++) {
+				FormantCoefficients c1 = morph(voicePosition, vowel1Position, i);
+				FormantCoefficients c2 = morph(voicePosition, vowel2Position, i);
+
+				float cutoffExp = params[FREQ_1_CUTOFF_PARAM+i].getValue() + inputs[FREQ_1_CUTOFF_INPUT+i].getVoltage() * params[FREQ_1_CV_ATTENUVERTER_PARAM+i].getValue(); 
+				cutoffExp = clamp(cutoffExp, -1.0f, 1.0f);
+				float Fc = lerp(c1.Fc, c2.Fc, vowelBalance);
+				//Apply individual formant CV
+				Fc = Fc + (Fc / 2 * cutoffExp); //Formant CV can alter formant by +/- 50%
+				//Apply global Fc shift
+				Fc = Fc * fcShift; //Global can double or really lower freq
+				freq[i] = Fc * args.sampleRate;
+
+				Q[i] = lerp(c1.Q, c2.Q, vowelBalance);
+				float bandwidth = 1.0f / std::max(Q[i] + expanderQ[i], 0.5f);
+
+				float manualAttenuation = params[AMP_1_PARAM+i].getValue() + inputs[AMP_1_INPUT+i].getVoltage() * params[AMP_1_CV_ATTENUVERTER_PARAM+i].getValue(); 
+				float gain = clamp(lerp(c1.gain, c2.gain, vowelBalance) * manualAttenuation, 0.0f, 1.0f);
+
+				fcStep[i] = (Fc - currentFc[i]) / CONTROL_DIVISION;
+				bandwidthStep[i] = (bandwidth - currentBandwidth[i]) / CONTROL_DIVISION;
+				gainStep[i] = (gain - currentGain[i]) / CONTROL_DIVISION;
 			}
-			float newQ = Q[i] + expanderQ[i];
-			if(newQ != lastQ[i]) {
-				filterParams[i].setQ(newQ); 
-				filterParams[BANDS + i].setQ(newQ); 
-				lastQ[i] = newQ;
-			}		
+		}
+
+		for (int i=0; i<BANDS;i++) {
+			currentFc[i] += fcStep[i];
+			currentBandwidth[i] += bandwidthStep[i];
+			currentGain[i] += gainStep[i];
+			filterParams[i].setFreq(T(currentFc[i]));
+			filterParams[BANDS + i].setFreq(T(currentFc[i]));
+			filterParams[i].setNormalizedBandwidth(T(currentBandwidth[i]));
+			filterParams[BANDS + i].setNormalizedBandwidth(T(currentBandwidth[i]));
 		}
 
 		float out = 0.0f;	
@@ -264,15 +339,25 @@ struct VoxInhumana : Module {
 				lastFilterOut = firstFilterOut;
 			} 
 
-			float attenuation = powf(10,peak[i] / 20.0f);
-			float manualAttenuation = params[AMP_1_PARAM+i].getValue() + inputs[AMP_1_INPUT+i].getVoltage() * params[AMP_1_CV_ATTENUVERTER_PARAM+i].getValue(); 
-			attenuation = clamp(attenuation * manualAttenuation, 0.0f, 1.0f);
-			out += lastFilterOut * attenuation * 5.0f;
+			out += lastFilterOut * currentGain[i] * 5.0f;
 		}
 
 
 		outputs[VOX_OUTPUT].setVoltage(out / 5.0f);
-		
+
+		for(int i=0;i<BANDS*2;i++) {
+			denormals.check(i, filterStates[i].z1);
+			denormals.check(i, filterStates[i].z2);
+		}
+		denormals.tick(args.sampleRate);
+
+		//Resonant formants ring out well within half a second once they are this quiet
+		silence.setHold(0.5f, args.sampleRate);
+		if(silence.update(std::max(inputPeak, std::fabs(out / 5.0f)))) {
+			for(int i=0;i<BANDS*2;i++) {
+				filterStates[i] = StateVariableFilterState<T>();
+			}
+		}
 	}
 };
 
@@ -328,6 +413,18 @@ struct VoxInhumanaBandDisplay : TransparentWidget {
 };
 
 struct VoxInhumanaWidget : ModuleWidget {
+	void appendContextMenu(Menu *menu) override {
+		MenuLabel *spacerLabel = new MenuLabel();
+		menu->addChild(spacerLabel);
+
+		VoxInhumana *module = dynamic_cast<VoxInhumana*>(this->module);
+		assert(module);
+
+		FrozenWasteland::SilenceStatusItem *statusItem = new FrozenWasteland::SilenceStatusItem();
+		statusItem->tracker = &module->silence;
+		menu->addChild(statusItem);
+	}
+
 	VoxInhumanaWidget(VoxInhumana *module) {
 		setModule(module);
 
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+namespace FrozenWasteland {
+
+/** Extends a stereo history ring with minutes of older audio at half the memory.
+Blocks that are about to fall off the end of the ring are encoded to 16 bits with a per-block scale into a bounded pool by a worker thread.
+Readers go through cursors: each one says which block it is reading, and the worker decodes that block and its neighbours ahead of time.
+Reads never wait, a block that is not decoded yet reads as silence, so the callers move cursors while their output is faded out where they can.
+advance(), setCapacity() and read() are for the audio thread only. The worker doesn't run until start() is called, until then nothing older than the ring is kept.
+SOURCE is the ring buffer, it must provide readAt() and keep the frame of push number n at position n.
+*/
+template <int CURSORS, typename SOURCE>
+struct ColdHistory {
+	static const int BLOCK_SIZE = 2048;
+	static const int SLOTS = 4;
+	// Quieter blocks are kept as silence, so a decoding scale is never denormal and the worker needs no flush-to-zero mode
+	static constexpr float MIN_PEAK = 1e-20f;
+
+	struct Cursor {
+		std::atomic<int64_t> wanted{-1};
+		std::atomic<int64_t> tags[SLOTS];
+		// Allocated by the worker the first time the cursor is serviced
+		std::unique_ptr<float[]> data[SLOTS];
+
+		Cursor() {
+			for (int s = 0; s < SLOTS; s++) {
+				tags[s].store(-1);
+			}
+		}
+	};
+
+	const SOURCE &source;
+	const int64_t sourceFrames;
+
+	// Audio thread
+	int64_t written = 0;
+	int64_t capacity = 0;
+
+	// Shared
+	std::atomic<int64_t> sharedWritten{0};
+	std::atomic<int64_t> requestedCapacity{0};
+	Cursor cursors[CURSORS];
+
+	// Worker thread
+	int64_t poolBlocks = 0;
+	std::vector<int16_t> pool;
+	std::vector<float> poolScale;
+	std::vector<int64_t> poolTag;
+	int64_t encoded = 0;
+	std::vector<float> frames;
+	std::atomic<bool> running{true};
+	std::thread worker;
+
+	/** source is the stereo ring being extended, sourceFrames long (a power of 2 and a multiple of BLOCK_SIZE). It must outlive the ColdHistory. */
+	ColdHistory(const SOURCE &source, int64_t sourceFrames) : source(source), sourceFrames(sourceFrames), frames(BLOCK_SIZE * 2) {
+	}
+
+	~ColdHistory() {
+		if (!worker.joinable())
+			return;
+		running = false;
+		worker.join();
+	}
+
+	/** Starts the worker thread if it isn't running yet. Call from the UI thread when the owner first needs long delays. */
+	void start() {
+		if (!worker.joinable())
+			worker = std::thread(&ColdHistory::work, this);
+	}
+
+	/** How many frames of history to keep in total, hot ring included. 0 frees the pool. */
+	void setCapacity(int64_t frames) {
+		if (frames == capacity)
+			return;
+		capacity = frames;
+		requestedCapacity.store(frames, std::memory_order_relaxed);
+	}
+
+	/** Call after each frame written to the source ring. */
+	void advance() {
+		sharedWritten.store(++written, std::memory_order_release);
+	}
+
+	/** Reads the frame written age frames before the newest one through cursor. Returns false, leaving l and r alone, if it is not available. */
+	bool read(int cursor, int64_t age, float *l, float *r) {
+		int64_t position = written - 1 - age;
+		if (position < 0)
+			return false;
+		int64_t block = position / BLOCK_SIZE;
+		Cursor &c = cursors[cursor];
+		c.wanted.store(block, std::memory_order_relaxed);
+		for (int s = 0; s < SLOTS; s++) {
+			if (c.tags[s].load(std::memory_order_acquire) != block)
+				continue;
+			const float *frame = &c.data[s][(position - block * BLOCK_SIZE) * 2];
+			float left = frame[0];
+			float right = frame[1];
+			// The worker may have started reusing the slot while we read it
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (c.tags[s].load(std::memory_order_relaxed) != block)
+				return false;
+			*l = left;
+			*r = right;
+			return true;
+		}
+		return false;
+	}
+
+	void work() {
+		while (running) {
+			resize();
+			encode();
+			for (int c = 0; c < CURSORS; c++) {
+				service(cursors[c]);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+	}
+
+	void resize() {
+		int64_t frames = requestedCapacity.load(std::memory_order_relaxed);
+		int64_t blocks = std::max(frames - sourceFrames, (int64_t) 0) / BLOCK_SIZE;
+		if (blocks > 0)
+			blocks += (sourceFrames / 8) / BLOCK_SIZE + 2;
+		if (blocks == poolBlocks)
+			return;
+		poolBlocks = blocks;
+		pool.assign((size_t) blocks * BLOCK_SIZE * 2, 0);
+		pool.shrink_to_fit();
+		poolScale.assign(blocks, 0.f);
+		poolTag.assign(blocks, -1);
+	}
+
+	/** Encodes every block that is at least 7/8 of the way through the source ring, which leaves the worker plenty of slack. */
+	void encode() {
+		int64_t writtenFrames = sharedWritten.load(std::memory_order_acquire);
+		int64_t ready = std::max(writtenFrames - sourceFrames + sourceFrames / 8, (int64_t) 0) / BLOCK_SIZE;
+		// Blocks already overwritten in the source are lost
+		encoded = std::max(encoded, oldestIntact(writtenFrames));
+		if (poolBlocks == 0) {
+			encoded = std::max(encoded, ready);
+			return;
+		}
+		for (; encoded < ready; encoded++) {
+			int64_t p = encoded % poolBlocks;
+			source.readAt(encoded * BLOCK_SIZE, frames.data(), BLOCK_SIZE);
+			float peak = 0.f;
+			for (int i = 0; i < BLOCK_SIZE * 2; i++) {
+				peak = std::max(peak, std::fabs(frames[i]));
+			}
+			float scale = peak > MIN_PEAK ? 32767.f / peak : 0.f;
+			int16_t *out = &pool[(size_t) p * BLOCK_SIZE * 2];
+			for (int i = 0; i < BLOCK_SIZE * 2; i++) {
+				out[i] = (int16_t) std::lround(frames[i] * scale);
+			}
+			poolScale[p] = scale > 0.f ? peak / 32767.f : 0.f;
+			// Only keep it if the audio thread didn't lap us while we were reading
+			poolTag[p] = encoded >= oldestIntact(sharedWritten.load(std::memory_order_acquire)) ? encoded : -1;
+		}
+	}
+
+	int64_t oldestIntact(int64_t writtenFrames) const {
+		return std::max(writtenFrames - sourceFrames + BLOCK_SIZE - 1, (int64_t) 0) / BLOCK_SIZE;
+	}
+
+	/** Decodes the cursor's block and the ones either side of it, for heads moving in either direction. */
+	void service(Cursor &c) {
+		int64_t wanted = c.wanted.load(std::memory_order_relaxed);
+		if (wanted < 0 || poolBlocks == 0)
+			return;
+		const int64_t order[3] = {wanted, wanted + 1, wanted - 1};
+		for (int64_t block : order) {
+			if (block < 0 || poolTag[block % poolBlocks] != block)
+				continue;
+			int victim = -1;
+			for (int s = 0; s < SLOTS; s++) {
+				int64_t tag = c.tags[s].load(std::memory_order_relaxed);
+				if (tag == block) {
+					victim = -2;
+					break;
+				}
+				if (victim == -1 && (tag < wanted - 1 || tag > wanted + 1))
+					victim = s;
+			}
+			if (victim < 0)
+				continue;
+			if (!c.data[victim])
+				c.data[victim].reset(new float[BLOCK_SIZE * 2]);
+			c.tags[victim].store(-1, std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_release);
+			const int16_t *in = &pool[(size_t) (block % poolBlocks) * BLOCK_SIZE * 2];
+			float scale = poolScale[block % poolBlocks];
+			float *out = c.data[victim].get();
+			for (int i = 0; i < BLOCK_SIZE * 2; i++) {
+				out[i] = in[i] * scale;
+			}
+			c.tags[victim].store(block, std::memory_order_release);
+		}
+	}
+};
+
+} // namespace FrozenWasteland
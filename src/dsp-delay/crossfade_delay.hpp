@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+
+namespace FrozenWasteland {
+
+/** Follows a tap's delay time by jumping instead of gliding.
+At rest a single head reads at the current delay. When the target moves by a sample or more, a second head starts at the new delay
+and the two are crossfaded; once the fade completes the new head is the only one left. Targets that arrive during a fade are picked up when it ends.
+Smaller changes are followed directly so slow modulation doesn't keep restarting fades.
+Each head reads through one of two cursors. They swap along with the heads when a fade ends, so the head left playing keeps the cursor that has been reading at its delay.
+*/
+struct CrossfadeDelay {
+	float delay[2] = {};
+	int cursor[2] = {0, 1};
+	float fade = 0.f;
+	bool fading = false;
+
+	/** Places the head at delay without a fade. */
+	void reset(float target) {
+		delay[0] = delay[1] = target;
+		fade = 0.f;
+		fading = false;
+	}
+
+	/** Call once per sample with the target delay in samples and the crossfade length in samples. */
+	void process(float target, float fadeLength) {
+		if (fading) {
+			fade += 1.f / std::max(fadeLength, 1.f);
+			if (fade < 1.f)
+				return;
+			delay[0] = delay[1];
+			std::swap(cursor[0], cursor[1]);
+			fade = 0.f;
+			fading = false;
+		}
+		if (std::fabs(target - delay[0]) < 1.f) {
+			delay[0] = target;
+		} else {
+			delay[1] = target;
+			fading = true;
+		}
+	}
+
+	/** Number of heads that need to be read, 1 at rest and 2 while fading. */
+	int heads() const {
+		return fading ? 2 : 1;
+	}
+
+	float gain(int head) const {
+		return head == 0 ? 1.f - fade : fade;
+	}
+};
+
+} // namespace FrozenWasteland
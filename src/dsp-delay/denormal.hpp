@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#ifdef __SSE2__
+#include <pmmintrin.h>
+#endif
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** True if the calling thread flushes denormals to zero. Rack's engine threads do, so process() never sees them.
+Off x86 the host's floating point mode is taken on trust.
+*/
+inline bool flushingDenormals() {
+#ifdef __SSE2__
+	const unsigned int FTZ_DAZ = _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON;
+	return (_mm_getcsr() & FTZ_DAZ) == FTZ_DAZ;
+#else
+	return true;
+#endif
+}
+
+
+template <typename T>
+inline bool isDenormal(T x) {
+	return x != T(0) && std::fabs(x) < std::numeric_limits<T>::min();
+}
+
+
+/** Counts, per filter instance, how many samples the state of a module's recursive filters spent denormal.
+Only compiled in with `make DENORMAL_STATS=1`, otherwise every call is empty and optimised away.
+Every 10 seconds the counts are logged along with whether the audio thread was flushing denormals, then cleared.
+*/
+struct DenormalStats {
+#ifdef FW_DENORMAL_STATS
+	std::string module;
+	std::vector<std::string> names;
+	std::vector<uint64_t> hits;
+	std::vector<bool> hit;
+	int64_t samples = 0;
+	bool flushing = true;
+#endif
+
+	DenormalStats(const char *module) {
+#ifdef FW_DENORMAL_STATS
+		this->module = module;
+#endif
+	}
+
+	/** Registers a filter instance, returns the id to check() it with. */
+	int add(const std::string &name) {
+#ifdef FW_DENORMAL_STATS
+		names.push_back(name);
+		hits.push_back(0);
+		hit.push_back(false);
+		return (int) names.size() - 1;
+#else
+		return 0;
+#endif
+	}
+
+	/** Call with each state variable of the instance, every sample. */
+	template <typename T>
+	void check(int instance, T x) {
+#ifdef FW_DENORMAL_STATS
+		if (isDenormal(x))
+			hit[instance] = true;
+#endif
+	}
+
+	/** Call once per sample, after checking. */
+	void tick(float sampleRate) {
+#ifdef FW_DENORMAL_STATS
+		for (size_t i = 0; i < hit.size(); i++) {
+			hits[i] += hit[i];
+			hit[i] = false;
+		}
+		flushing = flushing && flushingDenormals();
+		if (++samples < (int64_t) (10.f * sampleRate))
+			return;
+		for (size_t i = 0; i < names.size(); i++) {
+			if (hits[i] > 0)
+				INFO("%s %s: denormal state on %lld of %lld samples", module.c_str(), names[i].c_str(), (long long) hits[i], (long long) samples);
+			hits[i] = 0;
+		}
+		if (!flushing)
+			WARN("%s: audio thread is not flushing denormals", module.c_str());
+		samples = 0;
+		flushing = true;
+#endif
+	}
+};
+
+} // namespace FrozenWasteland
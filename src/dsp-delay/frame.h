@@ -1,2 +1,3 @@
+#pragma once
 typedef float T;
 typedef struct { T l; T r; } FloatFrame;
\ No newline at end of file
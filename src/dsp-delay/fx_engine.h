@@ -32,11 +32,15 @@
 //#include "stmlib/stmlib.h"
 //#include "stmlib/dsp/dsp.h"
 #include "utility.h"
+#include "rack.hpp"
 
 #define TAIL , -1
 
 
-template <typename T, size_t size>
+// max_block is the longest block Start(Block*, n) accepts. Delay lines are
+// laid out max_block cells apart so that writing a whole block to one line
+// never lands on the part of its neighbour that the block reads.
+template <typename T, size_t size, size_t max_block = 1>
 class FxEngine {
  public:
   FxEngine() { }
@@ -66,7 +70,7 @@ class FxEngine {
   struct DelayLine {
     enum {
       length = DelayLine<typename Memory::Tail, index - 1>::length,
-      base = DelayLine<Memory, index - 1>::base + DelayLine<Memory, index - 1>::length + 1
+      base = DelayLine<Memory, index - 1>::base + DelayLine<Memory, index - 1>::length + max_block
     };
   };
 
@@ -107,7 +111,7 @@ class FxEngine {
     
     template<typename D>
     inline void Write(D& d, int32_t offset, float scale) {
-      //STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
       T w = accumulator_;
       if (offset == -1) {
         buffer_[(write_ptr_ + D::base + D::length - 1) & MASK] = w;
@@ -126,7 +130,7 @@ class FxEngine {
     
     template<typename D>
     inline void Read(D& d, int32_t offset, float scale) {
-      //STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
       T r;
       if (offset == -1) {
         r = buffer_[(write_ptr_ + D::base + D::length - 1) & MASK];
@@ -147,7 +151,7 @@ class FxEngine {
     
     template<typename D>
     inline void Interpolate(D& d, float offset, float scale) {
-      //STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
       MAKE_INTEGRAL_FRACTIONAL(offset); // returns integral and fractional parts (integral is an integer)
       float a = buffer_[(write_ptr_ + offset_integral + D::base) & MASK];
       float b = buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK];
@@ -164,6 +168,79 @@ class FxEngine {
     int32_t write_ptr_;
     
   };
+
+  // Runs a block of samples through the lines one operation at a time.
+  // Sample i of the block sees the write pointer the i-th call to
+  // Start(Context*) would have given it, so a line must be written before it
+  // is read, and a line can only feed back into itself when it is read at
+  // least one block back.
+  class Block {
+   friend class FxEngine;
+   public:
+    Block() { }
+    ~Block() { }
+
+    inline size_t length() const {
+      return size_;
+    }
+
+    template<typename D>
+    inline void Write(D& d, const float* in) {
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
+      for (size_t i = 0; i < size_; ++i) {
+        buffer_[(write_ptr_ - int32_t(i) + D::base) & MASK] = in[i];
+      }
+    }
+
+    // out[i] += d[offset] * scale, offset -1 being the end of the line.
+    template<typename D>
+    inline void Read(D& d, int32_t offset, float scale, float* out) {
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
+      if (offset == -1) {
+        offset = D::length - 1;
+      }
+      for (size_t i = 0; i < size_; ++i) {
+        out[i] += static_cast<float>(buffer_[(write_ptr_ - int32_t(i) + D::base + offset) & MASK]) * scale;
+      }
+    }
+
+    // out[i] += d[offset[i]] * scale[i], linearly interpolated. Index and
+    // interpolation math runs four samples at a time, gathering the taps.
+    template<typename D>
+    inline void Interpolate(D& d, const float* offset, const float* scale, float* out) {
+      STATIC_ASSERT(D::base + D::length + max_block <= size, delay_memory_full);
+      using rack::simd::float_4;
+      using rack::simd::int32_4;
+      size_t i = 0;
+      for (; i + 4 <= size_; i += 4) {
+        float_4 o = float_4::load(&offset[i]);
+        int32_4 integral = int32_4(o);
+        float_4 fractional = o - float_4(integral);
+        int32_4 position = integral + int32_4(write_ptr_ + D::base - int32_t(i)) - int32_4(0, 1, 2, 3);
+        float_4 a, b;
+        for (int k = 0; k < 4; ++k) {
+          a[k] = buffer_[position[k] & MASK];
+          b[k] = buffer_[(position[k] + 1) & MASK];
+        }
+        float_4 x = a + (b - a) * fractional;
+        float_4 y = float_4::load(&out[i]) + x * float_4::load(&scale[i]);
+        y.store(&out[i]);
+      }
+      for (; i < size_; ++i) {
+        float o = offset[i];
+        MAKE_INTEGRAL_FRACTIONAL(o);
+        int32_t position = write_ptr_ - int32_t(i) + o_integral + D::base;
+        float a = buffer_[position & MASK];
+        float b = buffer_[(position + 1) & MASK];
+        out[i] += (a + (b - a) * o_fractional) * scale[i];
+      }
+    }
+
+   private:
+    T* buffer_;
+    int32_t write_ptr_;
+    size_t size_;
+  };
   
   
   inline void Start(Context* c) {
@@ -176,6 +253,17 @@ class FxEngine {
     c->buffer_ = buffer_;
     c->write_ptr_ = write_ptr_;
   }
+
+  // Starts a block of n <= max_block samples.
+  inline void Start(Block* b, size_t n) {
+    b->buffer_ = buffer_;
+    b->write_ptr_ = write_ptr_ - 1;
+    b->size_ = n;
+    write_ptr_ -= int32_t(n);
+    if (write_ptr_ < 0) {
+      write_ptr_ += size;
+    }
+  }
   
  private:
   enum {
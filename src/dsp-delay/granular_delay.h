@@ -51,10 +51,68 @@ class GranularDelayPitchShift {
   }
 
   inline void Process(FloatFrame* input_output, size_t size, bool useTriangleWindow) {
-   while (size--) {
-     Process(input_output, useTriangleWindow);
-     ++input_output;
-   }
+    while (size) {
+      size_t n = std::min(size, static_cast<size_t>(kMaxBlockSize));
+      ProcessBlock(input_output, n, useTriangleWindow);
+      input_output += n;
+      size -= n;
+    }
+  }
+
+  // Same as n calls to Process(FloatFrame*, bool), with the windows worked
+  // out up front and each line written and read once for the whole block.
+  void ProcessBlock(FloatFrame* input_output, size_t n, bool useTriangleWindow) {
+    typedef E::Reserve<2047, E::Reserve<2047> > Memory;
+
+    E::DelayLine<Memory, 0> left;
+    E::DelayLine<Memory, 1> right;
+    E::Block b;
+    engine_.Start(&b, n);
+
+    float phase[kMaxBlockSize];
+    float half[kMaxBlockSize];
+    float tri[kMaxBlockSize];
+    float anti_tri[kMaxBlockSize];
+    float in[kMaxBlockSize];
+    float out[kMaxBlockSize];
+    for (size_t i = 0; i < n; ++i) {
+      phase_ += (1.0f - ratio_) / size_;
+      if (phase_ >= 1.0f) {
+        phase_ -= 1.0f;
+      }
+      if (phase_ <= 0.0f) {
+        phase_ += 1.0f;
+      }
+      tri[i] = 1.0f;
+      if(useTriangleWindow) {
+        tri[i] = 2.0f * (phase_ >= 0.5f ? 1.0f - phase_ : phase_);
+      }
+      anti_tri[i] = 1.0f - tri[i];
+      phase[i] = phase_ * size_;
+      half[i] = phase[i] + size_ * 0.5f;
+      if (half[i] >= size_) {
+        half[i] -= size_;
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      in[i] = input_output[i].l;
+      out[i] = 0.0f;
+    }
+    b.Write(left, in);
+    b.Interpolate(left, phase, tri, out);
+    b.Interpolate(left, half, anti_tri, out);
+    for (size_t i = 0; i < n; ++i) {
+      input_output[i].l = out[i];
+      in[i] = input_output[i].r;
+      out[i] = 0.0f;
+    }
+    b.Write(right, in);
+    b.Interpolate(right, phase, tri, out);
+    b.Interpolate(right, half, anti_tri, out);
+    for (size_t i = 0; i < n; ++i) {
+      input_output[i].r = out[i];
+    }
   }
   
   void Process(FloatFrame* input_output,bool useTriangleWindow) {
@@ -106,7 +164,11 @@ class GranularDelayPitchShift {
   }
   
  private:
-  typedef FxEngine<float,4096> E;
+  enum {
+    kMaxBlockSize = 32
+  };
+  // Lines are spaced for block processing, which is why the engine is larger than the 2 x 2047 it needs per sample
+  typedef FxEngine<float, 8192, kMaxBlockSize> E;
   E engine_;
   float phase_;
   float ratio_;
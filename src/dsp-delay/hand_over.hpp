@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+
+
+namespace FrozenWasteland {
+
+/** Lets the UI thread replace an object the audio thread is using, without the audio thread allocating, freeing or waiting.
+The replacement is built on the UI thread and offered, and the audio thread picks it up at the top of a later process().
+The object it replaced is handed back and deleted on the UI thread by the next offer() or collect().
+offer(), collect() and latest() are for the UI thread only, pickUp() and the accessors for the audio thread only.
+*/
+template <typename T>
+struct HandOver {
+	// Audio thread
+	T *current;
+
+	// UI thread, the last object offered, current once it has been picked up
+	T *newest;
+
+	// Shared
+	std::atomic<T*> incoming{nullptr};
+	std::atomic<T*> retired{nullptr};
+
+	/** Takes ownership of initial, which the audio thread uses until something else is picked up. Without one it has nothing until then. */
+	explicit HandOver(T *initial = nullptr) : current(initial), newest(initial) {
+	}
+
+	HandOver(const HandOver &) = delete;
+	HandOver &operator=(const HandOver &) = delete;
+
+	~HandOver() {
+		delete incoming.load();
+		delete retired.load();
+		delete current;
+	}
+
+	/** Takes ownership of replacement. One offered earlier that hasn't been picked up yet is dropped. */
+	void offer(T *replacement) {
+		newest = replacement;
+		delete incoming.exchange(replacement, std::memory_order_acq_rel);
+		collect();
+	}
+
+	/** Deletes the object the audio thread last let go of, if any. */
+	void collect() {
+		delete retired.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	/** The object the audio thread is using or about to pick up. */
+	T *latest() const {
+		return newest;
+	}
+
+	/** Switches to the object offered last, if there is one. Returns true when it did. Waits for the UI thread to collect the previous one first. */
+	bool pickUp() {
+		if (!incoming.load(std::memory_order_relaxed) || retired.load(std::memory_order_acquire))
+			return false;
+		T *replacement = incoming.exchange(nullptr, std::memory_order_acq_rel);
+		if (!replacement)
+			return false;
+		retired.store(current, std::memory_order_release);
+		current = replacement;
+		return true;
+	}
+
+	T *operator->() const {
+		return current;
+	}
+
+	T &operator*() const {
+		return *current;
+	}
+};
+
+} // namespace FrozenWasteland
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include "frame.h"
+#include "crossfade_delay.hpp"
+
+
+namespace FrozenWasteland {
+
+/** The jump crossfades the delays offer in their context menus, shortest first. */
+static const int NUM_JUMP_CROSSFADES = 5;
+static const float jumpCrossfadeTimes[NUM_JUMP_CROSSFADES] = {0.005f, 0.01f, 0.025f, 0.05f, 0.1f};
+static const char *const jumpCrossfadeNames[NUM_JUMP_CROSSFADES] = {"5 ms", "10 ms", "25 ms", "50 ms", "100 ms"};
+
+/** Stands in for a ColdHistory in delays without one: everything past the ring reads as silence. */
+struct NoColdHistory {
+	bool read(int cursor, int64_t age, float *l, float *r) {
+		return false;
+	}
+};
+
+/** Reads a stereo history ring directly at a fractional delay, for taps that jump or play backwards instead of resampling.
+length is how much has been written since the history was last cleared, anything older reads as silence.
+Frames the ring (ringFrames long, with peek(delay)) no longer holds come from cold through cursor, and read as silence until the cold tier has them.
+*/
+template <typename RING, typename COLD>
+FloatFrame readHistory(const RING &ring, size_t ringFrames, size_t length, COLD &cold, int cursor, float index) {
+	index = std::max(index, 0.f);
+	size_t i = (size_t) index;
+	if (i + 1 >= length)
+		return {0.f, 0.f};
+	float fraction = index - i;
+	FloatFrame a, b;
+	if (i + 1 < ringFrames) {
+		a = ring.peek(i);
+		b = ring.peek(i + 1);
+	} else if (!cold.read(cursor, i, &a.l, &a.r) || !cold.read(cursor, i + 1, &b.l, &b.r)) {
+		return {0.f, 0.f};
+	}
+	return {a.l + (b.l - a.l) * fraction, a.r + (b.r - a.r) * fraction};
+}
+
+/** Follows index by jumping, crossfading from the old delay to the new one over fadeLength samples. restart places jump at index without a fade.
+read(delay, cursor) returns the history at delay through the head's cursor, 0 or 1.
+*/
+template <typename READ>
+FloatFrame readJump(CrossfadeDelay &jump, float index, float fadeLength, bool restart, READ read) {
+	if (restart)
+		jump.reset(index);
+	jump.process(index, fadeLength);
+	FloatFrame out = {0.f, 0.f};
+	for (int head = 0; head < jump.heads(); head++) {
+		FloatFrame frame = read(jump.delay[head], jump.cursor[head]);
+		out.l += frame.l * jump.gain(head);
+		out.r += frame.r * jump.gain(head);
+	}
+	return out;
+}
+
+} // namespace FrozenWasteland
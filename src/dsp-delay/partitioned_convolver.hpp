@@ -0,0 +1,276 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** The spectra of one impulse response, cut into blockSize long partitions.
+The first partition is kept in the time domain as a list of nonzero taps, so it can be applied without latency.
+Partitions that are entirely silent are skipped, which keeps sparse impulse responses such as combs cheap.
+*/
+struct ConvolutionKernel {
+	int blockSize = 0;
+	int partitions = 0;
+	// partitions * 2 * blockSize floats in PFFFT's unordered layout, prescaled for the inverse transform
+	std::vector<float> spectra;
+	std::vector<int> activePartitions;
+	std::vector<int> headOffsets;
+	std::vector<float> headGains;
+
+	void load(rack::dsp::RealFFT &fft, int blockSize, const std::vector<float> &ir) {
+		int fftSize = blockSize * 2;
+		int length = (int) ir.size();
+		this->blockSize = blockSize;
+
+		headOffsets.clear();
+		headGains.clear();
+		for (int i = 0; i < std::min(length, blockSize); i++) {
+			if (ir[i] != 0.f) {
+				headOffsets.push_back(i);
+				headGains.push_back(ir[i]);
+			}
+		}
+
+		partitions = std::max(length - 1, 0) / blockSize;
+		spectra.resize((size_t) partitions * fftSize);
+		activePartitions.clear();
+		std::vector<float> segment(fftSize);
+		float scale = 1.f / fftSize;
+		for (int p = 0; p < partitions; p++) {
+			int start = (p + 1) * blockSize;
+			bool silent = true;
+			for (int i = 0; i < blockSize; i++) {
+				segment[i] = start + i < length ? ir[start + i] * scale : 0.f;
+				silent = silent && segment[i] == 0.f;
+			}
+			if (silent)
+				continue;
+			std::fill(segment.begin() + blockSize, segment.end(), 0.f);
+			fft.rfftUnordered(segment.data(), &spectra[(size_t) p * fftSize]);
+			activePartitions.push_back(p);
+		}
+	}
+};
+
+
+/** Uniformly partitioned overlap-save convolution of CHANNELS signals with one shared impulse response.
+The impulse response is produced by the owner's generate() callback on a worker thread whenever request() is called with new settings,
+turned into a kernel there, and picked up by the audio thread a fixed number of blocks later, where it is crossfaded with the previous one.
+As long as the worker keeps up, the pick up doesn't depend on how quickly it got to it, so the same input and requests give the same output.
+If it hasn't finished by then the current kernel keeps playing, and the new one is picked up at the first block after it is built.
+The audio thread never waits or takes a lock: requests are handed over through an atomic slot the worker polls.
+Cost depends on the length of the impulse response, not on how many taps it has.
+process() and request() must be called from the audio thread only. The worker doesn't run until start() is called.
+*/
+template <typename REQUEST, int CHANNELS>
+struct PartitionedConvolver {
+	// The kernel playing, the one fading out and the one being built
+	static const int SLOTS = 3;
+
+	const int blockSize;
+	const int fftSize;
+	const int fadeLength;
+	const int latencyBlocks;
+
+	/** Called on the worker thread. Fills ir with the impulse response for request. */
+	std::function<void(const REQUEST &request, std::vector<float> &ir)> generate;
+
+	ConvolutionKernel kernels[SLOTS];
+
+	// Audio thread
+	rack::dsp::RealFFT fft;
+	int current = -1;
+	int previous = -1;
+	// The slot the worker is filling, -1 when nothing has been asked for
+	int building = -1;
+	int blocksUntilDue = 0;
+	bool fading = false;
+	int fadePosition = 0;
+	int position = 0;
+	int maxPartitions = 0;
+	int spectrumPosition = 0;
+	// Previous and current input block, also the history for the first partition
+	std::vector<float> window[CHANNELS];
+	std::vector<float> inputSpectra[CHANNELS];
+	std::vector<float> currentTail[CHANNELS];
+	std::vector<float> previousTail[CHANNELS];
+	std::vector<float> accumulator;
+	std::vector<float> timeDomain;
+
+	// Worker thread
+	rack::dsp::RealFFT workerFFT;
+	// Written by the audio thread while the worker is idle, then handed over by storing the slot to build it in
+	REQUEST pendingRequest;
+	std::atomic<int> pendingSlot{-1};
+	std::atomic<bool> running{true};
+	std::atomic<bool> started{false};
+	std::atomic<bool> built{false};
+	std::thread worker;
+
+	/** blockSize must be a multiple of 16. The latency of the tail partitions is hidden, so the output is not delayed.
+	A requested kernel is picked up latencyBlocks blocks later, at least fadeBlocks so one crossfade has finished before the next.
+	*/
+	PartitionedConvolver(int blockSize, int fadeBlocks, int latencyBlocks) : blockSize(blockSize), fftSize(blockSize * 2), fadeLength(blockSize * fadeBlocks),
+		latencyBlocks(std::max(latencyBlocks, fadeBlocks)), fft(blockSize * 2), workerFFT(blockSize * 2) {
+		for (int c = 0; c < CHANNELS; c++) {
+			window[c].assign(fftSize, 0.f);
+			currentTail[c].assign(blockSize, 0.f);
+			previousTail[c].assign(blockSize, 0.f);
+		}
+		accumulator.assign(fftSize, 0.f);
+		timeDomain.assign(fftSize, 0.f);
+	}
+
+	~PartitionedConvolver() {
+		if (!worker.joinable())
+			return;
+		running = false;
+		worker.join();
+	}
+
+	/** Starts the worker thread if it isn't running yet. Call from the UI thread, or wherever the owner decides it needs convolution. Requests before this are refused. */
+	void start() {
+		if (worker.joinable())
+			return;
+		worker = std::thread(&PartitionedConvolver::work, this);
+		started.store(true, std::memory_order_release);
+	}
+
+	/** Sizes the input history for impulse responses up to maxLength samples. Longer kernels are truncated. Clears the history. */
+	void configure(int maxLength) {
+		maxPartitions = std::max((maxLength - 1) / blockSize, 1);
+		for (int c = 0; c < CHANNELS; c++) {
+			inputSpectra[c].assign((size_t) maxPartitions * fftSize, 0.f);
+		}
+		reset();
+	}
+
+	void reset() {
+		for (int c = 0; c < CHANNELS; c++) {
+			std::fill(window[c].begin(), window[c].end(), 0.f);
+			std::fill(inputSpectra[c].begin(), inputSpectra[c].end(), 0.f);
+			std::fill(currentTail[c].begin(), currentTail[c].end(), 0.f);
+			std::fill(previousTail[c].begin(), previousTail[c].end(), 0.f);
+		}
+		position = 0;
+		spectrumPosition = 0;
+	}
+
+	/** Asks the worker for a kernel built from request. Returns false while the last one hasn't been picked up yet, or before start(); try again later. */
+	bool request(const REQUEST &request) {
+		if (building >= 0 || !started.load(std::memory_order_acquire))
+			return false;
+		building = 0;
+		while (building == current || building == previous)
+			building++;
+		built.store(false, std::memory_order_relaxed);
+		// The worker has taken the last request and finished with it, or building would still be set
+		pendingRequest = request;
+		pendingSlot.store(building, std::memory_order_release);
+		blocksUntilDue = latencyBlocks;
+		return true;
+	}
+
+	void process(const float *in, float *out) {
+		float fade = fading ? (float) fadePosition / fadeLength : 1.f;
+		for (int c = 0; c < CHANNELS; c++) {
+			window[c][blockSize + position] = in[c];
+			float y = currentTail[c][position] + head(current, c);
+			if (fading) {
+				float yPrevious = previousTail[c][position] + head(previous, c);
+				y = yPrevious + (y - yPrevious) * fade;
+			}
+			out[c] = y;
+		}
+
+		if (fading && ++fadePosition >= fadeLength) {
+			fading = false;
+			previous = -1;
+		}
+		if (++position >= blockSize) {
+			processBlock();
+			position = 0;
+		}
+	}
+
+	float head(int slot, int c) const {
+		if (slot < 0)
+			return 0.f;
+		const ConvolutionKernel &kernel = kernels[slot];
+		const float *x = &window[c][blockSize + position];
+		float y = 0.f;
+		for (size_t i = 0; i < kernel.headOffsets.size(); i++) {
+			y += kernel.headGains[i] * x[-kernel.headOffsets[i]];
+		}
+		return y;
+	}
+
+	void processBlock() {
+		if (blocksUntilDue > 0)
+			blocksUntilDue--;
+		if (building >= 0 && blocksUntilDue == 0 && built.load(std::memory_order_acquire)) {
+			previous = current;
+			current = building;
+			building = -1;
+			fading = true;
+			fadePosition = 0;
+		}
+
+		for (int c = 0; c < CHANNELS; c++) {
+			float *spectrum = &inputSpectra[c][(size_t) spectrumPosition * fftSize];
+			fft.rfftUnordered(window[c].data(), spectrum);
+			tail(current, c, currentTail[c]);
+			if (fading)
+				tail(previous, c, previousTail[c]);
+			std::copy(window[c].begin() + blockSize, window[c].end(), window[c].begin());
+		}
+		if (++spectrumPosition >= maxPartitions)
+			spectrumPosition = 0;
+	}
+
+	/** Output of the kernel's tail partitions for the next block. Partition p is one block later than it should be, which the missing first partition makes up for. */
+	void tail(int slot, int c, std::vector<float> &out) {
+		if (slot < 0) {
+			std::fill(out.begin(), out.end(), 0.f);
+			return;
+		}
+		const ConvolutionKernel &kernel = kernels[slot];
+		std::fill(accumulator.begin(), accumulator.end(), 0.f);
+		for (int p : kernel.activePartitions) {
+			if (p >= maxPartitions)
+				break;
+			int s = spectrumPosition - p;
+			if (s < 0)
+				s += maxPartitions;
+			pffft_zconvolve_accumulate(fft.setup, &inputSpectra[c][(size_t) s * fftSize], &kernel.spectra[(size_t) p * fftSize], accumulator.data(), 1.f);
+		}
+		fft.irfftUnordered(accumulator.data(), timeDomain.data());
+		std::copy(timeDomain.begin() + blockSize, timeDomain.end(), out.begin());
+	}
+
+	void work() {
+		std::vector<float> ir;
+		while (running) {
+			int slot = pendingSlot.load(std::memory_order_acquire);
+			if (slot < 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			REQUEST request = pendingRequest;
+			pendingSlot.store(-1, std::memory_order_relaxed);
+
+			ir.clear();
+			generate(request, ir);
+			kernels[slot].load(workerFFT, blockSize, ir);
+			built.store(true, std::memory_order_release);
+		}
+	}
+};
+
+} // namespace FrozenWasteland
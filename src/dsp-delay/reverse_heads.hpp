@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+
+namespace FrozenWasteland {
+
+/** Plays a delay line backwards in overlapping segments with two read heads.
+While the write position moves forward a head sweeps back through its segment, so its distance behind the write position grows by two samples per sample.
+The heads are half a segment apart under sin² windows, so their gains always sum to one and each one jumps back only while it is silent.
+Each head keeps the segment length it started its sweep with, so the length can follow a modulated delay time without tearing.
+*/
+struct ReverseHeads {
+	float phase = 0.f;
+	float length = 2.f;
+	float headLength[2] = {2.f, 2.f};
+	float headOffset[2] = {};
+	float headGain[2] = {0.f, 1.f};
+
+	/** Sets the segment length in samples. Heads pick it up when they next jump back. */
+	void setLength(float samples) {
+		length = std::max(samples, 2.f);
+	}
+
+	void reset() {
+		phase = 0.f;
+		headLength[0] = headLength[1] = length;
+		update();
+	}
+
+	void advance() {
+		float previous = phase;
+		phase += 1.f / length;
+		if (previous < 0.5f && phase >= 0.5f)
+			headLength[1] = length;
+		if (phase >= 1.f) {
+			phase -= 1.f;
+			headLength[0] = length;
+		}
+		update();
+	}
+
+	/** Samples the head reads behind the position it would read playing forwards. */
+	float offset(int head) const {
+		return headOffset[head];
+	}
+
+	float gain(int head) const {
+		return headGain[head];
+	}
+
+	void update() {
+		for (int head = 0; head < 2; head++) {
+			float p = phase + 0.5f * head;
+			if (p >= 1.f)
+				p -= 1.f;
+			float s = std::sin(float(M_PI) * p);
+			headOffset[head] = 2.f * p * headLength[head];
+			headGain[head] = s * s;
+		}
+	}
+};
+
+} // namespace FrozenWasteland
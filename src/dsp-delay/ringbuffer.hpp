@@ -1,7 +1,13 @@
 #pragma once
 
 #include <string.h>
+#include <cmath>
+#include <memory>
+#include <cstdint>
 #include "dsp/common.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 namespace FrozenWasteland {
@@ -133,85 +139,71 @@ struct DoubleRingBuffer {
 };
 
 
-/** A simple cyclic buffer. that returns items in reverse order they were pushed
-S must be a power of 2.
-Thread-safe for single producers and consumers.
+/** Sample formats for the multi-tap buffers.
+FloatStorage keeps samples as they are. Fixed16Storage keeps them in 16 bits over +-RANGE, which halves the memory and the cache traffic of the
+read heads for about 90 dB of signal to noise at 10V. Anything outside the range is clipped.
 */
-template <typename T, size_t S>
-struct ReverseRingBuffer {
-	T data[S];
-	size_t end = 0;
-	size_t delaySize = S-1;
-	size_t start = delaySize;
-
-
-	void setDelaySize(T t) {
-		delaySize = t;
-	}	
+struct FloatStorage {
+	typedef float Sample;
 
-	size_t mask(size_t i) const {
-		return i & (S - 1);
+	static Sample encode(float x) {
+		return x;
 	}
-
-	void push(T t) {
-		size_t i = mask(end++);
-		data[i] = t;				
+	static float decode(Sample s) {
+		return s;
 	}
-
-	T shift() {		
-		T value = data[mask(start--)];
-		if((start > end && start-end >= delaySize) || (end-start >=delaySize)) {
-			start = end;	
-		}
-		return value;
+	static void decode(const Sample *in, float *out, size_t n) {
+		std::memcpy(out, in, sizeof(float) * n);
 	}
+};
 
-	void pushBuffer(const T *t, int n) {
-		size_t i = mask(end);
-		size_t e1 = i + n;
-		size_t e2 = (e1 < S) ? e1 : S;
-		std::memcpy(&data[i], t, sizeof(T) * (e2 - i));
-		if (e1 > S) {
-			std::memcpy(data, &t[S - i], sizeof(T) * (e1 - S));
-		}
-		end += n;
-	}
+template <int RANGE>
+struct Fixed16Storage {
+	typedef int16_t Sample;
 
-	void shiftBuffer(T *t, size_t n) {
-		size_t i = mask(start);
-		size_t s1 = i + n;
-		size_t s2 = (s1 < S) ? s1 : S;
-		std::memcpy(t, &data[i], sizeof(T) * (s2 - i));
-		if (s1 > S) {
-			std::memcpy(&t[S - i], data, sizeof(T) * (s1 - S));
+	static Sample encode(float x) {
+		x = std::max(std::min(x * (32767.f / RANGE), 32767.f), -32767.f);
+#ifdef __SSE2__
+		return (Sample) _mm_cvtss_si32(_mm_set_ss(x));
+#else
+		return (Sample) std::lrint(x);
+#endif
+	}
+	static float decode(Sample s) {
+		return s * ((float) RANGE / 32767.f);
+	}
+	static void decode(const Sample *in, float *out, size_t n) {
+		size_t i = 0;
+#ifdef __SSE2__
+		const __m128 scale = _mm_set1_ps((float) RANGE / 32767.f);
+		for (; i < n / 8 * 8; i += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+			// Sign extend by unpacking into the high halves and shifting back down
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+			_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = decode(in[i]);
 		}
-		start += n;
-	}
-	void clear() {
-		start = end;
-		//start = delaySize-1;
-	}
-	bool empty() const {
-		return start == end;
-	}
-	bool full() const {
-		return end - start == S;
-	}
-	size_t size() const {
-		return end - start;
-	}
-	size_t capacity() const {
-		return S - size();
 	}
 };
 
+
 /** A cyclic buffer which maintains a valid linear array of size S by keeping a copy of the buffer in adjacent memory.
 S must be a power of 2. Provides N # of taps into array
+T is a float or a struct of floats, stored in the format given by STORAGE and converted on the way in and out.
 Thread-safe for single producers and consumers?
 */
-template <typename T, size_t S, int N>
+template <typename T, size_t S, int N, typename STORAGE = FloatStorage>
 struct MultiTapDoubleRingBuffer {
-	T data[S*2];
+	typedef typename STORAGE::Sample Sample;
+	// Samples per element
+	static const size_t CHANNELS = sizeof(T) / sizeof(float);
+
+	Sample data[S*2*CHANNELS];
 
 	size_t start[N];
 	size_t end = 0;
@@ -227,13 +219,16 @@ struct MultiTapDoubleRingBuffer {
 	}
 	
 	void push(T t) {
-		size_t i = mask(end++);
-		data[i] = t;
-		data[i + S] = t;
+		size_t i = mask(end++) * CHANNELS;
+		const float *in = (const float*) &t;
+		for (size_t c = 0; c < CHANNELS; c++) {
+			data[i + c] = STORAGE::encode(in[c]);
+			data[i + S * CHANNELS + c] = data[i + c];
+		}
 	}
 
 	T shift(int tap) {
-		return data[mask(start[tap]++)];
+		return peekAt(start[tap]++);
 	}
 	
 	void clear() {
@@ -253,34 +248,98 @@ struct MultiTapDoubleRingBuffer {
 	size_t capacity(int tap) const {
 		return S - size(tap);
 	}
-	/** Returns a pointer to S consecutive elements for appending.
-	If any data is appended, you must call endIncr afterwards.
-	Pointer is invalidated when any other method is called.
+	/** Copies up to S elements from the tap's read position into out, without consuming them.
+	Call startIncr afterwards for the ones that were used.
 	*/
-	T *endData() {
-		return &data[mask(end)];
+	void read(int tap, T *out, size_t n) const {
+		readAt(start[tap], (float*) out, n);
 	}
-	void endIncr(size_t n) {
-		size_t e = mask(end);
-		size_t e1 = e + n;
-		size_t e2 = (e1 < S) ? e1 : S;
-		// Copy data forward
-		std::memcpy(&data[S + e], &data[e], sizeof(T) * (e2 - e));
-
-		if (e1 > S) {
-			// Copy data backward from the doubled block to the main block
-			std::memcpy(data, &data[S], sizeof(T) * (e1 - S));
+	/** Converts n elements, starting at the one written by push number position, into n * CHANNELS floats. */
+	void readAt(size_t position, float *out, size_t n) const {
+		STORAGE::decode(&data[mask(position) * CHANNELS], out, n * CHANNELS);
+	}
+	void startIncr(int tap, size_t n) {
+		start[tap] += n;
+	}
+	/** Moves the tap's read position delay elements behind the write position. */
+	void setDelay(int tap, size_t delay) {
+		start[tap] = end - std::min(delay, std::min(end, S));
+	}
+	/** Moves the tap's read position to where another tap is reading. */
+	void alignTap(int tap, int other) {
+		start[tap] = start[other];
+	}
+	/** Returns the element pushed delay pushes before the most recent one. delay must be less than S. */
+	T peek(size_t delay) const {
+		return peekAt(end - 1 - delay);
+	}
+	T peekAt(size_t position) const {
+		T t;
+		float *out = (float*) &t;
+		size_t i = mask(position) * CHANNELS;
+		for (size_t c = 0; c < CHANNELS; c++) {
+			out[c] = STORAGE::decode(data[i + c]);
 		}
-		end += n;
+		return t;
 	}
-	/** Returns a pointer to S consecutive elements for consumption
-	If any data is consumed, call startIncr afterwards.
-	*/
-	const T *startData(int tap) const {
-		return &data[mask(start[tap])];
+};
+
+
+enum StorageFormats {
+	STORAGE_FLOAT,
+	STORAGE_FIXED16,
+	NUM_STORAGE_FORMATS
+};
+
+/** A MultiTapDoubleRingBuffer whose storage format is picked at runtime, for modules that offer it as a memory/quality option.
+Only the buffer for the current format is allocated. Fixed16Storage uses +-RANGE.
+*/
+template <typename T, size_t S, int N, int RANGE>
+struct SwitchableMultiTapRingBuffer {
+	typedef MultiTapDoubleRingBuffer<T, S, N, FloatStorage> FloatBuffer;
+	typedef MultiTapDoubleRingBuffer<T, S, N, Fixed16Storage<RANGE>> FixedBuffer;
+
+	std::unique_ptr<FloatBuffer> floatBuffer;
+	std::unique_ptr<FixedBuffer> fixedBuffer;
+	const int format;
+
+	/** Allocates the buffer for format, not real-time safe. To change format, make a new one. */
+	explicit SwitchableMultiTapRingBuffer(int format = STORAGE_FLOAT) : format(format) {
+		if (format == STORAGE_FIXED16)
+			fixedBuffer.reset(new FixedBuffer());
+		else
+			floatBuffer.reset(new FloatBuffer());
+	}
+
+	void push(T t) {
+		if (fixedBuffer) fixedBuffer->push(t); else floatBuffer->push(t);
+	}
+	void clear() {
+		if (fixedBuffer) fixedBuffer->clear(); else floatBuffer->clear();
+	}
+	bool full(int tap) const {
+		return fixedBuffer ? fixedBuffer->full(tap) : floatBuffer->full(tap);
+	}
+	size_t size(int tap) const {
+		return fixedBuffer ? fixedBuffer->size(tap) : floatBuffer->size(tap);
+	}
+	void read(int tap, T *out, size_t n) const {
+		if (fixedBuffer) fixedBuffer->read(tap, out, n); else floatBuffer->read(tap, out, n);
+	}
+	void readAt(size_t position, float *out, size_t n) const {
+		if (fixedBuffer) fixedBuffer->readAt(position, out, n); else floatBuffer->readAt(position, out, n);
 	}
 	void startIncr(int tap, size_t n) {
-		start[tap] += n;
+		if (fixedBuffer) fixedBuffer->startIncr(tap, n); else floatBuffer->startIncr(tap, n);
+	}
+	void setDelay(int tap, size_t delay) {
+		if (fixedBuffer) fixedBuffer->setDelay(tap, delay); else floatBuffer->setDelay(tap, delay);
+	}
+	void alignTap(int tap, int other) {
+		if (fixedBuffer) fixedBuffer->alignTap(tap, other); else floatBuffer->alignTap(tap, other);
+	}
+	T peek(size_t delay) const {
+		return fixedBuffer ? fixedBuffer->peek(delay) : floatBuffer->peek(delay);
 	}
 };
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Lets a heavy module stop processing while it has nothing to do.
+Before processing, the module asks idle() with the peak of its inputs. Afterwards it reports the peak of everything it can still hear through update():
+inputs, outputs and anything that feeds back. Once that has stayed below the threshold for the hold time, which must cover the longest tail the module
+can still produce, the tracker goes to sleep and idle() returns true until an input rises above the threshold, on the very sample it does.
+Only isIdle() may be called from other threads.
+*/
+struct SilenceTracker {
+	// About -100 dB below a 10V signal
+	float threshold = 1e-4f;
+	int64_t holdSamples = 0;
+	int64_t quietSamples = 0;
+	std::atomic<bool> sleeping{false};
+
+	/** How long everything must stay quiet before sleeping. Cheap enough to call every sample. */
+	void setHold(float seconds, float sampleRate) {
+		holdSamples = (int64_t) (seconds * sampleRate);
+	}
+
+	/** Returns true if the module can skip this sample. Wakes up as soon as inputPeak is above the threshold. */
+	bool idle(float inputPeak) {
+		if (!sleeping.load(std::memory_order_relaxed))
+			return false;
+		if (inputPeak <= threshold)
+			return true;
+		wake();
+		return false;
+	}
+
+	/** Reports the peak level of the sample just processed. Returns true on the sample the tracker goes to sleep,
+	which is when the module should clear whatever is left of its tails so it wakes up from silence.
+	*/
+	bool update(float peak) {
+		if (peak > threshold) {
+			quietSamples = 0;
+			return false;
+		}
+		if (++quietSamples < holdSamples)
+			return false;
+		sleep();
+		return true;
+	}
+
+	/** For modules that know by themselves when they are done. */
+	void sleep() {
+		sleeping.store(true, std::memory_order_relaxed);
+	}
+
+	void wake() {
+		sleeping.store(false, std::memory_order_relaxed);
+		quietSamples = 0;
+	}
+
+	bool isIdle() const {
+		return sleeping.load(std::memory_order_relaxed);
+	}
+
+	/** Largest absolute voltage on any channel of the input. */
+	static float peak(rack::engine::Input &input) {
+		float p = 0.f;
+		for (int c = 0; c < input.getChannels(); c++) {
+			p = std::max(p, std::fabs(input.getVoltage(c)));
+		}
+		return p;
+	}
+};
+
+} // namespace FrozenWasteland
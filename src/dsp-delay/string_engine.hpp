@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Karplus-Strong delay lines for BANKS * 4 strings, processed four at a time with simd::float_4.
+Each string reads its line at an integer offset and supplies the fractional part with a first order Thiran allpass,
+so the loop length follows the requested delay exactly on every sample instead of being chased by a resampler.
+Every string has a line of its own, which the owner allocates and attaches, so each is only as long as its string can get
+and strings nobody plays take no memory. A string without a line is silent.
+Clearing a string is lazy: it reads silence from whatever it hasn't written since.
+Not thread-safe.
+*/
+template <int BANKS>
+struct StringEngine {
+	typedef rack::simd::float_4 float_4;
+	static const int STRINGS = BANKS * 4;
+
+	// String bank * 4 + k is lane k of the bank. The lines belong to the owner
+	float *line[STRINGS] = {};
+	int32_t length[STRINGS] = {};
+	int32_t writePos[STRINGS] = {};
+	// How much of its line each string has written since it was cleared, anything older reads as silence
+	int32_t written[STRINGS] = {};
+
+	int32_t offset[STRINGS] = {};
+	float_4 longest[BANKS] = {};
+	float_4 allpassCoefficient[BANKS] = {};
+	float_4 allpassState[BANKS] = {};
+
+	/** Gives a string a line length samples long, from which it can play delays up to length - 4. Clears the string. */
+	void attach(int string, float *line, int length) {
+		this->line[string] = line;
+		this->length[string] = length;
+		longest[string / 4][string % 4] = (float) (length - 4);
+		offset[string] = 1;
+		writePos[string] = 0;
+		clear(string);
+	}
+
+	void clear(int string) {
+		written[string] = 0;
+		allpassState[string / 4][string % 4] = 0.f;
+	}
+
+	/** Sets the loop length of the bank's 4 strings in samples. Cheap enough to call every sample.
+	latency is how many samples the owner's loop adds outside the line, such as the sample it takes to feed a string's output
+	back in and the phase delay of any filters, and is taken off the line so the whole loop is delay long.
+	*/
+	void setDelay(int bank, float_4 delay, float_4 latency) {
+		delay = rack::simd::fmin(rack::simd::fmax(delay - latency, 2.f), longest[bank]);
+		// Keep the allpass delay in [1,2) where its phase delay is flattest
+		float_4 integral = rack::simd::floor(delay) - 1.f;
+		float_4 fractional = delay - integral;
+		allpassCoefficient[bank] = (1.f - fractional) / (1.f + fractional);
+		for (int k = 0; k < 4; k++) {
+			offset[bank * 4 + k] = (int32_t) integral[k];
+		}
+	}
+
+	/** Returns the delayed output of the bank's 4 strings. */
+	float_4 read(int bank) {
+		float_4 x0 = float_4::zero();
+		float_4 x1 = float_4::zero();
+		for (int k = 0; k < 4; k++) {
+			int s = bank * 4 + k;
+			if (!line[s] || offset[s] < 1)
+				continue;
+			int32_t p = writePos[s] - offset[s];
+			if (p < 0)
+				p += length[s];
+			int32_t p1 = p > 0 ? p - 1 : length[s] - 1;
+			if (offset[s] <= written[s])
+				x0[k] = line[s][p];
+			if (offset[s] < written[s])
+				x1[k] = line[s][p1];
+		}
+		float_4 y = allpassCoefficient[bank] * (x0 - allpassState[bank]) + x1;
+		allpassState[bank] = y;
+		return y;
+	}
+
+	/** Writes the bank's next input and moves its strings on a sample. */
+	void write(int bank, float_4 in) {
+		for (int k = 0; k < 4; k++) {
+			int s = bank * 4 + k;
+			if (!line[s])
+				continue;
+			line[s][writePos[s]] = in[k];
+			if (++writePos[s] >= length[s])
+				writePos[s] = 0;
+			if (written[s] < length[s])
+				written[s]++;
+		}
+	}
+};
+
+} // namespace FrozenWasteland
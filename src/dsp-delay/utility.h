@@ -2,12 +2,7 @@
   int32_t x ## _integral = static_cast<int32_t>(x); \
   float x ## _fractional = x - static_cast<float>(x ## _integral)
 
-#define STATIC_ASSERT(expression, message)\
-struct JOIN(__static_assertion_at_line_, __LINE__)\
-{\
-impl::StaticAssertion<static_cast<bool>((expression))> JOIN(JOIN(JOIN(STATIC_ASSERTION_FAILED_AT_LINE_, __LINE__), _), message);\
-};\
-typedef impl::StaticAssertionTest<sizeof(JOIN(__static_assertion_at_line_, __LINE__))> JOIN(__static_assertion_test_at_line_, __LINE__)
+#define STATIC_ASSERT(expression, message) static_assert(expression, #message)
 
 #define DISALLOW_COPY_AND_ASSIGN(TypeName) \
   TypeName(const TypeName&);               \
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "rack.hpp"
+#include "DspFilter.h"
+
+
+namespace FrozenWasteland {
+
+enum CascadeTypes {
+	CASCADE_LOWPASS,
+	CASCADE_HIGHPASS,
+	CASCADE_BANDPASS,
+	CASCADE_NOTCH,
+	NUM_CASCADE_TYPES
+};
+
+/** Coefficients of a chain of second order sections, in falco's convention: y = b0 x + b1 x[-1] + b2 x[-2] + a1 y[-1] + a2 y[-2] */
+template <int MAX_STAGES>
+struct CascadeDesign {
+	int stages = 0;
+	float b0[MAX_STAGES] = {};
+	float b1[MAX_STAGES] = {};
+	float b2[MAX_STAGES] = {};
+	float a1[MAX_STAGES] = {};
+	float a2[MAX_STAGES] = {};
+};
+
+
+/** Butterworth cascades of 1 to MAX_STAGES sections designed with falco's DspFilter, cached by type, order, cutoff and Q.
+Cutoffs are rounded to 1/120 of an octave and Q to 1/24 of an octave, so a modulated cutoff sweeps through a few hundred designs
+that are each computed once. Low and highpass are Butterworth with their most resonant section raised to Q, bandpass and notch are
+Butterworth band filters of bandwidth cutoff / Q.
+The designs are computed by a worker thread, since falco allocates and can throw. load() never waits: a design that isn't cached yet
+is queued for the worker and reported missing, so the caller keeps its old coefficients and asks again. A design falco rejects passes
+signal through unfiltered. load() is for the audio thread only. The worker doesn't run until start() is called.
+*/
+template <int MAX_STAGES>
+struct CascadeCache {
+	typedef CascadeDesign<MAX_STAGES> Design;
+	static const int SIZE = 4096;
+	static const int QUEUE_SIZE = 256;
+	static const int FC_STEPS_PER_OCTAVE = 120;
+	static const int Q_STEPS_PER_OCTAVE = 24;
+	// Cutoffs from 2^-16 of the sample rate up to 0.45, Q from 1/16 to 128
+	static const int FC_LOWEST_OCTAVE = -16;
+	static const int Q_LOWEST_OCTAVE = -4;
+	static const uint32_t NO_KEY = UINT32_MAX;
+
+	struct Entry {
+		std::atomic<uint32_t> key{NO_KEY};
+		Design design;
+		// Audio thread, the key last queued for this entry so it is only asked for once
+		uint32_t requested = NO_KEY;
+	};
+	std::vector<Entry> entries;
+
+	// Keys waiting for the worker, written by the audio thread and read by the worker
+	uint32_t queue[QUEUE_SIZE];
+	std::atomic<uint32_t> queueWrite{0};
+	std::atomic<uint32_t> queueRead{0};
+
+	// Worker thread
+	Dsp::BiquadLp lowpassSection;
+	Dsp::BiquadHp highpassSection;
+	Dsp::ButterBandPass<MAX_STAGES, 1> bandpass;
+	Dsp::ButterBandStop<MAX_STAGES, 1> bandstop;
+	std::atomic<bool> running{true};
+	std::thread worker;
+
+	CascadeCache() : entries(SIZE) {}
+
+	~CascadeCache() {
+		if (!worker.joinable())
+			return;
+		running = false;
+		worker.join();
+	}
+
+	/** Starts the worker thread if it isn't running yet. Call from the UI thread when the owner first needs cascades. Until then every load() misses. */
+	void start() {
+		if (!worker.joinable())
+			worker = std::thread(&CascadeCache::work, this);
+	}
+
+	/** Identifies the cached design for these settings. fc is the cutoff (or center) divided by the sample rate.
+	Callers that modulate can compare keys and skip get() and loading the coefficients while the rounded settings stay the same.
+	*/
+	static uint32_t key(int type, int stages, float fc, float q) {
+		int fcIndex = (int) std::round((std::log2(rack::clamp(fc, 1.f / 65536.f, 0.45f)) - FC_LOWEST_OCTAVE) * FC_STEPS_PER_OCTAVE);
+		int qIndex = (int) std::round((std::log2(rack::clamp(q, 1.f / 16.f, 128.f)) - Q_LOWEST_OCTAVE) * Q_STEPS_PER_OCTAVE);
+		return ((uint32_t) type << 28) | ((uint32_t) stages << 24) | ((uint32_t) fcIndex << 10) | (uint32_t) qIndex;
+	}
+
+	/** Copies the design for key into d. Returns false, leaving d alone, if it isn't cached yet. */
+	bool load(uint32_t key, Design &d) {
+		Entry &entry = entries[(key * 2654435761u) >> 20];
+		if (entry.key.load(std::memory_order_acquire) == key) {
+			Design copy = entry.design;
+			// The worker may have started replacing the entry while we copied it
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (entry.key.load(std::memory_order_relaxed) == key) {
+				d = copy;
+				return true;
+			}
+		}
+		if (entry.requested != key) {
+			uint32_t write = queueWrite.load(std::memory_order_relaxed);
+			if (write - queueRead.load(std::memory_order_acquire) < QUEUE_SIZE) {
+				queue[write % QUEUE_SIZE] = key;
+				queueWrite.store(write + 1, std::memory_order_release);
+				entry.requested = key;
+			}
+		}
+		return false;
+	}
+
+	void work() {
+		while (running) {
+			uint32_t read = queueRead.load(std::memory_order_relaxed);
+			if (read == queueWrite.load(std::memory_order_acquire)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			uint32_t key = queue[read % QUEUE_SIZE];
+			queueRead.store(read + 1, std::memory_order_release);
+			build(key);
+		}
+	}
+
+	void build(uint32_t key) {
+		int fcIndex = (key >> 10) & 0x3fff;
+		int qIndex = key & 0x3ff;
+		double designFc = std::exp2((double) fcIndex / FC_STEPS_PER_OCTAVE + FC_LOWEST_OCTAVE);
+		double designQ = std::exp2((double) qIndex / Q_STEPS_PER_OCTAVE + Q_LOWEST_OCTAVE);
+		Design d;
+		try {
+			design(d, key >> 28, (key >> 24) & 0xf, designFc, designQ);
+		} catch (const std::exception &e) {
+			// Unfiltered is better than a filter that blows up
+			d = Design();
+		}
+		Entry &entry = entries[(key * 2654435761u) >> 20];
+		entry.key.store(NO_KEY, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		entry.design = d;
+		entry.key.store(key, std::memory_order_release);
+	}
+
+	void design(Design &d, int type, int stages, double fc, double q) {
+		d.stages = stages;
+		if (type == CASCADE_LOWPASS || type == CASCADE_HIGHPASS) {
+			// Butterworth pole pairs, the last one is the most resonant
+			for (int s = 0; s < stages; s++) {
+				double sectionQ = 1.0 / (2.0 * std::sin((2 * s + 1) * M_PI / (4.0 * stages)));
+				if (s == stages - 1)
+					sectionQ = std::max(sectionQ, q);
+				Dsp::Cascade *section;
+				if (type == CASCADE_LOWPASS) {
+					lowpassSection.Setup(fc, sectionQ);
+					section = &lowpassSection;
+				} else {
+					highpassSection.Setup(fc, sectionQ);
+					section = &highpassSection;
+				}
+				copyStage(d, s, section->Stages()[0]);
+			}
+			return;
+		}
+
+		Dsp::Spec spec;
+		spec.order = stages;
+		spec.sampleRate = 1.0;
+		// Float coefficients can't place poles this close to DC: keep the band above about 7 Hz at 48 kHz and no narrower than 5 Hz
+		fc = std::max(fc, 1.5e-4);
+		// Both band edges must stay between 0 and Nyquist
+		spec.normWidth = std::min(std::max(fc / q, 1e-4), std::min(fc, 2.0 * (0.49 - fc)));
+		spec.centerFreq = fc;
+		Dsp::Cascade *cascade;
+		if (type == CASCADE_BANDPASS) {
+			bandpass.Setup(spec);
+			cascade = &bandpass;
+		} else {
+			bandstop.Setup(spec);
+			cascade = &bandstop;
+		}
+		for (int s = 0; s < stages; s++) {
+			copyStage(d, s, cascade->Stages()[s]);
+		}
+	}
+
+	static void copyStage(Design &d, int s, const Dsp::Cascade::Stage &stage) {
+		d.b0[s] = (float) stage.b[0];
+		d.b1[s] = (float) stage.b[1];
+		d.b2[s] = (float) stage.b[2];
+		d.a1[s] = (float) stage.a[1];
+		d.a2[s] = (float) stage.a[2];
+	}
+};
+
+
+/** Runs GROUPS * 4 independent biquad cascades side by side, one per lane of a float_4, each with its own coefficients.
+Meant for the many identical filters of a module, such as every tap and channel of a delay, which then cost a quarter as much.
+Sections are in transposed direct form II, which copes well with coefficients changing every sample.
+Lanes that use fewer sections than the others pass the rest through unchanged.
+*/
+template <int GROUPS, int MAX_STAGES>
+struct BiquadCascade {
+	typedef rack::simd::float_4 float_4;
+	static const int LANES = GROUPS * 4;
+
+	int stages = MAX_STAGES;
+	// Coefficients are kept per lane so set() is plain stores, and loaded four lanes at a time
+	alignas(16) float b0[MAX_STAGES][LANES];
+	alignas(16) float b1[MAX_STAGES][LANES];
+	alignas(16) float b2[MAX_STAGES][LANES];
+	alignas(16) float a1[MAX_STAGES][LANES];
+	alignas(16) float a2[MAX_STAGES][LANES];
+	float_4 s1[MAX_STAGES][GROUPS];
+	float_4 s2[MAX_STAGES][GROUPS];
+
+	BiquadCascade() {
+		for (int lane = 0; lane < LANES; lane++) {
+			bypass(lane);
+		}
+		reset();
+	}
+
+	/** How many sections to run for every lane. */
+	void setStages(int stages) {
+		this->stages = stages;
+	}
+
+	template <int DESIGN_STAGES>
+	void set(int lane, const CascadeDesign<DESIGN_STAGES> &design) {
+		for (int s = 0; s < MAX_STAGES; s++) {
+			bool used = s < design.stages;
+			b0[s][lane] = used ? design.b0[s] : 1.f;
+			b1[s][lane] = used ? design.b1[s] : 0.f;
+			b2[s][lane] = used ? design.b2[s] : 0.f;
+			a1[s][lane] = used ? design.a1[s] : 0.f;
+			a2[s][lane] = used ? design.a2[s] : 0.f;
+		}
+	}
+
+	void bypass(int lane) {
+		set(lane, CascadeDesign<MAX_STAGES>());
+	}
+
+	void reset() {
+		for (int s = 0; s < MAX_STAGES; s++) {
+			for (int g = 0; g < GROUPS; g++) {
+				s1[s][g] = float_4::zero();
+				s2[s][g] = float_4::zero();
+			}
+		}
+	}
+
+	float_4 process(int g, float_4 x) {
+		for (int s = 0; s < stages; s++) {
+			float_4 y = float_4::load(&b0[s][g * 4]) * x + s1[s][g];
+			s1[s][g] = float_4::load(&b1[s][g * 4]) * x + float_4::load(&a1[s][g * 4]) * y + s2[s][g];
+			s2[s][g] = float_4::load(&b2[s][g * 4]) * x + float_4::load(&a2[s][g * 4]) * y;
+			x = y;
+		}
+		return x;
+	}
+
+	/** Filters one sample of every lane in place. */
+	void process(float *lanes) {
+		for (int g = 0; g < GROUPS; g++) {
+			process(g, float_4::load(&lanes[g * 4])).store(&lanes[g * 4]);
+		}
+	}
+};
+
+} // namespace FrozenWasteland
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Channel vocoder working on short time spectra instead of a filter bank, so the number of bands costs next to nothing.
+Modulator and carrier are analysed with FFT_SIZE point Hann windows every HOP samples. The modulator's energy is measured in log spaced bands
+between 50 Hz and 16 kHz, followed by an attack/decay envelope per band, and the carrier's bins are scaled by the envelope of their band before
+being windowed again and overlap-added. Bands narrower than a bin get one bin each, so at high band counts the low end is vocoded bin by bin,
+and asking for more bands than there are bins in that range gives one band per bin.
+The bands are also gathered into GROUPS groups, which stand in for the bands of a 16 band filter bank vocoder: each group reports its level,
+can have its level replaced from outside and has a gain.
+The output is LATENCY samples late. Everything is allocated up front, process() never allocates.
+*/
+struct SpectralVocoder {
+	static const int FFT_SIZE = 1024;
+	static const int HOP = FFT_SIZE / 4;
+	static const int LATENCY = FFT_SIZE;
+	static const int BINS = FFT_SIZE / 2;
+	static const int MAX_BANDS = 512;
+	static const int GROUPS = 16;
+
+	// Set by the owner before process()
+	/** How far each band's envelope moves towards its level per frame when rising and falling, 0 to 1. */
+	float attack = 1.f;
+	float decay = 1.f;
+	/** Carrier group g takes its envelopes from modulator group g + groupOffset, wrapping around. */
+	int groupOffset = 0;
+	float groupGain[GROUPS];
+	/** When inserted, a group's envelopes are scaled so the group's level follows insertLevel instead of the modulator. */
+	bool inserted[GROUPS] = {};
+	float insertLevel[GROUPS] = {};
+
+	// Results of the last frame
+	float groupLevel[GROUPS] = {};
+	/** Center frequency of each group in Hz. */
+	float groupFreq[GROUPS] = {};
+
+	int bands = 32;
+	int bandStart[MAX_BANDS + 1];
+	float envelope[MAX_BANDS];
+	float bandGain[MAX_BANDS];
+	float sampleRate = 44100.f;
+
+	rack::dsp::RealFFT fft;
+	std::vector<float> window;
+	std::vector<float> modulatorHistory;
+	std::vector<float> carrierHistory;
+	std::vector<float> frame;
+	std::vector<float> modulatorSpectrum;
+	std::vector<float> carrierSpectrum;
+	std::vector<float> resynthesis;
+	std::vector<float> overlap;
+	std::vector<float> output;
+	int position = 0;
+	int hopPosition = 0;
+
+	SpectralVocoder() : fft(FFT_SIZE), window(FFT_SIZE), modulatorHistory(FFT_SIZE), carrierHistory(FFT_SIZE), frame(FFT_SIZE),
+		modulatorSpectrum(FFT_SIZE), carrierSpectrum(FFT_SIZE), resynthesis(FFT_SIZE), overlap(FFT_SIZE), output(HOP) {
+		for (int i = 0; i < FFT_SIZE; i++) {
+			window[i] = 0.5f - 0.5f * std::cos(2.f * M_PI * i / FFT_SIZE);
+		}
+		for (int g = 0; g < GROUPS; g++) {
+			groupGain[g] = 1.f;
+		}
+		configure(bands, sampleRate);
+	}
+
+	/** Splits the spectrum into GROUPS to MAX_BANDS bands. Doesn't allocate, so it can be called from process(). */
+	void configure(int bands, float sampleRate) {
+		this->sampleRate = sampleRate;
+		float binWidth = sampleRate / FFT_SIZE;
+		float lowest = 50.f;
+		float highest = std::min(16000.f, 0.45f * sampleRate);
+		int lowestBin = std::max((int) std::round(lowest / binWidth), 1);
+		int highestBin = std::min((int) std::round(highest / binWidth), BINS);
+		this->bands = rack::clamp(bands, GROUPS, std::min(highestBin - lowestBin, MAX_BANDS));
+		for (int b = 0; b <= this->bands; b++) {
+			int bin = (int) std::round(lowest * std::pow(highest / lowest, (float) b / this->bands) / binWidth);
+			// At least one bin per band, leaving room for the bands above
+			bin = std::max(bin, b > 0 ? bandStart[b - 1] + 1 : lowestBin);
+			bandStart[b] = std::min(bin, highestBin - (this->bands - b));
+		}
+		for (int g = 0; g < GROUPS; g++) {
+			float low = bandStart[g * this->bands / GROUPS] * binWidth;
+			float high = bandStart[(g + 1) * this->bands / GROUPS] * binWidth;
+			groupFreq[g] = std::sqrt(low * high);
+		}
+		reset();
+	}
+
+	void reset() {
+		std::fill(modulatorHistory.begin(), modulatorHistory.end(), 0.f);
+		std::fill(carrierHistory.begin(), carrierHistory.end(), 0.f);
+		std::fill(overlap.begin(), overlap.end(), 0.f);
+		std::fill(output.begin(), output.end(), 0.f);
+		std::fill(envelope, envelope + MAX_BANDS, 0.f);
+		std::fill(groupLevel, groupLevel + GROUPS, 0.f);
+		position = 0;
+		hopPosition = 0;
+	}
+
+	float process(float modulator, float carrier) {
+		modulatorHistory[position] = modulator;
+		carrierHistory[position] = carrier;
+		if (++position >= FFT_SIZE)
+			position = 0;
+		float out = output[hopPosition];
+		if (++hopPosition >= HOP) {
+			hopPosition = 0;
+			processFrame();
+		}
+		return out;
+	}
+
+	void analyse(const std::vector<float> &history, std::vector<float> &spectrum) {
+		// position is the oldest sample
+		for (int i = 0; i < FFT_SIZE; i++) {
+			frame[i] = history[(position + i) & (FFT_SIZE - 1)] * window[i];
+		}
+		fft.rfft(frame.data(), spectrum.data());
+	}
+
+	void processFrame() {
+		analyse(modulatorHistory, modulatorSpectrum);
+		analyse(carrierHistory, carrierSpectrum);
+
+		// A sine of amplitude A in a band measures as A
+		const float levelScale = 4.f / (FFT_SIZE * std::sqrt(1.5f));
+		float groupEnergy[GROUPS] = {};
+		for (int b = 0; b < bands; b++) {
+			float energy = 0.f;
+			for (int k = bandStart[b]; k < bandStart[b + 1]; k++) {
+				float re = modulatorSpectrum[2 * k];
+				float im = modulatorSpectrum[2 * k + 1];
+				energy += re * re + im * im;
+			}
+			float level = std::sqrt(energy) * levelScale;
+			envelope[b] += (level - envelope[b]) * (level > envelope[b] ? attack : decay);
+			groupEnergy[b * GROUPS / bands] += envelope[b] * envelope[b];
+		}
+		for (int g = 0; g < GROUPS; g++) {
+			groupLevel[g] = std::sqrt(groupEnergy[g]);
+		}
+
+		int bandOffset = groupOffset * bands / GROUPS;
+		for (int b = 0; b < bands; b++) {
+			int source = ((b + bandOffset) % bands + bands) % bands;
+			int sourceGroup = source * GROUPS / bands;
+			float gain = envelope[source];
+			if (inserted[sourceGroup])
+				gain = groupLevel[sourceGroup] > 1e-6f ? gain * insertLevel[sourceGroup] / groupLevel[sourceGroup] : insertLevel[sourceGroup];
+			bandGain[b] = gain * groupGain[b * GROUPS / bands];
+		}
+
+		// Ordered spectrum: DC and Nyquist first, then re/im pairs. Bins outside the bands are dropped
+		std::fill(frame.begin(), frame.end(), 0.f);
+		for (int b = 0; b < bands; b++) {
+			for (int k = bandStart[b]; k < bandStart[b + 1]; k++) {
+				frame[2 * k] = carrierSpectrum[2 * k] * bandGain[b];
+				frame[2 * k + 1] = carrierSpectrum[2 * k + 1] * bandGain[b];
+			}
+		}
+		fft.irfft(frame.data(), resynthesis.data());
+
+		// Hann squared windows at 75% overlap sum to 1.5
+		const float synthesisScale = 1.f / (FFT_SIZE * 1.5f);
+		for (int i = 0; i < FFT_SIZE; i++) {
+			overlap[i] += resynthesis[i] * window[i] * synthesisScale;
+		}
+		std::copy(overlap.begin(), overlap.begin() + HOP, output.begin());
+		std::copy(overlap.begin() + HOP, overlap.end(), overlap.begin());
+		std::fill(overlap.end() - HOP, overlap.end(), 0.f);
+	}
+};
+
+} // namespace FrozenWasteland
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "random.hpp"
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Four xoshiro128+ streams side by side in SSE2 registers, giving 4 random words per step.
+The lanes are one Random stream and three split off it, so they never overlap and a seed gives the same words on every machine.
+*/
+struct Xoshiro128x4 {
+	__m128i _s[4];
+
+	Xoshiro128x4() {
+		Random random;
+		seed(random.getSeed());
+	}
+
+	explicit Xoshiro128x4(uint64_t seed) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		Random lanes[4];
+		lanes[0].seed(seed);
+		lanes[0].split(lanes + 1, 3);
+		for (int w = 0; w < 4; w++) {
+			_s[w] = _mm_set_epi32(lanes[3]._s[w], lanes[2]._s[w], lanes[1]._s[w], lanes[0]._s[w]);
+		}
+	}
+
+	__m128i next() {
+		__m128i result = _mm_add_epi32(_s[0], _s[3]);
+		__m128i t = _mm_slli_epi32(_s[1], 9);
+		_s[2] = _mm_xor_si128(_s[2], _s[0]);
+		_s[3] = _mm_xor_si128(_s[3], _s[1]);
+		_s[1] = _mm_xor_si128(_s[1], _s[2]);
+		_s[0] = _mm_xor_si128(_s[0], _s[3]);
+		_s[2] = _mm_xor_si128(_s[2], t);
+		_s[3] = _mm_or_si128(_mm_slli_epi32(_s[3], 11), _mm_srli_epi32(_s[3], 21));
+		return result;
+	}
+
+	void fill(uint32_t *out, int n) {
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm_storeu_si128((__m128i*) (out + i), next());
+		}
+		if (i < n) {
+			uint32_t rest[4];
+			_mm_storeu_si128((__m128i*) rest, next());
+			std::copy(rest, rest + (n - i), out + i);
+		}
+	}
+};
+
+/** -1 to 1, from the top 24 bits of each word. */
+struct WhiteNoise {
+	Xoshiro128x4 _core;
+
+	WhiteNoise() {}
+
+	explicit WhiteNoise(uint64_t seed) : _core(seed) {}
+
+	void seed(uint64_t seed) {
+		_core.seed(seed);
+	}
+
+	static __m128 bipolar(__m128i words) {
+		__m128 x = _mm_cvtepi32_ps(_mm_srli_epi32(words, 8));
+		return _mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(1.f / 8388608.f)), _mm_set1_ps(1.f));
+	}
+
+	void fill(float *out, int n) {
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm_storeu_ps(out + i, bipolar(_core.next()));
+		}
+		if (i < n) {
+			float rest[4];
+			_mm_storeu_ps(rest, bipolar(_core.next()));
+			std::copy(rest, rest + (n - i), out + i);
+		}
+	}
+};
+
+/** The layers of Marsaglia and Tsang's 128 layer ziggurat for the standard normal. Built on first use and shared by every generator. */
+struct ZigguratTable {
+	static const int LAYERS = 128;
+
+	uint32_t kn[LAYERS];
+	float wn[LAYERS];
+	float fn[LAYERS];
+
+	ZigguratTable() {
+		const double m1 = 2147483648.0;
+		const double vn = 9.91256303526217e-3;
+		double dn = 3.442619855899;
+		double tn = dn;
+		double q = vn / std::exp(-.5 * dn * dn);
+		kn[0] = (uint32_t) ((dn / q) * m1);
+		kn[1] = 0;
+		wn[0] = q / m1;
+		wn[LAYERS - 1] = dn / m1;
+		fn[0] = 1.f;
+		fn[LAYERS - 1] = std::exp(-.5 * dn * dn);
+		for (int i = LAYERS - 2; i >= 1; i--) {
+			dn = std::sqrt(-2. * std::log(vn / dn + std::exp(-.5 * dn * dn)));
+			kn[i + 1] = (uint32_t) ((dn / tn) * m1);
+			tn = dn;
+			fn[i] = std::exp(-.5 * dn * dn);
+			wn[i] = dn / m1;
+		}
+	}
+
+	static const ZigguratTable &get() {
+		static const ZigguratTable table;
+		return table;
+	}
+};
+
+/** Mean 0, standard deviation 1. The words come from the SIMD core a block at a time and nearly every one is accepted with a compare and
+a multiply. The 1.2% that land outside a layer's box fall back to the exact test, drawing whatever else they need from a scalar stream.
+The layer is picked by the top 7 bits of a word, as xoshiro128+'s low bits are its weakest, and the rest of the word, shifted up, is the sample.
+*/
+struct GaussianNoise {
+	static const int CHUNK = 64;
+	static const int LAYER_BITS = 7;
+	static constexpr float R = 3.442620f;
+
+	Xoshiro128x4 _core;
+	Random _fallback;
+
+	GaussianNoise() {
+		seed(_fallback.getSeed());
+	}
+
+	explicit GaussianNoise(uint64_t seed) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		_core.seed(seed);
+		_fallback.seed(~seed);
+	}
+
+	static int layer(uint32_t word) {
+		return word >> (32 - LAYER_BITS);
+	}
+
+	void fill(float *out, int n) {
+		const ZigguratTable &z = ZigguratTable::get();
+		uint32_t words[CHUNK];
+		while (n > 0) {
+			int m = std::min(n, (int) CHUNK);
+			_core.fill(words, m);
+			for (int i = 0; i < m; i++) {
+				int iz = layer(words[i]);
+				int32_t hz = (int32_t) (words[i] << LAYER_BITS);
+				uint32_t magnitude = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+				out[i] = magnitude < z.kn[iz] ? hz * z.wn[iz] : edge(z, hz, iz);
+			}
+			out += m;
+			n -= m;
+		}
+	}
+
+	float edge(const ZigguratTable &z, int32_t hz, int iz) {
+		for (;;) {
+			float x = hz * z.wn[iz];
+			if (iz == 0) {
+				// The tail past R, by Marsaglia's method
+				float y;
+				do {
+					x = -std::log(1.f - _fallback.uniform()) / R;
+					y = -std::log(1.f - _fallback.uniform());
+				} while (y + y < x * x);
+				return hz > 0 ? R + x : -R - x;
+			}
+			if (z.fn[iz] + _fallback.uniform() * (z.fn[iz - 1] - z.fn[iz]) < std::exp(-.5f * x * x))
+				return x;
+			uint32_t word = _fallback.next();
+			iz = layer(word);
+			hz = (int32_t) (word << LAYER_BITS);
+			uint32_t magnitude = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+			if (magnitude < z.kn[iz])
+				return hz * z.wn[iz];
+		}
+	}
+};
+
+/** Voss-McCartney: the sum of a fresh sample of S and ROWS held ones, where row k is redrawn every 2^(k+1) samples.
+Only one row changes per sample, picked by the lowest set bit of a counter, so the sum is kept running rather than added up each time.
+Over white noise it's pink, and over pink noise it's red.
+*/
+template <typename S>
+struct VossMcCartneyNoise {
+	static const int ROWS = 7;
+	static const int CHUNK = 64;
+
+	S _source;
+	float _rows[ROWS];
+	float _sum;
+	uint32_t _count;
+
+	VossMcCartneyNoise() {
+		prime();
+	}
+
+	explicit VossMcCartneyNoise(uint64_t seed) : _source(seed) {
+		prime();
+	}
+
+	void seed(uint64_t seed) {
+		_source.seed(seed);
+		prime();
+	}
+
+	void prime() {
+		_source.fill(_rows, ROWS);
+		_count = 0;
+		resum();
+	}
+
+	void resum() {
+		_sum = 0.f;
+		for (int k = 0; k < ROWS; k++) {
+			_sum += _rows[k];
+		}
+	}
+
+	void fill(float *out, int n) {
+		// Each sample takes two from the source, one for itself and one for the row it redraws
+		float source[2 * CHUNK];
+		while (n > 0) {
+			int m = std::min(n, (int) CHUNK);
+			_source.fill(source, 2 * m);
+			for (int i = 0; i < m; i++) {
+				int row = __builtin_ctz(++_count | (1u << ROWS));
+				if (row < ROWS) {
+					_sum += source[2 * i + 1] - _rows[row];
+					_rows[row] = source[2 * i + 1];
+				} else {
+					// Once a cycle, so rounding in the running sum never builds up
+					resum();
+				}
+				out[i] = (_sum + source[2 * i]) * (1.f / (ROWS + 1));
+			}
+			out += m;
+			n -= m;
+		}
+	}
+};
+
+typedef VossMcCartneyNoise<WhiteNoise> PinkNoise;
+typedef VossMcCartneyNoise<PinkNoise> RedNoise;
+
+} // namespace dsp
+} // namespace frozenwasteland
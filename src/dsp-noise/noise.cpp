@@ -1,5 +1,5 @@
 
-#include "noise.hpp"
+#include "seeds.hpp"
 
 using namespace frozenwasteland::dsp;
 
@@ -21,3 +21,7 @@ Seeds& Seeds::getInstance() {
 unsigned int Seeds::next() {
   return getInstance()._next();
 };
+
+void Seeds::seed(unsigned int seed) {
+  getInstance()._generator.seed(seed);
+}
@@ -1,78 +1,48 @@
 #pragma once
 
-#include <random>
-
 #include "base.hpp"
+#include "seeds.hpp"
+#include "block_noise.hpp"
 
 namespace frozenwasteland {
 namespace dsp {
 
-class Seeds {
-private:
-	std::mt19937 _generator;
-	Seeds();
-	unsigned int _next();
-
-public:
-	Seeds(const Seeds&) = delete;
-	void operator=(const Seeds&) = delete;
-	static Seeds& getInstance();
-
-	static unsigned int next();
-};
-
-struct NoiseGenerator : Generator {
-	std::minstd_rand _generator; // one of the faster options.
-
-	NoiseGenerator() : _generator(Seeds::next()) {}
-};
-
-struct WhiteNoiseGenerator : NoiseGenerator {
-	std::uniform_real_distribution<float> _uniform;
-
-	WhiteNoiseGenerator() : _uniform(-1.0, 1.0) {}
-
-	virtual float _next() override {
-		return _uniform(_generator);
+/** A sample at a time from one of the block generators, for callers that can't ask for a block up front.
+It refills BLOCK samples when it runs out, and next() hides Generator's so calls on the concrete type don't go through _next().
+*/
+template<typename B>
+struct BlockNoiseGenerator : Generator {
+	static const int BLOCK = 64;
+	B _block;
+	float _buffer[BLOCK];
+	int _position = BLOCK;
+
+	void seed(uint64_t seed) {
+		_block.seed(seed);
+		_position = BLOCK;
 	}
-};
 
-template<typename G>
-struct BasePinkNoiseGenerator : NoiseGenerator {
-	static const int _n = 7;
-	G _g;
-	G _gs[_n];
-	uint32_t _count = _g.next();
+	float next() {
+		if (_position == BLOCK) {
+			_block.fill(_buffer, BLOCK);
+			_position = 0;
+		}
+		return _current = _buffer[_position++];
+	}
 
 	virtual float _next() override {
-		// See: http://www.firstpr.com.au/dsp/pink-noise/
-		float sum = _g.next();
-		for (int i = 0, bit = 1; i < _n; ++i, bit <<= 1) {
-			if (_count & bit) {
-				sum += _gs[i].next();
-			}
-			else {
-				sum += _gs[i].current();
-			}
-		}
-		++_count;
-		return sum / (float)(_n + 1);
+		next();
+		return _current;
 	}
 };
 
-struct PinkNoiseGenerator : BasePinkNoiseGenerator<WhiteNoiseGenerator> {};
+struct WhiteNoiseGenerator : BlockNoiseGenerator<WhiteNoise> {};
 
-struct RedNoiseGenerator : BasePinkNoiseGenerator<PinkNoiseGenerator> {};
+struct PinkNoiseGenerator : BlockNoiseGenerator<PinkNoise> {};
 
-struct GaussianNoiseGenerator : NoiseGenerator {
-	std::normal_distribution<float> _normal;
+struct RedNoiseGenerator : BlockNoiseGenerator<RedNoise> {};
 
-	GaussianNoiseGenerator() : _normal(0, 1.0) {}
-
-	virtual float _next() override {
-		return _normal(_generator);
-	}
-};
+struct GaussianNoiseGenerator : BlockNoiseGenerator<GaussianNoise> {};
 
 } // namespace dsp
 } // namespace frozenwasteland
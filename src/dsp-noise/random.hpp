@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+#include "seeds.hpp"
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** xoshiro128+ (Blackman and Vigna), for randomness on the audio thread.
+Each module owns its own, so unlike rand() there is no lock and nothing shared between instances or engine threads.
+The state is filled from a 64 bit seed, which modules save in the patch so a performance can be replayed.
+jump() moves 2^64 draws ahead, so streams split off with it never overlap.
+*/
+struct Random {
+	uint64_t _seed = 0;
+	uint32_t _s[4];
+
+	/** Seeded from the plugin's Seeds, not from the audio thread. */
+	Random() {
+		seed(((uint64_t) Seeds::next() << 32) | Seeds::next());
+	}
+
+	explicit Random(uint64_t seed) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		_seed = seed;
+		// splitmix64, so that similar seeds still give unrelated states
+		uint64_t x = seed;
+		for (int i = 0; i < 4; i += 2) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			z ^= z >> 31;
+			_s[i] = (uint32_t) z;
+			_s[i + 1] = (uint32_t) (z >> 32);
+		}
+		if (!(_s[0] | _s[1] | _s[2] | _s[3]))
+			_s[0] = 1;
+	}
+
+	uint64_t getSeed() const {
+		return _seed;
+	}
+
+	uint32_t next() {
+		uint32_t result = _s[0] + _s[3];
+		uint32_t t = _s[1] << 9;
+		_s[2] ^= _s[0];
+		_s[3] ^= _s[1];
+		_s[1] ^= _s[2];
+		_s[0] ^= _s[3];
+		_s[2] ^= t;
+		_s[3] = (_s[3] << 11) | (_s[3] >> 21);
+		return result;
+	}
+
+	/** 0 to 1, never 1. Takes the top 24 bits, the low bits of xoshiro128+ are weaker. */
+	float uniform() {
+		return (next() >> 8) * (1.f / 16777216.f);
+	}
+
+	void jump() {
+		static const uint32_t JUMP[] = {0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+		uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		for (int i = 0; i < 4; i++) {
+			for (int b = 0; b < 32; b++) {
+				if (JUMP[i] & (1u << b)) {
+					s0 ^= _s[0];
+					s1 ^= _s[1];
+					s2 ^= _s[2];
+					s3 ^= _s[3];
+				}
+				next();
+			}
+		}
+		_s[0] = s0;
+		_s[1] = s1;
+		_s[2] = s2;
+		_s[3] = s3;
+	}
+
+	/** Splits off count streams after this one, each 2^64 draws further on. Leaves this stream where it was. */
+	void split(Random *streams, int count) const {
+		Random r = *this;
+		for (int i = 0; i < count; i++) {
+			r.jump();
+			streams[i] = r;
+		}
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
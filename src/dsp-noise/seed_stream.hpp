@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Shapes two uniform numbers x and y into a rough bell curve from 0 to 1, the Gaussian distribution of Seeds of Change. */
+inline float bellCurve(double x, double y) {
+	const double x1 = .68;
+	const double x2 = .92;
+	double s = (y<.5) ? .5 : -.5;
+	if (x<x1) {
+		return y*.333*s + .5;
+	} else if (x<x2) {
+		return (y*.333+.333)*s + .5;
+	} else {
+		return (y*.333+.666)*s + .5;
+	}
+}
+
+/** The random numbers of a Seeds of Change chain, as one stream owned by the mother.
+Word n of the stream for a seed is the splitmix64 output for counter n, so any word can be had directly: reaching a position after a reset
+costs nothing, however far into the stream it is. Each clock the mother draws a block, and every module in the chain takes its own SLICE
+words of that block, the mother the first. Only the seed, the block number and each module's position go down the chain, so expanders
+never regenerate what came before them and the 1 sample delay of each hop doesn't change which words they get.
+*/
+struct SeedStream {
+	static const int SLICE = 32;
+
+	uint64_t _key = 0;
+	uint64_t _base = 0;
+
+	static uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	/** Positions the stream at this module's slice of a block. position is 0 for the mother, 1 for the expander next to it and so on. */
+	void set(uint32_t seed, uint32_t block, int position) {
+		_key = mix(seed + 0x9e3779b97f4a7c15ULL);
+		_base = ((uint64_t) block << 16) + (uint64_t) position * SLICE;
+	}
+
+	uint32_t word(int slot) const {
+		return (uint32_t) (mix(_key + (_base + slot) * 0x9e3779b97f4a7c15ULL) >> 32);
+	}
+
+	/** 0 to 1, never 1. */
+	double real(int slot) const {
+		return word(slot) * (1.0 / 4294967296.0);
+	}
+
+	/** A rough bell curve from 0 to 1, using slots slot and slot + 1. */
+	float normal(int slot) const {
+		return bellCurve(real(slot), real(slot + 1));
+	}
+};
+
+/** The Mersenne Twister (MT19937) Seeds of Change used before SeedStream, kept so patches saved with it still play the same sequences.
+In such a chain every module runs its own, reseeded with the same seed on each reset, and draws from it in turn on each clock.
+*/
+struct MersenneTwister {
+	static const int N = 624;
+	static const int M = 397;
+
+	uint32_t mt[N];
+	int mti = N + 1; // N + 1 means mt isn't seeded
+
+	void seed(uint32_t s) {
+		mt[0] = s;
+		for (mti = 1; mti < N; mti++) {
+			mt[mti] = 1812433253u * (mt[mti - 1] ^ (mt[mti - 1] >> 30)) + mti;
+		}
+	}
+
+	/** 0 to 0xffffffff. */
+	uint32_t word() {
+		static const uint32_t mag01[2] = {0x0u, 0x9908b0dfu};
+		const uint32_t UPPER_MASK = 0x80000000u;
+		const uint32_t LOWER_MASK = 0x7fffffffu;
+		uint32_t y;
+
+		if (mti >= N) {
+			// Unseeded, the modules asked for the default seed 5489, which their 0-99 limit turned into 99
+			if (mti == N + 1)
+				seed(99);
+			int kk;
+			for (kk = 0; kk < N - M; kk++) {
+				y = (mt[kk] & UPPER_MASK) | (mt[kk + 1] & LOWER_MASK);
+				mt[kk] = mt[kk + M] ^ (y >> 1) ^ mag01[y & 0x1u];
+			}
+			for (; kk < N - 1; kk++) {
+				y = (mt[kk] & UPPER_MASK) | (mt[kk + 1] & LOWER_MASK);
+				mt[kk] = mt[kk + (M - N)] ^ (y >> 1) ^ mag01[y & 0x1u];
+			}
+			y = (mt[N - 1] & UPPER_MASK) | (mt[0] & LOWER_MASK);
+			mt[N - 1] = mt[M - 1] ^ (y >> 1) ^ mag01[y & 0x1u];
+			mti = 0;
+		}
+
+		y = mt[mti++];
+		y ^= (y >> 11);
+		y ^= (y << 7) & 0x9d2c5680u;
+		y ^= (y << 15) & 0xefc60000u;
+		y ^= (y >> 18);
+		return y;
+	}
+
+	/** 0 to 1, never 1. */
+	double real() {
+		return word() * (1.0 / 4294967296.0);
+	}
+
+	/** The same bell curve as SeedStream::normal(), from the next two words. */
+	float normal() {
+		double x = real();
+		double y = real();
+		return bellCurve(x, y);
+	}
+};
+
+/** What each module of a Seeds of Change chain passes to the one on its right. Floats only hold 24 bits exactly, so the seed and block are split in halves. */
+struct SeedStreamMessage {
+	enum Fields {
+		SEED_HIGH,
+		SEED_LOW,
+		BLOCK_HIGH,
+		BLOCK_LOW,
+		POSITION,
+		CLOCK,
+		GAUSSIAN,
+		RESET,
+		MERSENNE,
+		NUM_FIELDS
+	};
+
+	/** mersenne is set for chains that run a MersenneTwister in each module, which reseed them on reset. */
+	static void write(float *message, uint32_t seed, uint32_t block, int position, float clock, bool gaussian, float reset, bool mersenne) {
+		message[SEED_HIGH] = seed >> 16;
+		message[SEED_LOW] = seed & 0xffff;
+		message[BLOCK_HIGH] = block >> 16;
+		message[BLOCK_LOW] = block & 0xffff;
+		message[POSITION] = position;
+		message[CLOCK] = clock;
+		message[GAUSSIAN] = gaussian;
+		message[RESET] = reset;
+		message[MERSENNE] = mersenne;
+	}
+
+	static uint32_t seed(const float *message) {
+		return ((uint32_t) message[SEED_HIGH] << 16) | (uint32_t) message[SEED_LOW];
+	}
+
+	static uint32_t block(const float *message) {
+		return ((uint32_t) message[BLOCK_HIGH] << 16) | (uint32_t) message[BLOCK_LOW];
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <random>
+
+namespace frozenwasteland {
+namespace dsp {
+
+class Seeds {
+private:
+	std::mt19937 _generator;
+	Seeds();
+	unsigned int _next();
+
+public:
+	Seeds(const Seeds&) = delete;
+	void operator=(const Seeds&) = delete;
+	static Seeds& getInstance();
+
+	static unsigned int next();
+
+	/** Restarts the sequence from seed, so generators made afterwards draw the same numbers every run. For offline renders, not patches. */
+	static void seed(unsigned int seed);
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
@@ -0,0 +1,120 @@
+#include "glottal.hpp"
+
+using namespace frozenwasteland::dsp;
+using rack::simd::float_4;
+
+
+const int GlottalWavetable::OPENING_STEPS;
+const int GlottalWavetable::CLOSED_STEPS;
+const int GlottalWavetable::LEVELS;
+const int GlottalWavetable::TABLE_SIZE;
+const int GlottalWavetable::MIN_LEVEL_SIZE;
+constexpr float GlottalWavetable::MIN_OPENING;
+constexpr float GlottalWavetable::MAX_CLOSED;
+
+float GlottalWavetable::rosenberg(float timeOpening, float timeOpen, float phase) {
+	if(phase < timeOpening) {
+		return 0.5f * (1.0f - cosf(M_PI * phase / timeOpening));
+	} else if (phase < timeOpen) {	
+		return cosf(M_PI * (phase - timeOpening) / (timeOpen - timeOpening) / 2);
+	}
+	return 0.0f;
+}
+
+GlottalWavetable::GlottalWavetable() {
+	_shapeStride = 0;
+	for (int l = 0; l < LEVELS; l++) {
+		_levelSize[l] = std::max(TABLE_SIZE >> l, MIN_LEVEL_SIZE);
+		_levelOffset[l] = _shapeStride;
+		_shapeStride += _levelSize[l] + 1;
+	}
+	_tables.assign(OPENING_STEPS * CLOSED_STEPS * _shapeStride, 0.f);
+
+	rack::dsp::RealFFT fft(TABLE_SIZE);
+	std::vector<rack::dsp::RealFFT*> levelFFT(LEVELS);
+	for (int l = 0; l < LEVELS; l++) {
+		levelFFT[l] = new rack::dsp::RealFFT(_levelSize[l]);
+	}
+
+	alignas(16) float cycle[TABLE_SIZE];
+	alignas(16) float spectrum[TABLE_SIZE];
+	alignas(16) float levelSpectrum[TABLE_SIZE];
+	alignas(16) float levelCycle[TABLE_SIZE];
+
+	for (int o = 0; o < OPENING_STEPS; o++) {
+		for (int c = 0; c < CLOSED_STEPS; c++) {
+			float timeOpening = MIN_OPENING + (1.0f - MIN_OPENING) * o / (OPENING_STEPS - 1);
+			float timeClosed = MAX_CLOSED * c / (CLOSED_STEPS - 1);
+			float timeOpen = rack::clamp(1.0f - timeClosed, timeOpening, 1.0f);
+			for (int i = 0; i < TABLE_SIZE; i++) {
+				cycle[i] = rosenberg(timeOpening, timeOpen, (float) i / TABLE_SIZE);
+			}
+			// Ordered real spectrum: DC, Nyquist, then re/im pairs for each harmonic
+			fft.rfft(cycle, spectrum);
+
+			for (int l = 0; l < LEVELS; l++) {
+				int size = _levelSize[l];
+				int harmonics = std::min((TABLE_SIZE / 2) >> l, size / 2 - 1);
+				std::fill(levelSpectrum, levelSpectrum + size, 0.f);
+				levelSpectrum[0] = spectrum[0];
+				for (int h = 1; h <= harmonics; h++) {
+					levelSpectrum[2 * h] = spectrum[2 * h];
+					levelSpectrum[2 * h + 1] = spectrum[2 * h + 1];
+				}
+				float* t = &_tables[(o * CLOSED_STEPS + c) * _shapeStride + _levelOffset[l]];
+				levelFFT[l]->irfft(levelSpectrum, levelCycle);
+				for (int i = 0; i < size; i++) {
+					t[i] = levelCycle[i] / TABLE_SIZE;
+				}
+				t[size] = t[0];
+			}
+		}
+	}
+
+	for (int l = 0; l < LEVELS; l++) {
+		delete levelFFT[l];
+	}
+}
+
+const GlottalWavetable& GlottalWavetable::getInstance() {
+	static GlottalWavetable instance;
+	return instance;
+}
+
+
+float_4 GlottalOscillator::process(float_4 deltaPhase, float_4 timeOpening, float_4 timeClosed) {
+	const GlottalWavetable& wavetable = GlottalWavetable::getInstance();
+
+	phase += rack::simd::fmin(deltaPhase, 0.5f);
+	phase -= rack::simd::floor(phase);
+
+	float_4 o = rack::simd::clamp((timeOpening - GlottalWavetable::MIN_OPENING) / (1.0f - GlottalWavetable::MIN_OPENING), 0.f, 1.f) * (GlottalWavetable::OPENING_STEPS - 1);
+	float_4 c = rack::simd::clamp(timeClosed / GlottalWavetable::MAX_CLOSED, 0.f, 1.f) * (GlottalWavetable::CLOSED_STEPS - 1);
+
+	float_4 out;
+	for (int k = 0; k < 4; k++) {
+		int o0 = std::min((int) o[k], GlottalWavetable::OPENING_STEPS - 2);
+		int c0 = std::min((int) c[k], GlottalWavetable::CLOSED_STEPS - 2);
+		float oFrac = o[k] - o0;
+		float cFrac = c[k] - c0;
+
+		int level = GlottalWavetable::level(deltaPhase[k]);
+		int size = wavetable.levelSize(level);
+		float position = phase[k] * size;
+		int i = std::min((int) position, size - 1);
+		float frac = position - i;
+
+		const float* t00 = wavetable.table(o0, c0, level);
+		const float* t01 = wavetable.table(o0, c0 + 1, level);
+		const float* t10 = wavetable.table(o0 + 1, c0, level);
+		const float* t11 = wavetable.table(o0 + 1, c0 + 1, level);
+		float v00 = t00[i] + (t00[i + 1] - t00[i]) * frac;
+		float v01 = t01[i] + (t01[i + 1] - t01[i]) * frac;
+		float v10 = t10[i] + (t10[i + 1] - t10[i]) * frac;
+		float v11 = t11[i] + (t11[i + 1] - t11[i]) * frac;
+		float v0 = v00 + (v01 - v00) * cFrac;
+		float v1 = v10 + (v11 - v10) * cFrac;
+		out[k] = v0 + (v1 - v0) * oFrac;
+	}
+	return out;
+}
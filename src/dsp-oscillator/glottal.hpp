@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "rack.hpp"
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Band-limited Rosenberg glottal pulses.
+One cycle is rendered for every point of a (time opening, time closed) grid and mip-mapped by octave,
+each level keeping only the harmonics that stay below Nyquist for its pitch range.
+The tables are built once, on first use, and shared by every instance.
+*/
+class GlottalWavetable {
+public:
+	static const int OPENING_STEPS = 12;
+	static const int CLOSED_STEPS = 8;
+	static const int LEVELS = 11;
+	static const int TABLE_SIZE = 2048;
+	static const int MIN_LEVEL_SIZE = 64;
+
+	static constexpr float MIN_OPENING = 0.01f;
+	static constexpr float MAX_CLOSED = 1.0f;
+
+	GlottalWavetable(const GlottalWavetable&) = delete;
+	void operator=(const GlottalWavetable&) = delete;
+	static const GlottalWavetable& getInstance();
+
+	/** Returns levelSize(level) + 1 samples, the last one wrapping to the first. */
+	const float* table(int opening, int closed, int level) const {
+		return &_tables[(opening * CLOSED_STEPS + closed) * _shapeStride + _levelOffset[level]];
+	}
+	int levelSize(int level) const {
+		return _levelSize[level];
+	}
+	/** Picks the first level whose highest harmonic is below Nyquist. deltaPhase is frequency / sample rate. */
+	static int level(float deltaPhase) {
+		int l = 0;
+		while (l < LEVELS - 1 && (float) ((TABLE_SIZE / 2) >> l) * deltaPhase > 0.5f) {
+			l++;
+		}
+		return l;
+	}
+
+	/** The naive pulse the tables are rendered from, 0 to 1. */
+	static float rosenberg(float timeOpening, float timeOpen, float phase);
+
+private:
+	GlottalWavetable();
+
+	std::vector<float> _tables;
+	int _levelSize[LEVELS];
+	int _levelOffset[LEVELS];
+	int _shapeStride;
+};
+
+/** Up to four glottal voices, one per float_4 lane. */
+struct GlottalOscillator {
+	rack::simd::float_4 phase = 0.f;
+
+	/** Advances each lane by deltaPhase and returns the pulse (0 to 1) for its (timeOpening, timeClosed) shape. */
+	rack::simd::float_4 process(rack::simd::float_4 deltaPhase, rack::simd::float_4 timeOpening, rack::simd::float_4 timeClosed);
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include "rack.hpp"
+
+
+namespace FrozenWasteland {
+
+/** The skewed saw and pulse the BPM and Lissajous LFOs morph towards a sine, read from tables instead of worked out per output.
+The skewed saw is tabled over (skew, phase) and read bilinearly. Rows are exact at their skew, and between rows the peak is only softened
+within 1 / SKEW_STEPS of it. waveSlope is a linear blend with the sine, so it is applied after the lookup rather than being a third axis.
+Phases are 0 to 1. Built on first use and shared by every instance.
+The float_4 versions read four phases at once for modules with several outputs of the same shape, such as the BPM LFO's phase expander.
+*/
+struct MorphingLfoTable {
+	typedef rack::simd::float_4 float_4;
+	typedef rack::simd::int32_4 int32_4;
+
+	static const int SKEW_STEPS = 128;
+	static const int PHASE_SIZE = 512;
+
+	/** The original 0 to 2 skewed saw, with a guard point at each end of both axes. */
+	float skewsaws[SKEW_STEPS + 1][PHASE_SIZE + 1];
+	/** sin(2 pi phase) */
+	float sines[PHASE_SIZE + 1];
+
+	MorphingLfoTable() {
+		for (int s = 0; s <= SKEW_STEPS; s++) {
+			float skew = (float) s / SKEW_STEPS;
+			for (int i = 0; i <= PHASE_SIZE; i++) {
+				float x = (float) i / PHASE_SIZE;
+				if (x <= skew && skew > 0)
+					skewsaws[s][i] = 2.0 * x / skew;
+				else
+					skewsaws[s][i] = 2.0 * (1 - (x - skew) / (1 - skew));
+			}
+		}
+		for (int i = 0; i <= PHASE_SIZE; i++) {
+			sines[i] = (float) std::sin(2 * M_PI * i / PHASE_SIZE);
+		}
+	}
+
+	static const MorphingLfoTable &get() {
+		static const MorphingLfoTable table;
+		return table;
+	}
+
+	static void index(float phase, int &i, float &f) {
+		float x = phase * PHASE_SIZE;
+		i = (int) x;
+		if (i < 0)
+			i = 0;
+		else if (i > PHASE_SIZE - 1)
+			i = PHASE_SIZE - 1;
+		f = x - i;
+	}
+
+	static void index(float_4 phase, int32_4 &i, float_4 &f) {
+		float_4 x = phase * PHASE_SIZE;
+		float_4 xi = rack::simd::clamp(rack::simd::floor(x), 0.f, PHASE_SIZE - 1.f);
+		i = int32_4(xi);
+		f = x - xi;
+	}
+
+	/** row read at four positions and linearly interpolated. The reads are one per lane, the interpolation is shared. */
+	static float_4 lookup(const float *row, int32_4 i, float_4 f) {
+		float_4 a(row[i[0]], row[i[1]], row[i[2]], row[i[3]]);
+		float_4 b(row[i[0] + 1], row[i[1] + 1], row[i[2] + 1], row[i[3] + 1]);
+		return a + (b - a) * f;
+	}
+
+	/** The sine the shapes morph towards, a quarter cycle behind them. 0 to 2 when offset, otherwise -1 to 1. */
+	float sine(float phase, bool offset) const {
+		// sin(2 pi (phase - 0.25)) = sin(2 pi (phase + 0.75)) and 1 - cos(2 pi (phase - 0.25)) = 1 - sin(2 pi phase)
+		if (!offset) {
+			phase += 0.75f;
+			if (phase >= 1.f)
+				phase -= 1.f;
+		}
+		int i;
+		float f;
+		index(phase, i, f);
+		float s = sines[i] + (sines[i + 1] - sines[i]) * f;
+		return offset ? 1.f - s : s;
+	}
+
+	float_4 sine(float_4 phase, bool offset) const {
+		if (!offset) {
+			phase += 0.75f;
+			phase -= rack::simd::ifelse(phase >= 1.f, 1.f, 0.f);
+		}
+		int32_4 i;
+		float_4 f;
+		index(phase, i, f);
+		float_4 s = lookup(sines, i, f);
+		return offset ? 1.f - s : s;
+	}
+
+	float skewsaw(float skew, float waveSlope, bool offset, float phase) const {
+		float y = skew * SKEW_STEPS;
+		int s = (int) y;
+		if (s < 0)
+			s = 0;
+		else if (s > SKEW_STEPS - 1)
+			s = SKEW_STEPS - 1;
+		float g = y - s;
+		int i;
+		float f;
+		index(phase, i, f);
+		const float *row0 = skewsaws[s];
+		const float *row1 = skewsaws[s + 1];
+		float v0 = row0[i] + (row0[i + 1] - row0[i]) * f;
+		float v1 = row1[i] + (row1[i + 1] - row1[i]) * f;
+		float wave = v0 + (v1 - v0) * g;
+		if (!offset)
+			wave -= 1.f;
+		return wave + (sine(phase, offset) - wave) * waveSlope;
+	}
+
+	float_4 skewsaw(float skew, float waveSlope, bool offset, float_4 phase) const {
+		float y = skew * SKEW_STEPS;
+		int s = (int) y;
+		if (s < 0)
+			s = 0;
+		else if (s > SKEW_STEPS - 1)
+			s = SKEW_STEPS - 1;
+		float g = y - s;
+		int32_4 i;
+		float_4 f;
+		index(phase, i, f);
+		float_4 v0 = lookup(skewsaws[s], i, f);
+		float_4 v1 = lookup(skewsaws[s + 1], i, f);
+		float_4 wave = v0 + (v1 - v0) * g;
+		if (!offset)
+			wave -= 1.f;
+		return wave + (sine(phase, offset) - wave) * waveSlope;
+	}
+
+	float pulse(float pw, float waveSlope, bool offset, float phase) const {
+		float wave = (phase < pw) ? 1.0 : -1.0;
+		if (offset)
+			wave += 1.f;
+		return wave + (sine(phase, offset) - wave) * waveSlope;
+	}
+
+	float_4 pulse(float pw, float waveSlope, bool offset, float_4 phase) const {
+		float_4 wave = rack::simd::ifelse(phase < pw, 1.f, -1.f);
+		if (offset)
+			wave += 1.f;
+		return wave + (sine(phase, offset) - wave) * waveSlope;
+	}
+};
+
+} // namespace FrozenWasteland
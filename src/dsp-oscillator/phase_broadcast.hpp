@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cmath>
+
+
+namespace FrozenWasteland {
+
+/** The message BPM LFO and BPM LFO 2 send down a chain of phase expanders every sample.
+The mother is the only one keeping time: it sends the phase its oscillator is at and how far it moved this sample, and the expanders just evaluate
+the waveform at their phase offsets. Each expander passes the message on with HOPS increased, because every module boundary delays it by a sample,
+and looks HOPS samples ahead of the phase it received so the whole chain stays in step with the mother.
+*/
+struct PhaseBroadcast {
+	enum Fields {
+		PHASE,
+		DELTA_PHASE,
+		HOLDING,
+		OFFSET,
+		WAVESHAPE,
+		WAVE_SLOPE,
+		SKEW,
+		HOPS,
+		NUM_FIELDS
+	};
+
+	static void write(float *message, double phase, double deltaPhase, bool holding, bool offset, float waveshape, float waveSlope, float skew) {
+		message[PHASE] = (float) phase;
+		message[DELTA_PHASE] = (float) deltaPhase;
+		message[HOLDING] = holding;
+		message[OFFSET] = offset;
+		message[WAVESHAPE] = waveshape;
+		message[WAVE_SLOPE] = waveSlope;
+		message[SKEW] = skew;
+		message[HOPS] = 1.f;
+	}
+
+	/** The mother's phase now, from a message that took HOPS samples to arrive. */
+	static float currentPhase(const float *message) {
+		float phase = message[PHASE] + message[DELTA_PHASE] * message[HOPS];
+		return phase - std::floor(phase);
+	}
+};
+
+} // namespace FrozenWasteland
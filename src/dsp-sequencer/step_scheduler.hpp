@@ -0,0 +1,62 @@
+#pragma once
+
+
+namespace FrozenWasteland {
+
+/** When each track of a sequencer takes its next step, kept in order so the engine only looks at the earliest one each sample.
+Times are in samples on the module's own timeline and can fall between samples: a step fires on the first sample at or after its time,
+and the owner can time the following step from the exact point rather than from the sample it fired on, so steps don't drift late.
+A track has at most one step scheduled, scheduling it again moves it.
+*/
+template <int TRACKS>
+struct StepScheduler {
+	int count = 0;
+	int order[TRACKS];
+	double due[TRACKS];
+	bool scheduled[TRACKS] = {};
+
+	void schedule(int track, double time) {
+		cancel(track);
+		int i = count;
+		while (i > 0 && due[order[i - 1]] > time) {
+			order[i] = order[i - 1];
+			i--;
+		}
+		order[i] = track;
+		due[track] = time;
+		scheduled[track] = true;
+		count++;
+	}
+
+	void cancel(int track) {
+		if (!scheduled[track])
+			return;
+		int i = 0;
+		while (order[i] != track)
+			i++;
+		for (; i < count - 1; i++) {
+			order[i] = order[i + 1];
+		}
+		scheduled[track] = false;
+		count--;
+	}
+
+	void clear() {
+		for (int t = 0; t < TRACKS; t++) {
+			scheduled[t] = false;
+		}
+		count = 0;
+	}
+
+	/** Takes the earliest step off the queue if it is due by now. */
+	bool pop(double now, int &track, double &time) {
+		if (count == 0 || due[order[0]] > now)
+			return false;
+		track = order[0];
+		time = due[track];
+		cancel(track);
+		return true;
+	}
+};
+
+} // namespace FrozenWasteland
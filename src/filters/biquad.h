@@ -40,6 +40,9 @@ public:
     void setPeakGain(double peakGainDB);
     void setBiquad(int type, double Fc, double Q, double peakGain);
     float process(float in);
+    void reset();
+    double getZ1() const { return z1; }
+    double getZ2() const { return z2; }
 
 protected:
     void calcBiquad(void);
@@ -57,4 +60,8 @@ inline float Biquad::process(float in) {
     return out;
 }
 
+inline void Biquad::reset() {
+    z1 = z2 = 0.0;
+}
+
 #endif // Biquad_h
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cmath>
+#include "rack.hpp"
+#include "biquad.h"
+
+
+namespace FrozenWasteland {
+
+/** tan(pi * Fc) for Fc from 0 to just below Nyquist, linearly interpolated from a table.
+Relative error stays below 2e-4 up to Fc = 0.49, and tan is nearly linear at the low end where the table is exact.
+*/
+struct BiquadTanTable {
+	static const int SIZE = 2048;
+	static constexpr float MAX_FC = 0.49f;
+	float values[SIZE + 2];
+
+	BiquadTanTable() {
+		for (int i = 0; i < SIZE + 2; i++) {
+			values[i] = (float) std::tan(M_PI * 0.5 * i / SIZE);
+		}
+	}
+
+	float tan(float Fc) const {
+		float x = rack::clamp(Fc, 0.f, MAX_FC) * (2.f * SIZE);
+		int i = (int) x;
+		float f = x - i;
+		return values[i] + (values[i + 1] - values[i]) * f;
+	}
+
+	static const BiquadTanTable &get() {
+		static const BiquadTanTable table;
+		return table;
+	}
+};
+
+
+/** A float version of the EarLevel Biquad for filters whose Fc, Q or gain move every block or faster.
+K = tan(pi Fc) comes from BiquadTanTable and the peak gain from an exp2 approximation, and K and K^2 are kept between updates
+so setQ() costs one division. New coefficients are reached by a linear ramp over rampSamples samples rather than at once,
+which hides the steps of coarse CV updates. The poles of every point on the ramp are stable when both ends are,
+because the stable region of (b1, b2) is a triangle.
+Same types, coefficient names and sign convention as Biquad. From 1 kHz up it follows the double Biquad to better than -80 dB. Lower down,
+float coefficients move the poles by a few cents (up to about 6 at 50 Hz), so narrow filters no longer match it sample for sample.
+`make test` checks both.
+*/
+struct ModulatedBiquad {
+	int type = bq_type_lowpass;
+	float Fc = 0.5f;
+	float Q = 0.707f;
+	float peakGain = 0.f;
+	int rampSamples = 32;
+
+	// Kept from the last setFc() and setPeakGain()
+	float K = 0.f;
+	float KK = 0.f;
+	float V = 1.f;
+
+	// Current, target and per sample step of a0, a1, a2, b1, b2
+	float c[5] = {1.f, 0.f, 0.f, 0.f, 0.f};
+	float target[5] = {1.f, 0.f, 0.f, 0.f, 0.f};
+	float step[5] = {};
+	int rampRemaining = 0;
+
+	float z1 = 0.f;
+	float z2 = 0.f;
+
+	ModulatedBiquad() {}
+
+	ModulatedBiquad(int type, float Fc, float Q, float peakGainDB) {
+		setBiquad(type, Fc, Q, peakGainDB);
+		jump();
+	}
+
+	void setBiquad(int type, float Fc, float Q, float peakGainDB) {
+		this->type = type;
+		this->Fc = Fc;
+		this->Q = Q;
+		this->peakGain = peakGainDB;
+		K = BiquadTanTable::get().tan(Fc);
+		KK = K * K;
+		V = gain(peakGainDB);
+		calcBiquad();
+	}
+
+	void setType(int type) {
+		this->type = type;
+		calcBiquad();
+	}
+
+	void setFc(float Fc) {
+		this->Fc = Fc;
+		K = BiquadTanTable::get().tan(Fc);
+		KK = K * K;
+		calcBiquad();
+	}
+
+	void setQ(float Q) {
+		this->Q = Q;
+		calcBiquad();
+	}
+
+	void setPeakGain(float peakGainDB) {
+		this->peakGain = peakGainDB;
+		V = gain(peakGainDB);
+		calcBiquad();
+	}
+
+	/** Sets the Q of count filters at once. For low, high, band pass and notch filters that is one division per filter. */
+	static void setQ(ModulatedBiquad *filters, int count, float Q) {
+		float invQ = 1.f / Q;
+		for (int i = 0; i < count; i++) {
+			ModulatedBiquad &f = filters[i];
+			f.Q = Q;
+			switch (f.type) {
+				case bq_type_lowpass:
+				case bq_type_highpass:
+				case bq_type_bandpass:
+				case bq_type_notch:
+					f.setPoleSection(invQ);
+					break;
+				default:
+					f.calcBiquad();
+					break;
+			}
+		}
+	}
+
+	/** Skips the ramp, for when the filter is set up before it is heard. */
+	void jump() {
+		for (int i = 0; i < 5; i++) {
+			c[i] = target[i];
+		}
+		rampRemaining = 0;
+	}
+
+	float process(float in) {
+		float out = in * c[0] + z1;
+		z1 = in * c[1] + z2 - c[3] * out;
+		z2 = in * c[2] - c[4] * out;
+		if (rampRemaining > 0)
+			ramp();
+		return out;
+	}
+
+	void ramp() {
+		if (--rampRemaining == 0) {
+			jump();
+			return;
+		}
+		c[0] += step[0];
+		c[1] += step[1];
+		c[2] += step[2];
+		c[3] += step[3];
+		c[4] += step[4];
+	}
+
+	void reset() {
+		z1 = z2 = 0.f;
+	}
+
+	float getZ1() const { return z1; }
+	float getZ2() const { return z2; }
+
+	/** 10^(|dB| / 20) */
+	static float gain(float peakGainDB) {
+		return rack::dsp::approxExp2_taylor5(std::fabs(peakGainDB) * (float) (M_LN10 / (20.0 * M_LN2)));
+	}
+
+	/** Low, high, band pass and notch share their denominator. */
+	void setPoleSection(float invQ) {
+		float norm = 1.f / (1.f + K * invQ + KK);
+		float b1 = 2.f * (KK - 1.f) * norm;
+		float b2 = (1.f - K * invQ + KK) * norm;
+		switch (type) {
+			case bq_type_lowpass:
+				setTarget(KK * norm, 2.f * KK * norm, KK * norm, b1, b2);
+				break;
+			case bq_type_highpass:
+				setTarget(norm, -2.f * norm, norm, b1, b2);
+				break;
+			case bq_type_bandpass:
+				setTarget(K * invQ * norm, 0.f, -K * invQ * norm, b1, b2);
+				break;
+			case bq_type_notch:
+				setTarget((1.f + KK) * norm, b1, (1.f + KK) * norm, b1, b2);
+				break;
+		}
+	}
+
+	void calcBiquad() {
+		float invQ = 1.f / Q;
+		float norm;
+		const float sqrt2 = (float) M_SQRT2;
+		float sqrt2V = std::sqrt(2.f * V);
+		switch (type) {
+			case bq_type_lowpass:
+			case bq_type_highpass:
+			case bq_type_bandpass:
+			case bq_type_notch:
+				setPoleSection(invQ);
+				break;
+
+			case bq_type_peak:
+				if (peakGain >= 0) {
+					norm = 1.f / (1.f + invQ * K + KK);
+					setTarget((1.f + V * invQ * K + KK) * norm, 2.f * (KK - 1.f) * norm, (1.f - V * invQ * K + KK) * norm,
+						2.f * (KK - 1.f) * norm, (1.f - invQ * K + KK) * norm);
+				} else {
+					norm = 1.f / (1.f + V * invQ * K + KK);
+					setTarget((1.f + invQ * K + KK) * norm, 2.f * (KK - 1.f) * norm, (1.f - invQ * K + KK) * norm,
+						2.f * (KK - 1.f) * norm, (1.f - V * invQ * K + KK) * norm);
+				}
+				break;
+
+			case bq_type_lowshelf:
+				if (peakGain >= 0) {
+					norm = 1.f / (1.f + sqrt2 * K + KK);
+					setTarget((1.f + sqrt2V * K + V * KK) * norm, 2.f * (V * KK - 1.f) * norm, (1.f - sqrt2V * K + V * KK) * norm,
+						2.f * (KK - 1.f) * norm, (1.f - sqrt2 * K + KK) * norm);
+				} else {
+					norm = 1.f / (1.f + sqrt2V * K + V * KK);
+					setTarget((1.f + sqrt2 * K + KK) * norm, 2.f * (KK - 1.f) * norm, (1.f - sqrt2 * K + KK) * norm,
+						2.f * (V * KK - 1.f) * norm, (1.f - sqrt2V * K + V * KK) * norm);
+				}
+				break;
+
+			case bq_type_highshelf:
+				if (peakGain >= 0) {
+					norm = 1.f / (1.f + sqrt2 * K + KK);
+					setTarget((V + sqrt2V * K + KK) * norm, 2.f * (KK - V) * norm, (V - sqrt2V * K + KK) * norm,
+						2.f * (KK - 1.f) * norm, (1.f - sqrt2 * K + KK) * norm);
+				} else {
+					norm = 1.f / (V + sqrt2V * K + KK);
+					setTarget((1.f + sqrt2 * K + KK) * norm, 2.f * (KK - 1.f) * norm, (1.f - sqrt2 * K + KK) * norm,
+						2.f * (KK - V) * norm, (V - sqrt2V * K + KK) * norm);
+				}
+				break;
+		}
+	}
+
+	void setTarget(float a0, float a1, float a2, float b1, float b2) {
+		target[0] = a0;
+		target[1] = a1;
+		target[2] = a2;
+		target[3] = b1;
+		target[4] = b2;
+		if (rampSamples <= 1) {
+			jump();
+			return;
+		}
+		float scale = 1.f / rampSamples;
+		for (int i = 0; i < 5; i++) {
+			step[i] = (target[i] - c[i]) * scale;
+		}
+		rampRemaining = rampSamples;
+	}
+};
+
+} // namespace FrozenWasteland
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../FrozenWasteland.hpp"
+#include "ringbuffer.hpp"
+#include "history_reader.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Context menu sections shared by the delays that can read their history directly, Portland Weather and Hair Pick.
+MODULE needs delayChangeMode, crossfadeTime and historyFormat members, setHistoryFormat() and the DELAY_CHANGE_GLIDE and DELAY_CHANGE_JUMP modes.
+*/
+template <typename MODULE>
+struct DelayChangeModeItem : MenuItem {
+	MODULE *module;
+	int delayChangeMode;
+	void onAction(const event::Action &e) override {
+		module->delayChangeMode = delayChangeMode;
+	}
+	void step() override {
+		rightText = (module->delayChangeMode == delayChangeMode) ? "✔" : "";
+	}
+};
+
+template <typename MODULE>
+struct CrossfadeTimeItem : MenuItem {
+	MODULE *module;
+	float crossfadeTime;
+	void onAction(const event::Action &e) override {
+		module->crossfadeTime = crossfadeTime;
+	}
+	void step() override {
+		rightText = (module->crossfadeTime == crossfadeTime) ? "✔" : "";
+	}
+};
+
+template <typename MODULE>
+struct HistoryFormatItem : MenuItem {
+	MODULE *module;
+	int historyFormat;
+	void onAction(const event::Action &e) override {
+		module->setHistoryFormat(historyFormat);
+	}
+	void step() override {
+		rightText = (module->historyFormat == historyFormat) ? "✔" : "";
+	}
+};
+
+/** Glide or jump, and how long a jump crossfades. */
+template <typename MODULE>
+void appendDelayChangeMenu(Menu *menu, MODULE *module) {
+	MenuLabel *delayChangeLabel = new MenuLabel();
+	delayChangeLabel->text = "Delay Time Changes";
+	menu->addChild(delayChangeLabel);
+
+	DelayChangeModeItem<MODULE> *glideItem = new DelayChangeModeItem<MODULE>();
+	glideItem->text = "Glide";
+	glideItem->module = module;
+	glideItem->delayChangeMode = MODULE::DELAY_CHANGE_GLIDE;
+	menu->addChild(glideItem);
+
+	DelayChangeModeItem<MODULE> *jumpItem = new DelayChangeModeItem<MODULE>();
+	jumpItem->text = "Jump";
+	jumpItem->module = module;
+	jumpItem->delayChangeMode = MODULE::DELAY_CHANGE_JUMP;
+	menu->addChild(jumpItem);
+
+	menu->addChild(new MenuLabel());// empty line
+
+	MenuLabel *crossfadeLabel = new MenuLabel();
+	crossfadeLabel->text = "Jump Crossfade";
+	menu->addChild(crossfadeLabel);
+
+	for (int i = 0; i < NUM_JUMP_CROSSFADES; i++) {
+		CrossfadeTimeItem<MODULE> *crossfadeItem = new CrossfadeTimeItem<MODULE>();
+		crossfadeItem->text = jumpCrossfadeNames[i];
+		crossfadeItem->module = module;
+		crossfadeItem->crossfadeTime = jumpCrossfadeTimes[i];
+		menu->addChild(crossfadeItem);
+	}
+}
+
+/** 32-bit float or 16-bit history. */
+template <typename MODULE>
+void appendHistoryFormatMenu(Menu *menu, MODULE *module) {
+	MenuLabel *historyFormatLabel = new MenuLabel();
+	historyFormatLabel->text = "History Memory/Quality (clears history)";
+	menu->addChild(historyFormatLabel);
+
+	HistoryFormatItem<MODULE> *floatItem = new HistoryFormatItem<MODULE>();
+	floatItem->text = "32-bit float";
+	floatItem->module = module;
+	floatItem->historyFormat = STORAGE_FLOAT;
+	menu->addChild(floatItem);
+
+	HistoryFormatItem<MODULE> *fixedItem = new HistoryFormatItem<MODULE>();
+	fixedItem->text = "16-bit (half memory, clips at +-20V)";
+	fixedItem->module = module;
+	fixedItem->historyFormat = STORAGE_FIXED16;
+	menu->addChild(fixedItem);
+}
+
+} // namespace FrozenWasteland
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../FrozenWasteland.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Context menu toggle for the modules that save their random seed, QAR and Probably Note.
+Unlocked, the seed isn't saved, so a loaded patch or a duplicated module rolls a new one like a freshly added module does.
+Locked, the patch keeps the seed and replays the same sequence every time it's loaded, and duplicates of the module share it.
+MODULE needs a lockSeed member.
+*/
+template <typename MODULE>
+struct LockSeedItem : MenuItem {
+	MODULE *module;
+	void onAction(const event::Action &e) override {
+		module->lockSeed = !module->lockSeed;
+	}
+	void step() override {
+		rightText = module->lockSeed ? "✔" : "";
+	}
+};
+
+template <typename MODULE>
+void appendSeedMenu(Menu *menu, MODULE *module) {
+	LockSeedItem<MODULE> *lockSeedItem = new LockSeedItem<MODULE>();
+	lockSeedItem->text = "Lock Random Seed (same sequence on every load)";
+	lockSeedItem->module = module;
+	menu->addChild(lockSeedItem);
+}
+
+} // namespace FrozenWasteland
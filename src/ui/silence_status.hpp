@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../FrozenWasteland.hpp"
+#include "silence_tracker.hpp"
+
+
+namespace FrozenWasteland {
+
+/** Context menu line showing whether a module's SilenceTracker has put it to sleep. */
+struct SilenceStatusItem : rack::ui::MenuLabel {
+	const SilenceTracker *tracker;
+
+	void step() override {
+		text = tracker->isIdle() ? "Status: idle, waiting for input" : "Status: processing";
+		MenuLabel::step();
+	}
+};
+
+} // namespace FrozenWasteland
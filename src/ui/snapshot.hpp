@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+
+
+namespace FrozenWasteland {
+
+/** Hands display snapshots from the audio thread to the UI thread without locks.
+Three copies of T are kept: the producer fills one, the consumer reads one, and the third holds the most recent finished snapshot.
+Publishing and consuming swap with the middle copy, so neither side ever sees a half written frame.
+
+The UI calls requestFrame() from draw(). Widgets are only drawn while they are on screen, so the audio thread can use watching() to skip
+display work entirely for modules nobody is looking at.
+Thread-safe for a single producer (audio thread) and a single consumer (UI thread).
+*/
+template <typename T>
+struct SnapshotBuffer {
+	static const int INDEX_MASK = 0x3;
+	static const int FRESH_BIT = 0x4;
+
+	T buffers[3] = {};
+	int writeIndex = 0;
+	int readIndex = 1;
+	std::atomic<int> middle{2};
+	std::atomic<bool> requested{false};
+	// Seconds since the UI last asked for a frame. Only touched by the producer.
+	float idleTime = 0.f;
+	float watchTimeout = 0.25f;
+
+	// Producer side
+
+	/** True while the UI has asked for a frame recently. Call once per sample. */
+	bool watching(float sampleTime) {
+		if (requested.load(std::memory_order_relaxed)) {
+			idleTime = 0.f;
+			return true;
+		}
+		if (idleTime >= watchTimeout)
+			return false;
+		idleTime += sampleTime;
+		return true;
+	}
+	bool frameRequested() const {
+		return requested.load(std::memory_order_acquire);
+	}
+	T &writeBuffer() {
+		return buffers[writeIndex];
+	}
+	void publish() {
+		writeIndex = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+		requested.store(false, std::memory_order_relaxed);
+	}
+
+	// Consumer side
+
+	void requestFrame() {
+		requested.store(true, std::memory_order_release);
+	}
+	/** Picks up the newest published snapshot, if any. Returns true when readBuffer() changed. */
+	bool update() {
+		if (!(middle.load(std::memory_order_relaxed) & FRESH_BIT))
+			return false;
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	const T &readBuffer() const {
+		return buffers[readIndex];
+	}
+};
+
+} // namespace FrozenWasteland